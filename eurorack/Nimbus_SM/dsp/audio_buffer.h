@@ -38,6 +38,11 @@ using namespace daisy;
 const int32_t kCrossFadeSize     = 256;
 const int32_t kInterpolationTail = 8;
 
+// Pages a buffer can be read from instead of its own storage (snapshot
+// banks), in bytes.
+const int32_t kBufferPageShift = 11;
+const int32_t kBufferPageSize  = 1 << kBufferPageShift;
+
 enum Resolution
 {
     RESOLUTION_16_BIT,
@@ -53,6 +58,17 @@ enum InterpolationMethod
     INTERPOLATION_HERMITE
 };
 
+// Laurent de Soras's Hermite interpolator.
+inline float InterpolateHermite(float xm1, float x0, float x1, float x2, float t)
+{
+    const float c     = (x1 - xm1) * 0.5f;
+    const float v     = x0 - x1;
+    const float w     = c + v;
+    const float a     = w + v + (x2 - x0) * 0.5f;
+    const float b_neg = w + a;
+    return (((a * t) - b_neg) * t + c) * t + x0;
+}
+
 template <Resolution resolution>
 class AudioBuffer
 {
@@ -60,7 +76,12 @@ class AudioBuffer
     AudioBuffer() {}
     ~AudioBuffer() {}
 
-    void Init(void* buffer, int32_t size, int16_t* tail_buffer)
+    // Clearing can be skipped for very large buffers that were zeroed at
+    // boot, as it would take far longer than one audio block.
+    void Init(void*    buffer,
+              int32_t  size,
+              int16_t* tail_buffer,
+              bool     clear = true)
     {
         s16_                = static_cast<int16_t*>(buffer);
         s8_                 = static_cast<int8_t*>(buffer);
@@ -68,15 +89,20 @@ class AudioBuffer
         write_head_         = 0;
         quantization_error_ = 0.0f;
         crossfade_counter_  = 0;
-        if(resolution == RESOLUTION_16_BIT)
+        pages_              = NULL;
+        pages_head_         = 0;
+        if(clear)
         {
-            std::fill(&s16_[0], &s16_[size], 0);
-        }
-        else
-        {
-            std::fill(&s8_[0],
-                      &s8_[size],
-                      resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
+            if(resolution == RESOLUTION_16_BIT)
+            {
+                std::fill(&s16_[0], &s16_[size], 0);
+            }
+            else
+            {
+                std::fill(&s8_[0],
+                          &s8_[size],
+                          resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
+            }
         }
         tail_ = tail_buffer;
     }
@@ -240,17 +266,20 @@ class AudioBuffer
         float x0, scale;
         if(resolution == RESOLUTION_16_BIT)
         {
-            x0    = s16_[integral];
+            int16_t scratch[1];
+            x0    = *Taps(s16_, integral, 1, scratch);
             scale = 1.0f / 32768.0f;
         }
         else if(resolution == RESOLUTION_8_BIT_MU_LAW)
         {
-            x0    = MuLaw2Lin(s8_[integral]);
+            int8_t scratch[1];
+            x0    = MuLaw2Lin(*Taps(s8_, integral, 1, scratch));
             scale = 1.0f / 32768.0f;
         }
         else
         {
-            x0    = s8_[integral];
+            int8_t scratch[1];
+            x0    = *Taps(s8_, integral, 1, scratch);
             scale = 1.0f / 128.0f;
         }
         return x0 * scale;
@@ -269,21 +298,27 @@ class AudioBuffer
         float t = static_cast<float>(fractional) / 65536.0f;
         if(resolution == RESOLUTION_16_BIT)
         {
-            x0    = s16_[integral];
-            x1    = s16_[integral + 1];
-            scale = 1.0f / 32768.0f;
+            int16_t        scratch[2];
+            const int16_t* s = Taps(s16_, integral, 2, scratch);
+            x0               = s[0];
+            x1               = s[1];
+            scale            = 1.0f / 32768.0f;
         }
         else if(resolution == RESOLUTION_8_BIT_MU_LAW)
         {
-            x0    = MuLaw2Lin(s8_[integral]);
-            x1    = MuLaw2Lin(s8_[integral + 1]);
-            scale = 1.0f / 32768.0f;
+            int8_t        scratch[2];
+            const int8_t* s = Taps(s8_, integral, 2, scratch);
+            x0              = MuLaw2Lin(s[0]);
+            x1              = MuLaw2Lin(s[1]);
+            scale           = 1.0f / 32768.0f;
         }
         else
         {
-            x0    = s8_[integral];
-            x1    = s8_[integral + 1];
-            scale = 1.0f / 128.0f;
+            int8_t        scratch[2];
+            const int8_t* s = Taps(s8_, integral, 2, scratch);
+            x0              = s[0];
+            x1              = s[1];
+            scale           = 1.0f / 128.0f;
         }
         return (x0 + (x1 - x0) * t) * scale;
     }
@@ -302,42 +337,82 @@ class AudioBuffer
 
         if(resolution == RESOLUTION_16_BIT)
         {
-            xm1   = s16_[integral];
-            x0    = s16_[integral + 1];
-            x1    = s16_[integral + 2];
-            x2    = s16_[integral + 3];
-            scale = 1.0f / 32768.0f;
+            int16_t        scratch[4];
+            const int16_t* s = Taps(s16_, integral, 4, scratch);
+            xm1              = s[0];
+            x0               = s[1];
+            x1               = s[2];
+            x2               = s[3];
+            scale            = 1.0f / 32768.0f;
         }
         else if(resolution == RESOLUTION_8_BIT_MU_LAW)
         {
-            xm1   = MuLaw2Lin(s8_[integral]);
-            x0    = MuLaw2Lin(s8_[integral + 1]);
-            x1    = MuLaw2Lin(s8_[integral + 2]);
-            x2    = MuLaw2Lin(s8_[integral + 3]);
-            scale = 1.0f / 32768.0f;
+            int8_t        scratch[4];
+            const int8_t* s = Taps(s8_, integral, 4, scratch);
+            xm1             = MuLaw2Lin(s[0]);
+            x0              = MuLaw2Lin(s[1]);
+            x1              = MuLaw2Lin(s[2]);
+            x2              = MuLaw2Lin(s[3]);
+            scale           = 1.0f / 32768.0f;
         }
         else
         {
-            xm1   = s8_[integral];
-            x0    = s8_[integral + 1];
-            x1    = s8_[integral + 2];
-            x2    = s8_[integral + 3];
-            scale = 1.0f / 128.0f;
+            int8_t        scratch[4];
+            const int8_t* s = Taps(s8_, integral, 4, scratch);
+            xm1             = s[0];
+            x0              = s[1];
+            x1              = s[2];
+            x2              = s[3];
+            scale           = 1.0f / 128.0f;
         }
 
-        // Laurent de Soras's Hermite interpolator.
-        const float c     = (x1 - xm1) * 0.5f;
-        const float v     = x0 - x1;
-        const float w     = c + v;
-        const float a     = w + v + (x2 - x0) * 0.5f;
-        const float b_neg = w + a;
-        return ((((a * t) - b_neg) * t + c) * t + x0) * scale;
+        return InterpolateHermite(xm1, x0, x1, x2, t) * scale;
+    }
+
+    // Reads go through a page table (a snapshot bank of this buffer), with
+    // `head` as the write head they are relative to; NULL goes back to the
+    // buffer. Writes always go to the buffer.
+    inline void set_pages(const uint8_t* const* pages, int32_t head)
+    {
+        pages_      = pages;
+        pages_head_ = head;
     }
 
     inline int32_t size() const { return size_; }
-    inline int32_t head() const { return write_head_; }
+    // Write head the reads are relative to.
+    inline int32_t head() const { return pages_ ? pages_head_ : write_head_; }
+    inline int32_t write_head() const { return write_head_; }
+
+    // Raw 16-bit storage, used to stage regions of the buffer elsewhere.
+    inline const int16_t* data() const { return s16_; }
 
   private:
+    // `taps` consecutive samples from `integral`, gathered in `scratch` when
+    // they straddle two pages.
+    template <typename T>
+    inline const T*
+    Taps(const T* samples, int32_t integral, int32_t taps, T* scratch) const
+    {
+        if(!pages_)
+        {
+            return &samples[integral];
+        }
+        const int32_t shift = kBufferPageShift - (sizeof(T) - 1);
+        const int32_t mask  = (1 << shift) - 1;
+        if((integral & mask) + taps <= mask + 1)
+        {
+            return reinterpret_cast<const T*>(pages_[integral >> shift])
+                   + (integral & mask);
+        }
+        for(int32_t i = 0; i < taps; ++i)
+        {
+            const int32_t index = integral + i;
+            scratch[i] = reinterpret_cast<const T*>(
+                pages_[index >> shift])[index & mask];
+        }
+        return scratch;
+    }
+
     int16_t* s16_;
     int8_t*  s8_;
 
@@ -350,6 +425,9 @@ class AudioBuffer
 
     int16_t* tail_;
     int32_t  crossfade_counter_;
+
+    const uint8_t* const* pages_;
+    int32_t               pages_head_;
 };
 
 
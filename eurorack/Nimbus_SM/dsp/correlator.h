@@ -50,9 +50,13 @@ class Correlator
         return offset_ + (best_match_ * (increment_ >> 4) >> 12);
     }
 
-    inline void EvaluateSomeCandidates()
+    // budget (0..1) scales the number of candidates evaluated per call. A
+    // search that does not complete before the next window is scheduled
+    // returns the best candidate found so far.
+    inline void EvaluateSomeCandidates(float budget = 1.0f)
     {
-        size_t num_candidates = (size_ >> 2) + 16;
+        size_t num_candidates
+            = static_cast<size_t>(((size_ >> 2) + 16) * budget);
         while(num_candidates)
         {
             EvaluateNextCandidate();
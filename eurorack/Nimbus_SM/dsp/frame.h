@@ -29,9 +29,17 @@
 #ifndef CLOUDS_DSP_FRAME_H_
 #define CLOUDS_DSP_FRAME_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 const int32_t kMaxNumChannels = 2;
 const size_t  kMaxBlockSize   = 32;
 
+// Block-rate work (filter coefficients, grain bookkeeping...) is done once
+// every kControlRateSize samples, so that running with blocks smaller than
+// kMaxBlockSize does not multiply its cost.
+const size_t kControlRateSize = 32;
+
 typedef struct
 {
     short l;
@@ -30,6 +30,7 @@
 #define CLOUDS_DSP_FX_DIFFUSER_H_
 
 #include "fx_engine.h"
+#include "parameter_ramp.h"
 
 using namespace daisysp;
 
@@ -39,10 +40,31 @@ class Diffuser
     Diffuser() {}
     ~Diffuser() {}
 
-    void Init(float* buffer) { engine_.Init(buffer); }
+    void Init(float* buffer)
+    {
+        engine_.Init(buffer);
+        economy_ = false;
+        skipped_ = false;
+    }
+
+    void Clear() { engine_.Clear(); }
 
-    void Process(FloatFrame* in_out, size_t size)
+    // `amount` is the wet mix, ramped across the block.
+    void Process(FloatFrame* in_out, size_t size, LinearRamp amount)
     {
+        if(economy_ && amount.silent())
+        {
+            // Whatever is left in the delays would be frozen, and heard
+            // once the diffuser is mixed in again.
+            if(!skipped_)
+            {
+                Clear();
+                skipped_ = true;
+            }
+            return;
+        }
+        skipped_ = false;
+
         typedef E::Reserve<
             126,
             E::Reserve<
@@ -69,6 +91,7 @@ class Diffuser
         while(size--)
         {
             engine_.Start(&c);
+            const float mix = amount.Next();
 
             float wet = 0.0f;
             c.Read(in_out->l);
@@ -81,7 +104,7 @@ class Diffuser
             c.Read(apl4 TAIL, kap);
             c.WriteAllPass(apl4, -kap);
             c.Write(wet, 0.0f);
-            in_out->l += amount_ * (wet - in_out->l);
+            in_out->l += mix * (wet - in_out->l);
 
             c.Read(in_out->r);
             c.Read(apr1 TAIL, kap);
@@ -93,19 +116,22 @@ class Diffuser
             c.Read(apr4 TAIL, kap);
             c.WriteAllPass(apr4, -kap);
             c.Write(wet, 0.0f);
-            in_out->r += amount_ * (wet - in_out->r);
+            in_out->r += mix * (wet - in_out->r);
 
             ++in_out;
         }
     }
 
-    void set_amount(float amount) { amount_ = amount; }
+    // Economy mode skips processing while the diffuser is not mixed in, and
+    // empties the delays when the skipping starts.
+    void set_economy(bool economy) { economy_ = economy; }
 
   private:
     typedef FxEngine<2048, FORMAT_32_BIT> E;
     E                                     engine_;
 
-    float amount_;
+    bool economy_;
+    bool skipped_;
 };
 
 
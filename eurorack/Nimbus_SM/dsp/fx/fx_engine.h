@@ -286,6 +286,36 @@ class FxEngine
             accumulator_ += x * scale;
         }
 
+        // 4-point Hermite interpolation, for delays swept by large amounts.
+        // Reads one sample before `offset`.
+        template <typename D>
+        inline void InterpolateHermite(D& d, float offset, float scale)
+        {
+            STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
+            MAKE_INTEGRAL_FRACTIONAL(offset);
+            const int32_t base = write_ptr_ + offset_integral + D::base;
+            float         xm1
+                = DataType<format>::Decompress(buffer_[(base - 1) & MASK]);
+            float x0 = DataType<format>::Decompress(buffer_[base & MASK]);
+            float x1 = DataType<format>::Decompress(buffer_[(base + 1) & MASK]);
+            float x2 = DataType<format>::Decompress(buffer_[(base + 2) & MASK]);
+
+            float c     = (x1 - xm1) * 0.5f;
+            float v     = x0 - x1;
+            float w     = c + v;
+            float a     = w + v + (x2 - x0) * 0.5f;
+            float b_neg = w + a;
+            float t     = offset_fractional;
+            float x     = (((a * t) - b_neg) * t + c) * t + x0;
+            previous_read_ = x;
+            accumulator_ += x * scale;
+        }
+
+        inline void SoftLimit()
+        {
+            accumulator_ = daisysp::SoftLimit(accumulator_);
+        }
+
       private:
         float   accumulator_;
         float   previous_read_;
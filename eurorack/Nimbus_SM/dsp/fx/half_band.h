@@ -0,0 +1,93 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Half-band decimator and interpolator by 2, for running an effect at half
+// the sample rate.
+//
+// Both use the 7-tap kernel (-1 0 9 16 9 0 -1) / 32. All odd taps but the
+// centre one are zero, so a decimated sample, or a pair of interpolated ones,
+// costs 4 multiplies. The response is within 1 dB up to 0.15 fs and -6 dB at
+// fs / 4, rejecting about 25 dB at 0.375 fs: cheap, and good enough for a
+// signal that is darkened anyway, like a reverb send.
+
+#ifndef CLOUDS_DSP_FX_HALF_BAND_H_
+#define CLOUDS_DSP_FX_HALF_BAND_H_
+
+class HalfBandDecimator
+{
+  public:
+    HalfBandDecimator() {}
+    ~HalfBandDecimator() {}
+
+    void Init()
+    {
+        odd_[0] = odd_[1] = odd_[2] = 0.0f;
+        even_                       = 0.0f;
+    }
+
+    // One output sample for two consecutive input samples, delayed by 3
+    // input samples.
+    inline float Process(float even, float odd)
+    {
+        const float out = 0.5f * even_
+                          + (9.0f * (odd_[0] + odd_[1]) - (odd + odd_[2]))
+                                * (1.0f / 32.0f);
+        odd_[2] = odd_[1];
+        odd_[1] = odd_[0];
+        odd_[0] = odd;
+        even_   = even;
+        return out;
+    }
+
+  private:
+    float odd_[3];
+    float even_;
+};
+
+class HalfBandInterpolator
+{
+  public:
+    HalfBandInterpolator() {}
+    ~HalfBandInterpolator() {}
+
+    void Init() { history_[0] = history_[1] = history_[2] = 0.0f; }
+
+    // Two output samples for one input sample, delayed by 3 output samples.
+    inline void Process(float in, float* out)
+    {
+        out[0] = (9.0f * (history_[0] + history_[1]) - (in + history_[2]))
+                 * (1.0f / 16.0f);
+        out[1]      = history_[0];
+        history_[2] = history_[1];
+        history_[1] = history_[0];
+        history_[0] = in;
+    }
+
+  private:
+    float history_[3];
+};
+
+#endif // CLOUDS_DSP_FX_HALF_BAND_H_
@@ -0,0 +1,492 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Oliverb, from the Parasites firmware: the reverb's tank with delays that
+// follow a size parameter and wander with smoothed random LFOs, a high-pass
+// filter and a soft limiter in the loop, and a pitch shifter on the
+// feedback (shimmer).
+//
+// The LFOs only move the delays by fractions of a sample per sample: they
+// are computed at the block's ends, and the taps ramp between them. The
+// shifter's window runs in a pass of its own before the tank, and its taps
+// are skipped while it is not mixed in, as are the plain taps while it is
+// fully.
+
+#ifndef CLOUDS_DSP_FX_OLIVERB_H_
+#define CLOUDS_DSP_FX_OLIVERB_H_
+
+#include <algorithm>
+#include <cmath>
+
+#include "fx_engine.h"
+#include "frame.h"
+#include "parameter_ramp.h"
+#include "random.h"
+#include "resources.h"
+
+using namespace daisysp;
+
+// ap1, ap2, ap3, ap4, dap1a, dap1b, del1, dap2a, dap2b, del2.
+const int32_t kNumOliverbLines = 10;
+const float   kOliverbLengths[kNumOliverbLines]
+    = {113.0f, 162.0f, 241.0f, 399.0f, 1253.0f,
+       1738.0f, 3411.0f, 1513.0f, 1363.0f, 4782.0f};
+// LFO sweeping each line, -1 for none.
+const int32_t kNumOliverbLfos                = 8;
+const int32_t kOliverbLfos[kNumOliverbLines] = {0, 1, 2, 3, 4, -1, 5, 6, -1, 7};
+
+// Parasites' RandomOscillator, advanced a block at a time: segments between
+// random values, alternately rising and falling by at least 30% of the way
+// to the rail, shaped by a smoothstep rather than a raised-cosine table.
+class RandomLfo
+{
+  public:
+    RandomLfo() {}
+    ~RandomLfo() {}
+
+    void Init(RandomSource* random)
+    {
+        random_          = random;
+        phase_           = 0.0f;
+        phase_increment_ = 0.0f;
+        value_           = 0.0f;
+        next_value_      = Uniform() * 2.0f - 1.0f;
+        direction_       = false;
+    }
+
+    // Phase increment per sample, for a whole excursion.
+    inline void set_slope(float slope)
+    {
+        const float gap  = fabsf(next_value_ - value_);
+        phase_increment_ = slope <= 0.0f  ? 0.0f
+                           : slope < gap ? slope / gap
+                                         : 1.0f;
+    }
+
+    // The value `size` samples later.
+    inline float Next(size_t size)
+    {
+        phase_ += phase_increment_ * static_cast<float>(size);
+        if(phase_ >= 1.0f)
+        {
+            phase_ -= static_cast<float>(static_cast<int32_t>(phase_));
+            value_     = next_value_;
+            direction_ = !direction_;
+            const float rnd = 0.7f * Uniform() + 0.3f;
+            next_value_     = direction_ ? value_ + (1.0f - value_) * rnd
+                                         : value_ - (1.0f + value_) * rnd;
+        }
+        const float s = phase_ * phase_ * (3.0f - 2.0f * phase_);
+        return value_ + (next_value_ - value_) * s;
+    }
+
+  private:
+    inline float Uniform() { return random_->Next() * kRandFrac; }
+
+    RandomSource* random_;
+    float         phase_;
+    float         phase_increment_;
+    float         value_;
+    float         next_value_;
+    bool          direction_;
+};
+
+class Oliverb
+{
+  public:
+    Oliverb() {}
+    ~Oliverb() {}
+
+    void Init(uint16_t* buffer, float sample_rate)
+    {
+        engine_.Init(buffer);
+        random_.Seed(RandomSource::kDefaultSeed);
+        diffusion_          = 0.625f;
+        size_               = 0.5f;
+        smooth_size_        = 0.5f;
+        mod_amount_         = 0.0f;
+        mod_rate_           = 0.0f;
+        input_gain_         = 1.0f;
+        decay_              = 0.5f;
+        lp_                 = 1.0f;
+        hp_                 = 0.0f;
+        phase_              = 0.0f;
+        ratio_              = 1.0f;
+        pitch_shift_amount_ = 1.0f;
+        economy_            = false;
+        skipped_            = false;
+        for(int32_t i = 0; i < kNumOliverbLfos; ++i)
+        {
+            lfo_[i].Init(&random_);
+            lfo_value_[i] = 0.0f;
+        }
+        set_sample_rate(sample_rate);
+        Clear();
+    }
+
+    // Empties the tank, e.g. after a non-finite sample got into it.
+    void Clear()
+    {
+        engine_.Clear();
+        lp_decay_1_ = 0.0f;
+        lp_decay_2_ = 0.0f;
+        hp_decay_1_ = 0.0f;
+        hp_decay_2_ = 0.0f;
+    }
+
+    // `amount` is the wet mix, ramped across the block. `size` is at most
+    // kMaxBlockSize.
+    void Process(FloatFrame* in_out, size_t size, LinearRamp amount)
+    {
+        if(economy_ && amount.silent())
+        {
+            // Whatever is left in the tank would be frozen, and heard as a
+            // stale tail once the reverb is mixed in again.
+            if(!skipped_)
+            {
+                Clear();
+                skipped_ = true;
+            }
+            return;
+        }
+        skipped_ = false;
+
+        Tank t;
+        t.kap  = diffusion_;
+        t.lp_1 = lp_decay_1_;
+        t.lp_2 = lp_decay_2_;
+        t.hp_1 = hp_decay_1_;
+        t.hp_2 = hp_decay_2_;
+
+        // The size follows its one-pole at block rate, and the taps ramp to
+        // where it and the LFOs end the block.
+        const float samples    = static_cast<float>(size);
+        const float size_start = smooth_size_;
+        smooth_size_
+            += std::min(0.01f * samples, 1.0f) * (size_ - smooth_size_);
+
+        float slope = mod_rate_ * mod_rate_;
+        slope *= slope * slope;
+        slope *= rate_scale_ / 200.0f;
+        float lfo_end[kNumOliverbLfos];
+        for(int32_t i = 0; i < kNumOliverbLfos; ++i)
+        {
+            lfo_[i].set_slope(slope);
+            lfo_end[i] = lfo_[i].Next(size);
+        }
+
+        for(int32_t i = 0; i < kNumOliverbLines; ++i)
+        {
+            const int32_t lfo   = kOliverbLfos[i];
+            const float   range = kOliverbLengths[i] - 1.0f;
+            float         start = range * size_start;
+            float         end   = range * smooth_size_;
+            if(lfo >= 0)
+            {
+                start += lfo_value_[lfo] * mod_amount_;
+                end += lfo_end[lfo] * mod_amount_;
+            }
+            CONSTRAIN(start, 1.0f, range);
+            CONSTRAIN(end, 1.0f, range);
+            t.offset[i]      = start;
+            t.offset_step[i] = (end - start) / samples;
+        }
+        std::copy(&lfo_end[0], &lfo_end[kNumOliverbLfos], &lfo_value_[0]);
+
+        // The shifter's taps and window.
+        t.shimmer      = pitch_shift_amount_ > 0.0f;
+        t.plain        = pitch_shift_amount_ < 1.0f;
+        t.plain_gain   = decay_ * (1.0f - pitch_shift_amount_);
+        t.shimmer_gain = decay_ * pitch_shift_amount_;
+        if(t.shimmer)
+        {
+            float       ps_size = 128.0f + 3282.0f * size_start;
+            const float ps_step
+                = 3282.0f * (smooth_size_ - size_start) / samples;
+            for(size_t i = 0; i < size; ++i)
+            {
+                ps_size += ps_step;
+                phase_ += (1.0f - ratio_) / ps_size;
+                if(phase_ >= 1.0f)
+                {
+                    phase_ -= 1.0f;
+                }
+                if(phase_ <= 0.0f)
+                {
+                    phase_ += 1.0f;
+                }
+                float tri = 2.0f * (phase_ >= 0.5f ? 1.0f - phase_ : phase_);
+                tri       = Interpolate(lut_window, tri, LUT_WINDOW_SIZE - 1);
+                float phase = phase_ * ps_size;
+                float half  = phase + ps_size * 0.5f;
+                if(half >= ps_size)
+                {
+                    half -= ps_size;
+                }
+                t.shift_phase[i] = phase;
+                t.shift_half[i]  = half;
+                t.shift_tri[i]   = tri * t.shimmer_gain;
+            }
+        }
+
+        if(economy_)
+        {
+            Run<true>(&t, in_out, size, amount);
+        }
+        else
+        {
+            Run<false>(&t, in_out, size, amount);
+        }
+
+        lp_decay_1_ = t.lp_1;
+        lp_decay_2_ = t.lp_2;
+        hp_decay_1_ = t.hp_1;
+        hp_decay_2_ = t.hp_2;
+    }
+
+    inline void set_input_gain(float input_gain) { input_gain_ = input_gain; }
+
+    inline void set_decay(float decay) { decay_ = decay; }
+
+    inline void set_diffusion(float diffusion) { diffusion_ = diffusion; }
+
+    inline void set_lp(float lp) { lp_ = lp; }
+
+    inline void set_hp(float hp) { hp_ = hp; }
+
+    inline void set_size(float size) { size_ = size; }
+
+    // Depth of the LFOs, in samples.
+    inline void set_mod_amount(float mod_amount) { mod_amount_ = mod_amount; }
+
+    inline void set_mod_rate(float mod_rate) { mod_rate_ = mod_rate; }
+
+    // Pitch ratio of the shifter.
+    inline void set_ratio(float ratio) { ratio_ = ratio; }
+
+    // Share of the feedback taken through the shifter.
+    inline void set_pitch_shift_amount(float pitch_shift)
+    {
+        pitch_shift_amount_ = pitch_shift;
+    }
+
+    // Economy mode reads the delays with linear interpolation, drops the
+    // smearing of the first allpass, and skips processing altogether while
+    // the reverb is not mixed in. The tank is emptied when the skipping
+    // starts.
+    inline void set_economy(bool economy) { economy_ = economy; }
+
+    // The delays are in samples, as in Parasites at 32 kHz; the LFOs run at
+    // the same rates in Hz whatever the sample rate.
+    inline void set_sample_rate(float sample_rate)
+    {
+        rate_scale_ = 32000.0f / sample_rate;
+        engine_.SetLFOFrequency(LFO_1, 0.5f / sample_rate);
+        engine_.SetLFOFrequency(LFO_2, 0.3f / sample_rate);
+    }
+
+  private:
+    typedef FxEngine<16384, FORMAT_16_BIT> E;
+    typedef E::Reserve<113,
+            E::Reserve<162,
+            E::Reserve<241,
+            E::Reserve<399,
+            E::Reserve<1253,
+            E::Reserve<1738,
+            E::Reserve<3411,
+            E::Reserve<1513,
+            E::Reserve<1363,
+            E::Reserve<4782> > > > > > > > > >
+        Memory;
+
+    struct Tank
+    {
+        float kap;
+        bool  plain;
+        bool  shimmer;
+        float plain_gain;
+        float shimmer_gain;
+        float lp_1;
+        float lp_2;
+        float hp_1;
+        float hp_2;
+        float offset[kNumOliverbLines];
+        float offset_step[kNumOliverbLines];
+        float shift_phase[kMaxBlockSize];
+        float shift_half[kMaxBlockSize];
+        float shift_tri[kMaxBlockSize];
+    };
+
+    // Economy mode reads the delays with linear rather than 4-point Hermite
+    // interpolation: half the reads, and a slight loss of highs where they
+    // are swept.
+    template <bool kEconomy, typename D>
+    static inline void Tap(E::Context* c, D& d, float offset, float scale)
+    {
+        if(kEconomy)
+        {
+            c->Interpolate(d, offset, scale);
+        }
+        else
+        {
+            c->InterpolateHermite(d, offset, scale);
+        }
+    }
+
+    // This is the reverb's topology, with every delay read at the taps set
+    // up by Process().
+    template <bool kEconomy>
+    inline void Run(Tank* t, FloatFrame* in_out, size_t size, LinearRamp amount)
+    {
+        E::DelayLine<Memory, 0> ap1;
+        E::DelayLine<Memory, 1> ap2;
+        E::DelayLine<Memory, 2> ap3;
+        E::DelayLine<Memory, 3> ap4;
+        E::DelayLine<Memory, 4> dap1a;
+        E::DelayLine<Memory, 5> dap1b;
+        E::DelayLine<Memory, 6> del1;
+        E::DelayLine<Memory, 7> dap2a;
+        E::DelayLine<Memory, 8> dap2b;
+        E::DelayLine<Memory, 9> del2;
+        E::Context c;
+
+        const float kap    = t->kap;
+        float*      offset = t->offset;
+
+        for(size_t i = 0; i < size; ++i, ++in_out)
+        {
+            engine_.Start(&c);
+            for(int32_t j = 0; j < kNumOliverbLines; ++j)
+            {
+                offset[j] += t->offset_step[j];
+            }
+
+            // Smear AP1 inside the loop.
+            if(!kEconomy)
+            {
+                c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
+                c.Write(ap1, 100, 0.0f);
+            }
+
+            c.Read(in_out->l + in_out->r, input_gain_);
+            // Diffuse through 4 allpasses.
+            Tap<kEconomy>(&c, ap1, offset[0], kap);
+            c.WriteAllPass(ap1, -kap);
+            Tap<kEconomy>(&c, ap2, offset[1], kap);
+            c.WriteAllPass(ap2, -kap);
+            Tap<kEconomy>(&c, ap3, offset[2], kap);
+            c.WriteAllPass(ap3, -kap);
+            Tap<kEconomy>(&c, ap4, offset[3], kap);
+            c.WriteAllPass(ap4, -kap);
+
+            float apout;
+            c.Write(apout);
+
+            if(t->plain)
+            {
+                Tap<kEconomy>(&c, del2, offset[9], t->plain_gain);
+            }
+            if(t->shimmer)
+            {
+                // Blend in the pitch shifted feedback.
+                Tap<kEconomy>(&c, del2, t->shift_phase[i], t->shift_tri[i]);
+                Tap<kEconomy>(&c,
+                              del2,
+                              t->shift_half[i],
+                              t->shimmer_gain - t->shift_tri[i]);
+            }
+            c.Lp(t->lp_1, lp_);
+            c.Hp(t->hp_1, hp_);
+            c.SoftLimit();
+            Tap<kEconomy>(&c, dap1a, offset[4], -kap);
+            c.WriteAllPass(dap1a, kap);
+            Tap<kEconomy>(&c, dap1b, offset[5], kap);
+            c.WriteAllPass(dap1b, -kap);
+            c.Write(del1, 2.0f);
+            float wet_l;
+            c.Write(wet_l, 0.0f);
+
+            c.Load(apout);
+            if(t->plain)
+            {
+                Tap<kEconomy>(&c, del1, offset[6], t->plain_gain);
+            }
+            if(t->shimmer)
+            {
+                Tap<kEconomy>(&c, del1, t->shift_phase[i], t->shift_tri[i]);
+                Tap<kEconomy>(&c,
+                              del1,
+                              t->shift_half[i],
+                              t->shimmer_gain - t->shift_tri[i]);
+            }
+            c.Lp(t->lp_2, lp_);
+            c.Hp(t->hp_2, hp_);
+            c.SoftLimit();
+            Tap<kEconomy>(&c, dap2a, offset[7], kap);
+            c.WriteAllPass(dap2a, -kap);
+            Tap<kEconomy>(&c, dap2b, offset[8], -kap);
+            c.WriteAllPass(dap2b, kap);
+            c.Write(del2, 2.0f);
+            float wet_r;
+            c.Write(wet_r, 0.0f);
+
+            const float mix = amount.Next();
+            in_out->l += (wet_l - in_out->l) * mix;
+            in_out->r += (wet_r - in_out->r) * mix;
+        }
+    }
+
+    E engine_;
+
+    float input_gain_;
+    float decay_;
+    float diffusion_;
+    float lp_;
+    float hp_;
+    float size_;
+    float smooth_size_;
+    float mod_amount_;
+    float mod_rate_;
+    float pitch_shift_amount_;
+    bool  economy_;
+    bool  skipped_;
+    float rate_scale_;
+
+    float lp_decay_1_;
+    float lp_decay_2_;
+    float hp_decay_1_;
+    float hp_decay_2_;
+
+    float phase_;
+    float ratio_;
+
+    RandomSource random_;
+    RandomLfo    lfo_[kNumOliverbLfos];
+    // LFO values at the end of the last block.
+    float lfo_value_[kNumOliverbLfos];
+};
+
+#endif // CLOUDS_DSP_FX_OLIVERB_H_
@@ -32,6 +32,7 @@
 
 #include "frame.h"
 #include "fx_engine.h"
+#include "parameter_ramp.h"
 
 using namespace daisysp;
 
@@ -46,21 +47,24 @@ class PitchShifterClouds
         engine_.Init(buffer);
         phase_ = 0;
         size_  = 2047.0f;
-        dry_wet_ = 0.0f;
     }
 
     void Clear() { engine_.Clear(); }
 
-    inline void Process(FloatFrame* input_output, size_t size)
+    // The transposition ratio and the wet mix are ramped across the block.
+    inline void Process(FloatFrame* input_output,
+                        size_t      size,
+                        LinearRamp  ratio,
+                        LinearRamp  dry_wet)
     {
         while(size--)
         {
-            Process(input_output);
+            Process(input_output, ratio.Next(), dry_wet.Next());
             ++input_output;
         }
     }
 
-    void Process(FloatFrame* input_output)
+    void Process(FloatFrame* input_output, float ratio, float dry_wet)
     {
         typedef E::Reserve<2047, E::Reserve<2047>> Memory;
         E::DelayLine<Memory, 0>                    left;
@@ -68,7 +72,7 @@ class PitchShifterClouds
         E::Context                                 c;
         engine_.Start(&c);
 
-        phase_ += (1.0f - ratio_) / size_;
+        phase_ += (1.0f - ratio) / size_;
         if(phase_ >= 1.0f)
         {
             phase_ -= 1.0f;
@@ -92,20 +96,16 @@ class PitchShifterClouds
         c.Interpolate(left, phase, tri);
         c.Interpolate(left, half, 1.0f - tri);
         c.Write(wet, 0.0f);
-        input_output->l += (wet - input_output->l) * dry_wet_;
+        input_output->l += (wet - input_output->l) * dry_wet;
 
         c.Read(input_output->r, 1.0f);
         c.Write(right, 0.0f);
         c.Interpolate(right, phase, tri);
         c.Interpolate(right, half, 1.0f - tri);
         c.Write(wet, 0.0f);
-        input_output->r += (wet - input_output->r) * dry_wet_;
+        input_output->r += (wet - input_output->r) * dry_wet;
     }
 
-    inline void set_ratio(float ratio) { ratio_ = ratio; }
-
-    inline void set_dry_wet(float dry_wet) { dry_wet_ = dry_wet; }
-
     inline void set_size(float size)
     {
         float target_size = 128.0f + (2047.0f - 128.0f) * size * size * size;
@@ -116,9 +116,7 @@ class PitchShifterClouds
     typedef FxEngine<4096, FORMAT_16_BIT> E;
     E                                     engine_;
     float                                 phase_;
-    float                                 ratio_;
     float                                 size_;
-    float                                 dry_wet_;
 };
 
 
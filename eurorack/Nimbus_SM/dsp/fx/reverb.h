@@ -31,6 +31,8 @@
 
 
 #include "fx_engine.h"
+#include "half_band.h"
+#include "parameter_ramp.h"
 
 using namespace daisysp;
 
@@ -40,40 +42,190 @@ class Reverb
     Reverb() {}
     ~Reverb() {}
 
-    void Init(uint16_t* buffer)
+    void Init(uint16_t* buffer, float sample_rate)
     {
         engine_.Init(buffer);
-        engine_.SetLFOFrequency(LFO_1, 0.5f / 32000.0f);
-        engine_.SetLFOFrequency(LFO_2, 0.3f / 32000.0f);
-        lp_        = 0.7f;
-        diffusion_ = 0.625f;
+        decimator_.Init();
+        interpolator_l_.Init();
+        interpolator_r_.Init();
+        half_rate_         = false;
+        next_half_rate_    = false;
+        wet_peak_          = 0.0f;
+        set_sample_rate(sample_rate);
+        lp_         = 0.7f;
+        diffusion_  = 0.625f;
+        economy_    = false;
+        skipped_    = false;
+        lp_decay_1_ = 0.0f;
+        lp_decay_2_ = 0.0f;
     }
 
-    void Process(FloatFrame* in_out, size_t size)
+    // Empties the tank, e.g. after a non-finite sample got into it.
+    void Clear()
     {
-        // This is the Griesinger topology described in the Dattorro paper
-        // (4 AP diffusers on the input, then a loop of 2x 2AP+1Delay).
-        // Modulation is applied in the loop of the first diffuser AP for additional
-        // smearing; and to the two long delays for a slow shimmer/chorus effect.
-        typedef E::Reserve<
-            113,
-            E::Reserve<
-                162,
-                E::Reserve<
-                    241,
-                    E::Reserve<
-                        399,
-                        E::Reserve<
-                            1653,
-                            E::Reserve<
-                                2038,
-                                E::Reserve<
-                                    3411,
-                                    E::Reserve<
-                                        1913,
-                                        E::Reserve<1663,
-                                                   E::Reserve<4782>>>>>>>>>>
-                                Memory;
+        engine_.Clear();
+        decimator_.Init();
+        interpolator_l_.Init();
+        interpolator_r_.Init();
+        lp_decay_1_ = 0.0f;
+        lp_decay_2_ = 0.0f;
+        wet_peak_   = 0.0f;
+    }
+
+    // `amount` is the wet mix, ramped across the block. At half rate, `size`
+    // must be even.
+    void Process(FloatFrame* in_out, size_t size, LinearRamp amount)
+    {
+        if(next_half_rate_ != half_rate_
+           && (amount.silent() || wet_peak_ < kQuietLevel))
+        {
+            // The delays change lengths, which empties the tank: wait until
+            // it is not heard.
+            half_rate_ = next_half_rate_;
+            Clear();
+            set_sample_rate(sample_rate_);
+        }
+
+        if(economy_ && amount.silent())
+        {
+            // Whatever is left in the tank would be frozen, and heard as a
+            // stale tail once the reverb is mixed in again.
+            if(!skipped_)
+            {
+                Clear();
+                skipped_ = true;
+            }
+            return;
+        }
+        skipped_ = false;
+
+        Tank tank;
+        tank.peak  = 0.0f;
+        tank.kap   = diffusion_;
+        tank.krt   = reverb_time_;
+        tank.gain  = input_gain_;
+        tank.smear = !economy_;
+        tank.lp_1  = lp_decay_1_;
+        tank.lp_2  = lp_decay_2_;
+        E::Context c;
+
+        if(half_rate_)
+        {
+            // Same cutoff with half as many steps per second.
+            tank.klp = 1.0f - (1.0f - lp_) * (1.0f - lp_);
+            for(size /= 2; size--; in_out += 2)
+            {
+                float wet_l, wet_r;
+                float l[2], r[2];
+                const float send = decimator_.Process(
+                    in_out[0].l + in_out[0].r, in_out[1].l + in_out[1].r);
+                Tick<2>(&c, &tank, send, &wet_l, &wet_r);
+                tank.peak = fmaxf(tank.peak, fabsf(wet_l) + fabsf(wet_r));
+                interpolator_l_.Process(wet_l, l);
+                interpolator_r_.Process(wet_r, r);
+                for(int32_t i = 0; i < 2; ++i)
+                {
+                    const float mix = amount.Next();
+                    in_out[i].l += (l[i] - in_out[i].l) * mix;
+                    in_out[i].r += (r[i] - in_out[i].r) * mix;
+                }
+            }
+        }
+        else
+        {
+            tank.klp = lp_;
+            for(; size--; ++in_out)
+            {
+                float       wet_l, wet_r;
+                const float send = in_out->l + in_out->r;
+                Tick<1>(&c, &tank, send, &wet_l, &wet_r);
+                tank.peak = fmaxf(tank.peak, fabsf(wet_l) + fabsf(wet_r));
+                const float mix = amount.Next();
+                in_out->l += (wet_l - in_out->l) * mix;
+                in_out->r += (wet_r - in_out->r) * mix;
+            }
+        }
+
+        lp_decay_1_ = tank.lp_1;
+        lp_decay_2_ = tank.lp_2;
+        wet_peak_   = tank.peak;
+    }
+
+    inline void set_input_gain(float input_gain) { input_gain_ = input_gain; }
+
+    inline void set_time(float reverb_time) { reverb_time_ = reverb_time; }
+
+    inline void set_diffusion(float diffusion) { diffusion_ = diffusion; }
+
+    inline void set_lp(float lp) { lp_ = lp; }
+
+    // Economy mode drops the modulation of the tank, and skips processing
+    // altogether while the reverb is not mixed in. The tank is emptied when
+    // the skipping starts.
+    inline void set_economy(bool economy) { economy_ = economy; }
+
+    // Half rate runs the tank on a decimated send, at about half the cost,
+    // giving up the top octave of the wet signal. Switching empties the
+    // tank, so it is deferred until the reverb is not mixed in or its tail
+    // has decayed below kQuietLevel.
+    inline void set_half_rate(bool half_rate) { next_half_rate_ = half_rate; }
+
+    inline bool half_rate() const { return half_rate_; }
+
+    // The tank is modulated at 0.5Hz and 0.3Hz whatever the sample rate.
+    inline void set_sample_rate(float sample_rate)
+    {
+        const float tank_rate = half_rate_ ? sample_rate * 0.5f : sample_rate;
+        sample_rate_          = sample_rate;
+        engine_.SetLFOFrequency(LFO_1, 0.5f / tank_rate);
+        engine_.SetLFOFrequency(LFO_2, 0.3f / tank_rate);
+    }
+
+  private:
+    typedef FxEngine<16384, FORMAT_12_BIT> E;
+
+    // About -60 dB, summed over both channels.
+    static constexpr float kQuietLevel = 0.001f;
+
+    struct Tank
+    {
+        float peak;
+        float kap;
+        float klp;
+        float krt;
+        float gain;
+        bool  smear;
+        float lp_1;
+        float lp_2;
+    };
+
+    // This is the Griesinger topology described in the Dattorro paper
+    // (4 AP diffusers on the input, then a loop of 2x 2AP+1Delay).
+    // Modulation is applied in the loop of the first diffuser AP for additional
+    // smearing; and to the two long delays for a slow shimmer/chorus effect.
+    // At 1 / kRatio of the sample rate, every delay, tap and modulation depth
+    // is divided by kRatio, so that the times stay the same.
+    template <int32_t kRatio>
+    struct Network
+    {
+        typedef E::Reserve<113 / kRatio,
+                E::Reserve<162 / kRatio,
+                E::Reserve<241 / kRatio,
+                E::Reserve<399 / kRatio,
+                E::Reserve<1653 / kRatio,
+                E::Reserve<2038 / kRatio,
+                E::Reserve<3411 / kRatio,
+                E::Reserve<1913 / kRatio,
+                E::Reserve<1663 / kRatio,
+                E::Reserve<4782 / kRatio> > > > > > > > > >
+            Memory;
+    };
+
+    template <int32_t kRatio>
+    inline void
+    Tick(E::Context* c, Tank* t, float in, float* wet_l, float* wet_r)
+    {
+        typedef typename Network<kRatio>::Memory Memory;
         E::DelayLine<Memory, 0> ap1;
         E::DelayLine<Memory, 1> ap2;
         E::DelayLine<Memory, 2> ap3;
@@ -84,92 +236,79 @@ class Reverb
         E::DelayLine<Memory, 7> dap2a;
         E::DelayLine<Memory, 8> dap2b;
         E::DelayLine<Memory, 9> del2;
-        E::Context              c;
-
-        const float kap    = diffusion_;
-        const float klp    = lp_;
-        const float krt    = reverb_time_;
-        const float amount = amount_;
-        const float gain   = input_gain_;
 
-        float lp_1 = lp_decay_1_;
-        float lp_2 = lp_decay_2_;
+        const float kap   = t->kap;
+        const float klp   = t->klp;
+        const float krt   = t->krt;
+        float       apout = 0.0f;
+        engine_.Start(c);
 
-        while(size--)
+        // Smear AP1 inside the loop.
+        if(t->smear)
         {
-            float wet;
-            float apout = 0.0f;
-            engine_.Start(&c);
-
-            // Smear AP1 inside the loop.
-            c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
-            c.Write(ap1, 100, 0.0f);
-
-            c.Read(in_out->l + in_out->r, gain);
-
-            // Diffuse through 4 allpasses.
-            c.Read(ap1 TAIL, kap);
-            c.WriteAllPass(ap1, -kap);
-            c.Read(ap2 TAIL, kap);
-            c.WriteAllPass(ap2, -kap);
-            c.Read(ap3 TAIL, kap);
-            c.WriteAllPass(ap3, -kap);
-            c.Read(ap4 TAIL, kap);
-            c.WriteAllPass(ap4, -kap);
-            c.Write(apout);
-
-            // Main reverb loop.
-            c.Load(apout);
-            c.Interpolate(del2, 4680.0f, LFO_2, 100.0f, krt);
-            c.Lp(lp_1, klp);
-            c.Read(dap1a TAIL, -kap);
-            c.WriteAllPass(dap1a, kap);
-            c.Read(dap1b TAIL, kap);
-            c.WriteAllPass(dap1b, -kap);
-            c.Write(del1, 2.0f);
-            c.Write(wet, 0.0f);
-
-            in_out->l += (wet - in_out->l) * amount;
-
-            c.Load(apout);
-            // c.Interpolate(del1, 4450.0f, LFO_1, 50.0f, krt);
-            c.Read(del1 TAIL, krt);
-            c.Lp(lp_2, klp);
-            c.Read(dap2a TAIL, kap);
-            c.WriteAllPass(dap2a, -kap);
-            c.Read(dap2b TAIL, -kap);
-            c.WriteAllPass(dap2b, kap);
-            c.Write(del2, 2.0f);
-            c.Write(wet, 0.0f);
-
-            in_out->r += (wet - in_out->r) * amount;
-
-            ++in_out;
+            c->Interpolate(ap1, 10.0f / kRatio, LFO_1, 60.0f / kRatio, 1.0f);
+            c->Write(ap1, 100 / kRatio, 0.0f);
         }
 
-        lp_decay_1_ = lp_1;
-        lp_decay_2_ = lp_2;
-    }
-
-    inline void set_amount(float amount) { amount_ = amount; }
+        c->Read(in, t->gain);
 
-    inline void set_input_gain(float input_gain) { input_gain_ = input_gain; }
+        // Diffuse through 4 allpasses.
+        c->Read(ap1 TAIL, kap);
+        c->WriteAllPass(ap1, -kap);
+        c->Read(ap2 TAIL, kap);
+        c->WriteAllPass(ap2, -kap);
+        c->Read(ap3 TAIL, kap);
+        c->WriteAllPass(ap3, -kap);
+        c->Read(ap4 TAIL, kap);
+        c->WriteAllPass(ap4, -kap);
+        c->Write(apout);
 
-    inline void set_time(float reverb_time) { reverb_time_ = reverb_time; }
+        // Main reverb loop.
+        c->Load(apout);
+        if(t->smear)
+        {
+            c->Interpolate(del2, 4680.0f / kRatio, LFO_2, 100.0f / kRatio, krt);
+        }
+        else
+        {
+            c->Read(del2, 4680 / kRatio, krt);
+        }
+        c->Lp(t->lp_1, klp);
+        c->Read(dap1a TAIL, -kap);
+        c->WriteAllPass(dap1a, kap);
+        c->Read(dap1b TAIL, kap);
+        c->WriteAllPass(dap1b, -kap);
+        c->Write(del1, 2.0f);
+        c->Write(*wet_l, 0.0f);
 
-    inline void set_diffusion(float diffusion) { diffusion_ = diffusion; }
+        c->Load(apout);
+        // c->Interpolate(del1, 4450.0f, LFO_1, 50.0f, krt);
+        c->Read(del1 TAIL, krt);
+        c->Lp(t->lp_2, klp);
+        c->Read(dap2a TAIL, kap);
+        c->WriteAllPass(dap2a, -kap);
+        c->Read(dap2b TAIL, -kap);
+        c->WriteAllPass(dap2b, kap);
+        c->Write(del2, 2.0f);
+        c->Write(*wet_r, 0.0f);
+    }
 
-    inline void set_lp(float lp) { lp_ = lp; }
+    E engine_;
 
-  private:
-    typedef FxEngine<16384, FORMAT_12_BIT> E;
-    E                                      engine_;
+    HalfBandDecimator    decimator_;
+    HalfBandInterpolator interpolator_l_;
+    HalfBandInterpolator interpolator_r_;
 
-    float amount_;
     float input_gain_;
     float reverb_time_;
     float diffusion_;
     float lp_;
+    bool  economy_;
+    bool  skipped_;
+    bool  half_rate_;
+    bool  next_half_rate_;
+    float wet_peak_;
+    float sample_rate_;
 
     float lp_decay_1_;
     float lp_decay_2_;
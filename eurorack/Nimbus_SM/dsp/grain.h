@@ -127,11 +127,12 @@ class Grain
         envelope_phase_ = phase;
     }
 
-    template <int32_t num_channels, GrainQuality quality, Resolution resolution>
-    inline void OverlapAdd(const AudioBuffer<resolution>* buffer,
-                           float*                         destination,
-                           float*                         envelope,
-                           size_t                         size)
+    // Buffer is either an AudioBuffer or a StagedAudioBuffer.
+    template <int32_t num_channels, GrainQuality quality, typename Buffer>
+    inline void OverlapAdd(const Buffer* buffer,
+                           float*        destination,
+                           float*        envelope,
+                           size_t        size)
     {
         if(!active_)
         {
@@ -194,6 +195,14 @@ class Grain
         phase_ = phase;
     }
 
+    // Span of the recording buffer read while rendering the next size
+    // samples, interpolation taps included.
+    inline void StagingSpan(size_t size, int32_t* start, int32_t* length) const
+    {
+        *start  = first_sample_ + (phase_ >> 16);
+        *length = ((phase_increment_ * static_cast<int32_t>(size)) >> 16) + 4;
+    }
+
     inline bool active() { return active_; }
 
     inline GrainQuality recommended_quality() const
@@ -0,0 +1,151 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Onsets of the grains within a block.
+//
+// A grain starts on a trigger; when a clock counting samples reaches the
+// space between grains (deterministic seeding); or on a success of a
+// Bernoulli(p) draw made at every sample (probabilistic seeding). Rather
+// than testing every sample, the seeder jumps straight to the earliest of
+// the three: the clock's crossing is computed, and the distance to the next
+// success, geometric, drawn at once. tools/grain_onsets checks its intervals
+// against the per-sample draws.
+
+#ifndef CLOUDS_DSP_GRAIN_SEEDER_H_
+#define CLOUDS_DSP_GRAIN_SEEDER_H_
+
+#include <algorithm>
+#include <cmath>
+
+#include "daisysp.h"
+
+#include "random.h"
+
+using namespace daisysp;
+
+class GrainSeeder
+{
+  public:
+    GrainSeeder() {}
+    ~GrainSeeder() {}
+
+    // The draws come from random, which the caller may share.
+    void Init(RandomSource* random)
+    {
+        random_  = random;
+        phasor_  = 0.0f;
+        trigger_ = false;
+        p_       = 0.0f;
+        space_   = 0.0f;
+        t_       = 0;
+    }
+
+    // Starts a block. A negative p selects deterministic seeding, every
+    // space samples; otherwise the clock is held back and only the draws
+    // seed, while more_grains is set.
+    inline void Start(bool trigger, float p, float space, bool more_grains)
+    {
+        if(p >= 0.0f)
+        {
+            phasor_ = -1000.0f;
+        }
+        trigger_ = trigger;
+        p_       = more_grains ? p : 0.0f;
+        space_   = space;
+        t_       = 0;
+    }
+
+    // Sample of the next onset in a block of size samples, or size if there
+    // is none left.
+    inline size_t Next(size_t size)
+    {
+        if(t_ >= size)
+        {
+            return size;
+        }
+        size_t next = size;
+        if(trigger_)
+        {
+            next = t_;
+        }
+        else
+        {
+            // phasor_ holds the clock before the increment of sample t_.
+            float wait = space_ - phasor_ - 1.0f;
+            if(wait < static_cast<float>(size - t_))
+            {
+                next = t_;
+                if(wait > 0.0f)
+                {
+                    next += static_cast<size_t>(ceilf(wait));
+                }
+            }
+            if(p_ > 0.0f)
+            {
+                next = std::min(next, t_ + NextBernoulliSuccess(size - t_));
+            }
+        }
+        if(next < size)
+        {
+            phasor_  = 0.0f;
+            trigger_ = false;
+            t_       = next + 1;
+        }
+        return next;
+    }
+
+    // Ends the block: the clock runs on over the samples left.
+    inline void End(size_t size)
+    {
+        if(t_ < size)
+        {
+            phasor_ += static_cast<float>(size - t_);
+        }
+    }
+
+  private:
+    // Number of failed draws before the first success, saturated at limit.
+    inline size_t NextBernoulliSuccess(size_t limit)
+    {
+        if(p_ >= 1.0f)
+        {
+            return 0;
+        }
+        float u = (static_cast<float>(random_->Next()) + 1.0f) * kRandFrac;
+        float n = logf(u > 1.0f ? 1.0f : u) / logf(1.0f - p_);
+        return n < static_cast<float>(limit) ? static_cast<size_t>(n) : limit;
+    }
+
+    RandomSource* random_;
+
+    float  phasor_;
+    bool   trigger_;
+    float  p_;
+    float  space_;
+    size_t t_;
+};
+
+#endif // CLOUDS_DSP_GRAIN_SEEDER_H_
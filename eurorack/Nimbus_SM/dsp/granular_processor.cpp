@@ -28,6 +28,7 @@
 
 #include "granular_processor.h"
 #include <stdint.h>
+#include <cmath>
 #include <cstring>
 
 //#include "debug_pin.h"
@@ -40,6 +41,10 @@
 //using namespace daisy;
 using namespace std;
 
+// The resonators fit in the spectral memory.
+static_assert(kResonestorMemorySize <= kSpectralMemorySize,
+              "resonestor memory");
+
 void GranularProcessorClouds::Init(float  sample_rate,
                                    void*  large_buffer,
                                    size_t large_buffer_size,
@@ -52,6 +57,12 @@ void GranularProcessorClouds::Init(float  sample_rate,
     buffer_size_[0] = large_buffer_size;
     buffer_size_[1] = small_buffer_size;
 
+    long_buffer_      = NULL;
+    long_buffer_size_ = 0;
+    spectral_memory_  = NULL;
+    snapshots_.Init(NULL, 0);
+    snapshot_ = -1;
+
     num_channels_ = 2;
     low_fidelity_ = false;
     bypass_       = false;
@@ -63,7 +74,62 @@ void GranularProcessorClouds::Init(float  sample_rate,
 
     previous_playback_mode_ = PLAYBACK_MODE_LAST;
     reset_buffers_          = true;
-    dry_wet_                = 0.5f;
+    reset_rate_             = false;
+    block_size_             = kMaxBlockSize;
+
+    pitch_ratio_.Init(1.0f);
+    feedback_gain_.Init(0.0f);
+    diffusion_.Init(0.0f);
+    pitch_shifter_wet_.Init(0.0f);
+    reverb_amount_.Init(0.0f);
+    reverb_time_ = 0.35f;
+    post_oliverb_ = false;
+    tank_oliverb_ = false;
+    dry_gain_.Init(0.0f);
+    wet_gain_.Init(0.0f);
+
+    cpu_budget_.max_grains       = 1.0f;
+    cpu_budget_.midfi_grains     = 0.75f;
+    cpu_budget_.lofi_grains      = 0.0f;
+    cpu_budget_.correlator       = 1.0f;
+    cpu_budget_.fx_economy       = false;
+    cpu_budget_.half_rate_reverb = false;
+    cpu_budget_.resonator_chords = 1.0f;
+
+    stage_check_          = NULL;
+    stage_check_context_  = NULL;
+    num_recoveries_       = 0;
+    last_recovered_stage_ = PROCESS_STAGE_LAST;
+}
+
+void GranularProcessorClouds::set_cpu_budget(const CpuBudget& budget)
+{
+    cpu_budget_ = budget;
+    player_.set_budget(
+        budget.max_grains, budget.midfi_grains, budget.lofi_grains);
+    diffuser_.set_economy(budget.fx_economy);
+    reverb_.set_economy(budget.fx_economy);
+    reverb_.set_half_rate(budget.half_rate_reverb);
+    oliverb_.set_economy(budget.fx_economy);
+    resonestor_.set_max_chords(static_cast<int32_t>(
+        budget.resonator_chords * kNumResonestorChords + 0.5f));
+}
+
+void GranularProcessorClouds::set_sample_rate(float sample_rate)
+{
+    // The grains, the correlator's search, the vocoder's frames and the
+    // resonators are set up in samples: rebuild them at the next Prepare().
+    reset_rate_  = reset_rate_ || sample_rate != sample_rate_;
+    sample_rate_ = sample_rate;
+    ResetFilters();
+    reverb_.set_sample_rate(sample_rate_);
+    // The resonators, and Oliverb in its own mode, run at the playback's
+    // rate.
+    const float playback_rate
+        = low_fidelity_ ? sample_rate / kDownsamplingFactor : sample_rate;
+    resonestor_.set_sample_rate(playback_rate);
+    oliverb_.set_sample_rate(
+        playback_mode_ == PLAYBACK_MODE_OLIVERB ? playback_rate : sample_rate);
 }
 
 void GranularProcessorClouds::ResetFilters()
@@ -74,32 +140,163 @@ void GranularProcessorClouds::ResetFilters()
         lp_filter_[i].Init(sample_rate_);
         hp_filter_[i].Init(sample_rate_);
     }
+    control_phase_ = 0;
+}
+
+void GranularProcessorClouds::UpdateRamps()
+{
+    // Each mapping runs once, for the end of this block; the stages ramp to
+    // it from the end of the previous one.
+    float feedback = parameters_.feedback;
+    pitch_ratio_.Update(SemitonesToRatio(parameters_.pitch));
+    feedback_gain_.Update(feedback * (1.0f - freeze_lp_));
+
+    float texture = parameters_.texture;
+    diffusion_.Update(
+        playback_mode_ == PLAYBACK_MODE_GRANULAR
+            ? texture > 0.75f ? (texture - 0.75f) * 4.0f : 0.0f
+            : parameters_.density);
+
+    // The shifter fades in away from unison.
+    float       x     = parameters_.pitch;
+    const float limit = 0.7f;
+    const float slew  = 0.4f;
+    pitch_shifter_wet_.Update(x < -limit          ? 1.0f
+                              : x < -limit + slew ? 1.0f - (x + limit) / slew
+                              : x < limit - slew  ? 0.0f
+                              : x < limit         ? 1.0f + (x - limit) / slew
+                                                  : 1.0f);
+
+    float reverb_amount = parameters_.reverb * 0.95f;
+    reverb_amount += feedback * (2.0f - feedback) * freeze_lp_;
+    CONSTRAIN(reverb_amount, 0.0f, 1.0f);
+    reverb_amount_.Update(reverb_amount * 0.54f);
+    // Inside the tank's loop: follows at block rate.
+    reverb_time_ = 0.35f + 0.63f * reverb_amount;
+
+    const float post_gain = 1.2f;
+    float       dry_wet   = parameters_.dry_wet;
+    dry_gain_.Update(Interpolate(lut_xfade_out, dry_wet, 16.0f));
+    wet_gain_.Update(Interpolate(lut_xfade_in, dry_wet, 16.0f) * post_gain);
+}
+
+void GranularProcessorClouds::GuardStage(ProcessStage stage,
+                                         FloatFrame*  block,
+                                         size_t       size)
+{
+    if(stage_check_)
+    {
+        stage_check_(stage_check_context_, stage, block, size, parameters_);
+    }
+
+    // A NaN or an Inf anywhere in the block makes the sum non-finite. This
+    // is one add per sample; denormals are left to the FPU's flush-to-zero.
+    float sum = 0.0f;
+    for(size_t i = 0; i < size; ++i)
+    {
+        sum += block[i].l + block[i].r;
+    }
+    if(std::isfinite(sum))
+    {
+        return;
+    }
+
+    // The stage's state holds the value and would keep feeding it back: reset
+    // it, and drop the block so that the next stages only see silence.
+    switch(stage)
+    {
+        case PROCESS_STAGE_FEEDBACK:
+            ResetFilters();
+            std::fill(&fb_[0].l, &fb_[0].l + (kMaxBlockSize << 1), 0.0f);
+            break;
+
+        case PROCESS_STAGE_PLAYBACK:
+            // The grains, the players and the recording buffer itself may
+            // hold it: rebuild everything at the next Prepare().
+            reset_buffers_ = true;
+            break;
+
+        case PROCESS_STAGE_DIFFUSER:
+            diffuser_.Clear();
+            diffusion_.Init(0.0f);
+            break;
+
+        case PROCESS_STAGE_PITCH_SHIFTER:
+            pitch_shifter_.Clear();
+            pitch_shifter_wet_.Init(0.0f);
+            break;
+
+        case PROCESS_STAGE_FILTERS: ResetFilters(); break;
+
+        case PROCESS_STAGE_REVERB:
+            if(tank_oliverb_)
+            {
+                oliverb_.Clear();
+            }
+            else
+            {
+                reverb_.Clear();
+            }
+            reverb_amount_.Init(0.0f);
+            break;
+
+        case PROCESS_STAGE_OUTPUT:
+            // Fades back in from silence.
+            dry_gain_.Init(0.0f);
+            wet_gain_.Init(0.0f);
+            break;
+
+        default: break;
+    }
+    std::fill(&block[0].l, &block[0].l + (size << 1), 0.0f);
+    ++num_recoveries_;
+    last_recovered_stage_ = stage;
 }
 
 void GranularProcessorClouds::ProcessGranular(FloatFrame* input,
                                               FloatFrame* output,
                                               size_t      size)
 {
-    // At the exception of the spectral mode, all modes require the incoming
-    // audio signal to be written to the recording buffer.
-    if(playback_mode_ != PLAYBACK_MODE_SPECTRAL)
+    // At the exception of the spectral and resonestor modes, all modes
+    // require the incoming audio signal to be written to the recording
+    // buffer. Oliverb's pre-delay keeps recording when frozen: its tank
+    // holds the sound instead.
+    if(playback_mode_ != PLAYBACK_MODE_SPECTRAL
+       && playback_mode_ != PLAYBACK_MODE_RESONESTOR)
     {
         const float* input_samples = &input[0].l;
+        const bool   play
+            = !parameters_.freeze || playback_mode_ == PLAYBACK_MODE_OLIVERB;
         for(int32_t i = 0; i < num_channels_; ++i)
         {
+            if(play)
+            {
+                const int32_t head = resolution() == 8
+                                         ? buffer_8_[i].write_head()
+                                         : buffer_16_[i].write_head();
+                const int32_t length = resolution() == 8
+                                           ? buffer_8_[i].size()
+                                           : buffer_16_[i].size();
+                snapshots_.PreserveWrite(i, head, size, length);
+            }
             if(resolution() == 8)
             {
-                buffer_8_[i].WriteFade(
-                    &input_samples[i], size, 2, !parameters_.freeze);
+                buffer_8_[i].WriteFade(&input_samples[i], size, 2, play);
             }
             else
             {
-                buffer_16_[i].WriteFade(
-                    &input_samples[i], size, 2, !parameters_.freeze);
+                buffer_16_[i].WriteFade(&input_samples[i], size, 2, play);
             }
         }
     }
 
+    bool staged = long_memory() && playback_mode_ != PLAYBACK_MODE_SPECTRAL
+                  && playback_mode_ != PLAYBACK_MODE_RESONESTOR;
+    if(staged)
+    {
+        stager_.BeginBlock();
+    }
+
     switch(playback_mode_)
     {
         case PLAYBACK_MODE_GRANULAR:
@@ -149,11 +346,19 @@ void GranularProcessorClouds::ProcessGranular(FloatFrame* input,
         case PLAYBACK_MODE_LOOPING_DELAY:
             if(resolution() == 8)
             {
-                looper_.Play(buffer_8_, parameters_, &output[0].l, size);
+                looper_.Play(buffer_8_,
+                             parameters_,
+                             pitch_ratio_.ramp(size),
+                             &output[0].l,
+                             size);
             }
             else
             {
-                looper_.Play(buffer_16_, parameters_, &output[0].l, size);
+                looper_.Play(buffer_16_,
+                             parameters_,
+                             pitch_ratio_.ramp(size),
+                             &output[0].l,
+                             size);
             }
             break;
 
@@ -182,8 +387,123 @@ void GranularProcessorClouds::ProcessGranular(FloatFrame* input,
         }
         break;
 
+        case PLAYBACK_MODE_RESONESTOR:
+        {
+            // The knobs as in Parasites: POSITION shapes the burst, SIZE
+            // picks the chord, DENSITY sets the decay, TEXTURE the damping
+            // or the narrowness, FEEDBACK the harmonicity of the second tap,
+            // REVERB the strum across the notes and DRY/WET the pitch
+            // modulation.
+            std::copy(&input[0], &input[size], &output[0]);
+            resonestor_.set_pitch(parameters_.pitch);
+            resonestor_.set_chord(parameters_.size);
+            resonestor_.set_trigger(parameters_.trigger);
+            resonestor_.set_freeze(parameters_.freeze);
+            resonestor_.set_burst_damp(parameters_.position);
+            resonestor_.set_burst_comb(1.0f - parameters_.position);
+            resonestor_.set_burst_duration(1.0f - parameters_.position);
+            resonestor_.set_spread_amount(parameters_.reverb);
+            float spread = parameters_.stereo_spread;
+            resonestor_.set_stereo(spread < 0.5f ? 0.0f
+                                                 : (spread - 0.5f) * 2.0f);
+            resonestor_.set_separation(spread > 0.5f ? 0.0f
+                                                     : (0.5f - spread) * 2.0f);
+            resonestor_.set_harmonicity(1.0f - parameters_.feedback * 0.5f);
+            resonestor_.set_distortion(parameters_.dry_wet);
+
+            float t = parameters_.texture;
+            if(t < 0.5f)
+            {
+                float l = 1.0f - (0.5f - t) / 0.5f;
+                l       = l * (1.0f - 0.08f) + 0.08f;
+                resonestor_.set_narrow(0.001f);
+                resonestor_.set_damp(l * l);
+            }
+            else
+            {
+                float n = (t - 0.5f) / 0.5f * 1.35f;
+                n *= n * n * n;
+                resonestor_.set_narrow(0.001f + n * n * 0.6f);
+                resonestor_.set_damp(1.0f);
+            }
+
+            float d = (parameters_.density - 0.05f) / 0.9f;
+            if(d < 0.0f)
+            {
+                d = 0.0f;
+            }
+            d *= d * d;
+            d *= d * d;
+            d *= d * d;
+            resonestor_.set_feedback(d * 20.0f);
+
+            resonestor_.Process(output, size);
+        }
+        break;
+
+        case PLAYBACK_MODE_OLIVERB:
+        {
+            // The knobs as in Parasites: POSITION sets a pre-delay, read
+            // from the recording, SIZE the size of the tank, DENSITY the
+            // decay, TEXTURE the damping (low-pass, then high-pass),
+            // STEREO the diffusion, FEEDBACK and REVERB the rate and the
+            // depth of the modulation, and PITCH the shimmer.
+            Parameters pre_delay    = parameters_;
+            pre_delay.position      = parameters_.position * 0.25f;
+            pre_delay.size          = 0.1f;
+            pre_delay.pitch         = 0.0f;
+            pre_delay.density       = 0.0f;
+            pre_delay.texture       = 0.5f;
+            pre_delay.dry_wet       = 1.0f;
+            pre_delay.stereo_spread = 0.0f;
+            pre_delay.feedback      = 0.0f;
+            pre_delay.reverb        = 0.0f;
+            pre_delay.freeze        = false;
+            if(resolution() == 8)
+            {
+                ws_player_.Play(buffer_8_, pre_delay, &output[0].l, size);
+            }
+            else
+            {
+                ws_player_.Play(buffer_16_, pre_delay, &output[0].l, size);
+            }
+
+            oliverb_.set_diffusion(0.3f + 0.5f * parameters_.stereo_spread);
+            oliverb_.set_size(0.05f + 0.94f * parameters_.size);
+            oliverb_.set_mod_rate(parameters_.feedback);
+            oliverb_.set_mod_amount(parameters_.reverb * 300.0f);
+            oliverb_.set_ratio(pitch_ratio_.value());
+            oliverb_.set_pitch_shift_amount(pitch_shifter_wet_.value());
+            if(parameters_.freeze)
+            {
+                oliverb_.set_input_gain(0.0f);
+                oliverb_.set_decay(1.0f);
+                oliverb_.set_lp(1.0f);
+                oliverb_.set_hp(0.0f);
+            }
+            else
+            {
+                float t = parameters_.texture;
+                oliverb_.set_input_gain(0.5f);
+                oliverb_.set_decay(parameters_.density * 1.3f
+                                   + 0.15f * fabsf(parameters_.pitch) / 24.0f);
+                oliverb_.set_lp(0.03f + 0.9f * (t < 0.5f ? t * 2.0f : 1.0f));
+                // The small offset keeps large DC offsets from building up
+                // in the loop.
+                oliverb_.set_hp(0.01f
+                                + 0.2f * (t > 0.5f ? (t - 0.5f) * 2.0f : 0.0f));
+            }
+            oliverb_.Process(output, size, LinearRamp(1.0f, 0.0f));
+        }
+        break;
+
         default: break;
     }
+
+    if(staged)
+    {
+        stager_.EndBlock();
+    }
 }
 
 void GranularProcessorClouds::Process(FloatFrame* input,
@@ -204,6 +524,21 @@ void GranularProcessorClouds::Process(FloatFrame* input,
         return;
     }
 
+    // A recalled bank plays frozen: the live recording waits for it.
+    if(snapshot_ != -1)
+    {
+        parameters_.freeze = true;
+    }
+
+    // Filter coefficients are refreshed at control rate only.
+    bool control_tick = control_phase_ == 0;
+    control_phase_ += size;
+    if(control_phase_ >= kControlRateSize)
+    {
+        control_phase_ = 0;
+    }
+    block_size_ = size;
+
     for(size_t i = 0; i < size; ++i)
     {
         in_[i].l = input[i].l;
@@ -221,33 +556,61 @@ void GranularProcessorClouds::Process(FloatFrame* input,
     // Apply feedback, with high-pass filtering to prevent build-ups at very
     // low frequencies (causing large DC swings).
     ONE_POLE(freeze_lp_, parameters_.freeze ? 1.0f : 0.0f, 0.0005f)
+    UpdateRamps();
     float feedback = parameters_.feedback;
     float cutoff   = (20.0f + 100.0f * feedback * feedback);
 
-    fb_filter_[0].SetFreq(cutoff);
-    fb_filter_[0].SetRes(1.f);
+    if(control_tick)
+    {
+        fb_filter_[0].SetFreq(cutoff);
+        fb_filter_[0].SetRes(1.f);
 
-    fb_filter_[1].SetFreq(cutoff);
-    fb_filter_[1].SetRes(1.f);
+        fb_filter_[1].SetFreq(cutoff);
+        fb_filter_[1].SetRes(1.f);
+    }
 
-    for(size_t i = 0; i < size; i++)
+    // The resonators would ring forever through the feedback path, and
+    // FEEDBACK drives Oliverb's modulation.
+    if(playback_mode_ != PLAYBACK_MODE_RESONESTOR
+       && playback_mode_ != PLAYBACK_MODE_OLIVERB)
     {
-        fb_filter_[0].Process(fb_[i].l);
-        fb_[i].l = fb_filter_[0].High();
+        for(size_t i = 0; i < size; i++)
+        {
+            fb_filter_[0].Process(fb_[i].l);
+            fb_[i].l = fb_filter_[0].High();
+
+            fb_filter_[1].Process(fb_[i].r);
+            fb_[i].r = fb_filter_[1].High();
+        }
 
-        fb_filter_[1].Process(fb_[i].r);
-        fb_[i].r = fb_filter_[1].High();
+        LinearRamp fb_gain_mod = feedback_gain_.ramp(size);
+        for(size_t i = 0; i < size; ++i)
+        {
+            float fb_gain = fb_gain_mod.Next();
+            in_[i].l += fb_gain
+                        * (SoftLimit(fb_gain * 1.4f * fb_[i].l + in_[i].l)
+                           - in_[i].l);
+            in_[i].r += fb_gain
+                        * (SoftLimit(fb_gain * 1.4f * fb_[i].r + in_[i].r)
+                           - in_[i].r);
+        }
     }
+    GuardStage(PROCESS_STAGE_FEEDBACK, in_, size);
 
-    float fb_gain = feedback * (1.0f - freeze_lp_);
-    for(size_t i = 0; i < size; ++i)
+    // The reverbs share their memory: the one taking it over starts empty.
+    const bool tank_oliverb
+        = post_oliverb_ || playback_mode_ == PLAYBACK_MODE_OLIVERB;
+    if(tank_oliverb != tank_oliverb_)
     {
-        in_[i].l
-            += fb_gain
-               * (SoftLimit(fb_gain * 1.4f * fb_[i].l + in_[i].l) - in_[i].l);
-        in_[i].r
-            += fb_gain
-               * (SoftLimit(fb_gain * 1.4f * fb_[i].r + in_[i].r) - in_[i].r);
+        if(tank_oliverb)
+        {
+            oliverb_.Clear();
+        }
+        else
+        {
+            reverb_.Clear();
+        }
+        tank_oliverb_ = tank_oliverb;
     }
 
     if(low_fidelity_)
@@ -261,35 +624,27 @@ void GranularProcessorClouds::Process(FloatFrame* input,
     {
         ProcessGranular(in_, out_, size);
     }
+    GuardStage(PROCESS_STAGE_PLAYBACK, out_, size);
 
     // Diffusion and pitch-shifting post-processings.
-    if(playback_mode_ != PLAYBACK_MODE_SPECTRAL)
+    if(playback_mode_ != PLAYBACK_MODE_SPECTRAL
+       && playback_mode_ != PLAYBACK_MODE_RESONESTOR
+       && playback_mode_ != PLAYBACK_MODE_OLIVERB)
     {
-        float texture = parameters_.texture;
-        float diffusion
-            = playback_mode_ == PLAYBACK_MODE_GRANULAR
-                  ? texture > 0.75f ? (texture - 0.75f) * 4.0f : 0.0f
-                  : parameters_.density;
-        diffuser_.set_amount(diffusion);
-        diffuser_.Process(out_, size);
+        diffuser_.Process(out_, size, diffusion_.ramp(size));
+        GuardStage(PROCESS_STAGE_DIFFUSER, out_, size);
     }
 
     // Pitch shifting for looping delay mode (when not frozen or synchronized)
     if(playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY
        && (!parameters_.freeze || looper_.synchronized()))
     {
-        pitch_shifter_.set_ratio(SemitonesToRatio(parameters_.pitch));
         pitch_shifter_.set_size(parameters_.size);
-        float x           = parameters_.pitch;
-        const float limit = 0.7f;
-        const float slew  = 0.4f;
-        float       wet   = x < -limit          ? 1.0f
-                            : x < -limit + slew ? 1.0f - (x + limit) / slew
-                            : x < limit - slew  ? 0.0f
-                            : x < limit         ? 1.0f + (x - limit) / slew
-                                                : 1.0f;
-        pitch_shifter_.set_dry_wet(wet);
-        pitch_shifter_.Process(out_, size);
+        pitch_shifter_.Process(out_,
+                               size,
+                               pitch_ratio_.ramp(size),
+                               pitch_shifter_wet_.ramp(size));
+        GuardStage(PROCESS_STAGE_PITCH_SHIFTER, out_, size);
     }
 
     // Apply filters.
@@ -308,15 +663,18 @@ void GranularProcessorClouds::Process(FloatFrame* input,
         float lpq = 1.0f + 3.0f * (1.0f - feedback) * (0.5f - lp_cutoff);
         lpq *= .25f;
 
-        lp_filter_[0].SetFreq(lp_cutoff * sample_rate_);
-        lp_filter_[0].SetRes(lpq);
-        lp_filter_[1].SetFreq(lp_cutoff * sample_rate_);
-        lp_filter_[1].SetRes(lpq);
+        if(control_tick)
+        {
+            lp_filter_[0].SetFreq(lp_cutoff * sample_rate_);
+            lp_filter_[0].SetRes(lpq);
+            lp_filter_[1].SetFreq(lp_cutoff * sample_rate_);
+            lp_filter_[1].SetRes(lpq);
 
-        hp_filter_[0].SetFreq(hp_cutoff * sample_rate_);
-        hp_filter_[0].SetRes(lpq);
-        hp_filter_[1].SetFreq(hp_cutoff * sample_rate_);
-        hp_filter_[1].SetRes(lpq);
+            hp_filter_[0].SetFreq(hp_cutoff * sample_rate_);
+            hp_filter_[0].SetRes(lpq);
+            hp_filter_[1].SetFreq(hp_cutoff * sample_rate_);
+            hp_filter_[1].SetRes(lpq);
+        }
 
 
         for(size_t i = 0; i < size; i++)
@@ -333,37 +691,64 @@ void GranularProcessorClouds::Process(FloatFrame* input,
             hp_filter_[1].Process(out_[i].r);
             out_[i].r = hp_filter_[1].High();
         }
+        GuardStage(PROCESS_STAGE_FILTERS, out_, size);
     }
 
     // This is what is fed back. Reverb is not fed back.
     std::copy(&out_[0], &out_[size], &fb_[0]);
 
-    // Apply reverb.
-    float reverb_amount = parameters_.reverb * 0.95f;
-    reverb_amount += feedback * (2.0f - feedback) * freeze_lp_;
-    CONSTRAIN(reverb_amount, 0.0f, 1.0f);
+    // The resonestor takes the REVERB and DRY/WET knobs for itself, and is
+    // heard alone.
+    if(playback_mode_ == PLAYBACK_MODE_RESONESTOR)
+    {
+        std::copy(&out_[0], &out_[size], &output[0]);
+        GuardStage(PROCESS_STAGE_OUTPUT, output, size);
+        return;
+    }
 
-    reverb_.set_amount(reverb_amount * 0.54f);
-    reverb_.set_diffusion(0.7f);
-    reverb_.set_time(0.35f + 0.63f * reverb_amount);
-    reverb_.set_input_gain(0.2f);
-    reverb_.set_lp(0.6f + 0.37f * feedback);
-    reverb_.Process(out_, size);
+    // Apply reverb, unless Oliverb already is the playback.
+    if(playback_mode_ != PLAYBACK_MODE_OLIVERB)
+    {
+        if(post_oliverb_)
+        {
+            // Clouds' settings, on a large tank with a slow, shallow wander
+            // and no shimmer.
+            oliverb_.set_diffusion(0.7f);
+            oliverb_.set_size(0.9f);
+            oliverb_.set_decay(reverb_time_);
+            oliverb_.set_input_gain(0.2f);
+            oliverb_.set_lp(0.6f + 0.37f * feedback);
+            oliverb_.set_hp(0.01f);
+            oliverb_.set_mod_rate(0.3f);
+            oliverb_.set_mod_amount(20.0f);
+            oliverb_.set_pitch_shift_amount(0.0f);
+            oliverb_.Process(out_, size, reverb_amount_.ramp(size));
+        }
+        else
+        {
+            reverb_.set_diffusion(0.7f);
+            reverb_.set_time(reverb_time_);
+            reverb_.set_input_gain(0.2f);
+            reverb_.set_lp(0.6f + 0.37f * feedback);
+            reverb_.Process(out_, size, reverb_amount_.ramp(size));
+        }
+        GuardStage(PROCESS_STAGE_REVERB, out_, size);
+    }
 
-    const float           post_gain = 1.2f;
-    ParameterInterpolator dry_wet_mod(&dry_wet_, parameters_.dry_wet, size);
+    LinearRamp dry_gain = dry_gain_.ramp(size);
+    LinearRamp wet_gain = wet_gain_.ramp(size);
     for(size_t i = 0; i < size; ++i)
     {
-        float dry_wet  = dry_wet_mod.Next();
-        float fade_in  = Interpolate(lut_xfade_in, dry_wet, 16.0f);
-        float fade_out = Interpolate(lut_xfade_out, dry_wet, 16.0f);
+        float fade_out = dry_gain.Next();
+        float fade_in  = wet_gain.Next();
         float l        = input[i].l * fade_out;
         float r        = input[i].r * fade_out;
-        l += out_[i].l * post_gain * fade_in;
-        r += out_[i].r * post_gain * fade_in;
+        l += out_[i].l * fade_in;
+        r += out_[i].r * fade_in;
         output[i].l = l;
         output[i].r = r;
     }
+    GuardStage(PROCESS_STAGE_OUTPUT, output, size);
 }
 
 void GranularProcessorClouds::Prepare()
@@ -371,6 +756,10 @@ void GranularProcessorClouds::Prepare()
     bool playback_mode_changed = previous_playback_mode_ != playback_mode_;
     bool benign_change = previous_playback_mode_ != PLAYBACK_MODE_SPECTRAL
                          && playback_mode_ != PLAYBACK_MODE_SPECTRAL
+                         && previous_playback_mode_ != PLAYBACK_MODE_RESONESTOR
+                         && playback_mode_ != PLAYBACK_MODE_RESONESTOR
+                         && previous_playback_mode_ != PLAYBACK_MODE_OLIVERB
+                         && playback_mode_ != PLAYBACK_MODE_OLIVERB
                          && previous_playback_mode_ != PLAYBACK_MODE_LAST;
 
     if(!reset_buffers_ && playback_mode_changed && benign_change)
@@ -380,12 +769,15 @@ void GranularProcessorClouds::Prepare()
         previous_playback_mode_ = playback_mode_;
     }
 
-    if((playback_mode_changed && !benign_change) || reset_buffers_)
+    // A new sample rate alone rebuilds everything but the recording.
+    bool reset_recording
+        = reset_buffers_ || (playback_mode_changed && !benign_change);
+    if(reset_recording)
     {
         parameters_.freeze = false;
     }
 
-    if(reset_buffers_ || (playback_mode_changed && !benign_change))
+    if(reset_recording || reset_rate_)
     {
         void*  buffer[2];
         size_t buffer_size[2];
@@ -413,11 +805,33 @@ void GranularProcessorClouds::Prepare()
             workspace_size = buffer_size_[0] - buffer_size_[1];
             workspace      = static_cast<uint8_t*>(buffer[0]) + buffer_size[0];
         }
+        bool use_long_memory = long_memory()
+                               && playback_mode_ != PLAYBACK_MODE_SPECTRAL
+                               && playback_mode_ != PLAYBACK_MODE_RESONESTOR;
+        if(use_long_memory)
+        {
+            // External buffer: split between channels.
+            // Large buffer: fully allocated to FX workspace.
+            buffer_size[0] = buffer_size[1]
+                = (long_buffer_size_ / num_channels_) & ~3;
+            buffer[0]      = long_buffer_;
+            buffer[1]      = static_cast<uint8_t*>(long_buffer_) + buffer_size[0];
+            workspace      = buffer_[0];
+            workspace_size = buffer_size_[0];
+        }
         float sr = sample_rate();
 
         BufferAllocator allocator(workspace, workspace_size);
         diffuser_.Init(allocator.Allocate<float>(2048));
-        reverb_.Init(allocator.Allocate<uint16_t>(16384));
+        // Both reverbs on the same memory: only one of them runs at a time.
+        // Oliverb runs at the playback's rate in its own mode.
+        uint16_t* reverb_buffer = allocator.Allocate<uint16_t>(16384);
+        reverb_.Init(reverb_buffer, sample_rate_);
+        oliverb_.Init(reverb_buffer,
+                      playback_mode_ == PLAYBACK_MODE_OLIVERB ? sr
+                                                              : sample_rate_);
+        tank_oliverb_
+            = post_oliverb_ || playback_mode_ == PLAYBACK_MODE_OLIVERB;
 
         size_t    correlator_block_size = (kMaxWSOLASize / 32) + 2;
         uint32_t* correlator_data
@@ -428,17 +842,36 @@ void GranularProcessorClouds::Prepare()
 
         if(playback_mode_ == PLAYBACK_MODE_SPECTRAL)
         {
+            if(spectral_memory_)
+            {
+                // The whole working set in fast RAM, split between the
+                // channels.
+                buffer_size[0] = buffer_size[1]
+                    = kSpectralMemorySize / num_channels_;
+                buffer[0] = spectral_memory_;
+                buffer[1] = static_cast<uint8_t*>(spectral_memory_)
+                            + buffer_size[0];
+            }
             phase_vocoder_.Init(buffer,
                                 buffer_size,
                                 lut_sine_window_4096,
-                                4096,
+                                kMaxFftSize,
                                 num_channels_,
                                 resolution(),
                                 sr);
+            snapshots_.Detach();
+        }
+        else if(playback_mode_ == PLAYBACK_MODE_RESONESTOR)
+        {
+            // Nothing is recorded: the resonators take the fast memory, or
+            // else the first buffer.
+            void* memory = spectral_memory_ ? spectral_memory_ : buffer[0];
+            resonestor_.Init(static_cast<float*>(memory), sr);
+            snapshots_.Detach();
         }
         else
         {
-            for(int32_t i = 0; i < num_channels_; ++i)
+            for(int32_t i = 0; reset_recording && i < num_channels_; ++i)
             {
                 if(resolution() == 8)
                 {
@@ -447,8 +880,10 @@ void GranularProcessorClouds::Prepare()
                 }
                 else
                 {
-                    buffer_16_[i].Init(
-                        buffer[i], ((buffer_size[i]) >> 1), tail_buffer_[i]);
+                    buffer_16_[i].Init(buffer[i],
+                                       ((buffer_size[i]) >> 1),
+                                       tail_buffer_[i],
+                                       !use_long_memory);
                 }
             }
             int32_t num_grains
@@ -457,16 +892,54 @@ void GranularProcessorClouds::Prepare()
             player_.Init(num_channels_, num_grains);
             ws_player_.Init(&correlator_, num_channels_);
             looper_.Init(num_channels_);
+
+            SampleStager* stager = use_long_memory ? &stager_ : NULL;
+            player_.set_stager(stager);
+            ws_player_.set_stager(stager);
+            looper_.set_stager(stager);
+
+            // The stager copies straight from the buffers, and could not
+            // follow a page table. Oliverb never stops recording.
+            if(reset_recording)
+            {
+                if(use_long_memory || playback_mode_ == PLAYBACK_MODE_OLIVERB)
+                {
+                    snapshots_.Detach();
+                }
+                else
+                {
+                    snapshots_.Attach(buffer,
+                                      buffer_size[0],
+                                      num_channels_,
+                                      resolution() == 8 ? 1 : 2);
+                }
+            }
+        }
+        if(reset_recording)
+        {
+            snapshot_ = -1;
         }
+        set_cpu_budget(cpu_budget_);
+        reset_rate_             = false;
         reset_buffers_          = false;
         previous_playback_mode_ = playback_mode_;
     }
 
     if(playback_mode_ == PLAYBACK_MODE_SPECTRAL)
     {
-        phase_vocoder_.Buffer();
+        // With small blocks, a whole frame per block would blow the
+        // deadline of the block it lands in: spread it.
+        if(block_size_ < kMaxBlockSize)
+        {
+            phase_vocoder_.BufferStep();
+        }
+        else
+        {
+            phase_vocoder_.Buffer();
+        }
     }
-    else if(playback_mode_ == PLAYBACK_MODE_STRETCH)
+    else if(playback_mode_ == PLAYBACK_MODE_STRETCH
+            || playback_mode_ == PLAYBACK_MODE_OLIVERB)
     {
         if(resolution() == 8)
         {
@@ -476,6 +949,193 @@ void GranularProcessorClouds::Prepare()
         {
             ws_player_.LoadCorrelator(buffer_16_);
         }
-        correlator_.EvaluateSomeCandidates();
+        // Scale the search with the block size so that it progresses at the
+        // same speed in samples.
+        correlator_.EvaluateSomeCandidates(
+            cpu_budget_.correlator * block_size_ / kMaxBlockSize);
+    }
+}
+
+bool GranularProcessorClouds::CaptureSnapshot(int32_t bank)
+{
+    // While silenced, the main loop may be loading the buffers.
+    if(silence_ || reset_buffers_)
+    {
+        return false;
+    }
+    int32_t head[2];
+    for(int32_t i = 0; i < num_channels_; ++i)
+    {
+        head[i] = resolution() == 8 ? buffer_8_[i].write_head()
+                                    : buffer_16_[i].write_head();
+    }
+    bool captured = snapshots_.Capture(bank, head);
+    if(bank == snapshot_)
+    {
+        snapshot_ = captured ? bank : -1;
+        ApplySnapshot();
+    }
+    return captured;
+}
+
+bool GranularProcessorClouds::RecallSnapshot(int32_t bank)
+{
+    if(silence_ || reset_buffers_
+       || (bank != -1 && !snapshots_.captured(bank)))
+    {
+        return false;
+    }
+    snapshot_ = bank;
+    ApplySnapshot();
+    return true;
+}
+
+void GranularProcessorClouds::ApplySnapshot()
+{
+    for(int32_t i = 0; i < num_channels_; ++i)
+    {
+        const uint8_t* const* pages
+            = snapshot_ == -1 ? NULL : snapshots_.pages(snapshot_, i);
+        const int32_t head
+            = snapshot_ == -1 ? 0 : snapshots_.head(snapshot_, i);
+        if(resolution() == 8)
+        {
+            buffer_8_[i].set_pages(pages, head);
+        }
+        else
+        {
+            buffer_16_[i].set_pages(pages, head);
+        }
+    }
+}
+
+void GranularProcessorClouds::PreparePersistentData()
+{
+    persistent_state_.write_head[0] = resolution() == 8
+                                          ? buffer_8_[0].write_head()
+                                          : buffer_16_[0].write_head();
+    persistent_state_.write_head[1] = resolution() == 8
+                                          ? buffer_8_[1].write_head()
+                                          : buffer_16_[1].write_head();
+    persistent_state_.quality  = quality();
+    persistent_state_.spectral = playback_mode() == PLAYBACK_MODE_SPECTRAL;
+}
+
+bool GranularProcessorClouds::GetPersistentData(PersistentBlock* block,
+                                                size_t*          num_blocks)
+{
+    PersistentBlock* first_block = block;
+    if(long_memory() || playback_mode_ == PLAYBACK_MODE_RESONESTOR)
+    {
+        *num_blocks = 0;
+        return false;
+    }
+
+    block->tag  = FourCC<'s', 't', 'a', 't'>::value;
+    block->data = &persistent_state_;
+    block->size = sizeof(PersistentState);
+    ++block;
+
+    // Create save block holding the audio buffers, or the phase vocoder's
+    // working set when it lives in the spectral memory.
+    bool spectral_memory
+        = spectral_memory_ && playback_mode_ == PLAYBACK_MODE_SPECTRAL;
+    for(int32_t i = 0; i < num_channels_; ++i)
+    {
+        block->tag = FourCC<'b', 'u', 'f', 'f'>::value;
+        if(spectral_memory)
+        {
+            block->size = kSpectralMemorySize / num_channels_;
+            block->data = static_cast<uint8_t*>(spectral_memory_)
+                          + i * block->size;
+        }
+        else
+        {
+            block->data = buffer_[i];
+            block->size = buffer_size_[num_channels_ - 1];
+        }
+        ++block;
+    }
+    *num_blocks = block - first_block;
+    return true;
+}
+
+bool GranularProcessorClouds::LoadPersistentData(const uint32_t* data)
+{
+    PersistentBlock block[3];
+    size_t          num_blocks;
+    if(!GetPersistentData(block, &num_blocks))
+    {
+        return false;
+    }
+
+    // Check the whole format before anything is overwritten.
+    const uint32_t* cursor = data;
+    for(size_t i = 0; i < num_blocks; ++i)
+    {
+        if(block[i].tag != cursor[0] || block[i].size != cursor[1])
+        {
+            return false;
+        }
+        cursor += 2 + block[i].size / sizeof(uint32_t);
+    }
+    PersistentState state;
+    memcpy(&state, data + 2, sizeof(state));
+    const bool spectral = playback_mode_ == PLAYBACK_MODE_SPECTRAL;
+    if(state.quality != quality() || state.spectral != spectral)
+    {
+        return false;
+    }
+    if(!spectral)
+    {
+        const int32_t size = resolution() == 8 ? buffer_8_[0].size()
+                                               : buffer_16_[0].size();
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            if(state.write_head[i] < 0 || state.write_head[i] >= size)
+            {
+                return false;
+            }
+        }
+    }
+
+    // All good. The banks first keep their copy of what is about to be
+    // overwritten, and the live recording is played again.
+    if(!spectral)
+    {
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            const int32_t length = resolution() == 8 ? buffer_8_[i].size()
+                                                     : buffer_16_[i].size();
+            snapshots_.PreserveWrite(i, 0, length, length);
+        }
+        snapshot_ = -1;
+        ApplySnapshot();
+    }
+
+    // Load the data. 2 words are used for the block tag and the block size.
+    for(size_t i = 0; i < num_blocks; ++i)
+    {
+        data += 2;
+        memcpy(block[i].data, data, block[i].size);
+        data += block[i].size / sizeof(uint32_t);
+    }
+
+    // We can finally reset the position of the write heads.
+    if(!spectral)
+    {
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            if(resolution() == 8)
+            {
+                buffer_8_[i].Resync(persistent_state_.write_head[i]);
+            }
+            else
+            {
+                buffer_16_[i].Resync(persistent_state_.write_head[i]);
+            }
+        }
     }
+    parameters_.freeze = true;
+    return true;
 }
@@ -35,12 +35,16 @@
 #include "pitch_shifter.h"
 #include "reverb.h"
 #include "granular_processor.h"
+#include "sample_stager.h"
 #include "granular_sample_player.h"
 #include "looping_sample_player.h"
+#include "oliverb.h"
 #include "phase_vocoder.h"
+#include "resonestor.h"
 #include "sample_rate_converter.h"
+#include "snapshot_banks.h"
 #include "wsola_sample_player.h"
-#include "parameter_interpolator.h"
+#include "parameter_ramp.h"
 
 using namespace daisysp;
 
@@ -52,10 +56,33 @@ enum PlaybackMode
     PLAYBACK_MODE_STRETCH,
     PLAYBACK_MODE_LOOPING_DELAY,
     PLAYBACK_MODE_SPECTRAL,
+    PLAYBACK_MODE_RESONESTOR,
+    PLAYBACK_MODE_OLIVERB,
     PLAYBACK_MODE_LAST
 };
 
-// State of the recording buffer as saved in one of the 4 sample memories.
+// The stages of Process(), in order, each named after the block it leaves.
+enum ProcessStage
+{
+    PROCESS_STAGE_FEEDBACK,
+    PROCESS_STAGE_PLAYBACK,
+    PROCESS_STAGE_DIFFUSER,
+    PROCESS_STAGE_PITCH_SHIFTER,
+    PROCESS_STAGE_FILTERS,
+    PROCESS_STAGE_REVERB,
+    PROCESS_STAGE_OUTPUT,
+    PROCESS_STAGE_LAST
+};
+
+// Inspects the block a stage has just written, with the parameters it was
+// rendered with. Called from Process(), in the audio callback.
+typedef void (*StageCheck)(void*             context,
+                           ProcessStage      stage,
+                           const FloatFrame* block,
+                           size_t            size,
+                           const Parameters& parameters);
+
+// State of the recording buffer as saved in a sample memory.
 struct PersistentState
 {
     int32_t write_head[2];
@@ -63,7 +90,7 @@ struct PersistentState
     uint8_t spectral;
 };
 
-// Data block as saved in one of the 4 sample memories.
+// Data block as saved in a sample memory.
 struct PersistentBlock
 {
     uint32_t tag;
@@ -71,6 +98,26 @@ struct PersistentBlock
     void*    data;
 };
 
+// Run-time limits on the processing cost, lowered by the host when the CPU
+// load gets too close to the block deadline.
+struct CpuBudget
+{
+    // Fraction of the allocated grains that may be started.
+    float max_grains;
+    // Fractions of the allowed grains below which new grains are rendered at
+    // medium, then low quality.
+    float midfi_grains;
+    float lofi_grains;
+    // Fraction of the correlator candidates evaluated per block.
+    float correlator;
+    // Cheaper reverb and diffuser.
+    bool fx_economy;
+    // Reverb at half the sample rate (Reverb::set_half_rate).
+    bool half_rate_reverb;
+    // Fraction of the resonestor's chords left ringing.
+    float resonator_chords;
+};
+
 class GranularProcessorClouds
 {
   public:
@@ -116,6 +163,16 @@ class GranularProcessorClouds
 
     inline PlaybackMode playback_mode() const { return playback_mode_; }
 
+    // Post-processing reverb: Oliverb rather than Clouds' reverb, on the
+    // same memory and with the same knobs. The tank starts empty whenever
+    // the choice changes. Ignored in the oliverb mode, which has its own.
+    inline void set_post_oliverb(bool post_oliverb)
+    {
+        post_oliverb_ = post_oliverb;
+    }
+
+    inline bool post_oliverb() const { return post_oliverb_; }
+
     inline void set_quality(int32_t quality)
     {
         set_num_channels(quality & 1 ? 1 : 2);
@@ -134,6 +191,84 @@ class GranularProcessorClouds
         low_fidelity_  = low_fidelity;
     }
 
+    // Long-memory mode: the granular, stretch and looping modes record into
+    // a large external buffer (several minutes of audio in SDRAM) rather than
+    // into the large/small buffers, which are then fully given to the FX
+    // workspace. Reads from the external buffer go through a staging cache
+    // in staging_memory (kStagingMemorySize bytes of fast RAM). The buffer is
+    // not cleared when the recording buffers are reset, so it is expected to
+    // be zeroed once at boot. Pass a NULL buffer to leave the mode.
+    inline void set_long_memory(void*  buffer,
+                                size_t buffer_size,
+                                void*  staging_memory)
+    {
+        reset_buffers_    = reset_buffers_ || long_buffer_ != buffer;
+        long_buffer_      = buffer;
+        long_buffer_size_ = buffer_size;
+        if(buffer)
+        {
+            stager_.Init(staging_memory);
+        }
+    }
+
+    inline bool long_memory() const { return long_buffer_ != NULL; }
+
+    // Spectral mode runs from memory (kSpectralMemorySize bytes of AXI SRAM
+    // or DTCM) rather than from the large/small buffers, which may be in
+    // slow external RAM; so does the resonestor mode. Pass NULL to go back
+    // to the buffers.
+    inline void set_spectral_memory(void* memory)
+    {
+        reset_buffers_   = reset_buffers_ || spectral_memory_ != memory;
+        spectral_memory_ = memory;
+    }
+
+    // Snapshot banks keep what they still reference of the recording, once
+    // overwritten, in kBufferPageSize pages of `pool`: room for each bank to
+    // lose the whole buffer takes kNumSnapshotBanks times its size. Pass
+    // NULL to do without.
+    inline void set_snapshot_pool(void* pool, size_t pool_size)
+    {
+        reset_buffers_ = reset_buffers_ || snapshots_.pool() != pool;
+        snapshots_.Init(pool, pool_size);
+    }
+
+    // Captures the live recording into a bank, without copying it. Not
+    // available with long memory nor in the spectral, resonestor and
+    // oliverb modes; the banks are forgotten whenever the recording buffers
+    // are reset (quality change, switch to or from the spectral mode).
+    // Audio callback only.
+    bool CaptureSnapshot(int32_t bank);
+
+    // Plays a captured bank, frozen, until another one or the live
+    // recording (-1) is recalled. Audio callback only.
+    bool RecallSnapshot(int32_t bank);
+
+    inline int32_t recalled_snapshot() const { return snapshot_; }
+
+    inline bool has_snapshot(int32_t bank) const
+    {
+        return snapshots_.captured(bank);
+    }
+
+    // Pool pages holding recording since overwritten, all banks.
+    inline int32_t num_snapshot_pages() const
+    {
+        return snapshots_.num_used_pages();
+    }
+
+    // Gives access to the stager to install a background transport.
+    inline SampleStager* mutable_stager() { return &stager_; }
+
+    void set_cpu_budget(const CpuBudget& budget);
+
+    inline const CpuBudget& cpu_budget() const { return cpu_budget_; }
+
+    // Re-targets the filters and the reverb modulation to a new sample rate.
+    // The recording buffers are kept. Must not be called while Process() or
+    // Prepare() may run, and the resources must be rebuilt for the new rate.
+    void set_sample_rate(float sample_rate);
+
     inline int32_t quality() const
     {
         int32_t quality = 0;
@@ -144,8 +279,46 @@ class GranularProcessorClouds
         return quality;
     }
 
+    inline int32_t num_channels() const { return num_channels_; }
+
+    // Debug sentinels: `check` sees every stage's output block, before the
+    // recovery below. NULL (the default) to skip.
+    inline void set_stage_check(StageCheck check, void* context)
+    {
+        stage_check_         = check;
+        stage_check_context_ = context;
+    }
+
+    // A block holding a NaN or an Inf resets the stage that wrote it and is
+    // replaced by silence. Number of such recoveries since Init(), and the
+    // stage of the last one (PROCESS_STAGE_LAST if none).
+    inline uint32_t num_recoveries() const { return num_recoveries_; }
+    inline ProcessStage last_recovered_stage() const
+    {
+        return last_recovered_stage_;
+    }
+
+    // Smoothed number of active grains (granular mode).
+    inline float num_grains() const { return player_.num_grains(); }
+
+    // Sample memory: the recording buffers and their write heads, as
+    // consecutive blocks of { tag, size, data }. Not available with long
+    // memory, whose buffers do not fit in the flash, nor in the resonestor
+    // mode, which records nothing.
+    void PreparePersistentData();
+    bool GetPersistentData(PersistentBlock* block, size_t* num_blocks);
+
+    // Copies saved blocks back into the buffers and resyncs the write heads.
+    // Prepare() runs in the audio callback here, so data saved with another
+    // quality or mode is rejected rather than switched to. The output must
+    // have been silenced (set_silence) for at least one block.
+    bool LoadPersistentData(const uint32_t* data);
+
   private:
-    inline int32_t resolution() const { return low_fidelity_ ? 8 : 16; }
+    inline int32_t resolution() const
+    {
+        return low_fidelity_ && !long_memory() ? 8 : 16;
+    }
 
     inline float sample_rate() const
     {
@@ -153,6 +326,9 @@ class GranularProcessorClouds
     }
 
     void ResetFilters();
+    void UpdateRamps();
+    void ApplySnapshot();
+    void GuardStage(ProcessStage stage, FloatFrame* block, size_t size);
     void ProcessGranular(FloatFrame* input, FloatFrame* output, size_t size);
 
     PlaybackMode playback_mode_;
@@ -165,21 +341,35 @@ class GranularProcessorClouds
     bool  silence_;
     bool  bypass_;
     bool  reset_buffers_;
+    bool  reset_rate_;
     float freeze_lp_;
-    float dry_wet_;
+
+    size_t block_size_;
+    size_t control_phase_;
 
     void*  buffer_[2];
     size_t buffer_size_[2];
 
+    void*        long_buffer_;
+    size_t       long_buffer_size_;
+    SampleStager stager_;
+
+    void* spectral_memory_;
+
+    SnapshotBanks snapshots_;
+    int32_t       snapshot_;
+
     Correlator correlator_;
 
     GranularSamplePlayer player_;
     WSOLASamplePlayer    ws_player_;
     LoopingSamplePlayer  looper_;
     PhaseVocoder         phase_vocoder_;
+    Resonestor           resonestor_;
 
     Diffuser           diffuser_;
     Reverb             reverb_;
+    Oliverb            oliverb_;
     PitchShifterClouds pitch_shifter_;
     Svf                fb_filter_[2];
     Svf                hp_filter_[2];
@@ -197,11 +387,30 @@ class GranularProcessorClouds
     int16_t tail_buffer_[2][256];
 
     Parameters parameters_;
+    CpuBudget  cpu_budget_;
+
+    // Coefficients derived from the parameters, once per block (UpdateRamps).
+    SmoothedValue pitch_ratio_;
+    SmoothedValue feedback_gain_;
+    SmoothedValue diffusion_;
+    SmoothedValue pitch_shifter_wet_;
+    SmoothedValue reverb_amount_;
+    float         reverb_time_;
+    bool          post_oliverb_;
+    // Whether Oliverb rather than Reverb last used the shared tank memory.
+    bool          tank_oliverb_;
+    SmoothedValue dry_gain_;
+    SmoothedValue wet_gain_;
 
     SampleRateConverter<-kDownsamplingFactor, 45, src_filter_1x_2_45> src_down_;
     SampleRateConverter<+kDownsamplingFactor, 45, src_filter_1x_2_45> src_up_;
 
     PersistentState persistent_state_;
+
+    StageCheck   stage_check_;
+    void*        stage_check_context_;
+    uint32_t     num_recoveries_;
+    ProcessStage last_recovered_stage_;
 };
 
 
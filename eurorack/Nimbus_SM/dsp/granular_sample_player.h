@@ -32,18 +32,24 @@
 #include "daisy.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "audio_buffer.h"
 #include "frame.h"
 #include "grain.h"
+#include "grain_seeder.h"
 #include "parameters.h"
-
-#include <random>
+#include "random.h"
+#include "sample_stager.h"
 
 using namespace daisysp;
 
 const int32_t kMaxNumGrains = 64;
 
+// Grains read with a 16.16 fixed-point phase: a play-head may travel at most
+// 32767 samples, with some room left for the interpolation taps.
+const float kMaxGrainTravel = 32000.0f;
+
 using namespace daisy;
 
 class GranularSamplePlayer
@@ -55,7 +61,9 @@ class GranularSamplePlayer
     void Init(int32_t num_channels, int32_t max_num_grains)
     {
         max_num_grains_     = max_num_grains;
+        grain_cap_          = max_num_grains;
         num_midfi_grains_   = 3 * max_num_grains / 4;
+        num_lofi_grains_    = 0;
         gain_normalization_ = 1.0f;
         for(int32_t i = 0; i < kMaxNumGrains; ++i)
         {
@@ -64,8 +72,36 @@ class GranularSamplePlayer
         num_grains_      = 0.0f;
         num_channels_    = num_channels;
         grain_size_hint_ = 1024.0f;
+        stager_          = NULL;
+
+        num_available_grains_ = 0;
+        control_phase_        = 0;
+        random_.Seed(RandomSource::kDefaultSeed);
+        seeder_.Init(&random_);
     }
 
+    // Lowers the cost of the player under CPU pressure. Only the first
+    // max_grains (fraction of the allocated grains) may start; grains above
+    // the cap play until their end. New grains are rendered at medium quality
+    // once fewer than midfi of the allowed grains are free, at low quality
+    // once fewer than lofi are.
+    inline void set_budget(float max_grains, float midfi, float lofi)
+    {
+        float cap  = static_cast<float>(max_num_grains_) * max_grains;
+        grain_cap_ = static_cast<int32_t>(cap);
+        CONSTRAIN(grain_cap_, 1, max_num_grains_);
+        num_midfi_grains_ = static_cast<int32_t>(grain_cap_ * midfi);
+        num_lofi_grains_  = static_cast<int32_t>(grain_cap_ * lofi);
+        control_phase_    = 0;
+    }
+
+    // When set, grains read from regions of the buffer staged one block
+    // ahead rather than from the buffer itself.
+    inline void set_stager(SampleStager* stager) { stager_ = stager; }
+
+    // Smoothed number of active grains.
+    inline float num_grains() const { return num_grains_; }
+
     template <Resolution resolution>
     void Play(const AudioBuffer<resolution>* buffer,
               const Parameters&              parameters,
@@ -74,103 +110,108 @@ class GranularSamplePlayer
     {
         float overlap           = parameters.granular.overlap;
         overlap                 = overlap * overlap * overlap;
-        float target_num_grains = max_num_grains_ * overlap;
+        float target_num_grains = grain_cap_ * overlap;
         float p = target_num_grains / static_cast<float>(grain_size_hint_);
         float space_between_grains = grain_size_hint_ / target_num_grains;
         if(parameters.granular.use_deterministic_seed)
         {
             p = -1.0f;
         }
-        else
+
+        // Build a list of available grains. Grains only leave the list when
+        // they are scheduled, so with small blocks it is enough to collect the
+        // grains that ended at control rate.
+        if(control_phase_ == 0)
         {
-            grain_rate_phasor_ = -1000.0f;
+            num_available_grains_ = FillAvailableGrainsList();
         }
-
-        // Build a list of available grains.
-        int32_t num_available_grains = FillAvailableGrainsList();
+        control_phase_ += size;
+        if(control_phase_ >= kControlRateSize)
+        {
+            control_phase_ = 0;
+        }
+        int32_t num_available_grains = num_available_grains_;
 
         // Try to schedule new grains.
-        bool seed_trigger = parameters.trigger;
-        for(size_t t = 0; t < size; ++t)
+        seeder_.Start(parameters.trigger,
+                      p,
+                      space_between_grains,
+                      target_num_grains > num_grains_);
+        while(num_available_grains)
         {
-            grain_rate_phasor_ += 1.0f;
-            bool seed_probabilistic
-                = kRandFrac * rand() < p && target_num_grains > num_grains_;
-            bool seed_deterministic
-                = grain_rate_phasor_ >= space_between_grains;
-            bool seed
-                = seed_probabilistic || seed_deterministic || seed_trigger;
-            if(num_available_grains && seed)
+            size_t next = seeder_.Next(size);
+            if(next >= size)
             {
-                --num_available_grains;
-                int32_t      index = available_grains_[num_available_grains];
-                GrainQuality quality;
-                if(num_available_grains < num_midfi_grains_)
-                {
-                    quality = GRAIN_QUALITY_MEDIUM;
-                }
-                else
-                {
-                    quality = GRAIN_QUALITY_HIGH;
-                }
+                break;
+            }
 
-                Grain* g = &grains_[index];
-                ScheduleGrain(g,
-                              parameters,
-                              t,
-                              buffer->size(),
-                              buffer->head() - size + t,
-                              quality);
-                grain_rate_phasor_ = 0.0f;
-                seed_trigger       = false;
+            --num_available_grains;
+            int32_t      index = available_grains_[num_available_grains];
+            GrainQuality quality;
+            if(num_available_grains < num_lofi_grains_)
+            {
+                quality = GRAIN_QUALITY_LOW;
             }
+            else if(num_available_grains < num_midfi_grains_)
+            {
+                quality = GRAIN_QUALITY_MEDIUM;
+            }
+            else
+            {
+                quality = GRAIN_QUALITY_HIGH;
+            }
+
+            Grain* g = &grains_[index];
+            ScheduleGrain(g,
+                          parameters,
+                          next,
+                          buffer->size(),
+                          buffer->head() - size + next,
+                          quality);
         }
+        seeder_.End(size);
 
         // Overlap grains.
         std::fill(&out[0], &out[size * 2], 0.0f);
-        float* e = envelope_buffer_;
-        for(int32_t i = 0; i < max_num_grains_; ++i)
+        if(stager_ && resolution == RESOLUTION_16_BIT)
         {
-            Grain* g = &grains_[i];
-            if(g->recommended_quality() == GRAIN_QUALITY_HIGH)
+            StagedAudioBuffer<resolution> staged[kMaxNumChannels];
+            for(int32_t i = 0; i < max_num_grains_; ++i)
             {
-                if(num_channels_ == 1)
-                {
-                    g->OverlapAdd<1, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-                }
-                else
-                {
-                    g->OverlapAdd<2, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
-                }
+                stager_->Bind(
+                    kStagingSlotGrains + i, buffer, num_channels_, staged);
+                RenderGrain(&grains_[i], staged, out, size);
             }
-            else if(g->recommended_quality() == GRAIN_QUALITY_MEDIUM)
+            for(int32_t i = 0; i < max_num_grains_; ++i)
             {
-                if(num_channels_ == 1)
+                if(grains_[i].active())
                 {
-                    g->OverlapAdd<1, GRAIN_QUALITY_MEDIUM>(
-                        buffer, out, e, size);
-                }
-                else
-                {
-                    g->OverlapAdd<2, GRAIN_QUALITY_MEDIUM>(
-                        buffer, out, e, size);
+                    int32_t start, length;
+                    grains_[i].StagingSpan(size, &start, &length);
+                    stager_->Prefetch(kStagingSlotGrains + i,
+                                      buffer,
+                                      num_channels_,
+                                      start,
+                                      length);
                 }
             }
-            else
+        }
+        else
+        {
+            for(int32_t i = 0; i < max_num_grains_; ++i)
             {
-                if(num_channels_ == 1)
-                {
-                    g->OverlapAdd<1, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-                }
-                else
-                {
-                    g->OverlapAdd<2, GRAIN_QUALITY_LOW>(buffer, out, e, size);
-                }
+                RenderGrain(&grains_[i], buffer, out, size);
             }
         }
 
+        num_available_grains_ = num_available_grains;
+
         // Compute normalization factor.
-        int32_t active_grains = max_num_grains_ - num_available_grains;
+        int32_t active_grains = grain_cap_ - num_available_grains;
+        for(int32_t i = grain_cap_; i < max_num_grains_; ++i)
+        {
+            active_grains += grains_[i].active() ? 1 : 0;
+        }
         SLOPE(num_grains_, static_cast<float>(active_grains), 0.9f, 0.2f);
 
         float gain_normalization = num_grains_ > 2.0f
@@ -191,10 +232,50 @@ class GranularSamplePlayer
     }
 
   private:
+    template <typename Buffer>
+    inline void
+    RenderGrain(Grain* g, const Buffer* buffer, float* out, size_t size)
+    {
+        float* e = envelope_buffer_;
+        if(g->recommended_quality() == GRAIN_QUALITY_HIGH)
+        {
+            if(num_channels_ == 1)
+            {
+                g->OverlapAdd<1, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
+            }
+            else
+            {
+                g->OverlapAdd<2, GRAIN_QUALITY_HIGH>(buffer, out, e, size);
+            }
+        }
+        else if(g->recommended_quality() == GRAIN_QUALITY_MEDIUM)
+        {
+            if(num_channels_ == 1)
+            {
+                g->OverlapAdd<1, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
+            }
+            else
+            {
+                g->OverlapAdd<2, GRAIN_QUALITY_MEDIUM>(buffer, out, e, size);
+            }
+        }
+        else
+        {
+            if(num_channels_ == 1)
+            {
+                g->OverlapAdd<1, GRAIN_QUALITY_LOW>(buffer, out, e, size);
+            }
+            else
+            {
+                g->OverlapAdd<2, GRAIN_QUALITY_LOW>(buffer, out, e, size);
+            }
+        }
+    }
+
     int32_t FillAvailableGrainsList()
     {
         int32_t num_available_grains = 0;
-        for(int32_t i = 0; i < max_num_grains_; ++i)
+        for(int32_t i = 0; i < grain_cap_; ++i)
         {
             if(!grains_[i].active())
             {
@@ -219,7 +300,7 @@ class GranularSamplePlayer
         float pitch_ratio     = SemitonesToRatio(pitch);
         float inv_pitch_ratio = SemitonesToRatio(-pitch);
         float pan
-            = 0.5f + parameters.stereo_spread * (kRandFrac * rand() - 0.5f);
+            = 0.5f + parameters.stereo_spread * (kRandFrac * random_.Next() - 0.5f);
         float gain_l, gain_r;
         if(num_channels_ == 1)
         {
@@ -249,6 +330,9 @@ class GranularSamplePlayer
             grain_size
                 = std::min(grain_size, buffer_size * 0.25f * inv_pitch_ratio);
         }
+        // The recording buffers and the grain sizes at high sample rates are
+        // large enough for the phase to overflow otherwise.
+        grain_size = std::min(grain_size, kMaxGrainTravel * inv_pitch_ratio);
 
         float eaten_by_play_head      = grain_size * pitch_ratio;
         float eaten_by_recording_head = grain_size;
@@ -275,17 +359,24 @@ class GranularSamplePlayer
     }
 
     int32_t max_num_grains_;
+    int32_t grain_cap_;
     int32_t num_midfi_grains_;
+    int32_t num_lofi_grains_;
     int32_t num_channels_;
 
     float num_grains_;
     float gain_normalization_;
     float grain_size_hint_;
-    float grain_rate_phasor_;
 
     Grain   grains_[kMaxNumGrains];
     int32_t available_grains_[kMaxNumGrains];
+    int32_t num_available_grains_;
+    size_t  control_phase_;
     float   envelope_buffer_[kMaxBlockSize];
+
+    SampleStager* stager_;
+    RandomSource  random_;
+    GrainSeeder   seeder_;
 };
 
 
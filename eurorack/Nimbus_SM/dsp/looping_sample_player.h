@@ -33,7 +33,9 @@
 
 #include "audio_buffer.h"
 #include "frame.h"
+#include "parameter_ramp.h"
 #include "parameters.h"
+#include "sample_stager.h"
 
 using namespace daisysp;
 
@@ -58,15 +60,51 @@ class LoopingSamplePlayer
         tap_delay_counter_ = 0;
         synchronized_      = false;
         tail_duration_     = 1.0f;
+        target_delay_      = 0.0f;
+        phase_increment_   = 1.0f;
+        stager_            = NULL;
     }
 
     inline bool synchronized() const { return synchronized_; }
 
+    // When set, the main and tail taps read from regions of the buffer staged
+    // one block ahead rather than from the buffer itself.
+    inline void set_stager(SampleStager* stager) { stager_ = stager; }
+
+    // `pitch_ratio` is the playback speed of the frozen loop, ramped across
+    // the block (1 while synchronized).
     template <Resolution resolution>
     void Play(const AudioBuffer<resolution>* buffer,
               const Parameters&              parameters,
+              LinearRamp                     pitch_ratio,
               float*                         out,
               size_t                         size)
+    {
+        if(stager_ && resolution == RESOLUTION_16_BIT)
+        {
+            StagedAudioBuffer<resolution> staged[kMaxNumChannels];
+            stager_->Bind(kStagingSlotLooper,
+                          kStagingSlotLooper + 1,
+                          buffer,
+                          num_channels_,
+                          staged);
+            Render(staged, parameters, pitch_ratio, out, size);
+            Prefetch(buffer, parameters, size);
+        }
+        else
+        {
+            Render(buffer, parameters, pitch_ratio, out, size);
+        }
+    }
+
+  private:
+    // Buffer is either an AudioBuffer or a StagedAudioBuffer.
+    template <typename Buffer>
+    void Render(const Buffer*     buffer,
+                const Parameters& parameters,
+                LinearRamp        pitch_ratio,
+                float*            out,
+                size_t            size)
     {
         int32_t max_delay = buffer->size() - kCrossfadeDuration;
         tap_delay_counter_ += size;
@@ -94,12 +132,15 @@ class LoopingSamplePlayer
                 {
                     target_delay = tap_delay_;
                 }
-                float error       = (target_delay - current_delay_);
-                float delay       = current_delay_ + 0.00005f * error;
-                current_delay_    = delay;
-                int32_t delay_int = (buffer->head() - 4 - size + buffer->size())
-                                    << 12;
-                delay_int -= static_cast<int32_t>(delay * 4096.0f);
+                target_delay_  = target_delay;
+                double error   = (target_delay - current_delay_);
+                double delay   = current_delay_ + 0.00005 * error;
+                current_delay_ = delay;
+                int64_t delay_int
+                    = static_cast<int64_t>(buffer->head() - 4 - size
+                                           + buffer->size())
+                      << 12;
+                delay_int -= static_cast<int64_t>(delay * 4096.0);
 
                 float l
                     = buffer[0].ReadHermite((delay_int >> 12), delay_int << 4);
@@ -132,11 +173,15 @@ class LoopingSamplePlayer
             {
                 loop_point = max_delay - loop_duration;
             }
-            float phase_increment
-                = synchronized_ ? 1.0f : SemitonesToRatio(parameters.pitch);
+            if(synchronized_)
+            {
+                pitch_ratio = LinearRamp(1.0f, 0.0f);
+            }
+            float phase_increment = pitch_ratio.value();
 
             while(size--)
             {
+                phase_increment = pitch_ratio.Next();
                 if(phase_ >= loop_duration_ || phase_ == 0.0f)
                 {
                     if(phase_ >= loop_duration_)
@@ -163,14 +208,16 @@ class LoopingSamplePlayer
                     gain = phase_ / tail_duration_;
                     CONSTRAIN(gain, 0.0f, 1.0f);
                 }
-                int32_t delay_int = (buffer->head() - 4 + buffer->size()) << 12;
-                float ph = parameters.granular.reverse
-                               ? loop_duration_ - phase_
-                               : phase_;
-                int32_t position
+                int64_t delay_int
+                    = static_cast<int64_t>(buffer->head() - 4 + buffer->size())
+                      << 12;
+                double ph = parameters.granular.reverse
+                                ? loop_duration_ - phase_
+                                : phase_;
+                int64_t position
                     = delay_int
-                      - static_cast<int32_t>(
-                          (loop_duration_ - ph + loop_point_) * 4096.0f);
+                      - static_cast<int64_t>(
+                          (loop_duration_ - ph + loop_point_) * 4096.0);
                 float l
                     = buffer[0].ReadHermite((position >> 12), position << 4);
                 if(num_channels_ == 1)
@@ -189,9 +236,9 @@ class LoopingSamplePlayer
                 if(gain != 1.0f)
                 {
                     gain             = 1.0f - gain;
-                    int32_t position = delay_int
-                                       - static_cast<int32_t>(
-                                           (-phase_ + tail_start_) * 4096.0f);
+                    int64_t position = delay_int
+                                       - static_cast<int64_t>(
+                                           (-phase_ + tail_start_) * 4096.0);
 
                     float l = buffer[0].ReadHermite((position >> 12),
                                                     position << 4);
@@ -210,12 +257,68 @@ class LoopingSamplePlayer
                 }
                 out += 2;
             }
+            // Where the ramp ended, for the next block's prefetch.
+            phase_increment_ = phase_increment;
         }
     }
 
-  private:
-    float phase_;
-    float current_delay_;
+    // Stages the spans both taps will read during the next block, assuming
+    // the delay keeps slewing at the same rate and the loop does not wrap.
+    template <Resolution resolution>
+    void Prefetch(const AudioBuffer<resolution>* buffer,
+                  const Parameters&              parameters,
+                  size_t                         size)
+    {
+        const double head = buffer->head() - 4;
+        double       from, to;
+        if(!parameters.freeze)
+        {
+            double next_delay = current_delay_
+                                + 0.00005 * size
+                                      * (target_delay_ - current_delay_);
+            from = head - std::max(current_delay_, next_delay);
+            to   = head + size - std::min(current_delay_, next_delay);
+        }
+        else
+        {
+            double next_phase = phase_ + phase_increment_ * size;
+            if(parameters.granular.reverse)
+            {
+                from = head - loop_point_ - next_phase;
+                to   = head - loop_point_ - phase_;
+            }
+            else
+            {
+                from = head - loop_duration_ - loop_point_ + phase_;
+                to   = head - loop_duration_ - loop_point_ + next_phase;
+            }
+            if(phase_ < tail_duration_)
+            {
+                PrefetchSpan(kStagingSlotLooper + 1,
+                             buffer,
+                             head - tail_start_ + phase_,
+                             head - tail_start_ + next_phase);
+            }
+        }
+        PrefetchSpan(kStagingSlotLooper, buffer, from, to);
+    }
+
+    template <Resolution resolution>
+    inline void PrefetchSpan(int32_t                        slot,
+                             const AudioBuffer<resolution>* buffer,
+                             double                         from,
+                             double                         to)
+    {
+        int32_t start  = static_cast<int32_t>(from) - 2;
+        int32_t length = static_cast<int32_t>(to - from) + 8;
+        stager_->Prefetch(
+            slot, buffer, num_channels_, start + buffer->size(), length);
+    }
+
+    double phase_;
+    double current_delay_;
+    float  target_delay_;
+    float  phase_increment_;
 
     float loop_point_;
     float loop_duration_;
@@ -229,6 +332,8 @@ class LoopingSamplePlayer
     int32_t elapsed_;
     int32_t tap_delay_;
     int32_t tap_delay_counter_;
+
+    SampleStager* stager_;
 };
 
 
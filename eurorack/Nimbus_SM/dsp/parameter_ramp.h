@@ -0,0 +1,103 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Block-rate smoothing of the coefficients derived from the parameters.
+
+#ifndef CLOUDS_DSP_PARAMETER_RAMP_H_
+#define CLOUDS_DSP_PARAMETER_RAMP_H_
+
+#include <stddef.h>
+
+// A linear ramp across one block, read one sample at a time: the first
+// Next() is one step past the start, the last one lands on the end.
+class LinearRamp
+{
+  public:
+    LinearRamp(float start, float increment)
+    : value_(start), increment_(increment)
+    {
+    }
+
+    inline float Next()
+    {
+        value_ += increment_;
+        return value_;
+    }
+
+    inline float value() const { return value_; }
+    inline float increment() const { return increment_; }
+
+    // Nothing to ramp, nothing to mix in.
+    inline bool silent() const
+    {
+        return value_ == 0.0f && increment_ == 0.0f;
+    }
+
+  private:
+    float value_;
+    float increment_;
+};
+
+// A coefficient derived from the parameters (a gain, a ratio, a mix). The
+// mapping, however costly, runs once per block for the value at the block's
+// end; the stages read a linear ramp to it from where the previous block
+// ended instead of jumping there or redoing the mapping per sample.
+class SmoothedValue
+{
+  public:
+    SmoothedValue() {}
+    ~SmoothedValue() {}
+
+    // Starts (or restarts) from `value`, without a ramp.
+    inline void Init(float value)
+    {
+        previous_ = value;
+        target_   = value;
+    }
+
+    // Once per block, before the stages run.
+    inline void Update(float target)
+    {
+        previous_ = target_;
+        target_   = target;
+    }
+
+    // The ramp over this block, at the rate of the stage reading it (the
+    // players run at half rate in low-fidelity mode).
+    inline LinearRamp ramp(size_t size) const
+    {
+        return LinearRamp(previous_,
+                          (target_ - previous_) / static_cast<float>(size));
+    }
+
+    inline float value() const { return target_; }
+
+  private:
+    float previous_;
+    float target_;
+};
+
+#endif // CLOUDS_DSP_PARAMETER_RAMP_H_
@@ -29,7 +29,7 @@
 #include "frame_transformation.h"
 
 #include <algorithm>
-#include <random>
+#include <cstring>
 
 #include "stmtemp.h"
 #include "daisysp.h"
@@ -42,23 +42,24 @@ using namespace daisysp;
 using namespace std;
 using namespace daisy;
 
-void FrameTransformation::Init(float*  buffer,
-                               int32_t fft_size,
-                               int32_t num_textures)
+void FrameTransformation::Init(uint16_t* buffer,
+                               int32_t   fft_size,
+                               int32_t   num_textures)
 {
-    fft_size_ = fft_size;
-    size_     = (fft_size >> 1) - kHighFrequencyTruncation;
+    fft_size_     = fft_size;
+    size_         = (fft_size >> 1) - kHighFrequencyTruncation;
+    num_textures_ = num_textures;
 
     for(int32_t i = 0; i < num_textures; ++i)
     {
         textures_[i] = &buffer[i * size_];
     }
-    phases_ = static_cast<uint16_t*>((void*)(textures_[num_textures - 1]));
-    num_textures_
-        = num_textures - 1; // Last texture is used for storing phases.
+    // The phases are stored after the textures.
+    phases_       = &buffer[num_textures * size_];
     phases_delta_ = phases_ + size_;
 
     glitch_algorithm_ = 0;
+    random_.Seed(RandomSource::kDefaultSeed);
     Reset();
 }
 
@@ -66,7 +67,7 @@ void FrameTransformation::Reset()
 {
     for(int32_t i = 0; i < num_textures_; ++i)
     {
-        fill(&textures_[i][0], &textures_[i][size_], 0.0f);
+        fill(&textures_[i][0], &textures_[i][size_], 0);
     }
 }
 
@@ -83,79 +84,316 @@ void FrameTransformation::Process(const Parameters& parameters,
 
     if(!freeze)
     {
-        RectangularToPolar(fft_out);
-        StoreMagnitudes(
-            fft_out, parameters.position, parameters.spectral.refresh_rate);
+        AnalyzeMagnitudes(fft_out,
+                          ifft_in,
+                          parameters.position,
+                          parameters.spectral.refresh_rate);
     }
-    float* temp = &fft_out[0];
-    ReplayMagnitudes(ifft_in, parameters.position);
-    WarpMagnitudes(ifft_in, temp, parameters.spectral.warp);
-    ShiftMagnitudes(temp, ifft_in, pitch_ratio);
+    else
+    {
+        ReplayMagnitudes(ifft_in, parameters.position);
+    }
+    // The magnitudes go back and forth between the two buffers: the FFT's
+    // input is free once analyzed.
+    float* magnitudes = &fft_out[0];
+    WarpAndShiftMagnitudes(
+        ifft_in, magnitudes, parameters.spectral.warp, pitch_ratio);
     if(glitch)
     {
-        AddGlitch(ifft_in);
+        AddGlitch(magnitudes);
     }
-    QuantizeMagnitudes(ifft_in, parameters.spectral.quantization);
-    SetPhases(ifft_in, parameters.spectral.phase_randomization, pitch_ratio);
-    PolarToRectangular(ifft_in);
+    SynthesizeFrame(magnitudes,
+                    ifft_in,
+                    parameters.spectral.quantization,
+                    parameters.spectral.phase_randomization,
+                    pitch_ratio);
 
     if(!glitch)
     {
         // Decide on which glitch algorithm will be used next time... if glitch
         // is enabled on the next frame!
-        glitch_algorithm_ = static_cast<int16_t>(rand() >> 16) & 3;
+        glitch_algorithm_ = static_cast<int16_t>(random_.Next() >> 16) & 3;
     }
 
     ifft_in[0]              = 0.0f;
     ifft_in[fft_size_ >> 1] = 0.0f;
 }
 
-void FrameTransformation::RectangularToPolar(float* fft_data)
+namespace
+{
+#if defined(__ARM_FP16_FORMAT_IEEE)
+// VCVTB.F16.F32 and VCVTB.F32.F16 on the Cortex-M7 (-mfp16-format=ieee).
+// __fp16 is a storage format: no unions or by-value arguments.
+inline uint16_t FloatToHalf(float x)
+{
+    __fp16   h = x;
+    uint16_t bits;
+    memcpy(&bits, &h, sizeof(bits));
+    return bits;
+}
+
+inline float HalfToFloat(uint16_t bits)
+{
+    __fp16 h;
+    memcpy(&h, &bits, sizeof(h));
+    return h;
+}
+#else
+// Portable versions, rounding to nearest even like the FPU.
+inline uint16_t FloatToHalf(float x)
 {
-    float* real      = &fft_data[0];
-    float* imag      = &fft_data[fft_size_ >> 1];
-    float* magnitude = &fft_data[0];
-    for(int32_t i = 1; i < size_; ++i)
+    uint32_t bits = unsafe_bit_cast<uint32_t, float>(x);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+    uint32_t half;
+    if(bits >= 0x47800000)
     {
-        uint16_t angle   = fast_atan2r(imag[i], real[i], &magnitude[i]);
-        phases_delta_[i] = angle - phases_[i];
-        phases_[i]       = angle;
+        // Out of range: infinity, or a quiet NaN.
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
     }
+    else if(bits < 0x38800000)
+    {
+        // Denormal: adding 0.5 lines the result up with the low bits, and
+        // the float addition does the rounding.
+        float f = unsafe_bit_cast<float, uint32_t>(bits) + 0.5f;
+        half    = unsafe_bit_cast<uint32_t, float>(f) - 0x3f000000;
+    }
+    else
+    {
+        uint32_t odd = (bits >> 13) & 1;
+        half         = (bits - 0x38000000 + 0xfff + odd) >> 13;
+    }
+    return static_cast<uint16_t>(sign | half);
 }
 
-void FrameTransformation::SetPhases(float* destination,
-                                    float  phase_randomization,
-                                    float  pitch_ratio)
+inline float HalfToFloat(uint16_t h)
 {
-    uint32_t* synthesis_phase = (uint32_t*)&destination[fft_size_ >> 1];
-    for(int32_t i = 0; i < size_; ++i)
+    uint32_t bits     = static_cast<uint32_t>(h & 0x7fff) << 13;
+    uint32_t exponent = bits & 0x0f800000;
+    bits += 0x38000000;
+    if(exponent == 0x0f800000)
     {
-        synthesis_phase[i] = phases_[i];
-        phases_[i] += static_cast<uint16_t>(static_cast<float>(phases_delta_[i])
-                                            * pitch_ratio);
+        // Infinity or NaN.
+        bits += 0x38000000;
     }
+    else if(exponent == 0)
+    {
+        // Denormal: renormalized by the float subtraction.
+        bits += 0x00800000;
+        bits = unsafe_bit_cast<uint32_t, float>(
+            unsafe_bit_cast<float, uint32_t>(bits) - 6.103515625e-05f);
+    }
+    return unsafe_bit_cast<float, uint32_t>(bits
+                                            | static_cast<uint32_t>(h & 0x8000)
+                                                  << 16);
+}
+#endif // __ARM_FP16_FORMAT_IEEE
+
+// asin(s) in 16-bit angle units (65536 per turn) on [0, 1/sqrt(2)]: odd
+// polynomial fitted for a maximum error of 0.2 units (atan_lut: ~14).
+const float kAsin1 = 10427.976812f;
+const float kAsin3 = 1796.083435f;
+const float kAsin5 = 419.178108f;
+const float kAsin7 = 1233.182052f;
+
+// Magnitudes and 16-bit angles of 4 bins, with the quadrant arithmetic of
+// fast_atan2r() but no table and no branch: the angle is the arcsine of the
+// smaller component over the magnitude, mirrored about 45 degrees when the
+// imaginary part is the larger one. The reciprocal square root takes two
+// Newton steps. The Cortex-M7 has no float SIMD; the 4 lanes are
+// independent chains the compiler interleaves in the FPU pipeline.
+inline void
+RectangularToPolar4(const float* real, const float* imag, float* r, uint16_t* angle)
+{
+#pragma GCC unroll 4
+    for(int32_t k = 0; k < 4; ++k)
+    {
+        float    x       = real[k];
+        float    y       = imag[k];
+        float    squared = x * x + y * y;
+        uint32_t bits    = unsafe_bit_cast<uint32_t, float>(squared);
+        float    rinv = unsafe_bit_cast<float, uint32_t>(0x5f3759df - (bits >> 1));
+        float    half = squared * 0.5f;
+        rinv *= 1.5f - half * rinv * rinv;
+        rinv *= 1.5f - half * rinv * rinv;
+        r[k] = squared * rinv;
+
+        uint32_t sx       = unsafe_bit_cast<uint32_t, float>(x) & 0x80000000;
+        uint32_t sy       = unsafe_bit_cast<uint32_t, float>(y) & 0x80000000;
+        uint32_t quadrant = ((~sx & sy) >> 29 | sx >> 30);
+        float    ax       = fabsf(x);
+        float    ay       = fabsf(y);
+        float    s        = fminf(ax, ay) * rinv;
+        float    s2       = s * s;
+        float    a = s * (kAsin1 + s2 * (kAsin3 + s2 * (kAsin5 + s2 * kAsin7)));
+        int32_t  theta  = static_cast<int32_t>(a + 0.5f);
+        theta           = ay > ax ? 16384 - theta : theta;
+        int32_t negate  = static_cast<int32_t>((sx ^ sy) >> 31);
+        theta           = (theta ^ -negate) + negate;
+        theta           = squared > 0.0f ? theta + (quadrant << 14) : 0;
+        angle[k]        = static_cast<uint16_t>(theta);
+    }
+}
+} // namespace
+
+void FrameTransformation::AnalyzeMagnitudes(float* fft_data,
+                                            float* xf_polar,
+                                            float  position,
+                                            float  feedback)
+{
+    // One pass over the bins: polar conversion, write into the magnitude
+    // buffers (StoreMagnitudes) and read back at the same position
+    // (ReplayMagnitudes). Bin 0 is zeroed by Process().
+    const float* real = &fft_data[0];
+    const float* imag = &fft_data[fft_size_ >> 1];
+
+    float   index_float      = position * float(num_textures_ - 1);
+    int32_t index_int        = static_cast<int32_t>(index_float);
+    float   index_fractional = index_float - static_cast<float>(index_int);
+    float   gain_a           = 1.0f - index_fractional;
+    float   gain_b           = index_fractional;
+
+    uint16_t* a = textures_[index_int];
+    uint16_t* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
+
+    // Every refresh mode writes a[i] * old_a + x * new_a (and the same for
+    // b); the random one only for the bins it picks.
+    float    new_a, new_b, old_a, old_b;
+    bool     random    = false;
+    uint16_t threshold = 0;
+    if(feedback >= 0.5f)
+    {
+        feedback = 2.0f * (feedback - 0.5f);
+        if(feedback < 0.5f)
+        {
+            new_a = gain_a * (1.0f - feedback);
+            new_b = gain_b * (1.0f - feedback);
+            old_a = 1.0f - new_a;
+            old_b = 1.0f - new_b;
+        }
+        else
+        {
+            float t        = (feedback - 0.5f) * 0.7f + 0.5f;
+            float gain_new = t - 0.5f;
+            gain_new       = gain_new * gain_new * 2.0f + 0.5f;
+            new_a          = gain_a * gain_new;
+            new_b          = gain_b * gain_new;
+            old_a          = 1.0f - gain_a * (1.0f - t);
+            old_b          = 1.0f - gain_b * (1.0f - t);
+        }
+    }
+    else
+    {
+        feedback *= 2.0f;
+        feedback *= feedback;
+        threshold = feedback * 65535.0f;
+        random    = true;
+        new_a     = gain_a;
+        new_b     = gain_b;
+        old_a     = 1.0f - gain_a;
+        old_b     = 1.0f - gain_b;
+    }
+
+    // size_ (fft_size / 2 - 16) is a multiple of 4
+    float    magnitude[4];
+    uint16_t angle[4];
+    for(int32_t i = 0; i < size_; i += 4)
+    {
+        RectangularToPolar4(&real[i], &imag[i], magnitude, angle);
+        for(int32_t k = 0; k < 4; ++k)
+        {
+            int32_t  n     = i + k;
+            float    x     = magnitude[k];
+            float    na    = new_a;
+            float    nb    = new_b;
+            float    oa    = old_a;
+            float    ob    = old_b;
+            phases_delta_[n] = angle[k] - phases_[n];
+            phases_[n]       = angle[k];
+            if(random
+               && static_cast<uint16_t>(static_cast<int16_t>(random_.Next() >> 16))
+                      > threshold)
+            {
+                na = nb = 0.0f;
+                oa = ob = 1.0f;
+            }
+            // a and b are the same texture at position 1: b is updated
+            // from the new a, and a read back.
+            a[n]        = FloatToHalf(HalfToFloat(a[n]) * oa + x * na);
+            b[n]        = FloatToHalf(HalfToFloat(b[n]) * ob + x * nb);
+            xf_polar[n] = Crossfade(
+                HalfToFloat(a[n]), HalfToFloat(b[n]), index_fractional);
+        }
+    }
+}
+
+void FrameTransformation::SynthesizeFrame(const float* magnitudes,
+                                          float*       xf_polar,
+                                          float        quantization,
+                                          float        phase_randomization,
+                                          float        pitch_ratio)
+{
+    // QuantizeMagnitudes, SetPhases and PolarToRectangular in one pass: each
+    // bin's magnitude is read, quantized, and its rectangular form written.
+    float* real = &xf_polar[0];
+    float* imag = &xf_polar[fft_size_ >> 1];
+
     float r = phase_randomization;
     r       = (r - 0.05f) * 1.06f;
     CONSTRAIN(r, 0.0f, 1.0f);
     r *= r;
     int32_t amount = static_cast<int32_t>(r * 32768.0f);
-    for(int32_t i = 0; i < size_; ++i)
+
+    // Below 0.48, the magnitudes are truncated to a coarser grid; above
+    // 0.52, normalized and bent towards 4x(1-x)^3.
+    bool  truncate   = quantization <= 0.48f;
+    bool  bend       = quantization >= 0.52f;
+    float scale_down = 0.0f;
+    float scale_up   = 0.0f;
+    float norm       = 0.0f;
+    float inv_norm   = 0.0f;
+    if(truncate)
     {
-        synthesis_phase[i]
-            += static_cast<int32_t>(static_cast<int16_t>(rand() >> 16)) * amount
-               >> 14;
+        quantization *= 2.0f;
+        scale_down
+            = 0.5f
+              * SemitonesToRatio(-108.0f * (1.0f - quantization * quantization))
+              / float(fft_size_);
+        scale_up = 1.0f / scale_down;
+    }
+    else if(bend)
+    {
+        quantization = (quantization - 0.52f) * 2.0f;
+        norm         = *std::max_element(&magnitudes[0], &magnitudes[size_]);
+        inv_norm     = 1.0f / (norm + 0.0001f);
     }
-}
 
-void FrameTransformation::PolarToRectangular(float* fft_data)
-{
-    float*    real      = &fft_data[0];
-    float*    imag      = &fft_data[fft_size_ >> 1];
-    float*    magnitude = &fft_data[0];
-    uint32_t* angle     = (uint32_t*)&fft_data[fft_size_ >> 1];
-    for(int32_t i = 1; i < size_; ++i)
+    for(int32_t i = 0; i < size_; ++i)
     {
-        fast_p2r(magnitude[i], angle[i], &real[i], &imag[i]);
+        float magnitude = magnitudes[i];
+        if(truncate)
+        {
+            magnitude = scale_up
+                        * static_cast<float>(
+                            static_cast<int32_t>(scale_down * magnitude));
+        }
+        else if(bend)
+        {
+            float x      = magnitude * inv_norm;
+            float warped = 4.0f * x * (1.0f - x) * (1.0f - x) * (1.0f - x);
+            magnitude    = (x + (warped - x) * quantization) * norm;
+        }
+
+        uint32_t phase = phases_[i];
+        phases_[i] += static_cast<uint16_t>(static_cast<float>(phases_delta_[i])
+                                            * pitch_ratio);
+        if(amount)
+        {
+            phase += static_cast<int32_t>(static_cast<int16_t>(random_.Next() >> 16))
+                         * amount
+                     >> 14;
+        }
+        fast_p2r(magnitude, phase, &real[i], &imag[i]);
     }
     for(int32_t i = size_; i < (fft_size_ >> 1); ++i)
     {
@@ -175,7 +413,7 @@ void FrameTransformation::AddGlitch(float* xf_polar)
                 float held = 0.0;
                 for(int32_t i = 0; i < size_; ++i)
                 {
-                    if((static_cast<int16_t>(rand() >> 16) & 15) == 0)
+                    if((static_cast<int16_t>(random_.Next() >> 16) & 15) == 0)
                     {
                         held = x[i];
                     }
@@ -189,7 +427,7 @@ void FrameTransformation::AddGlitch(float* xf_polar)
             // Spectral shift up with aliasing.
             {
                 float factor
-                    = 1.0f + (static_cast<int16_t>(rand() >> 16) & 7) / 4.0f;
+                    = 1.0f + (static_cast<int16_t>(random_.Next() >> 16) & 7) / 4.0f;
                 float source = 0.0f;
                 for(int32_t i = 0; i < size_; ++i)
                 {
@@ -214,7 +452,7 @@ void FrameTransformation::AddGlitch(float* xf_polar)
             // Nasty high-pass
             for(int32_t i = 0; i < size_; ++i)
             {
-                uint32_t random = static_cast<int16_t>(rand() >> 16) & 15;
+                uint32_t random = static_cast<int16_t>(random_.Next() >> 16) & 15;
                 if(random == 0)
                 {
                     x[i] *= static_cast<float>(i) / 16.0f;
@@ -227,35 +465,21 @@ void FrameTransformation::AddGlitch(float* xf_polar)
     }
 }
 
-void FrameTransformation::QuantizeMagnitudes(float* xf_polar, float amount)
+namespace
 {
-    if(amount <= 0.48f)
-    {
-        amount = amount * 2.0f;
-        float scale_down
-            = 0.5f * SemitonesToRatio(-108.0f * (1.0f - amount * amount))
-              / float(fft_size_);
-        float scale_up = 1.0f / scale_down;
-        for(int32_t i = 0.0f; i < size_; ++i)
-        {
-            xf_polar[i] = scale_up
-                          * static_cast<float>(
-                              static_cast<int32_t>(scale_down * xf_polar[i]));
-        }
-    }
-    else if(amount >= 0.52f)
-    {
-        amount         = (amount - 0.52f) * 2.0f;
-        float norm     = *std::max_element(&xf_polar[0], &xf_polar[size_]);
-        float inv_norm = 1.0f / (norm + 0.0001f);
-        for(int32_t i = 1.0f; i < size_; ++i)
-        {
-            float x      = xf_polar[i] * inv_norm;
-            float warped = 4.0f * x * (1.0f - x) * (1.0f - x) * (1.0f - x);
-            xf_polar[i]  = (x + (warped - x) * amount) * norm;
-        }
-    }
+// The source at the warped position of the frequency f (0 to 1 over the
+// kept bins).
+inline float
+Warp(const float* source, const float* coefficients, float f, int32_t size)
+{
+    float a  = coefficients[0];
+    float b  = coefficients[1];
+    float c  = coefficients[2];
+    float d  = coefficients[3];
+    float wf = (d + f * (c + f * (b + a * f))) * size;
+    return Interpolate(source, wf, 1.0f);
 }
+} // namespace
 
 const float kWarpPolynomials[6][4] = {
     {10.5882f, -14.8824f, 5.29412f, 0.0f},
@@ -266,12 +490,16 @@ const float kWarpPolynomials[6][4] = {
     {-7.3333f, +9.5f, -2.416667f, 0.25f},
 };
 
-void FrameTransformation::WarpMagnitudes(float* source,
-                                         float* xf_polar,
-                                         float  amount)
+void FrameTransformation::WarpAndShiftMagnitudes(const float* source,
+                                                 float*       xf_polar,
+                                                 float        amount,
+                                                 float        pitch_ratio)
 {
+    // WarpMagnitudes and ShiftMagnitudes in one pass: the shift reads the
+    // warped spectrum in increasing order, so the warped bins are computed
+    // as it reaches them rather than stored. Bin 0 is zeroed by Process().
     float bin_width = 1.0f / static_cast<float>(size_);
-    float f         = 0.0;
+    float f         = 0.0f;
 
     float coefficients[4];
     amount *= 4.0f;
@@ -283,117 +511,56 @@ void FrameTransformation::WarpMagnitudes(float* source,
                                     amount_fractional);
     }
 
-    float a = coefficients[0];
-    float b = coefficients[1];
-    float c = coefficients[2];
-    float d = coefficients[3];
-
-    for(int32_t i = 1.0f; i < size_; ++i)
-    {
-        f += bin_width;
-        float wf    = (d + f * (c + f * (b + a * f))) * size_;
-        xf_polar[i] = Interpolate(source, wf, 1.0f);
-    }
-}
-
-void FrameTransformation::ShiftMagnitudes(float* source,
-                                          float* xf_polar,
-                                          float  pitch_ratio)
-{
     float* destination = &xf_polar[0];
-    float* temp        = &xf_polar[size_];
+    destination[0]     = 0.0f;
     if(pitch_ratio == 1.0f)
     {
-        copy(&source[0], &source[size_], &temp[0]);
+        for(int32_t i = 1; i < size_; ++i)
+        {
+            f += bin_width;
+            destination[i] = Warp(source, coefficients, f, size_);
+        }
     }
     else if(pitch_ratio > 1.0f)
     {
-        float index     = 1.0f;
-        float increment = 1.0f / pitch_ratio;
+        // The index moves by less than a bin: at most one more warped bin is
+        // needed per output bin.
+        float   index     = 1.0f;
+        float   increment = 1.0f / pitch_ratio;
+        int32_t warped    = 1;
+        f += bin_width;
+        float warped_0 = Warp(source, coefficients, f, size_);
+        f += bin_width;
+        float warped_1 = Warp(source, coefficients, f, size_);
         for(int32_t i = 1; i < size_; ++i)
         {
-            temp[i] = Interpolate(source, index, 1.0f);
+            MAKE_INTEGRAL_FRACTIONAL(index)
+            if(index_integral != warped)
+            {
+                f += bin_width;
+                warped_0 = warped_1;
+                warped_1 = Warp(source, coefficients, f, size_);
+                ++warped;
+            }
+            destination[i] = warped_0 + (warped_1 - warped_0) * index_fractional;
             index += increment;
         }
     }
     else
     {
-        fill(&temp[0], &temp[size_], 0.0f);
+        fill(&destination[1], &destination[size_], 0.0f);
         float index     = 1.0f;
         float increment = pitch_ratio;
         for(int32_t i = 1; i < size_; ++i)
         {
+            f += bin_width;
+            float warped = Warp(source, coefficients, f, size_);
             MAKE_INTEGRAL_FRACTIONAL(index)
-            temp[index_integral] += (1.0f - index_fractional) * source[i];
-            temp[index_integral + 1] += index_fractional * source[i];
+            destination[index_integral] += (1.0f - index_fractional) * warped;
+            destination[index_integral + 1] += index_fractional * warped;
             index += increment;
         }
     }
-    copy(&temp[0], &temp[size_], &destination[0]);
-}
-
-void FrameTransformation::StoreMagnitudes(float* xf_polar,
-                                          float  position,
-                                          float  feedback)
-{
-    // Write into magnitude buffers.
-    float   index_float      = position * float(num_textures_ - 1);
-    int32_t index_int        = static_cast<int32_t>(index_float);
-    float   index_fractional = index_float - index_int;
-    float   gain_a           = 1.0f - index_fractional;
-    float   gain_b           = index_fractional;
-
-    float* a = textures_[index_int];
-    float* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
-
-    if(feedback >= 0.5f)
-    {
-        feedback = 2.0f * (feedback - 0.5f);
-        if(feedback < 0.5f)
-        {
-            gain_a *= 1.0f - feedback;
-            gain_b *= 1.0f - feedback;
-            for(int32_t i = 0; i < size_; ++i)
-            {
-                float x = *xf_polar++;
-                a[i]    = Crossfade(a[i], x, gain_a);
-                b[i]    = Crossfade(b[i], x, gain_b);
-            }
-        }
-        else
-        {
-            float t          = (feedback - 0.5f) * 0.7f + 0.5f;
-            float gain_new   = t - 0.5f;
-            gain_new         = gain_new * gain_new * 2.0f + 0.5f;
-            float gain_new_a = gain_a * gain_new;
-            float gain_new_b = gain_b * gain_new;
-            float gain_old_a = 1.0f - gain_a * (1.0f - t);
-            float gain_old_b = 1.0f - gain_b * (1.0f - t);
-            for(int32_t i = 0; i < size_; ++i)
-            {
-                float x = *xf_polar++;
-                a[i]    = a[i] * gain_old_a + x * gain_new_a;
-                b[i]    = b[i] * gain_old_b + x * gain_new_b;
-            }
-        }
-    }
-    else
-    {
-        feedback *= 2.0f;
-        feedback *= feedback;
-        uint16_t threshold = feedback * 65535.0f;
-        for(int32_t i = 0; i < size_; ++i)
-        {
-            float x = *xf_polar++;
-            float gain
-                = static_cast<uint16_t>(static_cast<int16_t>(rand() >> 16))
-                          <= threshold
-                      ? 1.0f
-                      : 0.0f;
-            a[i] = Crossfade(a[i], x, gain_a * gain);
-            b[i] = Crossfade(b[i], x, gain_b * gain);
-        }
-    }
 }
 
 void FrameTransformation::ReplayMagnitudes(float* xf_polar, float position)
@@ -401,10 +568,11 @@ void FrameTransformation::ReplayMagnitudes(float* xf_polar, float position)
     float   index_float      = position * float(num_textures_ - 1);
     int32_t index_int        = static_cast<int32_t>(index_float);
     float   index_fractional = index_float - static_cast<float>(index_int);
-    float*  a                = textures_[index_int];
-    float*  b = textures_[index_int + (position == 1.0f ? 0 : 1)];
+    uint16_t* a              = textures_[index_int];
+    uint16_t* b = textures_[index_int + (position == 1.0f ? 0 : 1)];
     for(int32_t i = 0; i < size_; ++i)
     {
-        xf_polar[i] = Crossfade(a[i], b[i], index_fractional);
+        xf_polar[i]
+            = Crossfade(HalfToFloat(a[i]), HalfToFloat(b[i]), index_fractional);
     }
 }
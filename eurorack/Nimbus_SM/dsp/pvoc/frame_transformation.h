@@ -29,9 +29,15 @@
 #ifndef CLOUDS_DSP_PVOC_FRAME_TRANSFORMATION_H_
 #define CLOUDS_DSP_PVOC_FRAME_TRANSFORMATION_H_
 
+#include "random.h"
 #include "resources.h"
 
-const int32_t kMaxNumTextures          = 7;
+// Magnitude textures, stored as IEEE half floats. The phases and phase
+// deltas take two more texture slots.
+const int32_t kMaxNumTextures          = 6;
+const int32_t kNumPhaseTextures        = 2;
+// The replay crossfades between two neighbouring textures.
+const int32_t kMinNumTextures          = 2;
 const int32_t kHighFrequencyTruncation = 16;
 
 struct Parameters;
@@ -42,20 +48,32 @@ class FrameTransformation
     FrameTransformation() {}
     ~FrameTransformation() {}
 
-    void Init(float* buffer, int32_t fft_size, int32_t num_textures);
+    // buffer holds (num_textures + kNumPhaseTextures) * (fft_size / 2 -
+    // kHighFrequencyTruncation) 16-bit words.
+    void Init(uint16_t* buffer, int32_t fft_size, int32_t num_textures);
     void Reset();
 
     void Process(const Parameters& parameters, float* fft_out, float* ifft_in);
 
   private:
-    void RectangularToPolar(float* fft_data);
-    void PolarToRectangular(float* fft_data);
+    // Polar conversion, store and replay, in one pass over the bins.
+    void AnalyzeMagnitudes(float* fft_data,
+                           float* xf_polar,
+                           float  position,
+                           float  feedback);
+    // Quantization, phase advance and randomization, and rectangular
+    // conversion into xf_polar, in one pass over the bins.
+    void SynthesizeFrame(const float* magnitudes,
+                         float*       xf_polar,
+                         float        quantization,
+                         float        diffusion,
+                         float        pitch_ratio);
     void AddGlitch(float* xf_polar);
-    void ShiftMagnitudes(float* source, float* xf_polar, float pitch_ratio);
-    void WarpMagnitudes(float* source, float* xf_polar, float amount);
-    void QuantizeMagnitudes(float* xf_polar, float amount);
-    void StoreMagnitudes(float* xf_polar, float position, float feedback);
-    void SetPhases(float* destination, float diffusion, float pitch_ratio);
+    // Frequency warp and pitch shift, in one pass over the bins.
+    void WarpAndShiftMagnitudes(const float* source,
+                                float*       xf_polar,
+                                float        amount,
+                                float        pitch_ratio);
     void ReplayMagnitudes(float* xf_polar, float position);
     void DiffuseMagnitudes(float* xf_polar, float diffusion);
 
@@ -70,14 +88,16 @@ class FrameTransformation
     int32_t num_textures_;
     int32_t size_;
 
-    // Magnitude buffers.
-    float* textures_[kMaxNumTextures];
+    // Magnitude buffers (half floats).
+    uint16_t* textures_[kMaxNumTextures];
 
     // Original phase and phase unrolling buffers.
     uint16_t* phases_;
     uint16_t* phases_delta_;
 
     int8_t glitch_algorithm_;
+
+    RandomSource random_;
 };
 
 
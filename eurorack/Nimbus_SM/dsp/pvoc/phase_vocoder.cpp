@@ -45,41 +45,73 @@ void PhaseVocoder::Init(void**       buffer,
                         int32_t      resolution,
                         float        sample_rate)
 {
-    num_channels_ = num_channels;
+    num_channels_    = num_channels;
+    current_channel_ = 0;
 
     size_t fft_size  = largest_fft_size;
     size_t hop_ratio = 4;
 
-    BufferAllocator  allocator_0(buffer[0], buffer_size[0]);
-    BufferAllocator  allocator_1(buffer[1], buffer_size[1]);
+    // Halve the FFT until the buffers, the phases and at least
+    // kMinNumTextures textures fit in the memory given.
+    BufferAllocator  allocator_0;
+    BufferAllocator  allocator_1;
     BufferAllocator* allocator[2] = {&allocator_0, &allocator_1};
-    float*           fft_buffer   = allocator[0]->Allocate<float>(fft_size);
-    float*           ifft_buffer
-        = allocator[num_channels_ - 1]->Allocate<float>(fft_size);
+    float*           fft_buffer;
+    float*           ifft_buffer;
+    short*           ana_syn_buffer[2];
+    size_t           num_textures;
+    size_t           texture_size;
+    while(true)
+    {
+        allocator_0.Init(buffer[0], buffer_size[0]);
+        allocator_1.Init(buffer[1], buffer_size[1]);
+        fft_buffer  = allocator[0]->Allocate<float>(fft_size);
+        ifft_buffer = allocator[num_channels_ - 1]->Allocate<float>(fft_size);
+        bool fits   = fft_buffer && ifft_buffer;
+
+        num_textures = kMaxNumTextures;
+        texture_size = (fft_size >> 1) - kHighFrequencyTruncation;
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            ana_syn_buffer[i] = allocator[i]->Allocate<short>(
+                (fft_size + (fft_size >> 1)) * 2);
+            fits = fits && ana_syn_buffer[i];
+
+            size_t num_slots
+                = allocator[i]->free() / (sizeof(uint16_t) * texture_size);
+            size_t num_phases = kNumPhaseTextures;
+            num_textures      = min(
+                num_slots > num_phases ? num_slots - num_phases : 0,
+                num_textures);
+        }
+        if(fits && num_textures >= size_t(kMinNumTextures))
+        {
+            break;
+        }
+        if(fft_size <= kMinFftSize)
+        {
+            // Not even the smallest vocoder fits: stay silent.
+            num_channels_ = 0;
+            return;
+        }
+        fft_size >>= 1;
+    }
 
-    size_t num_textures = kMaxNumTextures;
-    size_t texture_size = (fft_size >> 1) - kHighFrequencyTruncation;
     for(int32_t i = 0; i < num_channels_; ++i)
     {
-        short* ana_syn_buffer
-            = allocator[i]->Allocate<short>((fft_size + (fft_size >> 1)) * 2);
-
-        num_textures
-            = min(allocator[i]->free() / (sizeof(float) * texture_size),
-                  num_textures);
         stft_[i].Init(&fft_,
                       fft_size,
                       fft_size / hop_ratio,
                       fft_buffer,
                       ifft_buffer,
                       large_window_lut,
-                      ana_syn_buffer,
+                      ana_syn_buffer[i],
                       &frame_transformation_[i]);
     }
     for(int32_t i = 0; i < num_channels_; ++i)
     {
-        float* texture_buffer
-            = allocator[i]->Allocate<float>(num_textures * texture_size);
+        uint16_t* texture_buffer = allocator[i]->Allocate<uint16_t>(
+            (num_textures + kNumPhaseTextures) * texture_size);
         frame_transformation_[i].Init(texture_buffer, fft_size, num_textures);
     }
 }
@@ -91,6 +123,11 @@ void PhaseVocoder::Process(const Parameters& parameters,
 {
     const float* input_samples  = &input[0].l;
     float*       output_samples = &output[0].l;
+    if(!num_channels_)
+    {
+        fill(&output_samples[0], &output_samples[size << 1], 0.0f);
+        return;
+    }
     for(int32_t i = 0; i < num_channels_; ++i)
     {
         stft_[i].Process(
@@ -105,3 +142,13 @@ void PhaseVocoder::Buffer()
         stft_[i].Buffer();
     }
 }
+
+void PhaseVocoder::BufferStep()
+{
+    // The channels share the FFT buffers: a channel must complete its frame
+    // before the next one starts.
+    if(num_channels_ && stft_[current_channel_].BufferStep())
+    {
+        current_channel_ = (current_channel_ + 1) % num_channels_;
+    }
+}
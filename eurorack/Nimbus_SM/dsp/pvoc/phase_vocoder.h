@@ -35,6 +35,19 @@
 
 using namespace daisysp;
 
+// Working set of a stereo vocoder at kMaxFftSize: per channel, one FFT
+// buffer, the analysis/synthesis buffers, the textures and the phases.
+const size_t kSpectralMemorySize
+    = 2
+      * (kMaxFftSize * sizeof(float)
+         + (kMaxFftSize + (kMaxFftSize >> 1)) * 2 * sizeof(short)
+         + (kMaxNumTextures + kNumPhaseTextures)
+               * ((kMaxFftSize >> 1) - kHighFrequencyTruncation)
+               * sizeof(uint16_t));
+
+// Smallest FFT the vocoder falls back to when the memory is short.
+const size_t kMinFftSize = 256;
+
 struct Parameters;
 
 class PhaseVocoder
@@ -43,6 +56,8 @@ class PhaseVocoder
     PhaseVocoder() {}
     ~PhaseVocoder() {}
 
+    // Runs at largest_fft_size, or at the largest smaller size whose working
+    // set fits in the buffers; outputs silence if none does.
     void Init(void**       buffer,
               size_t*      buffer_size,
               const float* large_window_lut,
@@ -57,6 +72,10 @@ class PhaseVocoder
                  size_t            size);
     void Buffer();
 
+    // Performs one analysis, transformation or synthesis step on one
+    // channel, to spread the work over several small blocks.
+    void BufferStep();
+
   private:
     FFT fft_;
 
@@ -64,6 +83,7 @@ class PhaseVocoder
     FrameTransformation frame_transformation_[2];
 
     int32_t num_channels_;
+    int32_t current_channel_;
 };
 
 
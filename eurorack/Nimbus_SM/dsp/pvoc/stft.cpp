@@ -83,6 +83,7 @@ void STFT::Reset()
     fill(&synthesis_[0], &synthesis_[buffer_size_], 0);
     ready_ = 0;
     done_  = 0;
+    step_  = 0;
 }
 
 void STFT::Process(const Parameters& parameters,
@@ -126,7 +127,38 @@ void STFT::Buffer()
     {
         return;
     }
+    Analyze();
+    Transform();
+    Synthesize();
+}
+
+bool STFT::BufferStep()
+{
+    switch(step_)
+    {
+        case 0:
+            if(ready_ == done_)
+            {
+                return true;
+            }
+            Analyze();
+            step_ = 1;
+            return false;
+
+        case 1:
+            Transform();
+            step_ = 2;
+            return false;
+
+        default:
+            Synthesize();
+            step_ = 0;
+            return true;
+    }
+}
 
+void STFT::Analyze()
+{
     // Copy block to FFT buffer and apply window.
     size_t       source_ptr = process_ptr_;
     const float* w          = window_;
@@ -161,6 +193,10 @@ void STFT::Buffer()
         fft_->Direct(fft_in_, fft_out_);
     }
 #endif // USE_ARM_FFT
+}
+
+void STFT::Transform()
+{
     // Process in the frequency domain.
     if(modifier_ != NULL && parameters_ != NULL)
     {
@@ -170,7 +206,10 @@ void STFT::Buffer()
     {
         copy(&fft_out_[0], &fft_out_[fft_size_], &ifft_in_[0]);
     }
+}
 
+void STFT::Synthesize()
+{
     // Compute IFFT. ifft_in is lost.
 #ifdef USE_ARM_FFT
     // Re-arrange data.
@@ -200,7 +239,7 @@ void STFT::Buffer()
         = 1.0f / float(fft_size_ * fft_size_ / hop_size_ >> 1);
 #endif // USE_ARM_FFT
 
-    w = window_;
+    const float* w = window_;
     for(size_t i = 0; i < fft_size_; ++i)
     {
         float s = ifft_out_[i] * w[0] * inverse_window_size;
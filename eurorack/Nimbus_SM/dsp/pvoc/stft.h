@@ -84,7 +84,16 @@ class STFT
 
     void Buffer();
 
+    // Same as Buffer(), split in three steps (analysis, transformation,
+    // synthesis) so that the work can be spread over several small blocks.
+    // Returns true when no frame is in progress.
+    bool BufferStep();
+
   private:
+    void Analyze();
+    void Transform();
+    void Synthesize();
+
     FFT*   fft_;
     size_t fft_size_;
     size_t fft_num_passes_;
@@ -107,6 +116,7 @@ class STFT
 
     size_t ready_;
     size_t done_;
+    size_t step_;
 
     const Parameters* parameters_;
 
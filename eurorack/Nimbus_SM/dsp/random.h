@@ -0,0 +1,60 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Per-instance random numbers, in place of the C library's rand().
+
+#ifndef CLOUDS_DSP_RANDOM_H_
+#define CLOUDS_DSP_RANDOM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// rand() keeps its state in a global, which two processors running on two
+// threads would share (and race on). Each user owns one of these instead,
+// reseeded on Init(), so that a processor renders the same output however
+// many others run beside it. Values have rand()'s range, [0, RAND_MAX].
+class RandomSource
+{
+  public:
+    RandomSource() : state_(kDefaultSeed) {}
+    ~RandomSource() {}
+
+    static const uint32_t kDefaultSeed = 0x21;
+
+    inline void Seed(uint32_t seed) { state_ = seed; }
+
+    inline int32_t Next()
+    {
+        state_ = state_ * 1664525L + 1013904223L;
+        return static_cast<int32_t>((state_ >> 1) & RAND_MAX);
+    }
+
+  private:
+    uint32_t state_;
+};
+
+
+#endif // CLOUDS_DSP_RANDOM_H_
@@ -0,0 +1,634 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Resonestor, from the Parasites firmware: chords of 4 comb resonators, each
+// struck by a noise burst on a trigger and fed the input while it is the
+// latest one.
+//
+// The resonators form a bank stored as arrays of their coefficients and
+// states, and the block is rendered one resonator at a time, its state held
+// in locals, rather than every resonator once per sample through an
+// FxEngine. A chord that is neither fed nor still ringing above
+// kResonestorSilence is skipped altogether, so that the cost follows the
+// number of chords sounding. Past the CPU budget (set_max_chords()), the
+// oldest chords are damped, and dropped from kResonestorDampedSilence.
+
+#ifndef CLOUDS_DSP_RESONESTOR_H_
+#define CLOUDS_DSP_RESONESTOR_H_
+
+#include <algorithm>
+#include <cmath>
+
+#include "frame.h"
+#include "random.h"
+#include "stmtemp.h"
+
+const int32_t kNumResonestorChords = 4;
+const int32_t kNumChordNotes       = 4;
+const int32_t kNumResonators       = kNumResonestorChords * kNumChordNotes;
+
+// Delay lines, in samples (powers of 2).
+const int32_t kResonatorSize  = 1024;
+const int32_t kExcitationSize = 4096;
+const int32_t kBurstCombSize  = 512;
+
+// Bytes of memory Init() takes.
+const size_t kResonestorMemorySize
+    = (kNumResonators * kResonatorSize + 2 * kExcitationSize + kBurstCombSize)
+      * sizeof(float);
+
+// Resonator periods, in samples: the longest leaves room for the modulation
+// and the interpolation taps (about 36 Hz at 32 kHz).
+const float kMinResonatorPeriod = 4.0f;
+const float kMaxResonatorPeriod = 900.0f;
+
+// Peak level below which a chord that is not fed stops being processed.
+const float kResonestorSilence = 1.0e-4f;
+// Same, past the CPU budget: once damped, a chord only leaves the slow tail
+// of its DC blocker, cut at about -50 dB.
+const float kResonestorDampedSilence = 3.0e-3f;
+
+// Intervals of the 3 upper notes of a chord, in semitones, along the chord
+// parameter.
+const float kResonestorChords[kNumChordNotes - 1][18] = {
+    {0.0f,
+     4.0f / 128.0f,
+     16.0f / 128.0f,
+     4.0f / 128.0f,
+     4.0f / 128.0f,
+     12.0f,
+     12.0f,
+     4.0f,
+     4.0f,
+     3.0f,
+     3.0f,
+     2.0f,
+     4.0f,
+     3.0f,
+     4.0f,
+     3.0f,
+     4.0f,
+     4.0f},
+    {0.0f,
+     8.0f / 128.0f,
+     32.0f / 128.0f,
+     7.0f,
+     12.0f,
+     24.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f,
+     7.0f},
+    {0.0f,
+     12.0f / 128.0f,
+     48.0f / 128.0f,
+     7.0f + 4.0f / 128.0f,
+     12.0f + 4.0f / 128.0f,
+     36.0f,
+     19.0f,
+     12.0f,
+     11.0f,
+     10.0f,
+     12.0f,
+     12.0f,
+     12.0f,
+     14.0f,
+     14.0f,
+     16.0f,
+     16.0f,
+     16.0f}};
+
+class Resonestor
+{
+  public:
+    Resonestor() {}
+    ~Resonestor() {}
+
+    // `buffer` holds kResonestorMemorySize bytes.
+    void Init(float* buffer, float sample_rate)
+    {
+        lines_         = buffer;
+        excitation_[0] = lines_ + kNumResonators * kResonatorSize;
+        excitation_[1] = excitation_[0] + kExcitationSize;
+        burst_line_    = excitation_[1] + kExcitationSize;
+        std::fill(lines_, burst_line_ + kBurstCombSize, 0.0f);
+        write_ptr_ = 0;
+        random_.Seed(RandomSource::kDefaultSeed);
+        set_sample_rate(sample_rate);
+
+        for(int32_t c = 0; c < kNumResonestorChords; ++c)
+        {
+            harmonicity_[c] = 1.0f;
+            narrow_[c]      = 0.001f;
+            level_[c]       = 0.0f;
+            order_[c]       = c;
+        }
+        for(int32_t r = 0; r < kNumResonators; ++r)
+        {
+            period_[r]   = kMinResonatorPeriod;
+            feedback_[r] = 0.0f;
+            SetFilter(&lp_[r], 0.5f, 0.4f);
+            SetFilter(&bp_[r], 0.5f, 1.0f);
+            lp_state_[r][0] = lp_state_[r][1] = 0.0f;
+            bp_state_[r][0] = bp_state_[r][1] = 0.0f;
+            hp_[r]                            = 0.0f;
+        }
+        spread_delay_[0] = 0.0f;
+        Spread();
+        max_chords_ = kNumResonestorChords;
+        fed_        = kExcitationSize;
+
+        pitch_          = 0.0f;
+        chord_          = 0.0f;
+        feedback_gain_  = 0.0f;
+        narrow_amount_  = 0.001f;
+        damp_           = 1.0f;
+        harmonicity_in_ = 1.0f;
+        distortion_     = 0.0f;
+        spread_amount_  = 0.0f;
+        stereo_         = 0.0f;
+        separation_     = 0.0f;
+        burst_time_     = 0.0f;
+        burst_comb_     = 1.0f;
+        burst_duration_ = 0.0f;
+        trigger_ = previous_trigger_ = false;
+        freeze_ = previous_freeze_ = false;
+
+        SetFilter(&burst_lp_, 0.5f, 0.8f);
+        SetFilter(&rand_lp_, 0.0f, 1.0f);
+        burst_lp_state_[0] = burst_lp_state_[1] = 0.0f;
+        rand_lp_state_[0] = rand_lp_state_[1] = 0.0f;
+        rand_hp_state_                         = 0.0f;
+    }
+
+    // The pitches, the decay and the 10 Hz DC blocker are kept in Hz; the
+    // burst comb and the spread in time, as at 32 kHz.
+    inline void set_sample_rate(float sample_rate)
+    {
+        sample_rate_ = sample_rate;
+        hp_k_        = 10.0f / sample_rate;
+        rand_hp_g_   = Tan(1.0f / sample_rate);
+        rand_hp_gi_  = 1.0f / (1.0f + rand_hp_g_);
+        time_scale_  = sample_rate / 32000.0f;
+    }
+
+    void Process(FloatFrame* in_out, size_t size)
+    {
+        const bool triggered = trigger_ && !previous_trigger_;
+        if((triggered && !freeze_) || (freeze_ && !previous_freeze_))
+        {
+            // The oldest chord takes the new notes; the others keep theirs.
+            const int32_t chord = order_[kNumResonestorChords - 1];
+            std::copy_backward(&order_[0],
+                               &order_[kNumResonestorChords - 1],
+                               &order_[kNumResonestorChords]);
+            order_[0] = chord;
+        }
+        previous_trigger_ = trigger_;
+        previous_freeze_  = freeze_;
+
+        const int32_t active = order_[0];
+        Tune(active);
+        if(triggered)
+        {
+            burst_time_ = period_[active * kNumChordNotes] * 2.0f
+                          * burst_duration_;
+            Spread();
+        }
+
+        Excite(in_out, size);
+        std::fill(&in_out[0].l, &in_out[0].l + (size << 1), 0.0f);
+
+        // Chords alternate sides with the separation, and notes with the
+        // stereo width.
+        const float side = 0.25f * (1.0f - stereo_);
+        const float mid  = 0.25f + 0.25f * stereo_;
+        for(int32_t rank = 0; rank < kNumResonestorChords; ++rank)
+        {
+            const int32_t c   = order_[rank];
+            const bool    fed = rank == 0 && fed_ < kExcitationSize;
+            const float   silence = silence_level(rank);
+            if(!fed && level_[c] < silence)
+            {
+                continue;
+            }
+            const float damping = rank < max_chords_ ? 1.0f : 0.0f;
+            const float gain    = 1.0f + 0.5f * narrow_[c];
+            const float* excitation = fed ? excitation_[c & 1] : NULL;
+            float        peak       = 0.0f;
+            for(int32_t p = 0; p < kNumChordNotes; ++p)
+            {
+                const float near = gain * (p & 1 ? mid : side)
+                                   * (1.0f - separation_);
+                const float far = gain * (p & 1 ? side : mid);
+                const int32_t pre
+                    = static_cast<int32_t>(spread_delay_[p] * spread_amount_);
+                const float level = Resonate(c * kNumChordNotes + p,
+                                             excitation,
+                                             pre,
+                                             harmonicity_[c],
+                                             damping,
+                                             c & 1 ? far : near,
+                                             c & 1 ? near : far,
+                                             in_out,
+                                             size);
+                peak = std::max(peak, level);
+            }
+            level_[c] = peak;
+            if(!fed && peak < silence)
+            {
+                Silence(c);
+            }
+        }
+        write_ptr_ += size;
+    }
+
+    // Root of the chord, in semitones from middle C.
+    inline void set_pitch(float pitch) { pitch_ = pitch; }
+
+    inline void set_chord(float chord) { chord_ = chord; }
+
+    // Gain of the resonators over one second.
+    inline void set_feedback(float feedback) { feedback_gain_ = feedback; }
+
+    inline void set_narrow(float narrow) { narrow_amount_ = narrow; }
+
+    inline void set_damp(float damp) { damp_ = damp; }
+
+    inline void set_harmonicity(float harmonicity)
+    {
+        harmonicity_in_ = harmonicity;
+    }
+
+    inline void set_distortion(float distortion)
+    {
+        distortion_ = distortion * distortion * distortion;
+        SetFilter(&rand_lp_, distortion_ * 0.4f, 1.0f);
+    }
+
+    // A rising edge strikes the chord, and moves to a new one unless frozen.
+    inline void set_trigger(bool trigger) { trigger_ = trigger; }
+
+    // A rising edge moves to a new chord, leaving the last one ringing.
+    inline void set_freeze(bool freeze) { freeze_ = freeze; }
+
+    inline void set_burst_damp(float burst_damp)
+    {
+        SetFilter(&burst_lp_, burst_damp * burst_damp * 0.5f, 0.8f);
+    }
+
+    inline void set_burst_comb(float burst_comb) { burst_comb_ = burst_comb; }
+
+    inline void set_burst_duration(float burst_duration)
+    {
+        burst_duration_ = burst_duration;
+    }
+
+    inline void set_spread_amount(float spread_amount)
+    {
+        spread_amount_ = spread_amount;
+    }
+
+    inline void set_stereo(float stereo) { stereo_ = stereo; }
+
+    inline void set_separation(float separation) { separation_ = separation; }
+
+    // Chords left ringing, the latest first (1 to kNumResonestorChords).
+    inline void set_max_chords(int32_t max_chords)
+    {
+        max_chords_ = std::max(1, std::min(max_chords, kNumResonestorChords));
+    }
+
+    // Chords processed in the last block.
+    inline int32_t num_active_chords() const
+    {
+        int32_t count = fed_ < kExcitationSize ? 1 : 0;
+        for(int32_t rank = count; rank < kNumResonestorChords; ++rank)
+        {
+            count += level_[order_[rank]] >= silence_level(rank);
+        }
+        return count;
+    }
+
+  private:
+    // stmlib's zero-delay feedback state variable filter.
+    struct Filter
+    {
+        float g;
+        float r;
+        float h;
+    };
+
+    // tan(pi * f), as stmlib's FREQUENCY_FAST.
+    static inline float Tan(float f)
+    {
+        const float a  = 3.260e-01f * 31.00627668f;
+        const float b  = 1.823e-01f * 306.0196848f;
+        const float f2 = f * f;
+        return f * (3.14159265f + f2 * (a + b * f2));
+    }
+
+    static inline void SetFilter(Filter* filter, float f, float q)
+    {
+        filter->g = Tan(f);
+        filter->r = 1.0f / q;
+        filter->h
+            = 1.0f / (1.0f + filter->r * filter->g + filter->g * filter->g);
+    }
+
+    // Returns the band-pass output, and the low-pass one in `lp`.
+    static inline float
+    ProcessFilter(const Filter& filter, float* state, float in, float* lp)
+    {
+        const float hp
+            = (in - (filter.r + filter.g) * state[0] - state[1]) * filter.h;
+        const float bp = filter.g * hp + state[0];
+        state[0]       = filter.g * hp + bp;
+        *lp            = filter.g * bp + state[1];
+        state[1]       = filter.g * bp + *lp;
+        return bp;
+    }
+
+    // Reads `delay` samples back from `t` in a line of mask + 1 samples.
+    static inline float
+    ReadHermite(const float* line, uint32_t mask, uint32_t t, float delay)
+    {
+        MAKE_INTEGRAL_FRACTIONAL(delay)
+        const uint32_t base  = t - delay_integral;
+        const float    xm1   = line[(base + 1) & mask];
+        const float    x0    = line[base & mask];
+        const float    x1    = line[(base - 1) & mask];
+        const float    x2    = line[(base - 2) & mask];
+        const float    c     = (x1 - xm1) * 0.5f;
+        const float    v     = x0 - x1;
+        const float    w     = c + v;
+        const float    a     = w + v + (x2 - x0) * 0.5f;
+        const float    b_neg = w + a;
+        const float    f     = delay_fractional;
+        return (((a * f) - b_neg) * f + c) * f + x0;
+    }
+
+    inline float InterpolatePlateau(const float* table, float index)
+    {
+        // Holds each entry over the second half of its span.
+        index *= 16.0f;
+        MAKE_INTEGRAL_FRACTIONAL(index)
+        const float a = table[index_integral];
+        const float b = table[index_integral + 1];
+        return index_fractional < 0.5f ? a + (b - a) * index_fractional * 2.0f
+                                       : b;
+    }
+
+    // New delays of the upper notes' excitation, for the strum.
+    inline float silence_level(int32_t rank) const
+    {
+        return rank < max_chords_ ? kResonestorSilence
+                                  : kResonestorDampedSilence;
+    }
+
+    // Clears the filters of a chord that stopped, so that they do not sit
+    // on denormals until it is struck again.
+    void Silence(int32_t c)
+    {
+        for(int32_t r = c * kNumChordNotes; r < (c + 1) * kNumChordNotes; ++r)
+        {
+            lp_state_[r][0] = lp_state_[r][1] = 0.0f;
+            bp_state_[r][0] = bp_state_[r][1] = 0.0f;
+            hp_[r]                            = 0.0f;
+        }
+        level_[c] = 0.0f;
+    }
+
+    void Spread()
+    {
+        const float spread
+            = std::min(3999.0f * time_scale_, float(kExcitationSize - 1));
+        for(int32_t p = 1; p < kNumChordNotes; ++p)
+        {
+            spread_delay_[p] = random_.Next() * kRandFrac * spread;
+        }
+    }
+
+    // The latest chord follows the parameters; the others keep theirs.
+    void Tune(int32_t c)
+    {
+        CONSTRAIN(chord_, 0.0f, 1.0f);
+        harmonicity_[c] = harmonicity_in_;
+        narrow_[c]      = narrow_amount_;
+        // Middle C.
+        float root = sample_rate_ / 261.626f / SemitonesToRatio(pitch_);
+        CONSTRAIN(root, kMinResonatorPeriod, kMaxResonatorPeriod);
+        for(int32_t p = 0; p < kNumChordNotes; ++p)
+        {
+            const int32_t r      = c * kNumChordNotes + p;
+            float         period = root;
+            if(p)
+            {
+                period /= SemitonesToRatio(
+                    InterpolatePlateau(kResonestorChords[p - 1], chord_));
+                CONSTRAIN(period, kMinResonatorPeriod, kMaxResonatorPeriod);
+            }
+            period_[r]   = period;
+            feedback_[r] = powf(feedback_gain_, period / sample_rate_);
+
+            const float f  = 1.0f / period;
+            float       lp = (2.0f * f + 1.0f) * damp_;
+            CONSTRAIN(lp, 0.0f, 1.0f);
+            SetFilter(&lp_[r], lp, 0.4f);
+            SetFilter(&bp_[r], f, narrow_amount_);
+        }
+    }
+
+    // Burst and input into the excitation lines; pitch modulation into
+    // modulation_.
+    void Excite(const FloatFrame* in, size_t size)
+    {
+        const uint32_t mask  = kExcitationSize - 1;
+        float          delay = burst_comb_ * 200.0f * time_scale_;
+        if(delay < 1.0f)
+        {
+            delay = 1.0f;
+        }
+        const float comb_feedback = 0.6f - burst_comb_ * 0.4f;
+        float       amplitude     = (1.0f - distortion_) * 0.3f;
+        amplitude *= amplitude;
+
+        float peak = 0.0f;
+        for(size_t i = 0; i < size; ++i)
+        {
+            const uint32_t t = write_ptr_ + i;
+            burst_time_ -= 1.0f;
+            const float noise = random_.Next() * kRandFrac * 2.0f - 1.0f;
+
+            float burst = burst_time_ > 0.0f ? noise : 0.0f;
+            burst += comb_feedback
+                     * ReadHermite(burst_line_, kBurstCombSize - 1, t, delay);
+            burst_line_[t & (kBurstCombSize - 1)] = burst;
+            ProcessFilter(burst_lp_, burst_lp_state_, burst, &burst);
+
+            const float l          = burst + in[i].l;
+            const float r          = burst + in[i].r;
+            excitation_[0][t & mask] = l;
+            excitation_[1][t & mask] = r;
+            peak = std::max(peak, std::max(fabsf(l), fabsf(r)));
+
+            // Filtered noise, then a DC blocker at 1 Hz.
+            float modulation;
+            ProcessFilter(
+                rand_lp_, rand_lp_state_, noise * amplitude, &modulation);
+            const float lp
+                = (rand_hp_g_ * modulation + rand_hp_state_) * rand_hp_gi_;
+            rand_hp_state_ = rand_hp_g_ * (modulation - lp) + lp;
+            modulation -= lp;
+            modulation_[i] = modulation;
+        }
+        // The spread reads up to a whole line back.
+        fed_ = peak >= kResonestorSilence
+                   ? 0
+                   : std::min(fed_ + static_cast<int32_t>(size),
+                              kExcitationSize);
+    }
+
+    // One resonator over the block, mixed into `out`. Returns its peak.
+    float Resonate(int32_t            r,
+                   const float*       excitation,
+                   int32_t            pre,
+                   float              harmonicity,
+                   float              damping,
+                   float              gain_l,
+                   float              gain_r,
+                   FloatFrame*        out,
+                   size_t             size)
+    {
+        const uint32_t mask      = kResonatorSize - 1;
+        float*         line      = lines_ + r * kResonatorSize;
+        const float    period    = period_[r];
+        const float    feedback  = feedback_[r] * damping;
+        const Filter   lp        = lp_[r];
+        const Filter   bp        = bp_[r];
+        float          lp_state[2] = {lp_state_[r][0], lp_state_[r][1]};
+        float          bp_state[2] = {bp_state_[r][0], bp_state_[r][1]};
+        float          hp          = hp_[r];
+        const float    hp_k        = hp_k_;
+        float          peak        = 0.0f;
+
+        for(size_t i = 0; i < size; ++i)
+        {
+            const uint32_t t   = write_ptr_ + i;
+            float          acc = excitation
+                            ? excitation[(t - pre) & (kExcitationSize - 1)]
+                            : 0.0f;
+            const float tap = period * (1.0f + modulation_[i]);
+            acc += ReadHermite(line, mask, t, tap) * feedback * 0.7f;
+            acc += ReadHermite(line, mask, t, tap * harmonicity) * feedback
+                   * 0.3f;
+            float low;
+            ProcessFilter(lp, lp_state, acc, &low);
+            acc = ProcessFilter(bp, bp_state, low, &low) * bp.r;
+            hp += hp_k * (acc - hp);
+            acc -= hp;
+            const float y = 2.0f * SoftLimit(0.5f * acc);
+            line[t & mask] = y;
+            out[i].l += y * gain_l;
+            out[i].r += y * gain_r;
+            peak = std::max(peak, fabsf(y));
+        }
+
+        lp_state_[r][0] = lp_state[0];
+        lp_state_[r][1] = lp_state[1];
+        bp_state_[r][0] = bp_state[0];
+        bp_state_[r][1] = bp_state[1];
+        hp_[r]          = hp;
+        return peak;
+    }
+
+    float*       lines_;
+    float*       excitation_[2];
+    float*       burst_line_;
+    uint32_t     write_ptr_;
+    RandomSource random_;
+    float        modulation_[kMaxBlockSize];
+
+    float sample_rate_;
+    float time_scale_;
+    float hp_k_;
+    float rand_hp_g_;
+    float rand_hp_gi_;
+
+    // Parameters, for the latest chord.
+    float pitch_;
+    float chord_;
+    float feedback_gain_;
+    float narrow_amount_;
+    float damp_;
+    float harmonicity_in_;
+    float distortion_;
+    float spread_amount_;
+    float stereo_;
+    float separation_;
+    float burst_comb_;
+    float burst_duration_;
+    bool  trigger_;
+    bool  previous_trigger_;
+    bool  freeze_;
+    bool  previous_freeze_;
+
+    // Per chord. order_ lists them from the latest.
+    float   harmonicity_[kNumResonestorChords];
+    float   narrow_[kNumResonestorChords];
+    float   level_[kNumResonestorChords];
+    int32_t order_[kNumResonestorChords];
+    int32_t max_chords_;
+    // Samples since the excitation lines were last fed.
+    int32_t fed_;
+
+    // Per resonator.
+    float  period_[kNumResonators];
+    float  feedback_[kNumResonators];
+    Filter lp_[kNumResonators];
+    Filter bp_[kNumResonators];
+    float  lp_state_[kNumResonators][2];
+    float  bp_state_[kNumResonators][2];
+    float  hp_[kNumResonators];
+
+    float  spread_delay_[kNumChordNotes];
+    float  burst_time_;
+    Filter burst_lp_;
+    float  burst_lp_state_[2];
+    Filter rand_lp_;
+    float  rand_lp_state_[2];
+    float  rand_hp_state_;
+};
+
+#endif // CLOUDS_DSP_RESONESTOR_H_
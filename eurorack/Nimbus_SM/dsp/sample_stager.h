@@ -0,0 +1,376 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Staging of recording-buffer regions into fast internal RAM.
+//
+// When the recording buffer is very large (long-memory mode) it lives in
+// SDRAM, where random accesses from the grain, WSOLA and looper inner loops
+// are slow. Each reader owns one or two staging slots. At the end of a block,
+// the span every reader will touch during the next block is copied into its
+// slot by a background transport (MDMA on the hardware); at the start of the
+// next block the slots are flipped and reads are served from the staged copy.
+// Reads falling outside the staged span (freshly scheduled grains, position
+// jumps, samples recorded during the block) fall through to the recording
+// buffer itself.
+
+#ifndef CLOUDS_DSP_SAMPLE_STAGER_H_
+#define CLOUDS_DSP_SAMPLE_STAGER_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "audio_buffer.h"
+#include "frame.h"
+
+const int32_t kStagingSlotSize = 192;
+
+const int32_t kStagingSlotGrains  = 0;
+const int32_t kStagingSlotWindows = 64;
+const int32_t kStagingSlotLooper  = 66;
+const int32_t kNumStagingSlots    = 68;
+
+const size_t kStagingMemorySize = 2 * kNumStagingSlots * kMaxNumChannels
+                                  * kStagingSlotSize * sizeof(int16_t);
+
+struct StagingTransfer
+{
+    const int16_t* source;
+    int16_t*       destination;
+    int32_t        size;
+};
+
+// Starts copying a batch of transfers in the background.
+typedef void (*StagingSubmitFn)(const StagingTransfer* transfers,
+                                size_t                 num_transfers,
+                                void*                  context);
+
+// Blocks until the last submitted batch has landed.
+typedef void (*StagingWaitFn)(void* context);
+
+struct StagedRegion
+{
+    const int16_t* data;
+    int32_t        base;
+    int32_t        length;
+};
+
+// Read-only view of one channel of the recording buffer, backed by up to two
+// staged regions. Exposes the same read interface as AudioBuffer so that the
+// players can render from either.
+template <Resolution resolution>
+class StagedAudioBuffer
+{
+  public:
+    StagedAudioBuffer() {}
+    ~StagedAudioBuffer() {}
+
+    inline void Init(const AudioBuffer<resolution>* buffer,
+                     const StagedRegion&            a,
+                     const StagedRegion&            b)
+    {
+        buffer_    = buffer;
+        region_[0] = a;
+        region_[1] = b;
+    }
+
+    template <InterpolationMethod method>
+    inline float Read(int32_t integral, uint16_t fractional) const
+    {
+        if(method == INTERPOLATION_ZOH)
+        {
+            return ReadZOH(integral, fractional);
+        }
+        else if(method == INTERPOLATION_LINEAR)
+        {
+            return ReadLinear(integral, fractional);
+        }
+        else
+        {
+            return ReadHermite(integral, fractional);
+        }
+    }
+
+    inline float ReadZOH(int32_t integral, uint16_t fractional) const
+    {
+        const int16_t* s = Lookup(integral, 1);
+        if(!s)
+        {
+            return buffer_->ReadZOH(integral, fractional);
+        }
+        return static_cast<float>(s[0]) / 32768.0f;
+    }
+
+    inline float ReadLinear(int32_t integral, uint16_t fractional) const
+    {
+        const int16_t* s = Lookup(integral, 2);
+        if(!s)
+        {
+            return buffer_->ReadLinear(integral, fractional);
+        }
+        float t  = static_cast<float>(fractional) / 65536.0f;
+        float x0 = s[0];
+        float x1 = s[1];
+        return (x0 + (x1 - x0) * t) / 32768.0f;
+    }
+
+    inline float ReadHermite(int32_t integral, uint16_t fractional) const
+    {
+        const int16_t* s = Lookup(integral, 4);
+        if(!s)
+        {
+            return buffer_->ReadHermite(integral, fractional);
+        }
+        float t = static_cast<float>(fractional) / 65536.0f;
+        return InterpolateHermite(s[0], s[1], s[2], s[3], t) / 32768.0f;
+    }
+
+    inline int32_t size() const { return buffer_->size(); }
+    inline int32_t head() const { return buffer_->head(); }
+
+  private:
+    inline const int16_t* Lookup(int32_t integral, int32_t taps) const
+    {
+        if(resolution != RESOLUTION_16_BIT)
+        {
+            return NULL;
+        }
+        const int32_t size = buffer_->size();
+        if(integral >= size)
+        {
+            integral -= size;
+        }
+        for(int32_t i = 0; i < 2; ++i)
+        {
+            int32_t local = integral - region_[i].base;
+            if(local < 0)
+            {
+                local += size;
+            }
+            if(local + taps <= region_[i].length)
+            {
+                return &region_[i].data[local];
+            }
+        }
+        return NULL;
+    }
+
+    const AudioBuffer<resolution>* buffer_;
+    StagedRegion                   region_[2];
+};
+
+class SampleStager
+{
+  public:
+    SampleStager() {}
+    ~SampleStager() {}
+
+    void Init(void* memory)
+    {
+        memory_      = static_cast<int16_t*>(memory);
+        submit_      = NULL;
+        wait_        = NULL;
+        context_     = NULL;
+        front_       = 0;
+        num_pending_ = 0;
+        misses_      = 0;
+        for(int32_t i = 0; i < 2; ++i)
+        {
+            for(int32_t j = 0; j < kNumStagingSlots; ++j)
+            {
+                length_[i][j] = 0;
+                base_[i][j]   = 0;
+            }
+        }
+    }
+
+    // Without a transport, transfers are performed synchronously with memcpy
+    // (useful on the host, pointless on the hardware).
+    inline void set_transport(StagingSubmitFn submit,
+                              StagingWaitFn   wait,
+                              void*           context)
+    {
+        submit_  = submit;
+        wait_    = wait;
+        context_ = context;
+    }
+
+    // Waits for the prefetch issued at the end of the previous block and makes
+    // it visible to the readers.
+    void BeginBlock()
+    {
+        if(wait_)
+        {
+            wait_(context_);
+        }
+        front_ ^= 1;
+        num_pending_ = 0;
+        std::fill(&length_[front_ ^ 1][0],
+                  &length_[front_ ^ 1][kNumStagingSlots],
+                  0);
+    }
+
+    // Kicks the prefetch for the next block.
+    void EndBlock()
+    {
+        if(!num_pending_)
+        {
+            return;
+        }
+        if(submit_)
+        {
+            submit_(pending_, num_pending_, context_);
+        }
+        else
+        {
+            for(size_t i = 0; i < num_pending_; ++i)
+            {
+                std::memcpy(pending_[i].destination,
+                            pending_[i].source,
+                            pending_[i].size * sizeof(int16_t));
+            }
+        }
+    }
+
+    // Requests the span [start, start + length) of the buffer to be staged
+    // into a slot for the next block. Spans that do not fit are left to be
+    // read directly from the buffer.
+    template <Resolution resolution>
+    void Prefetch(int32_t                        slot,
+                  const AudioBuffer<resolution>* buffer,
+                  int32_t                        num_channels,
+                  int32_t                        start,
+                  int32_t                        length)
+    {
+        const int32_t back = front_ ^ 1;
+        const int32_t size = buffer->size();
+        if(resolution != RESOLUTION_16_BIT || length > kStagingSlotSize
+           || length > size)
+        {
+            ++misses_;
+            return;
+        }
+        start %= size;
+        if(start < 0)
+        {
+            start += size;
+        }
+        // The next block records from the write head on before anything is
+        // read, so the copy stops short of it: reads at and past the head
+        // (near-zero delays) fall through to the freshly written buffer.
+        int32_t recorded = buffer->write_head() - start;
+        if(recorded < 0)
+        {
+            recorded += size;
+        }
+        length = std::min(length, recorded);
+        if(!length)
+        {
+            return;
+        }
+        int32_t first  = std::min(length, size - start);
+        int32_t second = length - first;
+        for(int32_t i = 0; i < num_channels; ++i)
+        {
+            int16_t*       destination = slot_data(back, slot, i);
+            const int16_t* source      = buffer[i].data();
+            Enqueue(&source[start], destination, first);
+            if(second)
+            {
+                Enqueue(&source[0], destination + first, second);
+            }
+        }
+        base_[back][slot]   = start;
+        length_[back][slot] = length;
+    }
+
+    template <Resolution resolution>
+    inline void Bind(int32_t                        slot_a,
+                     int32_t                        slot_b,
+                     const AudioBuffer<resolution>* buffer,
+                     int32_t                        num_channels,
+                     StagedAudioBuffer<resolution>* staged) const
+    {
+        for(int32_t i = 0; i < num_channels; ++i)
+        {
+            staged[i].Init(&buffer[i], region(slot_a, i), region(slot_b, i));
+        }
+    }
+
+    template <Resolution resolution>
+    inline void Bind(int32_t                        slot,
+                     const AudioBuffer<resolution>* buffer,
+                     int32_t                        num_channels,
+                     StagedAudioBuffer<resolution>* staged) const
+    {
+        Bind(slot, slot, buffer, num_channels, staged);
+    }
+
+    inline uint32_t misses() const { return misses_; }
+
+  private:
+    inline void Enqueue(const int16_t* source, int16_t* destination, int32_t n)
+    {
+        StagingTransfer* t = &pending_[num_pending_++];
+        t->source          = source;
+        t->destination     = destination;
+        t->size            = n;
+    }
+
+    inline int16_t* slot_data(int32_t side, int32_t slot, int32_t channel)
+    {
+        return &memory_[((side * kNumStagingSlots + slot) * kMaxNumChannels
+                         + channel)
+                        * kStagingSlotSize];
+    }
+
+    inline StagedRegion region(int32_t slot, int32_t channel) const
+    {
+        StagedRegion r;
+        r.data = &memory_[((front_ * kNumStagingSlots + slot) * kMaxNumChannels
+                           + channel)
+                          * kStagingSlotSize];
+        r.base   = base_[front_][slot];
+        r.length = length_[front_][slot];
+        return r;
+    }
+
+    int16_t* memory_;
+
+    StagingSubmitFn submit_;
+    StagingWaitFn   wait_;
+    void*           context_;
+
+    int32_t front_;
+    int32_t base_[2][kNumStagingSlots];
+    int32_t length_[2][kNumStagingSlots];
+
+    StagingTransfer pending_[kNumStagingSlots * kMaxNumChannels * 2];
+    size_t          num_pending_;
+
+    uint32_t misses_;
+};
+
+#endif // CLOUDS_DSP_SAMPLE_STAGER_H_
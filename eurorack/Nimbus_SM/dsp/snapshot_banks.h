@@ -0,0 +1,286 @@
+// Copyright 2014 Emilie Gillet.
+//
+// Author: Emilie Gillet (emilie.o.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Freeze snapshot banks, sharing pages with the recording buffers.
+//
+// The recording buffers are split into kBufferPageSize pages. Capturing a
+// bank copies nothing: its page table points at the pages of the buffers,
+// each of which counts the banks referencing it. Before the write head
+// overwrites a referenced page, the page is copied into a free page of the
+// pool and the banks holding it are pointed at the copy. The buffers are
+// never remapped, so the writer, the stager and the sample memory still see
+// them as contiguous; only a recalled bank is read through its page table
+// (AudioBuffer::set_pages).
+//
+// A capture needs as many free pool pages as there are buffer pages, the
+// worst case of the whole buffer being overwritten, so a write never finds
+// the pool empty.
+
+#ifndef CLOUDS_DSP_SNAPSHOT_BANKS_H_
+#define CLOUDS_DSP_SNAPSHOT_BANKS_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "audio_buffer.h"
+#include "frame.h"
+
+const int32_t kNumSnapshotBanks = 4;
+
+// Pages per channel: enough for the mono buffer, the largest one.
+const int32_t kMaxSnapshotPages = 176;
+// Pages of the largest pool that can be managed (2 MB).
+const int32_t kMaxSnapshotPoolPages = 1024;
+
+class SnapshotBanks
+{
+  public:
+    SnapshotBanks() {}
+    ~SnapshotBanks() {}
+
+    void Init(void* pool, size_t pool_size)
+    {
+        const int32_t num_pages
+            = static_cast<int32_t>(pool_size >> kBufferPageShift);
+        pool_           = static_cast<uint8_t*>(pool);
+        num_pool_pages_ = pool ? std::min(num_pages, kMaxSnapshotPoolPages) : 0;
+        Detach();
+    }
+
+    inline const void* pool() const { return pool_; }
+
+    // Forgets every bank and shares pages with new recording buffers of
+    // `size` bytes per channel (interpolation tail included), holding
+    // `sample_size` byte samples.
+    void Attach(void* const* buffer,
+                size_t       size,
+                int32_t      num_channels,
+                int32_t      sample_size)
+    {
+        Detach();
+        num_pages_ = static_cast<int32_t>(
+            (size + kBufferPageSize - 1) >> kBufferPageShift);
+        if(!num_pool_pages_ || num_pages_ > kMaxSnapshotPages)
+        {
+            return;
+        }
+        for(int32_t i = 0; i < num_channels; ++i)
+        {
+            buffer_[i] = static_cast<uint8_t*>(buffer[i]);
+        }
+        size_         = size;
+        num_channels_ = num_channels;
+        sample_shift_ = sample_size == 2 ? 1 : 0;
+    }
+
+    // Forgets every bank; none can be captured until the next Attach().
+    void Detach()
+    {
+        std::fill(&captured_[0], &captured_[kNumSnapshotBanks], false);
+        std::fill(&buffer_refs_[0][0],
+                  &buffer_refs_[kMaxNumChannels - 1][kMaxSnapshotPages],
+                  0);
+        for(int32_t i = 0; i < num_pool_pages_; ++i)
+        {
+            free_[i] = i;
+        }
+        num_free_     = num_pool_pages_;
+        num_shared_   = 0;
+        num_channels_ = 0;
+        num_pages_    = 0;
+        size_         = 0;
+    }
+
+    inline bool available() const { return num_channels_ != 0; }
+
+    inline bool captured(int32_t bank) const
+    {
+        return bank >= 0 && bank < kNumSnapshotBanks && captured_[bank];
+    }
+
+    // Replaces the bank with the current state of the buffers, given their
+    // write heads.
+    bool Capture(int32_t bank, const int32_t* head)
+    {
+        if(!available() || bank < 0 || bank >= kNumSnapshotBanks)
+        {
+            return false;
+        }
+        Release(bank);
+        if(num_free_ < num_pages_ * num_channels_)
+        {
+            return false;
+        }
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            for(int32_t page = 0; page < num_pages_; ++page)
+            {
+                pages_[bank][i][page] = buffer_page(i, page);
+                if(buffer_refs_[i][page]++ == 0)
+                {
+                    ++num_shared_;
+                }
+            }
+            head_[bank][i] = head[i];
+        }
+        captured_[bank] = true;
+        return true;
+    }
+
+    void Release(int32_t bank)
+    {
+        if(!captured(bank))
+        {
+            return;
+        }
+        for(int32_t i = 0; i < num_channels_; ++i)
+        {
+            for(int32_t page = 0; page < num_pages_; ++page)
+            {
+                const uint8_t* data = pages_[bank][i][page];
+                if(data == buffer_page(i, page))
+                {
+                    if(--buffer_refs_[i][page] == 0)
+                    {
+                        --num_shared_;
+                    }
+                }
+                else
+                {
+                    const int32_t index = static_cast<int32_t>(data - pool_)
+                                          >> kBufferPageShift;
+                    if(--pool_refs_[index] == 0)
+                    {
+                        free_[num_free_++] = index;
+                    }
+                }
+            }
+        }
+        captured_[bank] = false;
+    }
+
+    // Before `size` samples of a channel are written from `head`, in a
+    // buffer of `length` samples (AudioBuffer::size()). Writes to the first
+    // samples are mirrored into the interpolation tail.
+    inline void PreserveWrite(int32_t channel,
+                              int32_t head,
+                              int32_t size,
+                              int32_t length)
+    {
+        if(!num_shared_)
+        {
+            return;
+        }
+        int32_t first = std::min(size, length - head);
+        Preserve(channel, head, first);
+        if(size > first)
+        {
+            Preserve(channel, 0, size - first);
+        }
+        if(head < kInterpolationTail || size > first)
+        {
+            Preserve(channel, length, kInterpolationTail);
+        }
+    }
+
+    inline const uint8_t* const* pages(int32_t bank, int32_t channel) const
+    {
+        return pages_[bank][channel];
+    }
+
+    inline int32_t head(int32_t bank, int32_t channel) const
+    {
+        return head_[bank][channel];
+    }
+
+    // Pool pages holding overwritten audio, all banks.
+    inline int32_t num_used_pages() const
+    {
+        return num_pool_pages_ - num_free_;
+    }
+
+  private:
+    inline uint8_t* buffer_page(int32_t channel, int32_t page) const
+    {
+        return buffer_[channel] + (page << kBufferPageShift);
+    }
+
+    inline void Preserve(int32_t channel, int32_t start, int32_t size)
+    {
+        const int32_t first = (start << sample_shift_) >> kBufferPageShift;
+        const int32_t last
+            = (((start + size) << sample_shift_) - 1) >> kBufferPageShift;
+        for(int32_t page = first; page <= last; ++page)
+        {
+            if(buffer_refs_[channel][page])
+            {
+                PreservePage(channel, page);
+            }
+        }
+    }
+
+    void PreservePage(int32_t channel, int32_t page)
+    {
+        const uint8_t* data   = buffer_page(channel, page);
+        const int32_t  index  = free_[--num_free_];
+        uint8_t*       copy   = pool_ + (index << kBufferPageShift);
+        const size_t   offset = static_cast<size_t>(page) << kBufferPageShift;
+        memcpy(copy, data, std::min(size_t(kBufferPageSize), size_ - offset));
+        for(int32_t bank = 0; bank < kNumSnapshotBanks; ++bank)
+        {
+            if(captured_[bank] && pages_[bank][channel][page] == data)
+            {
+                pages_[bank][channel][page] = copy;
+            }
+        }
+        pool_refs_[index]           = buffer_refs_[channel][page];
+        buffer_refs_[channel][page] = 0;
+        --num_shared_;
+    }
+
+    uint8_t* pool_;
+    int32_t  num_pool_pages_;
+    uint16_t free_[kMaxSnapshotPoolPages];
+    int32_t  num_free_;
+    uint8_t  pool_refs_[kMaxSnapshotPoolPages];
+
+    uint8_t* buffer_[kMaxNumChannels];
+    size_t   size_;
+    int32_t  num_channels_;
+    int32_t  num_pages_;
+    int32_t  sample_shift_;
+    uint8_t  buffer_refs_[kMaxNumChannels][kMaxSnapshotPages];
+    // Buffer pages referenced by a bank, each of which may still take a
+    // pool page: never more than num_free_.
+    int32_t num_shared_;
+
+    bool           captured_[kNumSnapshotBanks];
+    const uint8_t* pages_[kNumSnapshotBanks][kMaxNumChannels]
+                        [kMaxSnapshotPages];
+    int32_t        head_[kNumSnapshotBanks][kMaxNumChannels];
+};
+
+#endif // CLOUDS_DSP_SNAPSHOT_BANKS_H_
@@ -67,10 +67,10 @@ class Window
         envelope_phase_increment_ = 2.0f / static_cast<float>(width);
     }
 
-    template <Resolution resolution>
-    inline void OverlapAdd(const AudioBuffer<resolution>* buffer,
-                           float*                         samples,
-                           int32_t                        channels)
+    // Buffer is either an AudioBuffer or a StagedAudioBuffer.
+    template <typename Buffer>
+    inline void
+    OverlapAdd(const Buffer* buffer, float* samples, int32_t channels)
     {
         if(done_)
         {
@@ -102,6 +102,14 @@ class Window
         phase_ += phase_increment_;
     }
 
+    // Span of the recording buffer read while rendering the next size
+    // samples, interpolation taps included.
+    inline void StagingSpan(size_t size, int32_t* start, int32_t* length) const
+    {
+        *start  = first_sample_ + (phase_ >> 16);
+        *length = ((phase_increment_ * static_cast<int32_t>(size)) >> 16) + 4;
+    }
+
     inline bool done() { return done_; }
     inline bool needs_regeneration() { return half_ && !regenerated_; }
     inline void MarkAsRegenerated() { regenerated_ = true; }
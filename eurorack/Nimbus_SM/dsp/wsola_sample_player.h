@@ -40,6 +40,7 @@
 #include "frame.h"
 #include "window.h"
 #include "parameters.h"
+#include "sample_stager.h"
 
 using namespace daisysp;
 
@@ -74,59 +75,46 @@ class WSOLASamplePlayer
         env_phase_           = 0.0f;
         env_phase_increment_ = 0.5f;
         elapsed_             = 0;
+        stager_              = NULL;
     }
 
+    // When set, the two windows read from regions of the buffer staged one
+    // block ahead. The correlator is still loaded from the buffer itself.
+    inline void set_stager(SampleStager* stager) { stager_ = stager; }
+
     template <Resolution resolution>
     void Play(const AudioBuffer<resolution>* buffer,
               const Parameters&              parameters,
               float*                         out,
               size_t                         size)
     {
-        elapsed_++;
-        if(parameters.trigger)
-        {
-            env_phase_           = 0.0f;
-            env_phase_increment_ = 1.0f / static_cast<float>(elapsed_);
-            CONSTRAIN(env_phase_increment_, 0.0001f, 0.1f);
-            elapsed_ = 0;
-        }
-        env_phase_ += env_phase_increment_;
-        if(env_phase_ >= 1.0f)
-        {
-            env_phase_ = 1.0;
-        }
-        position_ = parameters.position;
-        position_ += (1.0f - env_phase_) * (1.0f - position_);
-
-        pitch_       = parameters.pitch;
-        size_factor_ = parameters.size;
-
-        if(windows_[0].done() && windows_[1].done())
+        if(stager_ && resolution == RESOLUTION_16_BIT)
         {
-            windows_[1].MarkAsRegenerated();
-            ScheduleAlignedWindow(buffer, &windows_[0]);
-        }
-
-        while(size--)
-        {
-            // Sum the two windows.
-            std::fill(&out[0], &out[kMaxNumChannels], 0);
+            StagedAudioBuffer<resolution> staged[2][kMaxNumChannels];
             for(int32_t i = 0; i < 2; ++i)
             {
-                windows_[i].OverlapAdd(buffer, out, num_channels_);
+                stager_->Bind(
+                    kStagingSlotWindows + i, buffer, num_channels_, staged[i]);
             }
-
-            // Regenerate expired windows.
+            Render(staged, parameters, out, size);
             for(int32_t i = 0; i < 2; ++i)
             {
-                if(windows_[i].needs_regeneration())
+                if(!windows_[i].done())
                 {
-                    windows_[i].MarkAsRegenerated();
-                    ScheduleAlignedWindow(buffer, &windows_[1 - i]);
-                    windows_[1 - i].OverlapAdd(buffer, out, num_channels_);
+                    int32_t start, length;
+                    windows_[i].StagingSpan(size, &start, &length);
+                    stager_->Prefetch(kStagingSlotWindows + i,
+                                      buffer,
+                                      num_channels_,
+                                      start,
+                                      length);
                 }
             }
-            out += 2;
+        }
+        else
+        {
+            const AudioBuffer<resolution>* views[2] = {buffer, buffer};
+            Render(views, parameters, out, size);
         }
     }
 
@@ -224,9 +212,65 @@ class WSOLASamplePlayer
     }
 
   private:
-    template <Resolution resolution>
-    void ScheduleAlignedWindow(const AudioBuffer<resolution>* buffer,
-                               Window*                        window)
+    // Each window reads through its own view, an AudioBuffer or a
+    // StagedAudioBuffer.
+    template <typename View>
+    void Render(const View        views[2],
+                const Parameters& parameters,
+                float*            out,
+                size_t            size)
+    {
+        elapsed_++;
+        if(parameters.trigger)
+        {
+            env_phase_           = 0.0f;
+            env_phase_increment_ = 1.0f / static_cast<float>(elapsed_);
+            CONSTRAIN(env_phase_increment_, 0.0001f, 0.1f);
+            elapsed_ = 0;
+        }
+        env_phase_ += env_phase_increment_;
+        if(env_phase_ >= 1.0f)
+        {
+            env_phase_ = 1.0;
+        }
+        position_ = parameters.position;
+        position_ += (1.0f - env_phase_) * (1.0f - position_);
+
+        pitch_       = parameters.pitch;
+        size_factor_ = parameters.size;
+
+        if(windows_[0].done() && windows_[1].done())
+        {
+            windows_[1].MarkAsRegenerated();
+            ScheduleAlignedWindow(views[0], &windows_[0]);
+        }
+
+        while(size--)
+        {
+            // Sum the two windows.
+            std::fill(&out[0], &out[kMaxNumChannels], 0);
+            for(int32_t i = 0; i < 2; ++i)
+            {
+                windows_[i].OverlapAdd(views[i], out, num_channels_);
+            }
+
+            // Regenerate expired windows.
+            for(int32_t i = 0; i < 2; ++i)
+            {
+                if(windows_[i].needs_regeneration())
+                {
+                    windows_[i].MarkAsRegenerated();
+                    ScheduleAlignedWindow(views[i], &windows_[1 - i]);
+                    windows_[1 - i].OverlapAdd(
+                        views[1 - i], out, num_channels_);
+                }
+            }
+            out += 2;
+        }
+    }
+
+    template <typename Buffer>
+    void ScheduleAlignedWindow(const Buffer* buffer, Window* window)
     {
         int32_t next_window_position = correlator_->best_match();
         correlator_loaded_           = false;
@@ -295,6 +339,8 @@ class WSOLASamplePlayer
     float   env_phase_;
     float   env_phase_increment_;
     int32_t elapsed_;
+
+    SampleStager* stager_;
 };
 
 
@@ -32,6 +32,7 @@
 
 #include "resources.h"
 #include <stdint.h>
+#include <algorithm>
 #include "daisysp.h"
 
 using namespace daisysp;
@@ -42,14 +43,54 @@ float    lut_pitch_ratio_low[LUT_PITCH_RATIO_LOW_SIZE];
 uint16_t atan_lut[ATAN_LUT_SIZE];
 
 float lut_sin[LUT_SIN_SIZE];
-float lut_window[LUT_WINDOW_SIZE];
-float lut_xfade_in[LUT_XFADE_IN_SIZE];
-float lut_xfade_out[LUT_XFADE_OUT_SIZE];
+float lut_window[LUT_WINDOW_SIZE + 1];
+float lut_xfade_in[LUT_XFADE_IN_SIZE + 1];
+float lut_xfade_out[LUT_XFADE_OUT_SIZE + 1];
 float lut_sine_window_4096[LUT_SINE_WINDOW_4096_SIZE];
-float lut_grain_size[LUT_GRAIN_SIZE_SIZE];
+float lut_grain_size[LUT_GRAIN_SIZE_SIZE + 1];
+
+namespace
+{
+// The tables are computed by the compiler (GCC folds the math builtins in
+// constant expressions) and kept in flash; InitResources() only copies them
+// to RAM, where the DSP code reads them. Only lut_grain_size depends on the
+// sample rate, and it is tabulated for each supported rate.
+struct ResourceTables
+{
+    int16_t  ulaw[LUT_ULAW_SIZE];
+    float    pitch_ratio_high[LUT_PITCH_RATIO_HIGH_SIZE];
+    float    pitch_ratio_low[LUT_PITCH_RATIO_LOW_SIZE];
+    uint16_t atan[ATAN_LUT_SIZE];
+    float    sin[LUT_SIN_SIZE];
+    float    window[LUT_WINDOW_SIZE];
+    float    xfade_in[LUT_XFADE_IN_SIZE];
+    float    xfade_out[LUT_XFADE_OUT_SIZE];
+    float    sine_window_4096[LUT_SINE_WINDOW_4096_SIZE];
+};
+
+struct GrainSizeTable
+{
+    float sample_rate;
+    float values[LUT_GRAIN_SIZE_SIZE];
+};
+
+//helper for ulaw encoding
+constexpr short MuLaw2Lin(uint8_t u_val)
+{
+    int16_t t = 0;
+    u_val     = ~u_val;
+    t         = ((u_val & 0xf) << 3) + 0x84;
+    t <<= ((unsigned)u_val & 0x70) >> 4;
+    return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
+}
+
+constexpr float Clamp(float x, float min, float max)
+{
+    return x < min ? min : (x > max ? max : x);
+}
 
 //helper for sine window
-void sum_window(float* window, int steps, float* output)
+constexpr void SumWindow(const float* window, int steps, float* output)
 {
     int n      = LUT_SINE_WINDOW_4096_SIZE;
     int start  = 0;
@@ -64,7 +105,7 @@ void sum_window(float* window, int steps, float* output)
     {
         for(int j = start; j < start + stride; j++)
         {
-            output[j - start] += powf(window[j], 2.f);
+            output[j - start] += __builtin_powf(window[j], 2.f);
             output[j] = output[j - start];
         }
 
@@ -72,53 +113,44 @@ void sum_window(float* window, int steps, float* output)
     }
 }
 
-//helper for ulaw encoding
-inline short MuLaw2Lin(uint8_t u_val)
+constexpr ResourceTables MakeResourceTables()
 {
-    int16_t t;
-    u_val = ~u_val;
-    t     = ((u_val & 0xf) << 3) + 0x84;
-    t <<= ((unsigned)u_val & 0x70) >> 4;
-    return ((u_val & 0x80) ? (0x84 - t) : (t - 0x84));
-}
+    ResourceTables r{};
 
-//init all the luts
-void InitResources(float sample_rate)
-{
     // lut_ulaw
     for(int i = 0; i < LUT_ULAW_SIZE; i++)
     {
-        lut_ulaw[i] = MuLaw2Lin(i);
+        r.ulaw[i] = MuLaw2Lin(i);
     }
 
     // lut_pitch_ratio_high + lut_pitch_ratio_low
     for(int i = 0; i < LUT_PITCH_RATIO_HIGH_SIZE; i++)
     {
-        float ratio             = (float)i - 128.f;
-        ratio                   = powf(2.f, ratio / 12.f);
-        float semitone          = powf(2.f, (float)i / 256.0 / 12.0);
-        lut_pitch_ratio_high[i] = ratio;
-        lut_pitch_ratio_low[i]  = semitone;
+        float ratio = (float)i - 128.f;
+        ratio       = __builtin_powf(2.f, ratio / 12.f);
+        float semitone = __builtin_powf(2.f, (float)i / 256.0 / 12.0);
+        r.pitch_ratio_high[i] = ratio;
+        r.pitch_ratio_low[i]  = semitone;
     }
 
     // atan_lut
-    for(size_t i = 0; i < ATAN_LUT_SIZE; ++i)
+    for(int i = 0; i < ATAN_LUT_SIZE; ++i)
     {
-        atan_lut[i] = 65536.0 / (2 * PI_F) * asinf(i / 512.0f);
+        r.atan[i] = 65536.0 / (2 * PI_F) * __builtin_asinf(i / 512.0f);
     }
 
     // lut_sin
     for(int i = 0; i < LUT_SIN_SIZE; i++)
     {
-        float t    = (float)i / 1024.f * TWOPI_F;
-        lut_sin[i] = sin(t);
+        float t  = (float)i / 1024.f * TWOPI_F;
+        r.sin[i] = __builtin_sin(t);
     }
 
     // lut_window
     for(int i = 0; i < LUT_WINDOW_SIZE; i++)
     {
-        float t       = (float)i / (float)LUT_WINDOW_SIZE;
-        lut_window[i] = 1.f - ((cos(t * PI_F) + 1.f) * .5f);
+        float t     = (float)i / (float)LUT_WINDOW_SIZE;
+        r.window[i] = 1.f - ((__builtin_cos(t * PI_F) + 1.f) * .5f);
     }
 
     // lut_xfade_in + lut_xfade_out
@@ -126,39 +158,101 @@ void InitResources(float sample_rate)
     {
         float t = i / (float)(LUT_XFADE_IN_SIZE - 1);
         t       = 1.04 * t - 0.02f;
-        t       = fclamp(t, 0.f, 1.f);
+        t       = Clamp(t, 0.f, 1.f);
         t *= PI_F / 2.f;
 
-        float two_neg_half = powf(2, -.5f);
-        lut_xfade_in[i]    = sin(t) * two_neg_half;
-        lut_xfade_out[i]   = cos(t) * two_neg_half;
+        float two_neg_half = __builtin_powf(2, -.5f);
+        r.xfade_in[i]      = __builtin_sin(t) * two_neg_half;
+        r.xfade_out[i]     = __builtin_cos(t) * two_neg_half;
     }
 
     // lut_sine_window_4096
     for(int i = 0; i < LUT_SINE_WINDOW_4096_SIZE; i++)
     {
         float t = (float)i / (float)LUT_SINE_WINDOW_4096_SIZE;
-        //float sine = sin(PI_F * t);
-        //float raised = (0.5f * cos(PI_F * t * 2.f) + 0.5f) * sqrt(4.f / 3.f);
-
-        lut_sine_window_4096[i] = powf(1.f - powf((2.f * t - 1.f), 2.f), 1.25f);
+        r.sine_window_4096[i]
+            = __builtin_powf(1.f - __builtin_powf((2.f * t - 1.f), 2.f), 1.25f);
     }
 
-    float compensation[LUT_SINE_WINDOW_4096_SIZE];
-    sum_window(lut_sine_window_4096, 2, compensation);
+    float compensation[LUT_SINE_WINDOW_4096_SIZE] = {};
+    SumWindow(r.sine_window_4096, 2, compensation);
 
     for(int i = 0; i < LUT_SINE_WINDOW_4096_SIZE; i++)
     {
-        compensation[i] = powf(compensation[i], .5f);
-        lut_sine_window_4096[i] /= compensation[i];
+        compensation[i] = __builtin_powf(compensation[i], .5f);
+        r.sine_window_4096[i] /= compensation[i];
+    }
+    return r;
+}
+
+// lut_grain_size: 1024 to 16384 samples at 32kHz, scaled so that grain
+// durations do not depend on the sample rate.
+constexpr float GrainSize(int i, float sample_rate)
+{
+    float grain_scale = sample_rate / 32000.0f;
+    float size        = ((float)i / (float)LUT_GRAIN_SIZE_SIZE) * 4.f;
+    return __builtin_floorf(1024.f * __builtin_powf(2, size) * grain_scale);
+}
+
+constexpr GrainSizeTable MakeGrainSizeTable(float sample_rate)
+{
+    GrainSizeTable g{};
+    g.sample_rate = sample_rate;
+    for(int i = 0; i < LUT_GRAIN_SIZE_SIZE; i++)
+    {
+        g.values[i] = GrainSize(i, sample_rate);
     }
+    return g;
+}
+
+constexpr ResourceTables kResourceTables = MakeResourceTables();
 
-    // lut_grain_size
+constexpr GrainSizeTable kGrainSizeTables[] = {
+    MakeGrainSizeTable(32000.0f),
+    MakeGrainSizeTable(48000.0f),
+    MakeGrainSizeTable(96000.0f),
+};
+
+// A destination one entry longer gets a guard entry: a copy of the last.
+template <typename T, size_t N, size_t M>
+void CopyTable(T (&destination)[M], const T (&source)[N])
+{
+    static_assert(M == N || M == N + 1, "table sizes differ");
+    std::copy(&source[0], &source[N], &destination[0]);
+    if(M > N)
+    {
+        destination[M - 1] = source[N - 1];
+    }
+}
+} // namespace
+
+//init all the luts
+void InitResources(float sample_rate)
+{
+    const ResourceTables& r = kResourceTables;
+    CopyTable(lut_ulaw, r.ulaw);
+    CopyTable(lut_pitch_ratio_high, r.pitch_ratio_high);
+    CopyTable(lut_pitch_ratio_low, r.pitch_ratio_low);
+    CopyTable(atan_lut, r.atan);
+    CopyTable(lut_sin, r.sin);
+    CopyTable(lut_window, r.window);
+    CopyTable(lut_xfade_in, r.xfade_in);
+    CopyTable(lut_xfade_out, r.xfade_out);
+    CopyTable(lut_sine_window_4096, r.sine_window_4096);
+
+    for(const GrainSizeTable& table : kGrainSizeTables)
+    {
+        if(table.sample_rate == sample_rate)
+        {
+            CopyTable(lut_grain_size, table.values);
+            return;
+        }
+    }
     for(int i = 0; i < LUT_GRAIN_SIZE_SIZE; i++)
     {
-        float size        = ((float)i / (float)LUT_GRAIN_SIZE_SIZE) * 4.f;
-        lut_grain_size[i] = floor(1024.f * powf(2, size));
+        lut_grain_size[i] = GrainSize(i, sample_rate);
     }
+    lut_grain_size[LUT_GRAIN_SIZE_SIZE] = lut_grain_size[LUT_GRAIN_SIZE_SIZE - 1];
 }
 const float src_filter_1x_2_45[] = {
     -6.928606892e-04, -5.894682972e-03, 4.393903915e-04,  5.352009980e-03,
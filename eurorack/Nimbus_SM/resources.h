@@ -79,14 +79,20 @@ extern float    lut_pitch_ratio_high[LUT_PITCH_RATIO_HIGH_SIZE];
 extern float    lut_pitch_ratio_low[LUT_PITCH_RATIO_LOW_SIZE];
 extern uint16_t atan_lut[ATAN_LUT_SIZE];
 
+// The tables Interpolate() reads across their whole range have a guard
+// entry, a copy of the last: at an index of exactly 1, it reads one entry
+// past the end (with a zero weight).
 extern float       lut_sin[LUT_SIN_SIZE];
 extern const float src_filter_1x_2_45[SRC_FILTER_1X_2_45_SIZE];
-extern float       lut_window[LUT_WINDOW_SIZE];
-extern float       lut_xfade_in[LUT_XFADE_IN_SIZE];
-extern float       lut_xfade_out[LUT_XFADE_OUT_SIZE];
+extern float       lut_window[LUT_WINDOW_SIZE + 1];
+extern float       lut_xfade_in[LUT_XFADE_IN_SIZE + 1];
+extern float       lut_xfade_out[LUT_XFADE_OUT_SIZE + 1];
 extern float       lut_sine_window_4096[LUT_SINE_WINDOW_4096_SIZE];
-extern float       lut_grain_size[LUT_GRAIN_SIZE_SIZE];
+extern float       lut_grain_size[LUT_GRAIN_SIZE_SIZE + 1];
 
+// The only writer of the tables above: call it while no processor runs.
+// The DSP code only reads them, so any number of processors (on any number
+// of threads) can then share one set, all at that sample rate.
 void InitResources(float sample_rate);
 
 #endif // CLOUDS_RESOURCES_H_
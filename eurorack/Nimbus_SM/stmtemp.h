@@ -1,3 +1,6 @@
+#ifndef CLOUDS_STMTEMP_H_
+#define CLOUDS_STMTEMP_H_
+
 #include "daisy.h"
 #include "daisysp.h"
 #include "resources.h"
@@ -206,4 +209,6 @@ static inline uint16_t fast_atan2r(float y, float x, float* r)
         angle = -angle;
     }
     return angle + (quadrant << 14);
-}
\ No newline at end of file
+}
+
+#endif // CLOUDS_STMTEMP_H_
@@ -2,9 +2,13 @@
 #ifndef __DSY_LOGGER_H__
 #define __DSY_LOGGER_H__
 
+#include <atomic>
 #include <cmath>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include "logger_impl.h"
 
 namespace daisy
@@ -180,6 +184,557 @@ class Logger<LOGGER_NONE>
     static void PrintLineV(const char* format, va_list va) {} /**<  */
 };
 
+/** @brief Deferred-formatting logger, safe to call from interrupts
+ *
+ *  Print() and PrintLine() only store the format string pointer and the
+ *  raw argument words in a lock-free ring: no formatting and no USB access
+ *  on the caller's side, a few dozen cycles per call from any context.
+ *  Drain(), called from the main loop when there is time, formats the
+ *  queued messages and hands them to the same transport as Logger.
+ *
+ *  Because formatting is deferred:
+ *  - the format string and any %s argument must outlive the call
+ *    (string literals, static buffers)
+ *  - at most kMaxArgs arguments per message; %n is ignored
+ *  - messages logged while the ring is full are dropped and counted
+ *
+ *  Example:
+ *  @code
+ *  using Log = AsyncLogger<LOGGER_INTERNAL>;
+ *  Log::StartLog();
+ *  // audio callback
+ *  Log::PrintLine("late block %u, load %d%%", block, load);
+ *  // main loop
+ *  Log::Drain();
+ *  @endcode
+ */
+template <LoggerDestination dest = LOGGER_INTERNAL, size_t capacity = 32>
+class AsyncLogger
+{
+  public:
+    /** Maximum number of arguments per message
+     */
+    static constexpr size_t kMaxArgs = 6;
+
+    /** Object constructor
+     */
+    AsyncLogger() {}
+
+    /**  Start the logging session, as Logger::StartLog()
+     * \param wait_for_pc block until remote terminal is ready
+     */
+    static void StartLog(bool wait_for_pc = false)
+    {
+        Logger<dest>::StartLog(wait_for_pc);
+    }
+
+    /** Queue a formatted string. Safe from any context.
+     * \return false if the ring was full and the message was dropped
+     */
+    template <typename... Args>
+    static bool Print(const char* format, Args... args)
+    {
+        return Push(format, false, args...);
+    }
+
+    /** Queue a formatted string, to be followed by the line termination
+     *  sequence. Safe from any context.
+     * \return false if the ring was full and the message was dropped
+     */
+    template <typename... Args>
+    static bool PrintLine(const char* format, Args... args)
+    {
+        return Push(format, true, args...);
+    }
+
+    /** Format queued messages and transmit them. Call from the main loop.
+     *  Never blocks: while the transport is busy, the formatted text is
+     *  kept and retried on the next call.
+     * \return number of messages taken from the ring
+     */
+    static size_t Drain();
+
+    /** Messages dropped because the ring was full
+     */
+    static uint32_t GetDroppedCount()
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /** Messages cut short because they did not fit LOGGER_BUFFER
+     */
+    static uint32_t GetTruncatedCount() { return truncated_; }
+
+    /** Format a message from argument words as stored by Print().
+     *  Same contract as snprintf: at most size - 1 characters are written,
+     *  followed by a terminator, and the untruncated length is returned.
+     */
+    static size_t Format(char*           out,
+                         size_t          size,
+                         const char*     format,
+                         const uint64_t* args,
+                         size_t          num_args);
+
+  protected:
+    static_assert((capacity & (capacity - 1)) == 0,
+                  "AsyncLogger capacity must be a power of two");
+
+    /** A queued message
+     */
+    struct Entry
+    {
+        std::atomic<bool> ready;
+        bool              newline;
+        uint8_t           num_args;
+        const char*       format;
+        uint64_t          args[kMaxArgs];
+    };
+
+    /** Length modifiers of a conversion specification
+     */
+    enum LengthModifier
+    {
+        LENGTH_NONE,
+        LENGTH_HH,
+        LENGTH_H,
+        LENGTH_L,
+        LENGTH_LL,
+        LENGTH_J,
+        LENGTH_Z,
+        LENGTH_T,
+    };
+
+    template <typename... Args>
+    static bool Push(const char* format, bool newline, Args... args)
+    {
+        static_assert(sizeof...(Args) <= kMaxArgs,
+                      "Too many arguments for AsyncLogger");
+
+        /** reserve a slot; an interrupt may preempt us and take the next */
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        do
+        {
+            if(head - tail_.load(std::memory_order_acquire) >= capacity)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while(!head_.compare_exchange_weak(head,
+                                             head + 1,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed));
+
+        Entry& entry   = entries_[head & (capacity - 1)];
+        entry.format   = format;
+        entry.newline  = newline;
+        entry.num_args = sizeof...(Args);
+        StoreArgs(entry.args, args...);
+        entry.ready.store(true, std::memory_order_release);
+        return true;
+    }
+
+    /** Arguments are stored as 64-bit words: integers sign- or zero-extended
+     *  as their type dictates, floating point as double, pointers as
+     *  addresses. Format() narrows them back following the specification.
+     */
+    static void StoreArgs(uint64_t*) {}
+
+    template <typename T, typename... Rest>
+    static void StoreArgs(uint64_t* words, T first, Rest... rest)
+    {
+        *words = ToWord(first);
+        StoreArgs(words + 1, rest...);
+    }
+
+    static uint64_t ToWord(double value)
+    {
+        uint64_t word;
+        memcpy(&word, &value, sizeof(word));
+        return word;
+    }
+    static uint64_t ToWord(float value)
+    {
+        return ToWord(static_cast<double>(value));
+    }
+    static uint64_t ToWord(long double value)
+    {
+        return ToWord(static_cast<double>(value));
+    }
+    template <typename T>
+    static uint64_t ToWord(T* value)
+    {
+        return reinterpret_cast<uintptr_t>(value);
+    }
+    template <typename T>
+    static uint64_t ToWord(T value)
+    {
+        return static_cast<uint64_t>(value);
+    }
+
+    /** Format an entry into the transmit buffer, appending the line
+     *  termination sequence if requested.
+     * \return false if the message did not fit
+     */
+    static bool FormatEntry(char* out, size_t size, const Entry& entry, size_t* length);
+
+    static long long ToSigned(uint64_t word, LengthModifier modifier);
+    static unsigned long long ToUnsigned(uint64_t word,
+                                         LengthModifier modifier);
+
+    /** member variables
+     */
+    static Entry                 entries_[capacity];
+    static std::atomic<uint32_t> head_;
+    static std::atomic<uint32_t> tail_;
+    static std::atomic<uint32_t> dropped_;
+    static uint32_t              truncated_;
+
+    /** the transport may still be sending one buffer while the next batch
+     *  is formatted into the other
+     */
+    static char    tx_buff_[2][LOGGER_BUFFER];
+    static size_t  tx_ptr_;   /**< pending bytes in the current buffer */
+    static uint8_t tx_index_; /**< current buffer */
+};
+
+template <LoggerDestination dest, size_t capacity>
+size_t AsyncLogger<dest, capacity>::Drain()
+{
+    size_t drained = 0;
+    if(tx_ptr_ == 0)
+    {
+        char*    buff = tx_buff_[tx_index_];
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        while(tail != head_.load(std::memory_order_acquire))
+        {
+            Entry& entry = entries_[tail & (capacity - 1)];
+            /** stop at a message an interrupted context is still writing */
+            if(!entry.ready.load(std::memory_order_acquire))
+            {
+                break;
+            }
+
+            size_t length;
+            if(!FormatEntry(
+                   buff + tx_ptr_, LOGGER_BUFFER - tx_ptr_, entry, &length))
+            {
+                if(tx_ptr_ > 0)
+                {
+                    /** send what we have, retry from an empty buffer */
+                    break;
+                }
+                /** indicate truncation with "$$", as Logger does */
+                buff[LOGGER_BUFFER - 1] = '$';
+                buff[LOGGER_BUFFER - 2] = '$';
+                length                  = LOGGER_BUFFER;
+                truncated_++;
+            }
+            tx_ptr_ += length;
+            entry.ready.store(false, std::memory_order_relaxed);
+            tail_.store(++tail, std::memory_order_release);
+            drained++;
+        }
+    }
+
+    if(tx_ptr_ > 0
+       && LoggerImpl<dest>::Transmit(tx_buff_[tx_index_], tx_ptr_))
+    {
+        tx_ptr_ = 0;
+        tx_index_ ^= 1;
+    }
+    return drained;
+}
+
+template <LoggerDestination dest, size_t capacity>
+bool AsyncLogger<dest, capacity>::FormatEntry(char*        out,
+                                              size_t       size,
+                                              const Entry& entry,
+                                              size_t*      length)
+{
+    size_t n = Format(out, size, entry.format, entry.args, entry.num_args);
+    if(entry.newline && n < size)
+    {
+        /*  trim existing control characters */
+        while(n > 0 && (out[n - 1] == '\n' || out[n - 1] == '\r'))
+        {
+            n--;
+        }
+        for(const char* nl = LOGGER_NEWLINE; *nl != '\0'; nl++, n++)
+        {
+            if(n < size)
+            {
+                out[n] = *nl;
+            }
+        }
+    }
+    *length = n;
+    return n < size;
+}
+
+template <LoggerDestination dest, size_t capacity>
+long long AsyncLogger<dest, capacity>::ToSigned(uint64_t       word,
+                                                LengthModifier modifier)
+{
+    switch(modifier)
+    {
+        case LENGTH_HH: return static_cast<signed char>(word);
+        case LENGTH_H: return static_cast<short>(word);
+        case LENGTH_L: return static_cast<long>(word);
+        case LENGTH_LL:
+        case LENGTH_J: return static_cast<long long>(word);
+        case LENGTH_Z:
+        case LENGTH_T: return static_cast<ptrdiff_t>(word);
+        default: return static_cast<int>(word);
+    }
+}
+
+template <LoggerDestination dest, size_t capacity>
+unsigned long long
+AsyncLogger<dest, capacity>::ToUnsigned(uint64_t word, LengthModifier modifier)
+{
+    switch(modifier)
+    {
+        case LENGTH_HH: return static_cast<unsigned char>(word);
+        case LENGTH_H: return static_cast<unsigned short>(word);
+        case LENGTH_L: return static_cast<unsigned long>(word);
+        case LENGTH_LL:
+        case LENGTH_J: return static_cast<unsigned long long>(word);
+        case LENGTH_Z:
+        case LENGTH_T: return static_cast<size_t>(word);
+        default: return static_cast<unsigned int>(word);
+    }
+}
+
+template <LoggerDestination dest, size_t capacity>
+size_t AsyncLogger<dest, capacity>::Format(char*           out,
+                                           size_t          size,
+                                           const char*     format,
+                                           const uint64_t* args,
+                                           size_t          num_args)
+{
+    size_t length = 0;
+    size_t arg    = 0;
+    while(*format != '\0')
+    {
+        if(*format != '%' || format[1] == '%')
+        {
+            if(length + 1 < size)
+            {
+                out[length] = *format;
+            }
+            length++;
+            format += *format == '%' ? 2 : 1;
+            continue;
+        }
+
+        /** copy flags, width and precision, resolving '*' from the
+         *  argument words
+         */
+        char   spec[48];
+        size_t s  = 0;
+        spec[s++] = *format++;
+        while(*format != '\0' && strchr("-+ #0", *format) != nullptr
+              && s < 8)
+        {
+            spec[s++] = *format++;
+        }
+        for(int field = 0; field < 2; field++)
+        {
+            if(field == 1)
+            {
+                if(*format != '.')
+                {
+                    break;
+                }
+                spec[s++] = *format++;
+            }
+            if(*format == '*')
+            {
+                int value = arg < num_args ? static_cast<int>(args[arg++]) : 0;
+                format++;
+                if(field == 1 && value < 0)
+                {
+                    /** a negative precision is taken as if omitted */
+                    s--;
+                    continue;
+                }
+                s += snprintf(spec + s, 12, "%d", value);
+            }
+            while(*format >= '0' && *format <= '9' && s < 20)
+            {
+                spec[s++] = *format++;
+            }
+        }
+
+        LengthModifier modifier = LENGTH_NONE;
+        switch(*format)
+        {
+            case 'h':
+                modifier = format[1] == 'h' ? LENGTH_HH : LENGTH_H;
+                format += modifier == LENGTH_HH ? 2 : 1;
+                break;
+            case 'l':
+                modifier = format[1] == 'l' ? LENGTH_LL : LENGTH_L;
+                format += modifier == LENGTH_LL ? 2 : 1;
+                break;
+            case 'q': modifier = LENGTH_LL, format++; break;
+            case 'j': modifier = LENGTH_J, format++; break;
+            case 'z': modifier = LENGTH_Z, format++; break;
+            case 't': modifier = LENGTH_T, format++; break;
+            case 'L': format++; break; /**< long double is stored as double */
+            default: break;
+        }
+
+        const char conversion = *format;
+        if(conversion == '\0')
+        {
+            break;
+        }
+        format++;
+
+        /** values that fit a long are printed with "l" rather than "ll",
+         *  which newlib-nano's printf lacks
+         */
+        const bool wide = modifier == LENGTH_LL || modifier == LENGTH_J;
+        if(strchr("diouxX", conversion) != nullptr)
+        {
+            spec[s++] = 'l';
+            if(wide)
+            {
+                spec[s++] = 'l';
+            }
+        }
+        spec[s++] = conversion;
+        spec[s]   = '\0';
+
+        const uint64_t word = arg < num_args ? args[arg++] : 0;
+        char*          dst  = length < size ? out + length : nullptr;
+        const size_t   room = length < size ? size - length : 0;
+        int            n    = 0;
+        switch(conversion)
+        {
+            case 'd':
+            case 'i':
+                n = wide ? snprintf(dst, room, spec, ToSigned(word, modifier))
+                         : snprintf(dst,
+                                    room,
+                                    spec,
+                                    static_cast<long>(ToSigned(word, modifier)));
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                n = wide ? snprintf(dst, room, spec, ToUnsigned(word, modifier))
+                         : snprintf(dst,
+                                    room,
+                                    spec,
+                                    static_cast<unsigned long>(
+                                        ToUnsigned(word, modifier)));
+                break;
+            case 'c':
+                n = snprintf(dst, room, spec, static_cast<int>(word));
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+            {
+                double value;
+                memcpy(&value, &word, sizeof(value));
+                n = snprintf(dst, room, spec, value);
+                break;
+            }
+            case 's':
+            {
+                const char* str
+                    = reinterpret_cast<const char*>(static_cast<uintptr_t>(word));
+                n = snprintf(dst, room, spec, str ? str : "(null)");
+                break;
+            }
+            case 'p':
+                n = snprintf(dst,
+                             room,
+                             spec,
+                             reinterpret_cast<void*>(static_cast<uintptr_t>(word)));
+                break;
+            case 'n': break;
+            default:
+                /** unknown conversion: print the specification as is */
+                n = snprintf(dst, room, "%s", spec);
+                break;
+        }
+        if(n > 0)
+        {
+            length += n;
+        }
+    }
+
+    if(size > 0)
+    {
+        out[length < size ? length : size - 1] = '\0';
+    }
+    return length;
+}
+
+/** @addtogroup logger_statics LoggerStaticMembers
+ *  @{
+ */
+
+template <LoggerDestination dest, size_t capacity>
+typename AsyncLogger<dest, capacity>::Entry
+    AsyncLogger<dest, capacity>::entries_[capacity];
+
+template <LoggerDestination dest, size_t capacity>
+std::atomic<uint32_t> AsyncLogger<dest, capacity>::head_(0);
+
+template <LoggerDestination dest, size_t capacity>
+std::atomic<uint32_t> AsyncLogger<dest, capacity>::tail_(0);
+
+template <LoggerDestination dest, size_t capacity>
+std::atomic<uint32_t> AsyncLogger<dest, capacity>::dropped_(0);
+
+template <LoggerDestination dest, size_t capacity>
+uint32_t AsyncLogger<dest, capacity>::truncated_ = 0;
+
+template <LoggerDestination dest, size_t capacity>
+char AsyncLogger<dest, capacity>::tx_buff_[2][LOGGER_BUFFER];
+
+template <LoggerDestination dest, size_t capacity>
+size_t AsyncLogger<dest, capacity>::tx_ptr_ = 0;
+
+template <LoggerDestination dest, size_t capacity>
+uint8_t AsyncLogger<dest, capacity>::tx_index_ = 0;
+
+/** @} */ // end logger_statics
+
+/** Specialization for a muted async log
+ */
+template <size_t capacity>
+class AsyncLogger<LOGGER_NONE, capacity>
+{
+  public:
+    AsyncLogger() {}                                  /**<  */
+    static void StartLog(bool wait_for_pc = false) {} /**<  */
+    template <typename... Args>
+    static bool Print(const char* format, Args... args) /**<  */
+    {
+        return true;
+    }
+    template <typename... Args>
+    static bool PrintLine(const char* format, Args... args) /**<  */
+    {
+        return true;
+    }
+    static size_t   Drain() { return 0; }             /**<  */
+    static uint32_t GetDroppedCount() { return 0; }   /**<  */
+    static uint32_t GetTruncatedCount() { return 0; } /**<  */
+};
+
 /** @} */
 } // namespace daisy
 
@@ -55,6 +55,7 @@ class CpuLoadMeter
         const auto ticksPassed = end - currentBlockStartTicks_;
         const auto currentBlockLoad
             = float(ticksPassed) * ticksPerBlockInv_; // usPassed / usPerBlock
+        last_ = currentBlockLoad;
 
         if(firstCycle_)
         {
@@ -73,6 +74,8 @@ class CpuLoadMeter
         }
     }
 
+    /** Returns the unsmoothed CPU load of the last block in the range 0..1 */
+    float GetLastCpuLoad() const { return last_; }
     /** Returns the smoothed average CPU load in the range 0..1 */
     float GetAvgCpuLoad() const { return avg_; }
     /** Returns the minimun CPU load observed since the last call to Reset(). */
@@ -85,6 +88,7 @@ class CpuLoadMeter
     {
         firstCycle_ = true;
         avg_ = max_ = min_ = NAN;
+        last_ = 0.0f;
     }
 
   private:
@@ -94,6 +98,7 @@ class CpuLoadMeter
     float    min_;
     float    max_;
     float    avg_;
+    float    last_;
     float    smoothingConstant_;
 
     CpuLoadMeter(const CpuLoadMeter&) = delete;
@@ -1,14 +1,18 @@
 #include "Kymatikos.h"
 #include "Arpeggiator.h"
 #include "SynthStateStorage.h"
+#include "SdCardSink.h"
 #include "AudioConfig.h"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "hid/logger.h"
 
 // --- Manager Includes ---
 #include "HardwareManager.h"
 #include "ControlsManager.h"
 #include "AudioEngine.h"
+#include "BootProfiler.h"
 
 // --- Namespace imports (local to this implementation file) ---
 using namespace daisy;
@@ -18,10 +22,22 @@ using namespace daisysp;
 HardwareManager g_hardware;
 ControlsManager g_controls;
 AudioEngine g_audio_engine;
+Telemetry g_telemetry;
+TaskScheduler g_scheduler;
+
+// WAV recordings go straight to the SD card
+static SdCardSink g_sd_sink;
+
+// Init step timings, printed once audio runs
+static BootProfiler g_boot_profiler;
 
 // Simple diagnostic blink: flashes the Daisy user LED 'count' times rapidly.
+// Skipped with FAST_BOOT: each blink costs 120 ms of boot time.
 static void DebugBlink(int count)
 {
+    if (FAST_BOOT) {
+        return;
+    }
     for(int i = 0; i < count; ++i)
     {
         g_hardware.GetHardware().SetLed(true);
@@ -31,6 +47,14 @@ static void DebugBlink(int count)
     }
 }
 
+static SynthSettings CurrentSettings() {
+    SynthSettings settings = {};
+    settings.engine_index = g_controls.GetCurrentEngineIndex();
+    settings.sample_rate = g_hardware.GetSampleRate();
+    settings.arp_enabled = g_controls.IsArpEnabled() ? 1 : 0;
+    return settings;
+}
+
 // --- Application-Specific Initialization ---
 // This handles initialization that is specific to the Kymatikos application,
 // NOT hardware configuration (which is handled by HardwareManager).
@@ -46,37 +70,103 @@ static void InitializeApplication() {
 }
 
 void InitializeSynth() {
+    g_boot_profiler.Start();
+
     // Application-specific initialization (QSPI, VTOR)
     InitializeApplication();
+    g_boot_profiler.Mark("qspi");
 
     // Bring up USB logging before hardware init so early prints are visible.
     // Hardware initialization (Patch SM platform, ADCs, touch sensor, LEDs, CPU meter)
     g_hardware.Init();
+    g_boot_profiler.Mark("hardware");
     DebugBlink(1);
 
+    // Settings saved by AutosaveState(); the sample rate is applied before
+    // anything is initialised with it
+    SynthStateStorage::Init();
+    SynthSettings saved_settings;
+    const bool have_settings = SynthStateStorage::LoadSettings(saved_settings);
+    if (have_settings) {
+        g_hardware.SetSampleRate(saved_settings.sample_rate);
+    }
+    g_boot_profiler.Mark("settings");
+
     // Controls initialization (arpeggiator and control state)
     g_controls.Init(g_hardware.GetSampleRate());
+    ControlsManager::ControlSnapshot saved_controls;
+    if (SynthStateStorage::LoadControls(saved_controls)) {
+        // Used by the first blocks, until the controls task reads the knobs
+        g_controls.UpdateControlSnapshot(saved_controls);
+    }
+    g_boot_profiler.Mark("controls");
     DebugBlink(2);
 
     // Audio engine initialization (Clouds processor only)
     g_audio_engine.Init(&g_hardware.GetHardware());
+    g_boot_profiler.Mark("audio eng");
+
+    // Saved recording buffers; loading one is hidden behind the output fade
+    SampleMemory::Config sample_memory_config;
+    sample_memory_config.Defaults();
+    sample_memory_config.mute = SetAudioMuted;
+    sample_memory_config.muted = IsAudioMuted;
+    g_audio_engine.GetSampleMemory().Init(sample_memory_config, &g_audio_engine.GetCloudsProcessor());
+    g_boot_profiler.Mark("samples");
+
+    // Dry L/R, wet L/R, pitch and pressure CV; the card is mounted on the
+    // first recording
+    WavRecorder::Config recorder_config;
+    recorder_config.Defaults();
+    recorder_config.ring = g_audio_engine.GetRecorderRing();
+    recorder_config.ring_size = AudioEngine::RECORDER_RING_SIZE;
+    recorder_config.num_channels = kRecorderChannels;
+    recorder_config.now_us = [] { return g_scheduler.NowUs(); };
+    g_audio_engine.GetRecorder().Init(recorder_config, g_sd_sink.GetSink());
+    g_boot_profiler.Mark("recorder");
     DebugBlink(3);
 
-    // MPR touch pad to LED index mapping
-    static const int kMprToLed[12] = {9, 8, 7, 6, 3, 4, 5, 2, 1, 0, 10, 11};
-    g_controls.GetArpeggiator().SetNoteTriggerCallback([&](int pad_idx){
-        g_controls.SetArpLEDTimestamp(kMprToLed[pad_idx], g_hardware.GetHardware().system.GetNow());
-        RequestArpGatePulse();
-        g_hardware.SetPitchCvVoltage(PadIndexToVoltage(pad_idx));
-    });
+    // Pitch/pressure CV rendered at the DAC rate, mapped through the maqam
+    // scale (pad 6 is 2.5 V, one octave down)
+    CvOutputEngine::Config cv_config;
+    cv_config.Defaults();
+    cv_config.scale = kArabicMaqamScale;
+    cv_config.scale_size = 12;
+    cv_config.center_degree = 6;
+    cv_config.offset = -12.0f;
+    cv_config.base_voltage = 2.5f;
+    g_hardware.GetCvOutput().Init(cv_config);
+    g_hardware.GetCvOutput().Start(g_hardware.GetHardware());
+    g_boot_profiler.Mark("cv out");
+
+    // Arpeggiator notes reach the LEDs, gate and pitch CV through the output
+    // event queue, drained by DispatchOutputEvents() in the main loop
     DebugBlink(4);
 
     g_controls.SetArpEnabled(false);
+    if (have_settings) {
+        g_controls.SetCurrentEngineIndex(saved_settings.engine_index);
+        if (saved_settings.arp_enabled) {
+            g_controls.GetArpeggiator().Init(g_hardware.GetSampleRate());
+            g_controls.GetArpeggiator().SetDirection(Arpeggiator::AsPlayed);
+            g_controls.SetArpEnabled(true);
+        }
+    }
+    g_boot_profiler.Mark("arp");
 
     g_hardware.GetHardware().StartLog(false); // Start log immediately (non-blocking)
+    // Binary status records share the logger's CDC port
+    g_telemetry.Init();
+    g_boot_profiler.Mark("log");
     DebugBlink(5);
 
+    // The buffers have been zeroing in the background since the audio engine
+    // init
+    g_audio_engine.FinishInit();
+    g_boot_profiler.Mark("sdram");
+
     g_hardware.GetHardware().StartAudio(AudioCallback);
+    g_boot_profiler.Mark("audio");
     DebugBlink(6);
 
     g_hardware.GetHardware().PrintLine("Clouds Granular Processor - Ready");
@@ -85,6 +175,13 @@ void InitializeSynth() {
     g_hardware.GetHardware().PrintLine(settings);
     g_hardware.GetHardware().PrintLine("Keyboard-Controlled Granular Synthesis");
     g_hardware.GetHardware().PrintLine("----------------");
+
+    for (int i = 0; i < g_boot_profiler.GetNumSteps(); ++i) {
+        g_hardware.GetHardware().PrintLine("Boot: %-10s %7u us", g_boot_profiler.GetStepName(i),
+                                           static_cast<unsigned>(g_boot_profiler.GetStepUs(i)));
+    }
+    g_hardware.GetHardware().PrintLine("Boot: audio after %u us",
+                                       static_cast<unsigned>(g_boot_profiler.GetTotalUs()));
 }
 
 // --- User Interface Functions ---
@@ -136,6 +233,56 @@ void UpdateLED() {
     }
 }
 
+void AutosaveState() {
+    // Settings are saved on change. The controls are saved once they have
+    // been still for a couple of calls, and only when moved by more than
+    // ADC noise, so that the flash is not written continuously.
+    constexpr float kThreshold = 0.01f;
+    constexpr int kSettleCalls = 2;
+    static bool initialised = false;
+    static SynthSettings saved_settings;
+    static ControlsManager::ControlSnapshot saved_controls;
+    static ControlsManager::ControlSnapshot previous_controls;
+    static int still_calls = 0;
+
+    const SynthSettings settings = CurrentSettings();
+    const ControlsManager::ControlSnapshot controls = g_controls.GetLatestControlSnapshot();
+    if (!initialised) {
+        initialised = true;
+        if (!SynthStateStorage::LoadSettings(saved_settings)) {
+            saved_settings = settings;
+            SynthStateStorage::SaveSettings(settings);
+        }
+        if (!SynthStateStorage::LoadControls(saved_controls)) {
+            saved_controls = controls;
+        }
+        previous_controls = controls;
+        return;
+    }
+
+    if (memcmp(&settings, &saved_settings, sizeof(settings)) != 0
+        && SynthStateStorage::SaveSettings(settings)) {
+        saved_settings = settings;
+    }
+
+    // The snapshot is all floats
+    const float* now = reinterpret_cast<const float*>(&controls);
+    const float* previous = reinterpret_cast<const float*>(&previous_controls);
+    const float* saved = reinterpret_cast<const float*>(&saved_controls);
+    const size_t count = sizeof(controls) / sizeof(float);
+    bool moving = false;
+    bool changed = false;
+    for (size_t i = 0; i < count; ++i) {
+        moving |= fabsf(now[i] - previous[i]) > kThreshold;
+        changed |= fabsf(now[i] - saved[i]) > kThreshold;
+    }
+    previous_controls = controls;
+    still_calls = moving ? 0 : still_calls + 1;
+    if (changed && still_calls >= kSettleCalls && SynthStateStorage::SaveControls(controls)) {
+        saved_controls = controls;
+    }
+}
+
 void UpdateArpeggiatorToggle() {
     constexpr float kThreshOn  = 0.30f;
     constexpr float kThreshOff = 0.20f;
@@ -155,6 +302,187 @@ void UpdateArpeggiatorToggle() {
     }
 }
 
+// Rate a change is fading out to, 0 when none
+static float g_pending_rate = 0.0f;
+static uint32_t g_fade_start = 0;
+
+bool ChangeSampleRate(float sample_rate) {
+    if (!HardwareManager::IsSupportedSampleRate(sample_rate)) {
+        return false;
+    }
+    if (g_pending_rate == 0.0f && sample_rate == g_hardware.GetSampleRate()) {
+        return true;
+    }
+    // A load's fade would be undone halfway through
+    if (g_audio_engine.GetSampleMemory().IsBusy()) {
+        AsyncLog::PrintLine("Sample rate: refused during a sample memory transfer");
+        return false;
+    }
+
+    // Fade out so that stopping the SAI does not click
+    if (g_pending_rate == 0.0f) {
+        SetAudioMuted(true);
+        g_fade_start = System::GetNow();
+    }
+    g_pending_rate = sample_rate;
+    return true;
+}
+
+void UpdateSampleRateChange() {
+    // The fade takes a few ms; it is polled rather than waited for, so that
+    // the other tasks run meanwhile
+    constexpr uint32_t kMaxFadeMs = 50;
+    if (g_pending_rate == 0.0f) {
+        return;
+    }
+    if (!IsAudioMuted() && System::GetNow() - g_fade_start < kMaxFadeMs) {
+        return;
+    }
+    auto& hw = g_hardware.GetHardware();
+
+    // The file being recorded keeps the rate it started with
+    g_audio_engine.GetRecorder().Stop();
+
+    // Nothing below may race with the audio callback
+    hw.StopAudio();
+    g_hardware.SetSampleRate(g_pending_rate);
+    const float new_rate = g_hardware.GetSampleRate();
+    g_audio_engine.SetSampleRate(new_rate);
+    g_controls.GetArpeggiator().SetSampleRate(new_rate);
+    hw.StartAudio(AudioCallback);
+    g_pending_rate = 0.0f;
+
+    SetAudioMuted(false);
+    AsyncLog::PrintLine("Sample rate: %d Hz", static_cast<int>(new_rate));
+}
+
+void UpdateSampleRateSelection() {
+    // Hold Prev + Next (without the arp pad, which would make it the
+    // bootloader combo) for ~1 s to step to the next sample rate
+    constexpr float kThreshOn  = 0.30f;
+    constexpr float kThreshOff = 0.20f;
+    constexpr uint16_t kHoldTicks = 1000; // ProcessControls runs at 1 kHz
+    static const float kRates[] = {32000.0f, 48000.0f, 96000.0f};
+    static uint16_t hold_cnt = 0;
+
+    bool held = g_hardware.GetPrevPad().Value() > kThreshOn &&
+                g_hardware.GetNextPad().Value() > kThreshOn &&
+                g_hardware.GetArpPad().Value() < kThreshOff;
+    if (!held) {
+        hold_cnt = 0;
+        return;
+    }
+    if (hold_cnt < kHoldTicks && ++hold_cnt == kHoldTicks) {
+        int next = 0;
+        for (int i = 0; i < 3; ++i) {
+            if (kRates[i] == g_hardware.GetSampleRate()) {
+                next = (i + 1) % 3;
+            }
+        }
+        ChangeSampleRate(kRates[next]);
+    }
+}
+
+void UpdateSampleMemory() {
+    // Hold Next alone for ~1 s to save the recording buffer, Prev alone to
+    // load it back (frozen). A shorter touch of either releases the freeze
+    constexpr float kThreshOn  = 0.30f;
+    constexpr uint16_t kHoldTicks = 1000; // ProcessControls runs at 1 kHz
+    static int held_pad = 0;              // 1: Prev, 2: Next
+    static uint16_t hold_cnt = 0;
+
+    const bool prev = g_hardware.GetPrevPad().Value() > kThreshOn;
+    const bool next = g_hardware.GetNextPad().Value() > kThreshOn;
+    const bool arp = g_hardware.GetArpPad().Value() > kThreshOn;
+    const int pad = prev != next && !arp ? (prev ? 1 : 2) : 0;
+    SampleMemory& sample_memory = g_audio_engine.GetSampleMemory();
+
+    // A key touched meanwhile makes it a snapshot bank gesture instead
+    if (pad != 0 && pad == held_pad && g_controls.GetCurrentTouchState() != 0) {
+        hold_cnt = kHoldTicks;
+    }
+    if (pad != held_pad) {
+        if (held_pad != 0 && pad == 0 && hold_cnt < kHoldTicks) {
+            sample_memory.ReleaseFreeze();
+        }
+        held_pad = pad;
+        hold_cnt = 0;
+        return;
+    }
+    if (pad != 0 && hold_cnt < kHoldTicks && ++hold_cnt == kHoldTicks) {
+        const bool started = pad == 2 ? sample_memory.Save() : sample_memory.Load();
+        AsyncLog::PrintLine(pad == 2 ? "Sample memory: save %s" : "Sample memory: load %s",
+                            started ? "started" : "refused");
+    }
+}
+
+void UpdateSnapshotBanks() {
+    // Touch one of the first keys while holding Next to capture the
+    // recording into that bank, while holding Prev to play the bank back
+    // (frozen). The key of the bank being played goes back to the live
+    // recording
+    constexpr float kThreshOn  = 0.30f;
+    static uint16_t last_touched = 0;
+    if (!SNAPSHOT_BANKS) {
+        return;
+    }
+    const uint16_t touched = g_controls.GetCurrentTouchState();
+    const uint16_t pressed = touched & ~last_touched;
+    last_touched = touched;
+
+    const bool prev = g_hardware.GetPrevPad().Value() > kThreshOn;
+    const bool next = g_hardware.GetNextPad().Value() > kThreshOn;
+    const bool arp = g_hardware.GetArpPad().Value() > kThreshOn;
+    if (prev == next || arp) {
+        return;
+    }
+    const GranularProcessorClouds& processor = g_audio_engine.GetCloudsProcessor();
+    for (int bank = 0; bank < kNumSnapshotBanks; ++bank) {
+        if (!(pressed & (1 << bank))) {
+            continue;
+        }
+        if (next) {
+            g_audio_engine.RequestSnapshotCapture(bank);
+            AsyncLog::PrintLine("Snapshot: capture bank %d", bank + 1);
+        } else if (processor.recalled_snapshot() == bank) {
+            g_audio_engine.RequestSnapshotRecall(-1);
+            AsyncLog::PrintLine("Snapshot: live");
+        } else if (processor.has_snapshot(bank)) {
+            g_audio_engine.RequestSnapshotRecall(bank);
+            AsyncLog::PrintLine("Snapshot: recall bank %d", bank + 1);
+        } else {
+            AsyncLog::PrintLine("Snapshot: bank %d is empty", bank + 1);
+        }
+    }
+}
+
+void UpdateRecorder() {
+    // A trigger on gate in 2 starts a new recording (KYM_0000.WAV,
+    // KYM_0001.WAV, ... skipping names already on the card) or stops it
+    constexpr int kMaxNameTries = 16;
+    static int next_take = 0;
+    if (!g_hardware.GetHardware().gate_in_2.Trig()) {
+        return;
+    }
+    WavRecorder& recorder = g_audio_engine.GetRecorder();
+    if (recorder.GetState() != WavRecorder::State::IDLE) {
+        recorder.Stop();
+        return;
+    }
+    char name[16];
+    for (int i = 0; i < kMaxNameTries; ++i) {
+        const int take = next_take;
+        snprintf(name, sizeof(name), "KYM_%04d.WAV", take);
+        next_take = (next_take + 1) % 10000;
+        if (recorder.Start(name, g_hardware.GetSampleRate())) {
+            // AsyncLog keeps %s arguments by pointer, and name is on the stack
+            AsyncLog::PrintLine("Recorder: KYM_%04d.WAV", take);
+            return;
+        }
+    }
+    AsyncLog::PrintLine("Recorder: no card or no free name");
+}
+
 void UpdateEngineSelection() {
     // TODO: repurpose for Clouds mode selection
 }
@@ -176,9 +504,24 @@ void ProcessControls() {
         g_controls.GetADCRawValues()[i] = hw.adc.GetFloat(i);
     }
 
+    // The same reads as a replayable trace; the touch frames complete it
+    if (INPUT_CAPTURE) {
+        TelemetryInputs inputs = {};
+        for (int i = 0; i < 12; ++i) {
+            inputs.adc[i] = *hw.adc.GetPtr(i);
+        }
+        inputs.gates = (hw.gate_in_1.State() ? 1 : 0) | (hw.gate_in_2.State() ? 2 : 0);
+        g_telemetry.Write(TELEMETRY_INPUTS, inputs);
+    }
+
     // Call the new engine selection function
     UpdateEngineSelection();
     UpdateArpeggiatorToggle(); // Call the new arp toggle function
+    UpdateSampleRateSelection();
+    UpdateSampleRateChange();
+    UpdateSampleMemory();
+    UpdateSnapshotBanks();
+    UpdateRecorder();
 }
 
 // Moved from AudioProcessor.cpp
@@ -1,5 +1,8 @@
 #include "Kymatikos.h"
+#include "AudioConfig.h"
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 
 // --- Namespace imports (local to this implementation file) ---
 using namespace daisy;
@@ -24,104 +27,177 @@ float PadIndexToVoltage(int pad_index)
 {
     if(pad_index < 0)
         return 0.0f;
-    constexpr int kCenterPad = 6;
-    constexpr float kBaseVoltage = 2.5f;
-    float pitch_offset = kArabicMaqamScale[pad_index] - kArabicMaqamScale[kCenterPad] - 12.0f;
-    return kBaseVoltage + (pitch_offset / 12.0f);
-}
-
-// Continuous version for sliding between pads
-static float PadPositionToVoltage(float pad_pos)
-{
-    pad_pos = daisysp::fclamp(pad_pos, 0.0f, 11.0f);
-    int i0 = static_cast<int>(pad_pos);
-    int i1 = std::min(i0 + 1, 11);
-    float frac = pad_pos - static_cast<float>(i0);
-    constexpr int kCenterPad = 6;
-    constexpr float kBaseVoltage = 2.5f;
-    float pitch0 = kArabicMaqamScale[i0] - kArabicMaqamScale[kCenterPad] - 12.0f;
-    float pitch1 = kArabicMaqamScale[i1] - kArabicMaqamScale[kCenterPad] - 12.0f;
-    float blended = pitch0 * (1.0f - frac) + pitch1 * frac;
-    return kBaseVoltage + (blended / 12.0f);
+    // Same maqam mapping as the CV output engine
+    return g_hardware.GetCvOutput().PadToVoltage(static_cast<float>(pad_index), true);
 }
 
 // Arp gate pulse deadline (ms since boot) for analog gate output
 static std::atomic<uint32_t> g_gate_deadline_ms{0};
 static constexpr uint32_t kGatePulseMs = 10;
 
-// Called from arp trigger callback to request a short gate pulse
+// Called from the main loop (touch and arp notes) to request a short gate pulse
 void RequestArpGatePulse() {
     uint32_t now = g_hardware.GetHardware().system.GetNow();
     g_gate_deadline_ms.store(now + kGatePulseMs, std::memory_order_relaxed);
     g_hardware.SetGateOut2(true);
 }
 
+// MPR touch pad to LED index mapping (used in multiple places)
+static const int kMprToLed[12] = {9, 8, 7, 6, 3, 4, 5, 2, 1, 0, 10, 11};
+
 // Volatile variables now managed by ControlsManager (see g_controls)
 
-void UpdateDisplay() {
-    if (g_controls.ShouldUpdateDisplay()) {
-        // Build stats message in a smaller buffer
-        char msg[512];
-        int pos = 0;
-
-        // cpu load average/max
-        float avg_cpu_load = g_hardware.GetCpuMeter().GetAvgCpuLoad();
-        int cpu_avg = static_cast<int>(avg_cpu_load * 100.0f);
-        cpu_avg = cpu_avg < 0 ? 0 : (cpu_avg > 100 ? 100 : cpu_avg);
-        float max_cpu_load = g_hardware.GetCpuMeter().GetMaxCpuLoad();
-        int cpu_max = static_cast<int>(max_cpu_load * 100.0f);
-        cpu_max = cpu_max < 0 ? 0 : (cpu_max > 100 ? 100 : cpu_max);
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "cpu : %d/%d\n", cpu_avg, cpu_max);
-
-        // Engine Info
-        int current_engine_idx = g_controls.GetCurrentEngineIndex();
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "Engine: %d (%s)\n", current_engine_idx, (current_engine_idx <= 3) ? "Poly-4" : "Mono");
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "InLvl: %d\n", static_cast<int>(g_controls.GetInputPeakLevel() * 1000.0f));
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "Touch: %03X (%s) Pres:%d\n",
-                        g_controls.GetCurrentTouchState(),
-                        g_hardware.IsTouchSensorPresent() ? "OK" : "MISS",
-                        static_cast<int>(g_controls.GetTouchCVValue() * 1000.0f));
-
-        const auto& control_snapshot = g_controls.GetLatestControlSnapshot();
-        int cv5 = static_cast<int>(control_snapshot.position_knob * 1000.0f);
-        int cv6 = static_cast<int>(control_snapshot.density_knob * 1000.0f);
-        int cv7 = static_cast<int>(control_snapshot.blend_knob * 1000.0f);
-        int raw7 = static_cast<int>(g_hardware.GetCV7Knob().GetRawFloat() * 1000.0f);
-        int pos_val = static_cast<int>(control_snapshot.clouds_position * 1000.0f);
-        int size_val = static_cast<int>(control_snapshot.clouds_size * 1000.0f);
-        int density_val = static_cast<int>(control_snapshot.clouds_density * 1000.0f);
-        int texture_val = static_cast<int>(control_snapshot.clouds_texture * 1000.0f);
-        int feedback_val = static_cast<int>(control_snapshot.clouds_feedback * 1000.0f);
-        int reverb_val = static_cast<int>(control_snapshot.clouds_reverb * 1000.0f);
-        pos += snprintf(msg + pos,
-                        sizeof(msg) - pos,
-                        "CV5:%03d CV6:%03d CV7:%03d Raw7:%03d\nPos:%03d Size:%03d Dens:%03d Text:%03d Fdbk:%03d Rev:%03d\n",
-                        cv5,
-                        cv6,
-                        cv7,
-                        raw7,
-                        pos_val,
-                        size_val,
-                        density_val,
-                        texture_val,
-                        feedback_val,
-                        reverb_val);
-
-        // Only show ADC values 8-11
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "ADC Values (8-11):\n");
-        for (int i = 8; i < 12; ++i) {
-            pos += snprintf(msg + pos, sizeof(msg) - pos, "[%d]: %d\n", i, static_cast<int>(g_controls.GetADCRawValues()[i] * 1000));
-            if(pos >= (int)sizeof(msg) - 20) break; // safety margin
+// Render the notes played by the audio callback once they are due: LED
+// flash and gate pulse, outside the audio deadline. Their pitch CV is
+// already scheduled on the DAC, so the gate follows it.
+void DispatchOutputEvents() {
+    OutputEventQueue& events = g_controls.GetOutputEvents();
+    const uint32_t now = System::GetTick();
+    OutputEvent event;
+    while (events.Peek(&event) && static_cast<int32_t>(now - event.timestamp) >= 0) {
+        events.Pop(&event);
+        if (event.pad >= 0 && event.pad < 12) {
+            g_controls.SetArpLEDTimestamp(kMprToLed[event.pad], g_hardware.GetHardware().system.GetNow());
         }
+        if (event.gate) {
+            RequestArpGatePulse();
+        }
+    }
+}
+
+// Fixed-point helpers for telemetry records (a NaN reads as -32768)
+static int16_t ToMilli(float value) {
+    float milli = value * 1000.0f;
+    milli = milli > -32768.0f ? (milli < 32767.0f ? milli : 32767.0f) : -32768.0f;
+    return static_cast<int16_t>(milli);
+}
+
+static uint16_t ToPermille(float value) {
+    float permille = value * 1000.0f;
+    permille = permille < 0.0f ? 0.0f : (permille > 65535.0f ? 65535.0f : permille);
+    return static_cast<uint16_t>(permille);
+}
+
+// Control snapshot record, sent at 20 Hz
+void SendControlTelemetry() {
+    const auto& snapshot = g_controls.GetLatestControlSnapshot();
+    TelemetryControls controls;
+    controls.pitch = ToMilli(snapshot.pitch);
+    controls.position_knob = ToMilli(snapshot.position_knob);
+    controls.density_knob = ToMilli(snapshot.density_knob);
+    controls.blend_knob = ToMilli(snapshot.blend_knob);
+    controls.clouds_position = ToMilli(snapshot.clouds_position);
+    controls.clouds_size = ToMilli(snapshot.clouds_size);
+    controls.clouds_density = ToMilli(snapshot.clouds_density);
+    controls.clouds_texture = ToMilli(snapshot.clouds_texture);
+    controls.clouds_feedback = ToMilli(snapshot.clouds_feedback);
+    controls.clouds_reverb = ToMilli(snapshot.clouds_reverb);
+    controls.clouds_dry_wet = ToMilli(snapshot.clouds_dry_wet);
+    controls.master_volume = ToMilli(snapshot.master_volume);
+    controls.mod_wheel = ToMilli(snapshot.mod_wheel);
+    g_telemetry.Write(TELEMETRY_CONTROLS, controls);
+}
 
-        // Separator
-        pos += snprintf(msg + pos, sizeof(msg) - pos, "--------");
+// Clouds stages reset after a NaN or an Inf, and (DSP_SENTINELS) the first
+// stage block found holding a denormal, a NaN or an Inf since the last call
+static void ReportDspFaults() {
+    static uint32_t last_recoveries = 0;
+    const GranularProcessorClouds& processor = g_audio_engine.GetCloudsProcessor();
+    const uint32_t recoveries = processor.num_recoveries();
+    if (recoveries != last_recoveries) {
+        AsyncLog::PrintLine("DSP: %s reset after a non-finite block (%u so far)",
+                            DspGuard::StageName(processor.last_recovered_stage()),
+                            static_cast<unsigned>(recoveries));
+        last_recoveries = recoveries;
+    }
 
-        // Print once with a single call to avoid throttling
-        g_hardware.GetHardware().PrintLine("%s", msg);
+    DspGuard::Fault fault;
+    if (!g_audio_engine.GetDspGuard().PopFault(&fault)) {
+        return;
+    }
+    const Parameters& p = fault.parameters;
+    TelemetryDspFault record = {};
+    record.stage = static_cast<uint8_t>(fault.stage);
+    record.kinds = fault.kinds;
+    record.playback_mode = static_cast<uint8_t>(fault.playback_mode);
+    record.quality = static_cast<uint8_t>(fault.quality);
+    record.faults = g_audio_engine.GetDspGuard().GetFaultCount();
+    record.position = ToMilli(p.position);
+    record.size = ToMilli(p.size);
+    record.pitch = ToMilli(p.pitch * 0.1f);
+    record.density = ToMilli(p.density);
+    record.texture = ToMilli(p.texture);
+    record.dry_wet = ToMilli(p.dry_wet);
+    record.stereo_spread = ToMilli(p.stereo_spread);
+    record.feedback = ToMilli(p.feedback);
+    record.reverb = ToMilli(p.reverb);
+    record.freeze = p.freeze ? 1 : 0;
+    g_telemetry.Write(TELEMETRY_DSP_FAULT, record);
+    // One string per set of kinds: AsyncLog takes at most six arguments
+    static const char* const kKindNames[8] = {
+        "", " denormal", " NaN", " denormal NaN", " Inf", " denormal Inf", " NaN Inf", " denormal NaN Inf",
+    };
+    AsyncLog::PrintLine("DSP:%s in %s, mode %d quality %d (%u blocks so far)", kKindNames[fault.kinds & 7],
+                        DspGuard::StageName(fault.stage), static_cast<int>(fault.playback_mode),
+                        static_cast<int>(fault.quality), static_cast<unsigned>(record.faults));
+}
 
-        g_controls.SetUpdateDisplay(false);
+// CPU, engine and scheduler records, sent at 10 Hz (one scheduler task per
+// call, in turn). Touch frames are sent by PollTouchSensor.
+void SendStatusTelemetry() {
+    CpuLoadMeter& meter = g_hardware.GetCpuMeter();
+    TelemetryCpu cpu;
+    cpu.avg_permille = ToPermille(meter.GetAvgCpuLoad());
+    cpu.max_permille = ToPermille(meter.GetMaxCpuLoad());
+    cpu.last_permille = ToPermille(meter.GetLastCpuLoad());
+    cpu.quality_level = static_cast<uint8_t>(g_audio_engine.GetQualityGovernor().GetLevel());
+    cpu.block_size = static_cast<uint8_t>(BLOCK_SIZE);
+    cpu.sample_rate = static_cast<uint32_t>(g_hardware.GetSampleRate());
+    cpu.governor_downgrades = g_audio_engine.GetQualityGovernor().GetDowngradeCount();
+    cpu.xruns = GetXrunCount();
+    cpu.telemetry_dropped = g_telemetry.GetDroppedCount();
+    g_telemetry.Write(TELEMETRY_CPU, cpu);
+
+    GranularProcessorClouds& processor = g_audio_engine.GetCloudsProcessor();
+    TelemetryEngine engine;
+    engine.grains = static_cast<uint16_t>(processor.num_grains() * 100.0f);
+    engine.playback_mode = static_cast<uint8_t>(processor.playback_mode());
+    engine.num_channels = static_cast<uint8_t>(processor.num_channels());
+    engine.input_peak = ToPermille(g_controls.GetInputPeakLevel());
+    engine.output_level = ToPermille(g_controls.GetSmoothedOutputLevel());
+    engine.staging_late = g_audio_engine.GetStagingDma().GetLateCount();
+    engine.output_events_dropped = g_controls.GetOutputEvents().GetDroppedCount();
+    engine.dsp_recoveries = processor.num_recoveries();
+    g_telemetry.Write(TELEMETRY_ENGINE, engine);
+    ReportDspFaults();
+
+    static int task_id = 0;
+    static uint32_t last_now_us = 0;
+    static uint64_t last_idle_us = 0;
+    if (g_scheduler.GetNumTasks() == 0) {
+        return;
     }
+    const uint32_t now_us = g_scheduler.NowUs();
+    const uint64_t idle_us = g_scheduler.GetIdleUs();
+    const uint32_t elapsed_us = now_us - last_now_us;
+    TelemetryTask task = {};
+    task.id = static_cast<uint8_t>(task_id);
+    task.priority = g_scheduler.GetTaskPriority(task_id);
+    // Left unterminated when it fills the field
+    const char* name = g_scheduler.GetTaskName(task_id);
+    memcpy(task.name, name, std::min(strlen(name), sizeof(task.name)));
+    task.period_us = g_scheduler.GetTaskPeriod(task_id);
+    const TaskScheduler::TaskStats& stats = g_scheduler.GetTaskStats(task_id);
+    task.runs = stats.runs;
+    task.overruns = stats.overruns;
+    task.avg_us = stats.GetAverageUs();
+    task.max_us = stats.max_us;
+    task.max_lateness_us = stats.max_lateness_us;
+    task.idle_permille = elapsed_us ? ToPermille(static_cast<float>(idle_us - last_idle_us) / elapsed_us) : 0;
+    g_telemetry.Write(TELEMETRY_TASK, task);
+    last_now_us = now_us;
+    last_idle_us = idle_us;
+    task_id = (task_id + 1) % g_scheduler.GetNumTasks();
 }
 
 // Poll the touch sensor and update shared variables
@@ -148,22 +224,10 @@ void PollTouchSensor() {
         cfg.Defaults();
         g_hardware.GetTouchSensor().Init(cfg);
         g_hardware.GetTouchSensor().SetThresholds(6, 3);
+        AsyncLog::PrintLine("MPR121: I2C error, re-initialised");
     }
     uint16_t touched = g_hardware.GetTouchSensor().Touched();
     
-    // MPR touch pad to LED index mapping (used in multiple places)
-    static const int kMprToLed[12] = {9, 8, 7, 6, 3, 4, 5, 2, 1, 0, 10, 11};
-    
-    // Diagnostic: print which pad was just pressed and which LED it maps to
-    uint16_t newly_pressed = touched & ~prev_touch_state;
-    if(newly_pressed != 0) {
-        for(int i = 0; i < 12; ++i) {
-            if(newly_pressed & (1 << i)) {
-                g_hardware.GetHardware().PrintLine("PAD: MPR bit %d -> LED index %d", i, kMprToLed[i]);
-            }
-        }
-    }
-    
     // On a new touch, fire a gate pulse
     if(touched != 0 && prev_touch_state == 0) {
         RequestArpGatePulse();
@@ -203,27 +267,38 @@ void PollTouchSensor() {
         touch_leds[ledIdx].Write(ledState);
     }
 
+    // Touch frame for the host decoder; deviations are only read (over
+    // I2C) for touched pads
+    TelemetryTouch frame = {};
+    frame.touched = touched;
+    frame.sensor_present = 1;
+
     static float pressure_env = 0.0f;
+    static float vib_depth = 0.0f;
+    static float slider_pos = 6.0f;
     if (touched == 0) {
         // Let the pressure value decay smoothly when released
         pressure_env *= 0.95f;
+        vib_depth = 0.0f;
+        g_hardware.GetCvOutput().SetVibratoDepth(0.0f);
         g_controls.SetTouchCVValue(pressure_env);
         g_hardware.SetPressureCvVoltage(pressure_env * 5.0f);
+        frame.pressure = ToPermille(pressure_env);
+        frame.slider = ToPermille(slider_pos);
+        g_telemetry.Write(TELEMETRY_TOUCH, frame);
         return;
     }
 
     int16_t max_deviation = 0;
     float weighted_pos = 0.0f;
     float weight_sum = 0.0f;
-    static float vib_depth = 0.0f;
     static float prev_slider_pos = 6.0f;
-    constexpr float kTwoPi = 6.283185307f;
-    static float vib_phase = 0.0f;
 
     // Find the maximum deviation from all touched pads
     for (int i = 0; i < 12; i++) {
         if (touched & (1 << i)) {
             int16_t deviation = g_hardware.GetTouchSensor().GetBaselineDeviation(i);
+            frame.deviation[i] = deviation;
             if (deviation > max_deviation) {
                 max_deviation = deviation;
             }
@@ -236,7 +311,6 @@ void PollTouchSensor() {
     }
 
     // Estimate continuous pad position from weighted deviations
-    static float slider_pos = 6.0f;
     if(weight_sum > 1e-3f) {
         float raw_pos = weighted_pos / weight_sum;
         // Heavier smoothing for a less sensitive, more spread glide
@@ -264,25 +338,63 @@ void PollTouchSensor() {
     // Vibrato depth follows how much the pressure is changing
     float target_vib = daisysp::fmin(change * 1.2f + slide_delta * 1.0f, 1.0f); // semitone depth cap
     vib_depth = vib_depth * 0.75f + target_vib * 0.25f;
-    // Keep vibrato running even when pressure is steady
-    vib_phase += kTwoPi * 6.0f * (g_hardware.GetSampleRate() > 0 ? 1.0f / g_hardware.GetSampleRate() : 0.000033f);
-    if(vib_phase > kTwoPi) vib_phase -= kTwoPi;
-    float vib = sinf(vib_phase) * vib_depth; // 6 Hz vibrato
-
-    // Continuous pitch CV regardless of arp state, with vibrato applied
-    float pitch_v = PadPositionToVoltage(slider_pos);
-    pitch_v += vib / 12.0f; // convert semitone vib to volts
-    pitch_v = daisysp::fclamp(pitch_v, 0.0f, 5.0f);
-    g_hardware.SetPitchCvVoltage(pitch_v);
-    
-    // Debug: show max deviation
-    static uint32_t last_dbg = 0;
-    if (now - last_dbg > 200) {
-        last_dbg = now;
-        g_hardware.GetHardware().PrintLine("DEV:%d CV:%dmV", 
-            max_deviation,
-            static_cast<int>(new_cv * 5000.0f));
+    // The 6 Hz vibrato LFO keeps running in the CV engine even when pressure is steady
+    g_hardware.GetCvOutput().SetVibratoDepth(vib_depth);
+
+    // Continuous pitch CV regardless of arp state: the CV engine blends
+    // between maqam degrees and glides between polls
+    g_hardware.GetCvOutput().SetPitchFromPad(slider_pos, false);
+
+    frame.pressure = ToPermille(pressure_env);
+    frame.slider = ToPermille(slider_pos);
+    g_telemetry.Write(TELEMETRY_TOUCH, frame);
+}
+
+// Scheduled together: ReadKnobValues() consumes what ProcessControls() read
+static void ControlsTask() {
+    ProcessControls();
+    ReadKnobValues();
+}
+
+// USB serial: binary telemetry and deferred log messages
+static void SerialTask() {
+    g_telemetry.Process();
+    AsyncLog::Drain();
+}
+
+// Saving or loading the recording buffer; reports how each one ended
+static void SampleMemoryTask() {
+    static const char* const kResults[] = {
+        "none", "saved", "loaded", "nothing saved", "corrupt", "saved in another mode", "unavailable", "verify failed",
+    };
+    static bool was_busy = false;
+    SampleMemory& sample_memory = g_audio_engine.GetSampleMemory();
+    sample_memory.Process();
+    const bool busy = sample_memory.IsBusy();
+    if (was_busy && !busy) {
+        AsyncLog::PrintLine("Sample memory: %s", kResults[static_cast<int>(sample_memory.GetLastResult())]);
+    }
+    was_busy = busy;
+}
+
+// Streams the WAV recording to the card; reports how each take ended
+static void RecorderTask() {
+    static const char* const kResults[] = {"none", "saved", "open failed", "write failed"};
+    static bool was_busy = false;
+    WavRecorder& recorder = g_audio_engine.GetRecorder();
+    recorder.Process();
+    const bool busy = recorder.GetState() != WavRecorder::State::IDLE;
+    if (was_busy && !busy) {
+        const WavRecorder::Stats stats = recorder.GetStats();
+        const uint32_t avg_us = stats.writes ? static_cast<uint32_t>(stats.total_write_us / stats.writes) : 0;
+        AsyncLog::PrintLine("Recorder: %s, %u frames", kResults[static_cast<int>(recorder.GetLastResult())],
+                            static_cast<unsigned>(recorder.GetFramesRecorded()));
+        AsyncLog::PrintLine("Recorder: ring high water %u kB, %u frames dropped, write avg %u us max %u us",
+                            static_cast<unsigned>(stats.high_water / 1024),
+                            static_cast<unsigned>(stats.dropped_frames), static_cast<unsigned>(avg_us),
+                            static_cast<unsigned>(stats.max_write_us));
     }
+    was_busy = busy;
 }
 
 int main(void) {
@@ -294,45 +406,26 @@ int main(void) {
     InitializeSynth();
     g_hardware.GetHardware().PrintLine("Kymatikos booted.");
 
-    uint32_t lastPoll = g_hardware.GetHardware().system.GetNow();  // Track last poll time
-    uint32_t lastUIUpdate = g_hardware.GetHardware().system.GetNow();  // Track last UI processing
-    uint32_t lastHeartbeat = lastPoll;
-    bool heartbeat_state = false;
-
-    // Main Loop
-    while (1) {
-        uint32_t now = g_hardware.GetHardware().system.GetNow();
-
-        // UI processing at 1ms intervals (1kHz) - moved from audio ISR for real-time safety
-        if (now - lastUIUpdate >= 1) {
-            lastUIUpdate = now;
-            ProcessControls();
-            ReadKnobValues();
-        }
-
-        UpdateLED();
-
-        // Check bootloader condition via ADC touch pads
-        Bootload();
-
-        UpdateDisplay();
-
-        // Poll touch sensor every 5 ms (200 Hz)
-        if (now - lastPoll >= 5) {
-            lastPoll = now;
-            PollTouchSensor();
-        }
-
-        // Heartbeat indicator to verify firmware is running
-        if (now - lastHeartbeat >= 500) {
-            lastHeartbeat = now;
-            heartbeat_state = !heartbeat_state;
-            g_hardware.GetHardware().SetLed(heartbeat_state);
-        }
-
-        // Yield for system tasks, adjusted for polling interval
-        System::Delay(1); // Shorter delay to allow more frequent polling checks
-    }
+    TaskScheduler::Config scheduler_config;
+    scheduler_config.Defaults();
+    g_scheduler.Init(scheduler_config);
+
+    // Periods in microseconds; priority 0 runs first when several are due
+    g_scheduler.AddTask("events", DispatchOutputEvents, 250, 0);   // Arp notes queued by the audio callback
+    g_scheduler.AddTask("controls", ControlsTask, 1000, 1);        // Moved from the audio ISR
+    g_scheduler.AddTask("touch", PollTouchSensor, 5000, 2);
+    g_scheduler.AddTask("bootload", Bootload, 2000, 3);            // Counts 500 polls for ~1 s
+    g_scheduler.AddTask("heartbeat", UpdateLED, 10000, 4);
+    g_scheduler.AddTask("tlm_ctrl", SendControlTelemetry, 50000, 5);
+    g_scheduler.AddTask("tlm_stat", SendStatusTelemetry, 100000, 5);
+    g_scheduler.AddTask("serial", SerialTask, 1000, 6);
+    g_scheduler.AddTask("autosave", AutosaveState, 1000000, 7);
+    g_scheduler.AddTask("storage", SynthStateStorage::Process, 1000, 7);   // Masks IRQs, ending before the next audio block
+    g_scheduler.AddTask("samples", SampleMemoryTask, 1000, 7);             // Same flash slices
+    g_scheduler.AddTask("recorder", RecorderTask, 1000, 6);                // One SD write in flight, 32 kB per ~57 ms at 48 kHz
+
+    // Never returns; sleeps between releases
+    g_scheduler.Run();
 
     return 0;
 }
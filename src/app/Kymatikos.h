@@ -13,6 +13,8 @@
 #include "HardwareManager.h"
 #include "ControlsManager.h"
 #include "AudioEngine.h"
+#include "Telemetry.h"
+#include "TaskScheduler.h"
 #include "stm32h7xx.h"
 
 // Clouds Integration (Nimbus SM port)
@@ -35,15 +37,47 @@ void ReadKnobValues();
 void UpdateEngineSelection();
 void UpdateArpeggiatorToggle();
 void RequestArpGatePulse();
+void DispatchOutputEvents();
+void UpdateSampleRateSelection();
+void UpdateSampleRateChange();
+void UpdateSampleMemory();
+void UpdateSnapshotBanks();
+void UpdateRecorder();
+void SendControlTelemetry();
+void SendStatusTelemetry();
+void AutosaveState();
+
+// Blocks that overran their deadline (measured load above 100%)
+uint32_t GetXrunCount();
+
+// Fades the output out (muted = true) or back in; IsAudioMuted() reports
+// when the fade-out has completed.
+void SetAudioMuted(bool muted);
+bool IsAudioMuted();
+
+// Starts a change to 32000, 48000 or 96000 Hz by fading out; once the fade
+// is done, UpdateSampleRateChange() stops audio, reconfigures hardware and
+// DSP, then restarts and fades back in. False for other rates and during a
+// sample memory transfer. Main loop only.
+bool ChangeSampleRate(float sample_rate);
+
+// Log from the main loop's time-critical paths or interrupts: formatting
+// and USB transfers are deferred to AsyncLog::Drain() in the main loop
+using AsyncLog = daisy::AsyncLogger<daisy::LOGGER_INTERNAL>;
 
 // --- Global Manager Instances ---
 extern HardwareManager g_hardware;
 extern ControlsManager g_controls;
 extern AudioEngine g_audio_engine;
+extern Telemetry g_telemetry;
+extern TaskScheduler g_scheduler;
 
 extern const float kArabicMaqamScale[12];
 float PadIndexToVoltage(int pad_index);
 
+// WAV recorder tracks: dry L/R, wet L/R, pitch CV, pressure CV
+constexpr int kRecorderChannels = 6;
+
 // Backup register magic to persist bootloader requests across resets
 constexpr uint32_t kBootloaderMagic = 0xB007B007;
 
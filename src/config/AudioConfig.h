@@ -4,7 +4,87 @@
 #include <cstddef>
 
 // Central definition for shared audio constants used across the firmware.
-// BLOCK_SIZE matches Clouds' expected block size for processing
+// BLOCK_SIZE is the audio callback size in frames. 32 matches Clouds' native
+// block size; 4, 8 or 16 trade CPU for lower latency (1 ms at 32 frames,
+// 125 us at 4 frames at 32 kHz).
 constexpr std::size_t BLOCK_SIZE = 32;
 
+// Control-rate work (control snapshot, Clouds parameters, filter coefficients)
+// still runs once every CONTROL_BLOCK_SIZE frames, i.e. every
+// CONTROL_RATE_DIVIDER callbacks.
+constexpr std::size_t CONTROL_BLOCK_SIZE = 32;
+constexpr std::size_t CONTROL_RATE_DIVIDER = CONTROL_BLOCK_SIZE / BLOCK_SIZE;
+
+static_assert(BLOCK_SIZE >= 4 && BLOCK_SIZE <= CONTROL_BLOCK_SIZE,
+              "Clouds processes at most 32 frames per block");
+static_assert(CONTROL_BLOCK_SIZE % BLOCK_SIZE == 0,
+              "BLOCK_SIZE must divide the control block size");
+static_assert(BLOCK_SIZE % 2 == 0,
+              "Clouds' low-fidelity mode downsamples blocks by 2");
+
+// Boot sample rate. Holding Prev + Next cycles 32 / 48 / 96 kHz at runtime:
+// more CPU headroom at 32 kHz, more bandwidth at 96 kHz.
+constexpr float DEFAULT_SAMPLE_RATE = 32000.0f;
+
+// Long-memory mode: Clouds records into a 32 MB SDRAM buffer (about 8.7 min
+// mono / 4.3 min stereo at 32 kHz) instead of its ~350 KB internal buffers,
+// and POSITION spans the whole history. Reads are served from an AXI SRAM
+// staging cache that MDMA refills one block ahead.
+constexpr bool LONG_MEMORY_MODE = false;
+constexpr std::size_t LONG_MEMORY_SIZE = 32u * 1024u * 1024u;
+
+// Freeze snapshot banks: Next + one of the first keys captures the
+// recording into that bank, Prev + the key plays it back frozen. Captures
+// share the recording's pages; the ~1.5 MB SDRAM pool only receives the
+// pages the recording overwrites afterwards. Not with long memory.
+constexpr bool SNAPSHOT_BANKS = true;
+
+// Fast boot: the SDRAM buffers are zeroed by MDMA while the rest of the
+// init runs, and the diagnostic LED blinks between init steps (~2.5 s in
+// total) are skipped. Each step is timed either way (BootProfiler).
+constexpr bool FAST_BOOT = true;
+
+// Quality governor: Clouds' cost is lowered one step once blocks keep taking
+// more than CPU_LOAD_TARGET of their deadline (at once above CPU_LOAD_PANIC),
+// and raised again once the load stays below CPU_LOAD_TARGET -
+// CPU_LOAD_HYSTERESIS.
+constexpr float CPU_LOAD_TARGET = 0.80f;
+constexpr float CPU_LOAD_HYSTERESIS = 0.15f;
+constexpr float CPU_LOAD_PANIC = 0.95f;
+
+// Half-rate reverb: Clouds' reverb runs on a decimated send at every
+// governor level, for about 40% less reverb CPU and without the top octave
+// of the wet signal (tools/reverb_bench). Otherwise only from level 2 on.
+constexpr bool REVERB_HALF_RATE = false;
+
+// Resonestor: Clouds boots in the resonator mode ported from Parasites
+// instead of the looping delay. Each pad press strikes a chord of comb
+// resonators on the pad's note, excited by the input and a noise burst;
+// the governor lets fewer chords ring as it lowers the quality
+// (tools/resonestor_bench).
+constexpr bool RESONESTOR_MODE = false;
+
+// Oliverb: the post-processing reverb is the tank ported from Parasites'
+// Oliverb mode, with delays wandering on random LFOs and a high-pass in the
+// loop, instead of Clouds' reverb. Same knobs, same memory; it costs two to
+// three times as much, has no half-rate version, and the governor only
+// trims it through the fx economy (tools/reverb_bench).
+constexpr bool OLIVERB_REVERB = false;
+
+// Input capture: the controls task sends the raw ADC codes and gate states
+// as telemetry (TELEMETRY_INPUTS, 1 kHz), alongside the touch frames. A
+// capture replays through the host co-simulator (tools/cosim).
+constexpr bool INPUT_CAPTURE = false;
+
+// DSP sentinels (DspGuard): every Clouds stage's output block is checked
+// for denormals, NaNs and Infs, and the first offender is logged and sent
+// as telemetry (TELEMETRY_DSP_FAULT) with the parameters that produced it.
+// On in debug builds (make DEBUG=1), which also leave flush-to-zero off so
+// that denormals show; release builds flush them instead.
+#ifdef DEBUG
+constexpr bool DSP_SENTINELS = true;
+#else
+constexpr bool DSP_SENTINELS = false;
+#endif
+
 #endif // AUDIO_CONFIG_H
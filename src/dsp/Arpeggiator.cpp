@@ -11,12 +11,16 @@ Arpeggiator::Arpeggiator()
       scale_(nullptr),
       scale_size_(0),
       octave_jump_prob_(0.0f),
-      note_callback_(nullptr),
+      num_triggers_(0),
       polyrhythm_ratio_(1.0f),
-      next_trigger_time_(0.0f),
-      current_time_(0.0f),
+      clock_(0),
+      countdown_(0),
+      interval_(0),
       sample_rate_(48000.0f),
       current_interval_(1.0f),
+      last_edge_(0),
+      has_edge_(false),
+      external_period_(0.0f),
       step_index_(0),
       direction_(Forward)
 {
@@ -29,8 +33,21 @@ Arpeggiator::Arpeggiator()
 void Arpeggiator::Init(float samplerate) {
     sample_rate_ = samplerate;
     metro_.Init(1.0f, samplerate);
-    next_trigger_time_ = 0.0f;
-    current_time_ = 0.0f;
+    clock_ = 0;
+    countdown_ = 0;
+    has_edge_ = false;
+    external_period_ = 0.0f;
+    UpdateInterval();
+}
+
+void Arpeggiator::SetSampleRate(float samplerate) {
+    // Keep the position within the current beat
+    float scale = samplerate / sample_rate_;
+    countdown_ = static_cast<int64_t>(countdown_ * scale);
+    external_period_ *= scale;
+    has_edge_ = false;
+    sample_rate_ = samplerate;
+    metro_.Init(metro_.GetFreq(), samplerate);
     UpdateInterval();
 }
 
@@ -55,10 +72,6 @@ void Arpeggiator::SetOctaveJumpProbability(float probability) {
     octave_jump_prob_ = probability;
 }
 
-void Arpeggiator::SetNoteTriggerCallback(std::function<void(int)> cb) {
-    note_callback_ = cb;
-}
-
 void Arpeggiator::SetDirection(Direction dir) {
     direction_ = dir;
     step_index_ = 0;
@@ -76,18 +89,79 @@ float Arpeggiator::GetCurrentInterval() const {
     return current_interval_;
 }
 
-void Arpeggiator::Process(size_t frames) {
-    if (note_count_ == 0 || !note_callback_) return;
-    for (size_t i = 0; i < frames; ++i) {
-        current_time_ += 1.0f / sample_rate_;
-        if (current_time_ >= next_trigger_time_) {
-            TriggerNote();
-            next_trigger_time_ += current_interval_;
+size_t Arpeggiator::Process(size_t frames) {
+    const int64_t block = static_cast<int64_t>(frames) << kFractionalBits;
+
+    // Fall back to the internal tempo when the external clock stops
+    if (external_period_ > 0.0f &&
+        static_cast<float>(static_cast<int32_t>(clock_ - last_edge_)) > 2.0f * external_period_) {
+        external_period_ = 0.0f;
+        has_edge_ = false;
+        UpdateInterval();
+    }
+
+    num_triggers_ = 0;
+    if (note_count_ == 0) {
+        if (external_period_ > 0.0f) {
+            // Keep the grid running so that the first note lands on it
+            while (countdown_ < block) {
+                countdown_ += interval_;
+            }
+            countdown_ -= block;
+        } else {
+            // Free-running: the first note plays immediately
+            countdown_ = 0;
+        }
+        clock_ += frames;
+        return 0;
+    }
+
+    // Jump from trigger to trigger rather than testing every sample
+    while (countdown_ < block) {
+        // First sample at or after the exact trigger time
+        int64_t offset = countdown_ > 0 ? (countdown_ + kOne - 1) >> kFractionalBits : 0;
+        TriggerNote(static_cast<size_t>(offset));
+        countdown_ += interval_;
+    }
+    countdown_ -= block;
+    clock_ += frames;
+    return num_triggers_;
+}
+
+void Arpeggiator::ClockEdge(size_t offset) {
+    constexpr float kFrequencyGain = 0.25f; // Period smoothing
+    constexpr float kPhaseGain = 0.5f;      // Fraction of the phase error corrected per edge
+
+    const uint32_t edge = clock_ + static_cast<uint32_t>(offset);
+    if (has_edge_) {
+        float period = static_cast<float>(edge - last_edge_);
+        // Ignore bounces and edges after a long pause (> 4 s)
+        if (period >= 16.0f && period <= 4.0f * sample_rate_) {
+            external_period_ = external_period_ > 0.0f
+                ? external_period_ + (period - external_period_) * kFrequencyGain
+                : period;
+            UpdateInterval();
         }
     }
+    last_edge_ = edge;
+    has_edge_ = true;
+    if (external_period_ <= 0.0f || interval_ <= 0) {
+        return;
+    }
+
+    // Distance from the edge to the nearest trigger of the grid, wrapped
+    // to [-interval / 2, interval / 2)
+    int64_t error = (countdown_ - (static_cast<int64_t>(offset) << kFractionalBits)) % interval_;
+    if (error < 0) {
+        error += interval_;
+    }
+    if (error >= interval_ / 2) {
+        error -= interval_;
+    }
+    countdown_ -= static_cast<int64_t>(error * kPhaseGain);
 }
 
-void Arpeggiator::TriggerNote() {
+void Arpeggiator::TriggerNote(size_t offset) {
     if (note_count_ == 0) return;
     int idx;
     if (direction_ == Random) {
@@ -97,14 +171,21 @@ void Arpeggiator::TriggerNote() {
         idx = step_index_ % note_count_;
         ++step_index_;
     }
-    if (note_callback_) {
-        note_callback_(notes_[idx]);
+    if (num_triggers_ < MAX_TRIGGERS) {
+        triggers_[num_triggers_].pad = notes_[idx];
+        triggers_[num_triggers_].offset = offset;
+        ++num_triggers_;
     }
 }
 
 void Arpeggiator::UpdateInterval() {
-    float main_interval = 1.0f / metro_.GetFreq();
+    float main_interval = external_period_ > 0.0f ? external_period_ / sample_rate_
+                                                  : 1.0f / metro_.GetFreq();
     current_interval_ = main_interval / polyrhythm_ratio_;
+    interval_ = static_cast<int64_t>(current_interval_ * sample_rate_ * kOne);
+    if (interval_ < kOne) {
+        interval_ = kOne;
+    }
 }
 
 void Arpeggiator::SetMainTempoFromKnob(float knob_value) {
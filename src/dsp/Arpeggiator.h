@@ -3,7 +3,6 @@
 
 #include "daisy.h"
 #include "daisysp.h"
-#include <functional>
 // #include <vector>  // REMOVED - replaced with fixed-size array for RT safety
 
 // NOTE: using namespace directives removed from header to avoid namespace pollution
@@ -13,13 +12,29 @@ class Arpeggiator {
 public:
     Arpeggiator();
     void Init(float samplerate);
+    void SetSampleRate(float samplerate);       // Keeps tempo and phase
     void SetScale(float* scale, int scale_size);
     void SetMainTempo(float tempo);             // Main tempo in Hz
     void SetPolyrhythmRatio(float ratio);       // Ratio for polyrhythm
     void SetOctaveJumpProbability(float probability); // 0.0f to 1.0f
-    void Process(size_t frames);                // Call each block for scheduling
+    // A note due within the block being processed
+    struct Trigger {
+        int pad;                                // Pad index
+        size_t offset;                          // Samples from the start of the block
+    };
+    static constexpr size_t MAX_TRIGGERS = 8;   // Per block; extra triggers are dropped
 
-    void SetNoteTriggerCallback(std::function<void(int)> cb);
+    // Call each block for scheduling. Returns the number of notes due in the
+    // block, read back with GetTrigger().
+    size_t Process(size_t frames);
+    const Trigger& GetTrigger(size_t i) const { return triggers_[i]; }
+
+    // External clock: call from the audio callback, before Process(), with the
+    // offset of the rising edge within the block. The tempo follows the edge
+    // period and the trigger grid is pulled onto the edges (PLL-style); the
+    // internal tempo takes over again when the edges stop.
+    void ClockEdge(size_t offset);
+    bool IsExternallyClocked() const { return external_period_ > 0.0f; }
 
     bool IsActive() const;
     float GetMetroRate();
@@ -49,16 +64,29 @@ private:
     float* scale_;
     int scale_size_;
     float octave_jump_prob_;
-    std::function<void(int)> note_callback_;
+    Trigger triggers_[MAX_TRIGGERS];
+    size_t num_triggers_;
 
     uint32_t Xorshift32();
-    void TriggerNote();
+    void TriggerNote(size_t offset);
+
+    // Sample clock in fixed point with 12 fractional bits: no per-sample
+    // work, and no drift from accumulating float time. 64 bits, as the
+    // slowest interval (0.1 Hz at half speed, 20 s) is 7.9e9 at 96 kHz.
+    static constexpr int kFractionalBits = 12;
+    static constexpr int64_t kOne = 1 << kFractionalBits;
 
     float polyrhythm_ratio_;
-    float next_trigger_time_;
-    float current_time_;
+    uint32_t clock_;                       // Samples since Init (wraps)
+    int64_t countdown_;                    // Samples to the next trigger, fixed point
+    int64_t interval_;                     // Samples between triggers, fixed point
     float sample_rate_;
-    float current_interval_;
+    float current_interval_;               // Seconds between triggers
+
+    // External clock tracking
+    uint32_t last_edge_;
+    bool has_edge_;
+    float external_period_;                // Smoothed edge period in samples, 0 when free-running
     int step_index_;
     Direction direction_;
 
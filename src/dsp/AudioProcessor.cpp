@@ -1,6 +1,8 @@
 #include "Kymatikos.h"
 #include "mpr121_daisy.h"
 #include "AudioConfig.h"
+#include "QspiFlash.h"
+#include <atomic>
 #include <cmath>
 #include <algorithm>
 
@@ -16,6 +18,44 @@ constexpr float kOutputGain =2.0f;
 FloatFrame g_clouds_in[BLOCK_SIZE];
 FloatFrame g_clouds_out[BLOCK_SIZE];
 
+// Counts callbacks within the current control block
+size_t g_control_phase = 0;
+
+// Output fade used to stop and restart audio without clicks (~8 ms at 32 kHz)
+constexpr float kFadeStep = 1.0f / 256.0f;
+std::atomic<bool> g_mute_request{false};
+std::atomic<bool> g_muted{false};
+float g_fade_gain = 1.0f;
+
+std::atomic<uint32_t> g_xruns{0};
+
+// Interleaved recorder frames, built only while recording
+float g_recorder_tap[BLOCK_SIZE * kRecorderChannels];
+
+// Resonestor strikes: pads held at the last control tick, and the note of
+// the last pad pressed, in semitones from the pitch knob
+uint16_t g_strike_touch_state = 0;
+float g_strike_note = 0.0f;
+
+// In the resonestor mode, a newly pressed pad (the highest one, if several)
+// strikes a chord rooted on its scale degree, an octave down. The trigger
+// is cleared at the next control tick, which the processor sees as an edge.
+void UpdateResonestorStrike(Parameters* params)
+{
+    const uint16_t touch_state = g_controls.GetCurrentTouchState();
+    const uint16_t pressed = touch_state & ~g_strike_touch_state;
+    g_strike_touch_state = touch_state;
+    if (pressed) {
+        int pad = 11;
+        while (!(pressed & (1 << pad))) {
+            --pad;
+        }
+        g_strike_note = kArabicMaqamScale[pad] - 12.0f;
+        params->trigger = true;
+    }
+    params->pitch += g_strike_note;
+}
+
 void UpdateCloudsParameters(GranularProcessorClouds& processor)
 {
     const auto& controls = g_controls.GetAudioControlSnapshot();
@@ -30,17 +70,21 @@ void UpdateCloudsParameters(GranularProcessorClouds& processor)
     params->reverb        = controls.clouds_reverb;
     params->pitch         = controls.clouds_pitch;
     params->dry_wet       = controls.clouds_dry_wet;
-    params->freeze        = false;
+    params->freeze        = g_audio_engine.GetSampleMemory().IsFreezeHeld();
     params->trigger       = false;
+    if (processor.playback_mode() == PLAYBACK_MODE_RESONESTOR) {
+        UpdateResonestorStrike(params);
+    }
 }
 } // namespace
 
 // Helper function declarations
 void ProcessAudioThroughClouds(AudioHandle::InterleavingInputBuffer in,
                                AudioHandle::InterleavingOutputBuffer out,
-                               size_t size);
+                               size_t size,
+                               bool control_tick);
 void UpdatePerformanceMonitors(size_t size, AudioHandle::InterleavingOutputBuffer out);
-void UpdateArpeggiator();
+void UpdateArpeggiator(uint32_t block_tick);
 
 // Touch state tracking for keyboard logic
 static uint16_t last_touch_state = 0;
@@ -52,23 +96,52 @@ void AudioCallback(AudioHandle::InterleavingInputBuffer in,
                  size_t size) {
     // Audio ISR - keep minimal and deterministic
     g_hardware.GetCpuMeter().OnBlockStart();
+    const uint32_t block_tick = System::GetTick();
+
+    // Flash slices must end before the next block starts
+    const float block_ticks = static_cast<float>(System::GetTickFreq()) * BLOCK_SIZE / g_hardware.GetSampleRate();
+    QspiFlash::SetAudioBlock(block_tick, static_cast<uint32_t>(block_ticks));
+
+    // Control-rate work runs once per CONTROL_BLOCK_SIZE frames, however
+    // small the audio blocks are
+    const bool control_tick = g_control_phase == 0;
+    if (++g_control_phase >= CONTROL_RATE_DIVIDER) {
+        g_control_phase = 0;
+    }
 
     // Sync control snapshot from UI thread
-    g_controls.SyncAudioControlSnapshot();
+    if (control_tick) {
+        g_controls.SyncAudioControlSnapshot();
+    }
 
     // Prepare Clouds state in the audio thread to avoid races with main loop
     g_audio_engine.GetCloudsProcessor().Prepare();
+    g_audio_engine.ApplySnapshotRequests();
 
     // Update arpeggiator state (keyboard logic preserved)
-    UpdateArpeggiator();
+    UpdateArpeggiator(block_tick);
 
     // Process audio input through simplified DSP path and output
-    ProcessAudioThroughClouds(in, out, size);
+    ProcessAudioThroughClouds(in, out, size, control_tick);
 
     g_hardware.GetCpuMeter().OnBlockEnd();
+
+    const float block_load = g_hardware.GetCpuMeter().GetLastCpuLoad();
+    if (block_load > 1.0f) {
+        TelemetryXrun xrun = {};
+        xrun.load_permille = static_cast<uint16_t>(std::min(block_load * 1000.0f, 65535.0f));
+        xrun.xruns = g_xruns.fetch_add(1, std::memory_order_relaxed) + 1;
+        g_telemetry.Write(TELEMETRY_XRUN, xrun);
+    }
+
+    // Trade Clouds quality for CPU time before the next block overruns
+    g_audio_engine.GetQualityGovernor().Update(block_load);
+
+    // Lets a save or load know the freeze or silence it asked for has held
+    g_audio_engine.GetSampleMemory().OnAudioBlock(g_audio_engine.GetCloudsProcessor().frozen());
 }
 
-void UpdateArpeggiator() {
+void UpdateArpeggiator(uint32_t block_tick) {
     // Clear arpeggiator notes if requested
     if(g_controls.ConsumeArpClearRequest()) {
         g_controls.GetArpeggiator().ClearNotes();
@@ -76,11 +149,31 @@ void UpdateArpeggiator() {
 
     bool current_arp_on = g_controls.IsArpEnabled();
 
+    // Gate in 1 clocks the arpeggiator, at the sample each edge came in
+    size_t edge_offset;
+    if (g_hardware.GetGateClock().ReadEdge(block_tick, BLOCK_SIZE, &edge_offset)) {
+        g_controls.GetArpeggiator().ClockEdge(edge_offset);
+    }
+
     // Update arpeggiator with current touch state (keyboard logic preserved)
     if (current_arp_on) {
         uint16_t current_touch_state = g_controls.GetCurrentTouchState();
         g_controls.GetArpeggiator().UpdateHeldNotes(current_touch_state, last_touch_state);
-        g_controls.GetArpeggiator().Process(BLOCK_SIZE);
+        const size_t num_triggers = g_controls.GetArpeggiator().Process(BLOCK_SIZE);
+
+        // Notes leave the outputs a fixed delay after their sample: the
+        // pitch CV on its DAC frame, the gate and LEDs from the main loop
+        const float ticks_per_sample = static_cast<float>(System::GetTickFreq()) / g_hardware.GetSampleRate();
+        const uint32_t due = block_tick + CvOutputEngine::kScheduleDelayUs * (System::GetTickFreq() / 1000000);
+        for (size_t i = 0; i < num_triggers; ++i) {
+            const Arpeggiator::Trigger& trigger = g_controls.GetArpeggiator().GetTrigger(i);
+            OutputEvent event;
+            event.timestamp = due + static_cast<uint32_t>(static_cast<float>(trigger.offset) * ticks_per_sample);
+            event.pad = static_cast<int8_t>(trigger.pad);
+            event.gate = true;
+            g_hardware.GetCvOutput().SchedulePitchVoltage(PadIndexToVoltage(trigger.pad), event.timestamp);
+            g_controls.GetOutputEvents().Push(event);
+        }
         last_touch_state = current_touch_state;
     } else {
         // When arp is disabled, still track touch state changes
@@ -92,9 +185,12 @@ void UpdateArpeggiator() {
 
 void ProcessAudioThroughClouds(AudioHandle::InterleavingInputBuffer in,
                                AudioHandle::InterleavingOutputBuffer out,
-                               size_t size) {
+                               size_t size,
+                               bool control_tick) {
     auto& processor = g_audio_engine.GetCloudsProcessor();
-    UpdateCloudsParameters(processor);
+    if (control_tick) {
+        UpdateCloudsParameters(processor);
+    }
 
     float block_peak = 0.0f;
 
@@ -115,16 +211,41 @@ void ProcessAudioThroughClouds(AudioHandle::InterleavingInputBuffer in,
 
     processor.Process(g_clouds_in, g_clouds_out, frame_count);
 
+    WavRecorder& recorder = g_audio_engine.GetRecorder();
+    if (recorder.IsRecording()) {
+        // The CV outputs render at the DAC rate; one value per block here
+        const CvOutputEngine& cv = g_hardware.GetCvOutput();
+        const float pitch_cv = cv.GetPitchOutput() / CvOutputEngine::kMaxVoltage;
+        const float pressure_cv = cv.GetPressureOutput() / CvOutputEngine::kMaxVoltage;
+        float* tap = g_recorder_tap;
+        for(size_t frame = 0; frame < frame_count; ++frame) {
+            tap[0] = g_clouds_in[frame].l;
+            tap[1] = g_clouds_in[frame].r;
+            tap[2] = g_clouds_out[frame].l;
+            tap[3] = g_clouds_out[frame].r;
+            tap[4] = pitch_cv;
+            tap[5] = pressure_cv;
+            tap += kRecorderChannels;
+        }
+        recorder.Push(g_recorder_tap, frame_count);
+    }
+
     g_controls.SetInputPeakLevel(block_peak);
 
     const float master_vol = g_controls.GetAudioControlSnapshot().master_volume;
+    const float fade_target = g_mute_request.load(std::memory_order_relaxed) ? 0.0f : 1.0f;
     for(size_t frame = 0; frame < frame_count; ++frame) {
         const size_t idx = frame * 2;
+        if (g_fade_gain != fade_target) {
+            g_fade_gain = fade_target > g_fade_gain ? std::min(g_fade_gain + kFadeStep, 1.0f)
+                                                    : std::max(g_fade_gain - kFadeStep, 0.0f);
+        }
         // Mono output to left channel only (use left channel, no summing to avoid combing)
         float mono = g_clouds_out[frame].l;
-        out[idx]     = mono * kOutputGain * master_vol;
+        out[idx]     = mono * kOutputGain * master_vol * g_fade_gain;
         out[idx + 1] = 0.0f;
     }
+    g_muted.store(g_fade_gain == 0.0f, std::memory_order_release);
 
     for(size_t frame = frame_count; frame < total_frames; ++frame) {
         const size_t idx = frame * 2;
@@ -135,17 +256,22 @@ void ProcessAudioThroughClouds(AudioHandle::InterleavingInputBuffer in,
     UpdatePerformanceMonitors(size, out);
 }
 
+void SetAudioMuted(bool muted) {
+    g_mute_request.store(muted, std::memory_order_relaxed);
+}
+
+bool IsAudioMuted() {
+    return g_muted.load(std::memory_order_acquire);
+}
+
+uint32_t GetXrunCount() {
+    return g_xruns.load(std::memory_order_relaxed);
+}
+
 void UpdatePerformanceMonitors(size_t size, AudioHandle::InterleavingOutputBuffer out) {
     if (size > 0) {
         float current_level = fabsf(out[0]);
         float prev = g_controls.GetSmoothedOutputLevel();
         g_controls.SetSmoothedOutputLevel(prev * 0.99f + current_level * 0.01f);
     }
-
-    static uint32_t display_counter = 0;
-    static const uint32_t display_interval_blocks = (uint32_t)(g_hardware.GetSampleRate() / BLOCK_SIZE * 3.0f);
-    if (++display_counter >= display_interval_blocks) {
-        display_counter = 0;
-        g_controls.SetUpdateDisplay(true);
-    }
 }
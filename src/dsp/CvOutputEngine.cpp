@@ -0,0 +1,188 @@
+#include "CvOutputEngine.h"
+#include <algorithm>
+#include <cmath>
+
+using daisy::System;
+
+namespace {
+
+constexpr float kTwoPi = 6.283185307f;
+constexpr float kMaxVoltage = CvOutputEngine::kMaxVoltage;
+
+// 0-5 V on the 12-bit DAC
+inline uint16_t VoltageToCode(float volts) {
+    float code = volts * 819.0f;
+    code = std::min(std::max(code, 0.0f), 4095.0f);
+    return static_cast<uint16_t>(code);
+}
+
+inline float OnePoleCoefficient(float time_constant, float rate) {
+    return time_constant > 0.0f ? 1.0f - expf(-1.0f / (time_constant * rate)) : 1.0f;
+}
+
+} // namespace
+
+// Bound to std::min and std::max by reference
+constexpr float CvOutputEngine::kMaxVoltage;
+
+CvOutputEngine* CvOutputEngine::instance_ = nullptr;
+
+void CvOutputEngine::Config::Defaults() {
+    scale = nullptr;
+    scale_size = 0;
+    center_degree = 0;
+    offset = 0.0f;
+    base_voltage = 0.0f;
+    glide_time = 0.002f;      // Smooths steps without audible portamento
+    pressure_time = 0.005f;   // One touch poll period
+    vibrato_rate = 6.0f;
+}
+
+CvOutputEngine::CvOutputEngine()
+    : glide_coefficient_(1.0f),
+      pressure_coefficient_(1.0f),
+      vibrato_increment_(0.0f),
+      pitch_index_(0),
+      vibrato_depth_(0.0f),
+      pressure_target_(0.0f),
+      pitch_output_(0.0f),
+      pressure_output_(0.0f),
+      steps_head_(0),
+      steps_tail_(0),
+      seen_pitch_index_(0),
+      has_step_(false),
+      step_volts_(0.0f),
+      pitch_(0.0f),
+      pressure_(0.0f),
+      vibrato_phase_(0.0f),
+      vibrato_(0.0f) {
+    config_.Defaults();
+    pitch_targets_[0] = pitch_targets_[1] = PitchTarget{0.0f, false, false};
+}
+
+void CvOutputEngine::Init(const Config& config) {
+    config_ = config;
+    glide_coefficient_ = OnePoleCoefficient(config_.glide_time, kDacRate);
+    pressure_coefficient_ = OnePoleCoefficient(config_.pressure_time, kDacRate);
+    vibrato_increment_ = config_.vibrato_rate / kDacRate;
+}
+
+void CvOutputEngine::Start(daisy::patch_sm::DaisyPatchSM& hw) {
+    instance_ = this;
+    hw.StartDac(&CvOutputEngine::DacCallback);
+}
+
+void CvOutputEngine::SetPitchFromPad(float pad_position, bool quantize) {
+    PublishPitchTarget(PitchTarget{pad_position, true, quantize});
+}
+
+void CvOutputEngine::SetPitchVoltage(float volts) {
+    PublishPitchTarget(PitchTarget{volts, false, false});
+}
+
+void CvOutputEngine::PublishPitchTarget(const PitchTarget& target) {
+    // The DAC interrupt only reads the published slot
+    const uint8_t next = pitch_index_.load(std::memory_order_relaxed) ^ 1;
+    pitch_targets_[next] = target;
+    pitch_index_.store(next, std::memory_order_release);
+}
+
+bool CvOutputEngine::SchedulePitchVoltage(float volts, uint32_t tick) {
+    const uint32_t head = steps_head_.load(std::memory_order_relaxed);
+    if (head - steps_tail_.load(std::memory_order_acquire) >= kMaxScheduledSteps) {
+        return false;
+    }
+    steps_[head & (kMaxScheduledSteps - 1)] = PitchStep{volts, tick};
+    steps_head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+float CvOutputEngine::PadToVoltage(float pad_position, bool quantize) const {
+    if (!config_.scale || config_.scale_size <= 0) {
+        return config_.base_voltage;
+    }
+    const int last = config_.scale_size - 1;
+    pad_position = std::min(std::max(pad_position, 0.0f), static_cast<float>(last));
+    if (quantize) {
+        pad_position = floorf(pad_position + 0.5f);
+    }
+    const int i0 = static_cast<int>(pad_position);
+    const int i1 = std::min(i0 + 1, last);
+    const float frac = pad_position - static_cast<float>(i0);
+    const float* scale = config_.scale;
+    float semitones = scale[i0] + (scale[i1] - scale[i0]) * frac;
+    semitones += config_.offset - scale[config_.center_degree];
+    return config_.base_voltage + semitones / 12.0f;
+}
+
+void CvOutputEngine::DacCallback(uint16_t** output, size_t size) {
+    if (instance_) {
+        instance_->Process(output, size);
+    }
+}
+
+// Frame of the block starting at `entry_tick` on which the step at `tail`
+// leaves, no earlier than `first`; `size` when none is due in the block
+size_t CvOutputEngine::StepFrame(uint32_t tail, uint32_t head, uint32_t entry_tick, size_t first, size_t size) const {
+    if (tail == head) {
+        return size;
+    }
+    // The block leaves after the one queued before it: frame i at
+    // entry + (size + i) frames
+    const float ticks_per_frame = static_cast<float>(System::GetTickFreq()) / kDacRate;
+    const int32_t until = static_cast<int32_t>(steps_[tail & (kMaxScheduledSteps - 1)].tick - entry_tick);
+    const float frame = static_cast<float>(until) / ticks_per_frame - static_cast<float>(size);
+    if (frame >= static_cast<float>(size)) {
+        return size;
+    }
+    return frame > static_cast<float>(first) ? static_cast<size_t>(frame) : first;
+}
+
+void CvOutputEngine::Process(uint16_t** output, size_t size) {
+    const uint32_t entry_tick = System::GetTick();
+
+    // Targets and scale mapping: once per block. A target published since
+    // the last block replaces the step holding the pitch.
+    const uint8_t index = pitch_index_.load(std::memory_order_acquire);
+    if (index != seen_pitch_index_) {
+        seen_pitch_index_ = index;
+        has_step_ = false;
+    }
+    const PitchTarget& target = pitch_targets_[index];
+    float pitch_target = target.is_pad ? PadToVoltage(target.value, target.quantize) : target.value;
+    pitch_target = std::min(std::max(has_step_ ? step_volts_ : pitch_target, 0.0f), kMaxVoltage);
+    float pressure_target = pressure_target_.load(std::memory_order_relaxed);
+    pressure_target = std::min(std::max(pressure_target, 0.0f), kMaxVoltage);
+
+    uint32_t tail = steps_tail_.load(std::memory_order_relaxed);
+    const uint32_t head = steps_head_.load(std::memory_order_acquire);
+    size_t step_frame = StepFrame(tail, head, entry_tick, 0, size);
+
+    // Vibrato at the end of the block, ramped to from the previous one
+    vibrato_phase_ += vibrato_increment_ * static_cast<float>(size);
+    if (vibrato_phase_ >= 1.0f) {
+        vibrato_phase_ -= 1.0f;
+    }
+    const float depth = vibrato_depth_.load(std::memory_order_relaxed);
+    const float vibrato_end = sinf(kTwoPi * vibrato_phase_) * depth / 12.0f;
+    const float vibrato_step = (vibrato_end - vibrato_) / static_cast<float>(size);
+
+    for (size_t i = 0; i < size; ++i) {
+        // Steps due by this frame; late ones land on the first
+        while (step_frame == i) {
+            step_volts_ = steps_[tail & (kMaxScheduledSteps - 1)].volts;
+            has_step_ = true;
+            pitch_target = std::min(std::max(step_volts_, 0.0f), kMaxVoltage);
+            steps_tail_.store(++tail, std::memory_order_release);
+            step_frame = StepFrame(tail, head, entry_tick, i, size);
+        }
+        pitch_ += (pitch_target - pitch_) * glide_coefficient_;
+        pressure_ += (pressure_target - pressure_) * pressure_coefficient_;
+        vibrato_ += vibrato_step;
+        output[0][i] = VoltageToCode(pitch_ + vibrato_);
+        output[1][i] = VoltageToCode(pressure_);
+    }
+    vibrato_ = vibrato_end;
+    pitch_output_.store(std::min(std::max(pitch_ + vibrato_, 0.0f), kMaxVoltage), std::memory_order_relaxed);
+    pressure_output_.store(pressure_, std::memory_order_relaxed);
+}
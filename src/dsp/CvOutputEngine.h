@@ -0,0 +1,122 @@
+#ifndef CV_OUTPUT_ENGINE_H
+#define CV_OUTPUT_ENGINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "daisy_patch_sm.h"
+
+/**
+ * CvOutputEngine renders CV_OUT_1 (pitch) and CV_OUT_2 (pressure) at the
+ * DAC's DMA rate (48 kHz, independent of the audio sample rate):
+ * - Pitch follows a pad position mapped through the scale (quantised to
+ *   the nearest degree, or blended between degrees while sliding), or a
+ *   raw voltage
+ * - Glide and pressure slew are one-pole filters run per sample
+ * - Vibrato is a free-running sine LFO, evaluated per DMA block and
+ *   interpolated across it
+ * - Pitch steps scheduled by the audio callback (arpeggiator notes) land on
+ *   the frame that leaves the DAC at their TIM2 tick. Frames are placed
+ *   from the callback's entry tick, so an entry held back by the audio
+ *   callback shifts them by as much
+ *
+ * The main loop only sets targets; rendering runs in the DAC DMA interrupt.
+ */
+class CvOutputEngine {
+public:
+    static constexpr float kMaxVoltage = 5.0f;    // DAC full scale
+
+    // Lead of a scheduled step over the audio block that played its note:
+    // the next DMA block may start up to one block later, and its first
+    // frame leaves one block after that
+    static constexpr uint32_t kScheduleDelayUs = 2000;
+
+    struct Config {
+        const float* scale;     // Semitone offset of each pad
+        int scale_size;
+        int center_degree;      // Pad that maps to base_voltage + offset
+        float offset;           // Semitones added to every degree
+        float base_voltage;
+        float glide_time;       // Seconds (time constant)
+        float pressure_time;    // Seconds (time constant)
+        float vibrato_rate;     // Hz
+
+        void Defaults();
+    };
+
+    CvOutputEngine();
+    ~CvOutputEngine() = default;
+
+    void Init(const Config& config);
+
+    // Installs the engine as the DAC DMA callback
+    void Start(daisy::patch_sm::DaisyPatchSM& hw);
+
+    // Targets (main loop)
+    void SetPitchFromPad(float pad_position, bool quantize);
+    void SetPitchVoltage(float volts);
+    void SetVibratoDepth(float semitones) { vibrato_depth_.store(semitones, std::memory_order_relaxed); }
+    void SetPressureVoltage(float volts) { pressure_target_.store(volts, std::memory_order_relaxed); }
+
+    // Audio callback: a pitch step in volts at the TIM2 tick. It holds until
+    // the next step or target. Returns false when the queue is full.
+    bool SchedulePitchVoltage(float volts, uint32_t tick);
+
+    // Pitch voltage of a pad position, following the same mapping
+    float PadToVoltage(float pad_position, bool quantize) const;
+
+    // Voltages at the end of the last rendered block (any context)
+    float GetPitchOutput() const { return pitch_output_.load(std::memory_order_relaxed); }
+    float GetPressureOutput() const { return pressure_output_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr float kDacRate = 48000.0f;
+    static constexpr size_t kMaxScheduledSteps = 8;   // Power of two
+
+    struct PitchTarget {
+        float value;            // Volts, or pad position
+        bool is_pad;
+        bool quantize;
+    };
+    void PublishPitchTarget(const PitchTarget& target);
+
+    struct PitchStep {
+        float volts;
+        uint32_t tick;
+    };
+
+    static void DacCallback(uint16_t** output, size_t size);
+    void Process(uint16_t** output, size_t size);
+    size_t StepFrame(uint32_t tail, uint32_t head, uint32_t entry_tick, size_t first, size_t size) const;
+
+    static CvOutputEngine* instance_;
+
+    Config config_;
+    float glide_coefficient_;
+    float pressure_coefficient_;
+    float vibrato_increment_;
+
+    // Double-buffered: the main loop fills the inactive slot, then flips
+    PitchTarget pitch_targets_[2];
+    std::atomic<uint8_t> pitch_index_;
+    std::atomic<float> vibrato_depth_;
+    std::atomic<float> pressure_target_;
+    std::atomic<float> pitch_output_;
+    std::atomic<float> pressure_output_;
+
+    // Audio callback to DAC interrupt; both run at the same priority
+    PitchStep steps_[kMaxScheduledSteps];
+    std::atomic<uint32_t> steps_head_;
+    std::atomic<uint32_t> steps_tail_;
+
+    // DAC interrupt state
+    uint8_t seen_pitch_index_;  // Target last read; a new one ends a step
+    bool has_step_;
+    float step_volts_;          // Pitch since the last step, while it holds
+    float pitch_;
+    float pressure_;
+    float vibrato_phase_;
+    float vibrato_;
+};
+
+#endif // CV_OUTPUT_ENGINE_H
@@ -0,0 +1,409 @@
+#include "FlashLog.h"
+#include <cstddef>
+#include <cstring>
+#include "stm32h7xx.h"
+#include "sys/system.h"
+
+using daisy::System;
+using QspiFlash::kSectorSize;
+using QspiFlash::Mapped;
+
+namespace {
+constexpr uint32_t kMagic = 0x474F4C4B;    // 'KLOG'
+constexpr uint16_t kErased = 0xFFFF;
+// Bytes per program command; each is suspended if it runs past the slice
+constexpr uint32_t kChunkSize = 64;
+}
+
+void FlashLog::Config::Defaults() {
+    base = 0;              // Below the firmware image at 0x40000
+    num_sectors = 16;
+    slice_us = 100;
+}
+
+FlashLog::FlashLog()
+    : slice_ticks_(1),
+      writable_(false),
+      has_head_(false),
+      head_sector_(0),
+      head_sequence_(0),
+      write_offset_(0),
+      spare_ready_(false),
+      next_ticket_(0),
+      job_(Job::NONE),
+      job_address_(0),
+      job_size_(0),
+      job_done_(0),
+      job_chunk_(0),
+      job_suspended_(false),
+      job_slot_(-1),
+      job_ticket_(0),
+      job_key_(0),
+      erase_count_(0),
+      records_written_(0),
+      verify_failures_(0) {
+    // Relocating every key out of the sector being reclaimed must leave
+    // room for one more record, or the head could fill before the spare is
+    // erased
+    static_assert(sizeof(SectorHeader) + (kMaxKeys + 1) * Span(kMaxRecordSize) <= kSectorSize,
+                  "all keys must fit in one sector with room to spare");
+    config_.Defaults();
+    for (int i = 0; i < kMaxKeys; ++i) {
+        index_[i] = kNoRecord;
+    }
+    for (int i = 0; i < kQueueDepth; ++i) {
+        pending_[i].used = false;
+    }
+}
+
+void FlashLog::Init(const Config& config) {
+    config_ = config;
+    const uint32_t ticks_per_us = System::GetTickFreq() / 1000000;
+    slice_ticks_ = config_.slice_us * (ticks_per_us ? ticks_per_us : 1);
+    writable_ = config_.num_sectors >= 3 && config_.base % kSectorSize == 0;
+
+    // QspiFlash runs from a copy made with .data; make sure it reached SRAM
+    // rather than sitting in the D-cache
+    SCB_CleanDCache();
+
+    // The newest intact sector header is the head
+    has_head_ = false;
+    const SectorHeader* head = nullptr;
+    for (uint32_t sector = 0; sector < config_.num_sectors; ++sector) {
+        const SectorHeader* header = reinterpret_cast<const SectorHeader*>(Mapped(SectorAddress(sector)));
+        if (header->magic != kMagic || header->crc != Crc32(header, offsetof(SectorHeader, crc))) {
+            continue;
+        }
+        if (!head || static_cast<int32_t>(header->sequence - head_sequence_) > 0) {
+            head = header;
+            head_sector_ = sector;
+            head_sequence_ = header->sequence;
+        }
+    }
+
+    for (int i = 0; i < kMaxKeys; ++i) {
+        index_[i] = head ? head->index[i] : kNoRecord;
+    }
+    if (head) {
+        has_head_ = true;
+        ScanHead();
+    }
+    // Checked (and relocated from or erased) by Process()
+    spare_ready_ = false;
+}
+
+const FlashLog::RecordHeader* FlashLog::ValidRecord(uint32_t address) const {
+    const uint32_t end = config_.base + config_.num_sectors * kSectorSize;
+    if (address < config_.base || address + sizeof(RecordHeader) > end || address % 4 != 0) {
+        return nullptr;
+    }
+    const RecordHeader* record = reinterpret_cast<const RecordHeader*>(Mapped(address));
+    if (record->size > kMaxRecordSize || record->key >= kMaxKeys || address + Span(record->size) > end) {
+        return nullptr;
+    }
+    const uint32_t crc = Crc32(record, offsetof(RecordHeader, crc));
+    if (Crc32(record + 1, record->size, crc) != record->crc) {
+        return nullptr;
+    }
+    return record;
+}
+
+bool FlashLog::IsSectorBlank(uint32_t sector) const {
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(Mapped(SectorAddress(sector)));
+    for (uint32_t i = 0; i < kSectorSize / 4; ++i) {
+        if (words[i] != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Applies the records written after the head's index was taken
+void FlashLog::ScanHead() {
+    const uint32_t sector_address = SectorAddress(head_sector_);
+    uint32_t offset = sizeof(SectorHeader);
+    while (offset + sizeof(RecordHeader) <= kSectorSize) {
+        const RecordHeader* record = reinterpret_cast<const RecordHeader*>(Mapped(sector_address + offset));
+        if (record->size == kErased) {
+            break;
+        }
+        if (record->size > kMaxRecordSize || offset + Span(record->size) > kSectorSize) {
+            // Torn header: nothing after it can be trusted to be erased
+            offset = kSectorSize;
+            break;
+        }
+        // A record torn by a power loss fails its CRC and is skipped
+        if (ValidRecord(sector_address + offset)) {
+            index_[record->key] = sector_address + offset;
+        }
+        offset += Span(record->size);
+    }
+    write_offset_ = offset;
+}
+
+bool FlashLog::Read(uint8_t key, void* data, size_t size) const {
+    if (key >= kMaxKeys) {
+        return false;
+    }
+    for (int i = 0; i < kQueueDepth; ++i) {
+        const Pending& pending = pending_[i];
+        if (pending.used && pending.key == key) {
+            if (pending.size != size) {
+                return false;
+            }
+            memcpy(data, pending.data, size);
+            return true;
+        }
+    }
+    if (index_[key] == kNoRecord) {
+        return false;
+    }
+    const RecordHeader* record = ValidRecord(index_[key]);
+    if (!record || record->size != size) {
+        return false;
+    }
+    memcpy(data, record + 1, size);
+    return true;
+}
+
+bool FlashLog::Write(uint8_t key, const void* data, size_t size) {
+    if (!writable_ || key >= kMaxKeys || size > kMaxRecordSize) {
+        return false;
+    }
+    int slot = -1;
+    for (int i = 0; i < kQueueDepth; ++i) {
+        if (pending_[i].used && pending_[i].key == key) {
+            slot = i;
+            break;
+        }
+        if (!pending_[i].used && slot < 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return false;
+    }
+    Pending& pending = pending_[slot];
+    pending.key = key;
+    pending.size = static_cast<uint16_t>(size);
+    pending.ticket = next_ticket_++;
+    memcpy(pending.data, data, size);
+    pending.used = true;
+    return true;
+}
+
+bool FlashLog::IsBusy() const {
+    if (job_ != Job::NONE) {
+        return true;
+    }
+    for (int i = 0; i < kQueueDepth; ++i) {
+        if (pending_[i].used) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlashLog::Process() {
+    if (!writable_) {
+        return;
+    }
+    if (job_ != Job::NONE) {
+        StepJob();
+        return;
+    }
+
+    // Reclaim the sector after the head before anything else is appended:
+    // copy forward what is still current in it, then erase it
+    if (!spare_ready_) {
+        const uint32_t spare = SpareSector();
+        for (int key = 0; key < kMaxKeys; ++key) {
+            if (index_[key] == kNoRecord || SectorOf(index_[key]) != spare) {
+                continue;
+            }
+            const RecordHeader* record = ValidRecord(index_[key]);
+            if (!record) {
+                index_[key] = kNoRecord;
+                continue;
+            }
+            if (write_offset_ + Span(record->size) > kSectorSize) {
+                // Only reachable after a failed program in the head
+                writable_ = false;
+                return;
+            }
+            StartRecord(static_cast<uint8_t>(key), record + 1, record->size, -1);
+            return;
+        }
+        if (IsSectorBlank(spare)) {
+            spare_ready_ = true;
+        } else {
+            StartEraseSpare();
+            return;
+        }
+    }
+
+    int slot = -1;
+    for (int i = 0; i < kQueueDepth; ++i) {
+        if (pending_[i].used
+            && (slot < 0 || static_cast<int32_t>(pending_[i].ticket - pending_[slot].ticket) < 0)) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return;
+    }
+    const Pending& pending = pending_[slot];
+    if (!has_head_ || write_offset_ + Span(pending.size) > kSectorSize) {
+        StartOpenSector();
+        return;
+    }
+    StartRecord(pending.key, pending.data, pending.size, slot);
+}
+
+void FlashLog::StartRecord(uint8_t key, const void* data, size_t size, int pending_slot) {
+    RecordHeader header;
+    header.size = static_cast<uint16_t>(size);
+    header.key = key;
+    header.reserved = 0xFF;
+    header.crc = Crc32(data, size, Crc32(&header, offsetof(RecordHeader, crc)));
+
+    // Copied: the source may be queued data that changes, or the flash
+    // itself when relocating
+    memcpy(job_buffer_, &header, sizeof(header));
+    memcpy(job_buffer_ + sizeof(header), data, size);
+
+    job_ = Job::WRITE_RECORD;
+    job_address_ = SectorAddress(head_sector_) + write_offset_;
+    job_size_ = sizeof(header) + size;
+    job_done_ = 0;
+    job_suspended_ = false;
+    job_key_ = key;
+    job_slot_ = pending_slot;
+    job_ticket_ = pending_slot >= 0 ? pending_[pending_slot].ticket : 0;
+}
+
+void FlashLog::StartOpenSector() {
+    SectorHeader header;
+    header.magic = kMagic;
+    header.sequence = head_sequence_ + 1;
+    for (int i = 0; i < kMaxKeys; ++i) {
+        header.index[i] = index_[i];
+    }
+    header.crc = Crc32(&header, offsetof(SectorHeader, crc));
+    memcpy(job_buffer_, &header, sizeof(header));
+
+    job_ = Job::OPEN_SECTOR;
+    job_address_ = SectorAddress(SpareSector());
+    job_size_ = sizeof(header);
+    job_done_ = 0;
+    job_suspended_ = false;
+}
+
+void FlashLog::StartEraseSpare() {
+    job_ = Job::ERASE_SPARE;
+    job_address_ = SectorAddress(SpareSector());
+    job_size_ = kSectorSize;
+    job_done_ = 0;
+    job_suspended_ = false;
+}
+
+void FlashLog::StepJob() {
+    QspiFlash::Result result;
+    if (!job_suspended_ && QspiFlash::IsSuspended()) {
+        return;    // Another client's operation
+    } else if (job_suspended_) {
+        result = QspiFlash::Resume(slice_ticks_);
+    } else if (job_ == Job::ERASE_SPARE) {
+        result = QspiFlash::Erase(job_address_, slice_ticks_);
+    } else {
+        const uint32_t address = job_address_ + job_done_;
+        uint32_t chunk = job_size_ - job_done_;
+        if (chunk > kChunkSize) {
+            chunk = kChunkSize;
+        }
+        const uint32_t page_left = QspiFlash::kPageSize - address % QspiFlash::kPageSize;
+        if (chunk > page_left) {
+            chunk = page_left;
+        }
+        job_chunk_ = chunk;
+        result = QspiFlash::Program(address, job_buffer_ + job_done_, chunk, slice_ticks_);
+    }
+
+    if (result == QspiFlash::Result::DEFERRED) {
+        return;    // Too close to the next audio block
+    }
+    if (result == QspiFlash::Result::ERROR) {
+        // Write protected: stay read-only
+        writable_ = false;
+        job_ = Job::NONE;
+        return;
+    }
+    if (result == QspiFlash::Result::SUSPENDED) {
+        job_suspended_ = true;
+        return;
+    }
+    job_suspended_ = false;
+    if (job_ != Job::ERASE_SPARE) {
+        job_done_ += job_chunk_;
+        if (job_done_ < job_size_) {
+            return;
+        }
+    }
+    FinishJob();
+}
+
+void FlashLog::FinishJob() {
+    // The flash changed underneath the D-cache
+    SCB_InvalidateDCache_by_Addr(const_cast<uint8_t*>(Mapped(job_address_)), job_size_);
+
+    const Job job = job_;
+    job_ = Job::NONE;
+    const bool verified = job == Job::ERASE_SPARE || memcmp(Mapped(job_address_), job_buffer_, job_size_) == 0;
+
+    if (job == Job::ERASE_SPARE) {
+        ++erase_count_;
+        spare_ready_ = IsSectorBlank(SpareSector());
+        if (!spare_ready_) {
+            ++verify_failures_;    // Erased again on the next call
+        }
+    } else if (job == Job::OPEN_SECTOR) {
+        if (!verified) {
+            ++verify_failures_;
+            spare_ready_ = false;
+            return;
+        }
+        has_head_ = true;
+        head_sector_ = SectorOf(job_address_);
+        head_sequence_ = reinterpret_cast<const SectorHeader*>(job_buffer_)->sequence;
+        write_offset_ = sizeof(SectorHeader);
+        spare_ready_ = false;
+    } else if (job == Job::WRITE_RECORD) {
+        if (!verified) {
+            // Retried from a fresh sector
+            ++verify_failures_;
+            write_offset_ = kSectorSize;
+            return;
+        }
+        index_[job_key_] = job_address_;
+        write_offset_ += Span(job_size_ - sizeof(RecordHeader));
+        ++records_written_;
+        if (job_slot_ >= 0 && pending_[job_slot_].ticket == job_ticket_) {
+            pending_[job_slot_].used = false;
+        }
+    }
+}
+
+uint32_t FlashLog::Crc32(const void* data, size_t size, uint32_t crc) {
+    // Reflected 0xEDB88320, four bits at a time
+    static const uint32_t kTable[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = kTable[(crc ^ bytes[i]) & 0x0F] ^ (crc >> 4);
+        crc = kTable[(crc ^ (bytes[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
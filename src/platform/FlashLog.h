@@ -0,0 +1,145 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include "QspiFlash.h"
+
+/**
+ * FlashLog is a small key/value store on the QSPI flash, written without
+ * stopping the firmware that executes from the same chip:
+ * - Records are appended to a ring of 4 kB sectors, so every sector is
+ *   erased equally often (wear levelling); each record carries a CRC32
+ * - Each sector starts with a header holding an index of the latest record
+ *   per key as of when the sector was opened. Mounting reads the sector
+ *   headers, takes the index of the newest and scans that one sector, so
+ *   boot time does not grow with the history
+ * - The sector after the head is kept erased. Before it is erased, the
+ *   records still current in it are copied forward into the head
+ * - Write() only queues; Process() advances the erase/program work by one
+ *   QspiFlash slice per call and verifies each record after programming
+ *
+ * A power loss at any point leaves the previous value of every key
+ * readable. Main loop only.
+ */
+class FlashLog {
+public:
+    struct Config {
+        uint32_t base;          // Flash offset of the first sector (sector aligned)
+        uint32_t num_sectors;   // Ring length, at least 3
+        uint32_t slice_us;      // Flash busy time per Process() call, at most
+
+        void Defaults();
+    };
+
+    static constexpr int kMaxKeys = 12;
+    static constexpr size_t kMaxRecordSize = 240;
+    static constexpr int kQueueDepth = 4;
+
+    FlashLog();
+    ~FlashLog() = default;
+
+    // Mounts the log: finds the newest sector and rebuilds the index
+    void Init(const Config& config);
+
+    // Copies the latest value of key (pending writes first). Returns false
+    // when there is none or its size differs (an older layout).
+    bool Read(uint8_t key, void* data, size_t size) const;
+
+    // Queues a value; a queued value for the same key is replaced. Returns
+    // false when the queue is full or the value too large.
+    bool Write(uint8_t key, const void* data, size_t size);
+
+    // Does one slice of flash work
+    void Process();
+
+    bool IsBusy() const;
+    bool IsWritable() const { return writable_; }
+
+    uint32_t GetSequence() const { return head_sequence_; }
+    uint32_t GetEraseCount() const { return erase_count_; }
+    uint32_t GetRecordsWritten() const { return records_written_; }
+    uint32_t GetVerifyFailures() const { return verify_failures_; }
+
+    static uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0);
+
+private:
+    static constexpr uint32_t kNoRecord = 0xFFFFFFFF;
+
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t index[kMaxKeys];   // Flash offsets, kNoRecord when none
+        uint32_t crc;
+    };
+
+    struct RecordHeader {
+        uint16_t size;              // 0xFFFF: erased, end of the sector
+        uint8_t key;
+        uint8_t reserved;
+        uint32_t crc;               // Over key, size and the payload
+    };
+
+    struct Pending {
+        bool used;
+        uint8_t key;
+        uint16_t size;
+        uint32_t ticket;            // Queue order; changes when replaced
+        uint8_t data[kMaxRecordSize];
+    };
+
+    enum class Job {
+        NONE,
+        OPEN_SECTOR,
+        WRITE_RECORD,
+        ERASE_SPARE,
+    };
+
+    // Flash taken by a record: header and payload, word aligned
+    static constexpr uint32_t Span(size_t size) { return (sizeof(RecordHeader) + size + 3) & ~3u; }
+    uint32_t SectorAddress(uint32_t sector) const { return config_.base + sector * QspiFlash::kSectorSize; }
+    uint32_t SectorOf(uint32_t address) const { return (address - config_.base) / QspiFlash::kSectorSize; }
+    uint32_t SpareSector() const { return has_head_ ? (head_sector_ + 1) % config_.num_sectors : 0; }
+
+    const RecordHeader* ValidRecord(uint32_t address) const;
+    bool IsSectorBlank(uint32_t sector) const;
+    void ScanHead();
+
+    void StartRecord(uint8_t key, const void* data, size_t size, int pending_slot);
+    void StartOpenSector();
+    void StartEraseSpare();
+    void StepJob();
+    void FinishJob();
+
+    Config config_;
+    uint32_t slice_ticks_;
+    bool writable_;
+
+    uint32_t index_[kMaxKeys];
+    bool has_head_;
+    uint32_t head_sector_;
+    uint32_t head_sequence_;
+    uint32_t write_offset_;         // Within the head sector
+    bool spare_ready_;              // Sector after the head is erased
+
+    Pending pending_[kQueueDepth];
+    uint32_t next_ticket_;
+
+    // Flash work in progress; the source must be in RAM while programming
+    Job job_;
+    uint32_t job_address_;
+    uint32_t job_size_;
+    uint32_t job_done_;
+    uint32_t job_chunk_;            // Bytes in the current (maybe suspended) program
+    bool job_suspended_;
+    int job_slot_;                  // Pending slot, or -1 when relocating
+    uint32_t job_ticket_;
+    uint8_t job_key_;
+    alignas(4) uint8_t job_buffer_[sizeof(RecordHeader) + kMaxRecordSize];
+
+    uint32_t erase_count_;
+    uint32_t records_written_;
+    uint32_t verify_failures_;
+};
+
+#endif // FLASH_LOG_H
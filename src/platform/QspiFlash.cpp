@@ -0,0 +1,225 @@
+#include "QspiFlash.h"
+#include "stm32h7xx.h"
+#include "dev/flash_IS25LP064A.h"
+#include "sys/system.h"
+
+// Everything below runs from RAM with interrupts masked: no HAL or libdaisy
+// calls, no switch tables or other read-only data that would live in QSPI.
+
+namespace {
+
+// Function register suspend flags (IS25LP064A datasheet, table 6.11)
+constexpr uint8_t kFunctionPsus = 0x04;
+constexpr uint8_t kFunctionEsus = 0x08;
+
+// 1-line instruction; 1-line 24-bit address; 1-line data
+constexpr uint32_t kInstruction1 = QUADSPI_CCR_IMODE_0;
+constexpr uint32_t kAddress1 = QUADSPI_CCR_ADMODE_0 | QUADSPI_CCR_ADSIZE_1;
+constexpr uint32_t kData1 = QUADSPI_CCR_DMODE_0;
+constexpr uint32_t kIndirectRead = QUADSPI_CCR_FMODE_0;
+
+QSPI_RAM_FUNC void WaitIdle() {
+    while (QUADSPI->SR & QUADSPI_SR_BUSY) {
+    }
+}
+
+QSPI_RAM_FUNC void WaitTransfer() {
+    while (!(QUADSPI->SR & QUADSPI_SR_TCF)) {
+    }
+    QUADSPI->FCR = QUADSPI_FCR_CTCF;
+}
+
+QSPI_RAM_FUNC uint8_t ReadDataByte() {
+    while (!(QUADSPI->SR & QUADSPI_SR_TCF)) {
+    }
+    const uint8_t value = *reinterpret_cast<volatile uint8_t*>(&QUADSPI->DR);
+    QUADSPI->FCR = QUADSPI_FCR_CTCF;
+    return value;
+}
+
+// Instruction only: starts on the CCR write
+QSPI_RAM_FUNC void Command(uint8_t instruction) {
+    WaitIdle();
+    QUADSPI->CCR = kInstruction1 | instruction;
+    WaitTransfer();
+}
+
+QSPI_RAM_FUNC uint8_t ReadRegister(uint8_t instruction) {
+    WaitIdle();
+    QUADSPI->DLR = 0;
+    QUADSPI->CCR = kIndirectRead | kData1 | kInstruction1 | instruction;
+    return ReadDataByte();
+}
+
+// Polls WIP until clear or the budget has passed since start
+QSPI_RAM_FUNC bool WaitReady(uint32_t start, uint32_t budget_ticks) {
+    while (ReadRegister(READ_STATUS_REG_CMD) & IS25LP064A_SR_WIP) {
+        if (TIM2->CNT - start >= budget_ticks) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QSPI_RAM_FUNC void WaitReadyForever() {
+    while (ReadRegister(READ_STATUS_REG_CMD) & IS25LP064A_SR_WIP) {
+    }
+}
+
+struct MappedState {
+    uint32_t ccr;
+    uint32_t abr;
+};
+
+// Aborts memory-mapped mode, keeping its configuration for Restore()
+QSPI_RAM_FUNC MappedState LeaveMemoryMapped() {
+    MappedState state;
+    state.ccr = QUADSPI->CCR;
+    state.abr = QUADSPI->ABR;
+    QUADSPI->CR |= QUADSPI_CR_ABORT;
+    while (QUADSPI->CR & QUADSPI_CR_ABORT) {
+    }
+    WaitIdle();
+
+    // libdaisy maps with send-instruction-once and mode bits 0xA0, which
+    // leaves the flash expecting another read address with no instruction.
+    // One such read with mode bits 0x00 returns it to normal commands.
+    if ((state.ccr & QUADSPI_CCR_SIOO) && (state.ccr & QUADSPI_CCR_ABMODE)) {
+        QUADSPI->ABR = 0;
+        QUADSPI->DLR = 0;
+        QUADSPI->CCR = (state.ccr & ~(QUADSPI_CCR_FMODE | QUADSPI_CCR_IMODE | QUADSPI_CCR_SIOO)) | kIndirectRead;
+        QUADSPI->AR = 0;
+        ReadDataByte();
+    }
+    return state;
+}
+
+QSPI_RAM_FUNC void RestoreMemoryMapped(const MappedState& state) {
+    WaitIdle();
+    QUADSPI->ABR = state.abr;
+    QUADSPI->CCR = state.ccr;
+}
+
+enum class Operation {
+    PROGRAM,
+    ERASE,
+    ERASE_BLOCK,
+    RESUME,
+};
+
+// Set by the last slice; RAM like all data, so safe to touch in Run()
+bool g_suspended = false;
+
+// Audio block timing (TIM2 ticks), set by the audio callback and read with
+// interrupts masked
+volatile uint32_t g_block_start = 0;
+volatile uint32_t g_block_period = 0;
+uint32_t g_overhead_ticks = 0;
+uint32_t g_min_budget_ticks = 0;
+
+// Caps the budget to the room left before the next audio callback, less
+// the overhead; 0 when there is too little
+QSPI_RAM_FUNC uint32_t AudioBudget(uint32_t start, uint32_t budget_ticks) {
+    const uint32_t period = g_block_period;
+    const uint32_t elapsed = start - g_block_start;
+    // Two periods without a callback: audio has stopped
+    if (!period || elapsed >= 2 * period) {
+        return budget_ticks;
+    }
+    if (elapsed + g_overhead_ticks + g_min_budget_ticks > period) {
+        return 0;
+    }
+    const uint32_t room = period - elapsed - g_overhead_ticks;
+    return room < budget_ticks ? room : budget_ticks;
+}
+
+QSPI_RAM_FUNC QspiFlash::Result Run(Operation operation, uint32_t address, const uint8_t* data,
+                                    uint32_t size, uint32_t budget_ticks) {
+    const uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    const uint32_t start = TIM2->CNT;
+    budget_ticks = AudioBudget(start, budget_ticks);
+    if (!budget_ticks) {
+        __set_PRIMASK(primask);
+        return QspiFlash::Result::DEFERRED;
+    }
+    const MappedState mapped = LeaveMemoryMapped();
+
+    QspiFlash::Result result = QspiFlash::Result::DONE;
+    if (operation == Operation::RESUME) {
+        Command(PROG_ERASE_RESUME_CMD);
+    } else {
+        Command(WRITE_ENABLE_CMD);
+        if (!(ReadRegister(READ_STATUS_REG_CMD) & IS25LP064A_SR_WREN)) {
+            RestoreMemoryMapped(mapped);
+            __set_PRIMASK(primask);
+            return QspiFlash::Result::ERROR;
+        }
+        WaitIdle();
+        if (operation == Operation::ERASE || operation == Operation::ERASE_BLOCK) {
+            const uint32_t instruction = operation == Operation::ERASE ? SECTOR_ERASE_CMD : BLOCK_ERASE_CMD;
+            QUADSPI->CCR = kAddress1 | kInstruction1 | instruction;
+            QUADSPI->AR = address;
+            WaitTransfer();
+        } else {
+            QUADSPI->DLR = size - 1;
+            QUADSPI->CCR = kData1 | kAddress1 | kInstruction1 | PAGE_PROG_CMD;
+            QUADSPI->AR = address;
+            volatile uint8_t* fifo = reinterpret_cast<volatile uint8_t*>(&QUADSPI->DR);
+            for (uint32_t i = 0; i < size; ++i) {
+                while (!(QUADSPI->SR & QUADSPI_SR_FTF)) {
+                }
+                *fifo = data[i];
+            }
+            WaitTransfer();
+        }
+    }
+
+    if (!WaitReady(start, budget_ticks)) {
+        // Suspend latency is bounded by the flash (tSUS), not by us
+        Command(PROG_ERASE_SUSPEND_CMD);
+        WaitReadyForever();
+        if (ReadRegister(READ_FUNCTION_REGISTER) & (kFunctionPsus | kFunctionEsus)) {
+            result = QspiFlash::Result::SUSPENDED;
+        }
+    }
+
+    g_suspended = result == QspiFlash::Result::SUSPENDED;
+    RestoreMemoryMapped(mapped);
+    __set_PRIMASK(primask);
+    return result;
+}
+
+} // namespace
+
+namespace QspiFlash {
+
+QSPI_RAM_FUNC Result Program(uint32_t address, const uint8_t* data, uint32_t size, uint32_t budget_ticks) {
+    return Run(Operation::PROGRAM, address, data, size, budget_ticks);
+}
+
+QSPI_RAM_FUNC Result Erase(uint32_t address, uint32_t budget_ticks) {
+    return Run(Operation::ERASE, address & ~(kSectorSize - 1), nullptr, 0, budget_ticks);
+}
+
+QSPI_RAM_FUNC Result EraseBlock(uint32_t address, uint32_t budget_ticks) {
+    return Run(Operation::ERASE_BLOCK, address & ~(kBlockSize - 1), nullptr, 0, budget_ticks);
+}
+
+QSPI_RAM_FUNC Result Resume(uint32_t budget_ticks) {
+    return Run(Operation::RESUME, 0, nullptr, 0, budget_ticks);
+}
+
+bool IsSuspended() {
+    return g_suspended;
+}
+
+void SetAudioBlock(uint32_t start_tick, uint32_t period_ticks) {
+    const uint32_t ticks_per_us = daisy::System::GetTickFreq() / 1000000;
+    g_overhead_ticks = kSliceOverheadUs * ticks_per_us;
+    g_min_budget_ticks = kMinBudgetUs * ticks_per_us;
+    g_block_start = start_tick;
+    g_block_period = period_ticks;
+}
+
+} // namespace QspiFlash
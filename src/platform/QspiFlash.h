@@ -0,0 +1,79 @@
+#ifndef QSPI_FLASH_H
+#define QSPI_FLASH_H
+
+#include <cstdint>
+
+// Code in this section is copied to AXI SRAM with .data at reset, so it
+// keeps running while the QSPI flash is out of memory-mapped mode
+#if defined(__arm__)
+#define QSPI_RAM_FUNC __attribute__((section(".data.ramfunc"), noinline, long_call))
+#else
+#define QSPI_RAM_FUNC __attribute__((section(".data.ramfunc"), noinline))
+#endif
+
+/**
+ * QspiFlash programs and erases the IS25LP064A while the firmware executes
+ * from it (libdaisy's QSPIHandle refuses to in that case):
+ * - The routines run from RAM and drive the QUADSPI registers directly;
+ *   memory-mapped mode is left and restored around each call
+ * - Each call is one slice: at most budget_ticks (TIM2 ticks) of flash
+ *   busy time, after which the operation is suspended so the flash can be
+ *   read again. Resume() continues it on a later call
+ * - Interrupts are masked for the slice, since any handler may fetch from
+ *   QSPI. The slice overruns its budget by up to the command transfers and
+ *   the suspend latency (under 100 us), so the budget is also cut to what
+ *   is left of the audio block, measured from the callback's start: the
+ *   next callback is never held back. A slice with too little room is
+ *   deferred
+ *
+ * Addresses are offsets into the flash (0x90000000 when mapped). Data
+ * sources must be in RAM.
+ */
+namespace QspiFlash {
+
+constexpr uint32_t kMappedBase = 0x90000000;
+constexpr uint32_t kSectorSize = 4096;
+constexpr uint32_t kBlockSize = 65536;
+constexpr uint32_t kPageSize = 256;
+
+// Masked time a slice may take beyond its budget: commands, a page of data
+// and the suspend latency
+constexpr uint32_t kSliceOverheadUs = 120;
+// Smallest budget worth leaving memory-mapped mode for
+constexpr uint32_t kMinBudgetUs = 20;
+
+enum class Result {
+    DONE,
+    SUSPENDED,   // Call Resume() before anything else
+    DEFERRED,    // No room before the next audio block; nothing was done
+    ERROR,       // Write enable was refused (protected)
+};
+
+// Audio callback, once per block: the block started at start_tick and the
+// next one is due period_ticks later. 0 (audio stopped) lifts the limit.
+void SetAudioBlock(uint32_t start_tick, uint32_t period_ticks);
+
+// Programs size bytes, which must not cross a page boundary
+QSPI_RAM_FUNC Result Program(uint32_t address, const uint8_t* data, uint32_t size, uint32_t budget_ticks);
+
+// Erases the 4 kB sector containing address
+QSPI_RAM_FUNC Result Erase(uint32_t address, uint32_t budget_ticks);
+
+// Erases the 64 kB block containing address
+QSPI_RAM_FUNC Result EraseBlock(uint32_t address, uint32_t budget_ticks);
+
+// Continues a suspended Program(), Erase() or EraseBlock()
+QSPI_RAM_FUNC Result Resume(uint32_t budget_ticks);
+
+// An operation is suspended. The flash holds only one: callers that did not
+// suspend it must wait for its owner to resume it to completion
+bool IsSuspended();
+
+// Memory-mapped view of a flash offset
+inline const uint8_t* Mapped(uint32_t address) {
+    return reinterpret_cast<const uint8_t*>(kMappedBase + address);
+}
+
+} // namespace QspiFlash
+
+#endif // QSPI_FLASH_H
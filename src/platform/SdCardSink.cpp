@@ -0,0 +1,178 @@
+#include "SdCardSink.h"
+#include "util/bsp_sd_diskio.h"
+
+using namespace daisy;
+
+extern SD_HandleTypeDef hsd1;
+
+namespace {
+constexpr uint32_t kCacheLine = 32;
+}
+
+SdCardSink::SdCardSink()
+    : mounted_(false),
+      open_(false),
+      data_(nullptr),
+      offset_(0),
+      remaining_(0),
+      transferring_(false),
+      failed_(false) {
+}
+
+RecorderSink SdCardSink::GetSink() {
+    RecorderSink sink;
+    sink.open = Open;
+    sink.write = Write;
+    sink.status = Status;
+    sink.close = Close;
+    sink.context = this;
+    return sink;
+}
+
+bool SdCardSink::Mount() {
+    if (mounted_) {
+        return true;
+    }
+    if (!fsi_.Initialized()) {
+        SdmmcHandler::Config sd_config;
+        sd_config.Defaults();
+        if (sd_.Init(sd_config) != SdmmcHandler::Result::OK
+            || fsi_.Init(FatFSInterface::Config::MEDIA_SD) != FatFSInterface::Result::OK) {
+            return false;
+        }
+    }
+    mounted_ = f_mount(&fsi_.GetSDFileSystem(), fsi_.GetSDPath(), 1) == FR_OK;
+    return mounted_;
+}
+
+bool SdCardSink::Open(void* context, const char* name, uint32_t capacity) {
+    SdCardSink* self = static_cast<SdCardSink*>(context);
+    if (self->open_ || !self->Mount()) {
+        return false;
+    }
+    // Never overwrites an earlier recording
+    if (f_open(&self->file_, name, FA_WRITE | FA_CREATE_NEW) != FR_OK) {
+        // A missing card shows up here first; mount again next time
+        self->mounted_ = false;
+        return false;
+    }
+
+    // Seeking past the end allocates the clusters; the map then turns file
+    // offsets into sectors without touching the FAT
+    bool ok = f_lseek(&self->file_, capacity) == FR_OK && f_tell(&self->file_) == capacity
+              && f_sync(&self->file_) == FR_OK;
+    if (ok) {
+        self->link_map_[0] = kLinkMapSize;
+        self->file_.cltbl = self->link_map_;
+        ok = f_lseek(&self->file_, CREATE_LINKMAP) == FR_OK;
+    }
+    if (!ok) {
+        self->file_.cltbl = nullptr;
+        f_close(&self->file_);
+        f_unlink(name);
+        return false;
+    }
+    self->open_ = true;
+    self->transferring_ = false;
+    self->failed_ = false;
+    self->remaining_ = 0;
+    return true;
+}
+
+bool SdCardSink::Write(void* context, uint32_t offset, const uint8_t* data, uint32_t size) {
+    SdCardSink* self = static_cast<SdCardSink*>(context);
+    if (!self->open_ || self->transferring_ || offset % WavRecorder::kSectorSize
+        || size % WavRecorder::kSectorSize) {
+        return false;
+    }
+    self->data_ = data;
+    self->offset_ = offset;
+    self->remaining_ = size;
+    self->failed_ = false;
+    return self->StartRun();
+}
+
+RecorderSink::Status SdCardSink::Status(void* context) {
+    SdCardSink* self = static_cast<SdCardSink*>(context);
+    if (self->failed_) {
+        return RecorderSink::Status::FAILED;
+    }
+    if (!self->transferring_) {
+        return RecorderSink::Status::IDLE;
+    }
+    if (HAL_SD_GetError(&hsd1) != HAL_SD_ERROR_NONE) {
+        self->transferring_ = false;
+        self->failed_ = true;
+        return RecorderSink::Status::FAILED;
+    }
+    // The DMA is done once the handle is ready; the card has the data once
+    // it is back in the transfer state
+    if (HAL_SD_GetState(&hsd1) != HAL_SD_STATE_READY || BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+        return RecorderSink::Status::BUSY;
+    }
+    self->transferring_ = false;
+    if (self->remaining_) {
+        if (!self->StartRun()) {
+            self->failed_ = true;
+            return RecorderSink::Status::FAILED;
+        }
+        return RecorderSink::Status::BUSY;
+    }
+    return RecorderSink::Status::IDLE;
+}
+
+bool SdCardSink::Close(void* context, uint32_t size) {
+    SdCardSink* self = static_cast<SdCardSink*>(context);
+    if (!self->open_) {
+        return false;
+    }
+    while (self->transferring_ && Status(context) == RecorderSink::Status::BUSY) {
+    }
+    self->open_ = false;
+    self->file_.cltbl = nullptr;
+    const bool ok = f_lseek(&self->file_, size) == FR_OK && f_truncate(&self->file_) == FR_OK;
+    return f_close(&self->file_) == FR_OK && ok;
+}
+
+bool SdCardSink::Locate(uint32_t offset, uint32_t* sector, uint32_t* run) const {
+    const FATFS* fs = file_.obj.fs;
+    const uint32_t cluster_bytes = static_cast<uint32_t>(fs->csize) * WavRecorder::kSectorSize;
+    uint32_t cluster = offset / cluster_bytes;
+    const DWORD* entry = link_map_ + 1;
+    while (entry[0]) {
+        const uint32_t count = entry[0];
+        if (cluster < count) {
+            *sector = fs->database + (entry[1] + cluster - 2) * fs->csize
+                      + offset % cluster_bytes / WavRecorder::kSectorSize;
+            *run = (count - cluster) * cluster_bytes - offset % cluster_bytes;
+            return true;
+        }
+        cluster -= count;
+        entry += 2;
+    }
+    return false;
+}
+
+bool SdCardSink::StartRun() {
+    uint32_t sector;
+    uint32_t run;
+    if (!Locate(offset_, &sector, &run)) {
+        return false;
+    }
+    const uint32_t size = remaining_ < run ? remaining_ : run;
+
+    // The DMA reads memory, not the cache
+    const uintptr_t start = reinterpret_cast<uintptr_t>(data_) & ~static_cast<uintptr_t>(kCacheLine - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(data_) + size;
+    SCB_CleanDCache_by_Addr(reinterpret_cast<uint32_t*>(start), static_cast<int32_t>(end - start));
+
+    uint32_t* source = reinterpret_cast<uint32_t*>(const_cast<uint8_t*>(data_));
+    if (BSP_SD_WriteBlocks_DMA(source, sector, size / WavRecorder::kSectorSize) != MSD_OK) {
+        return false;
+    }
+    data_ += size;
+    offset_ += size;
+    remaining_ -= size;
+    transferring_ = true;
+    return true;
+}
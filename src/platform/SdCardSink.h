@@ -0,0 +1,59 @@
+#ifndef SD_CARD_SINK_H
+#define SD_CARD_SINK_H
+
+#include <cstdint>
+#include "daisy.h"
+#include "WavRecorder.h"
+
+/**
+ * SdCardSink is WavRecorder's storage on the SD card (SDMMC1, 4-bit):
+ * - open() mounts the card on first use, creates the file and allocates
+ *   its clusters up front, then builds a FatFs fast-seek map of them
+ * - write() goes straight to the card: the map gives the sectors, and each
+ *   contiguous run is one multi-block DMA transfer. FatFs is bypassed, so
+ *   nothing waits for the card
+ * - status() polls the transfer and the card's programming state, and
+ *   starts the next run when a write spans fragments
+ * - close() truncates the file to its final size through FatFs
+ *
+ * Main loop only. Data must be in memory the SDMMC DMA reaches (AXI SRAM
+ * or SDRAM, not DTCM).
+ */
+class SdCardSink {
+public:
+    SdCardSink();
+    ~SdCardSink() = default;
+
+    RecorderSink GetSink();
+
+private:
+    // Fast-seek map entries: a size word, then (clusters, first cluster)
+    // pairs and a terminating 0; plenty for a freshly allocated file
+    static constexpr int kLinkMapSize = 256;
+
+    static bool Open(void* context, const char* name, uint32_t capacity);
+    static bool Write(void* context, uint32_t offset, const uint8_t* data, uint32_t size);
+    static RecorderSink::Status Status(void* context);
+    static bool Close(void* context, uint32_t size);
+
+    bool Mount();
+    // First sector of a file offset, and the bytes contiguous from there
+    bool Locate(uint32_t offset, uint32_t* sector, uint32_t* run) const;
+    bool StartRun();
+
+    daisy::SdmmcHandler sd_;
+    daisy::FatFSInterface fsi_;
+    FIL file_;
+    DWORD link_map_[kLinkMapSize];
+    bool mounted_;
+    bool open_;
+
+    // Write in progress, possibly over several runs
+    const uint8_t* data_;
+    uint32_t offset_;
+    uint32_t remaining_;
+    bool transferring_;
+    bool failed_;
+};
+
+#endif // SD_CARD_SINK_H
@@ -7,11 +7,15 @@ using namespace daisy;
 #define QSPIFUNC DSY_QSPI_TEXT
 
 namespace {
-constexpr uint32_t kFlashBase   = 0x90000000; // QSPI memory-mapped base
-constexpr uint32_t kSectorSize  = 4096;
-constexpr uint32_t kMagic       = 0x54485359; // 'THSY'
+enum Key : uint8_t {
+    KEY_SETTINGS = 0,
+    KEY_CONTROLS = 1,
+    KEY_PRESET_FIRST = 2,
+};
+static_assert(KEY_PRESET_FIRST + SynthStateStorage::kNumPresets <= FlashLog::kMaxKeys, "too many presets");
+static_assert(sizeof(SynthPreset) <= FlashLog::kMaxRecordSize, "preset too large for a record");
 
-inline uint32_t CalcCrc(uint32_t magic, int32_t engine) { return magic ^ static_cast<uint32_t>(engine); }
+FlashLog flash_log;
 
 QSPIHandle& GetQSPI() {
     static QSPIHandle* qspi_ptr = nullptr;
@@ -39,30 +43,48 @@ QSPIFUNC void ConfigureQSPI(QSPIHandle::Config::Mode mode) {
 
 namespace SynthStateStorage {
 
-QSPIFUNC bool Load(int &engine_index) {
-    const SynthState *state = reinterpret_cast<const SynthState *>(kFlashBase);
-    if(state->magic != kMagic) { return false; }
-    if(state->crc != CalcCrc(state->magic, state->engine_index)) { return false; }
-    engine_index = state->engine_index;
-    return true;
+void Init() {
+    FlashLog::Config config;
+    config.Defaults();
+    flash_log.Init(config);
 }
 
-QSPIFUNC void Save(int engine_index) {
-    SynthState state{};
-    state.magic = kMagic;
-    state.engine_index = engine_index;
-    state.crc = CalcCrc(state.magic, state.engine_index);
+void Process() {
+    flash_log.Process();
+}
 
-    // Writing while executing from QSPI requires caution. For now, if the
-    // program is running from QSPI we skip the write to avoid crashing.
-    if(daisy::System::GetProgramMemoryRegion() == daisy::System::MemoryRegion::QSPI)
-        return; // TODO: copy write routine to ITCM/DTCM so we can support runtime saves.
+bool IsBusy() {
+    return flash_log.IsBusy();
+}
 
-    ConfigureQSPI(QSPIHandle::Config::Mode::INDIRECT_POLLING);
-    auto &qspi = GetQSPI();
-    qspi.EraseSector(0);
-    qspi.Write(0, sizeof(state), reinterpret_cast<uint8_t *>(&state));
-    ConfigureQSPI(QSPIHandle::Config::Mode::MEMORY_MAPPED);
+bool LoadSettings(SynthSettings& settings) {
+    return flash_log.Read(KEY_SETTINGS, &settings, sizeof(settings));
+}
+
+bool SaveSettings(const SynthSettings& settings) {
+    return flash_log.Write(KEY_SETTINGS, &settings, sizeof(settings));
+}
+
+bool LoadControls(ControlsManager::ControlSnapshot& snapshot) {
+    return flash_log.Read(KEY_CONTROLS, &snapshot, sizeof(snapshot));
+}
+
+bool SaveControls(const ControlsManager::ControlSnapshot& snapshot) {
+    return flash_log.Write(KEY_CONTROLS, &snapshot, sizeof(snapshot));
+}
+
+bool LoadPreset(int slot, SynthPreset& preset) {
+    if(slot < 0 || slot >= kNumPresets) { return false; }
+    return flash_log.Read(static_cast<uint8_t>(KEY_PRESET_FIRST + slot), &preset, sizeof(preset));
+}
+
+bool SavePreset(int slot, const SynthPreset& preset) {
+    if(slot < 0 || slot >= kNumPresets) { return false; }
+    return flash_log.Write(static_cast<uint8_t>(KEY_PRESET_FIRST + slot), &preset, sizeof(preset));
+}
+
+const FlashLog& GetLog() {
+    return flash_log;
 }
 
 QSPIFUNC void InitMemoryMapped() {
@@ -1,14 +1,41 @@
 #pragma once
 #include "daisy.h"
+#include "ControlsManager.h"
+#include "FlashLog.h"
 
-struct SynthState {
-    uint32_t magic;
+// Settings restored at boot
+struct SynthSettings {
     int32_t engine_index;
-    uint32_t crc;
+    float sample_rate;
+    uint8_t arp_enabled;
+    uint8_t reserved[3];
 };
 
+// Everything needed to recall a sound
+struct SynthPreset {
+    SynthSettings settings;
+    ControlsManager::ControlSnapshot controls;
+};
+
+// Persistent state on the QSPI flash, kept in a FlashLog below the firmware
+// image. Saves are queued and written by Process() in the background.
 namespace SynthStateStorage {
-    bool Load(int &engine_index);
-    void Save(int engine_index);
+    constexpr int kNumPresets = 8;
+
     void InitMemoryMapped();
+
+    // Mounts the store; needs the system tick running
+    void Init();
+    // Main-loop task: one slice of flash work
+    void Process();
+    bool IsBusy();
+
+    bool LoadSettings(SynthSettings& settings);
+    bool SaveSettings(const SynthSettings& settings);
+    bool LoadControls(ControlsManager::ControlSnapshot& snapshot);
+    bool SaveControls(const ControlsManager::ControlSnapshot& snapshot);
+    bool LoadPreset(int slot, SynthPreset& preset);
+    bool SavePreset(int slot, const SynthPreset& preset);
+
+    const FlashLog& GetLog();
 } 
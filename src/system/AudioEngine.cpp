@@ -1,21 +1,49 @@
 #include "AudioEngine.h"
+#include "AudioConfig.h"
 #include "Nimbus_SM/resources.h"
-#include <cstring>
 
 // Global SDRAM buffers for Clouds (must be at file scope for DSY_SDRAM_BSS attribute)
 DSY_SDRAM_BSS static uint8_t g_cloud_buffer[AudioEngine::CLOUD_BUFFER_SIZE];
 DSY_SDRAM_BSS static uint8_t g_cloud_buffer_ccm[AudioEngine::CLOUD_BUFFER_CCM_SIZE];
 
+// Long-memory recording buffer, and the AXI SRAM cache its reads are staged
+// through (cache-line aligned: destinations are invalidated after each MDMA
+// batch).
+DSY_SDRAM_BSS static uint8_t g_long_buffer[LONG_MEMORY_MODE ? LONG_MEMORY_SIZE : 1];
+static uint8_t g_staging_memory[LONG_MEMORY_MODE ? kStagingMemorySize : 1]
+    __attribute__((aligned(32)));
+
+// Phase vocoder working set (FFT buffers and half-float textures), in AXI
+// SRAM rather than in the SDRAM recording buffers.
+static uint8_t g_spectral_memory[kSpectralMemorySize] __attribute__((aligned(32)));
+
+// Pages of the recording kept by the snapshot banks once overwritten. Not
+// cleared: a page is always copied in before it is read.
+DSY_SDRAM_BSS static uint8_t g_snapshot_pool[SNAPSHOT_BANKS ? AudioEngine::SNAPSHOT_POOL_SIZE : 1];
+
+// WAV recorder ring: ~14 s of six 16-bit channels at 48 kHz for the SD card
+// to fall behind by. Cache-line aligned for the SDMMC DMA.
+DSY_SDRAM_BSS static uint8_t g_recorder_ring[AudioEngine::RECORDER_RING_SIZE] __attribute__((aligned(32)));
+
 AudioEngine::AudioEngine()
     : cloud_buffer_(g_cloud_buffer),
-      cloud_buffer_ccm_(g_cloud_buffer_ccm) {
+      cloud_buffer_ccm_(g_cloud_buffer_ccm),
+      capture_request_(kNoSnapshotRequest),
+      recall_request_(kNoSnapshotRequest) {
 }
 
 void AudioEngine::Init(daisy::patch_sm::DaisyPatchSM* hw) {
     const float sample_rate = hw ? hw->AudioSampleRate() : 48000.0f;
 
-    memset(cloud_buffer_, 0, AudioEngine::CLOUD_BUFFER_SIZE);
-    memset(cloud_buffer_ccm_, 0, AudioEngine::CLOUD_BUFFER_CCM_SIZE);
+    sdram_clear_.Add(cloud_buffer_, AudioEngine::CLOUD_BUFFER_SIZE);
+    sdram_clear_.Add(cloud_buffer_ccm_, AudioEngine::CLOUD_BUFFER_CCM_SIZE);
+    if (LONG_MEMORY_MODE) {
+        sdram_clear_.Add(g_long_buffer, LONG_MEMORY_SIZE);
+    }
+    // Without the DMA (or FAST_BOOT), FinishInit() clears them in place
+    if (FAST_BOOT) {
+        sdram_clear_.Start();
+    }
 
     InitResources(sample_rate);
     clouds_processor_.Init(sample_rate,
@@ -24,7 +52,47 @@ void AudioEngine::Init(daisy::patch_sm::DaisyPatchSM* hw) {
                            cloud_buffer_ccm_,
                            AudioEngine::CLOUD_BUFFER_CCM_SIZE);
 
+    clouds_processor_.set_spectral_memory(g_spectral_memory);
+    if (LONG_MEMORY_MODE) {
+        clouds_processor_.set_long_memory(g_long_buffer, LONG_MEMORY_SIZE, g_staging_memory);
+        staging_dma_.Init();
+        staging_dma_.Attach(clouds_processor_.mutable_stager());
+    }
+    if (SNAPSHOT_BANKS) {
+        clouds_processor_.set_snapshot_pool(g_snapshot_pool, AudioEngine::SNAPSHOT_POOL_SIZE);
+    }
+
+    QualityGovernor::Config governor_config;
+    governor_config.Defaults();
+    quality_governor_.Init(governor_config, &clouds_processor_);
+    dsp_guard_.Init(&clouds_processor_);
+
     clouds_processor_.mutable_parameters()->dry_wet = 0.0f;
     clouds_processor_.mutable_parameters()->freeze = false;
-    clouds_processor_.set_playback_mode(PLAYBACK_MODE_LOOPING_DELAY);
+    clouds_processor_.set_playback_mode(RESONESTOR_MODE ? PLAYBACK_MODE_RESONESTOR : PLAYBACK_MODE_LOOPING_DELAY);
+    clouds_processor_.set_post_oliverb(OLIVERB_REVERB);
+}
+
+void AudioEngine::FinishInit() {
+    sdram_clear_.Wait();
+}
+
+void AudioEngine::ApplySnapshotRequests() {
+    const int capture = capture_request_.exchange(kNoSnapshotRequest, std::memory_order_acquire);
+    if (capture != kNoSnapshotRequest) {
+        clouds_processor_.CaptureSnapshot(capture);
+    }
+    const int recall = recall_request_.exchange(kNoSnapshotRequest, std::memory_order_acquire);
+    if (recall != kNoSnapshotRequest) {
+        clouds_processor_.RecallSnapshot(recall);
+    }
+}
+
+uint8_t* AudioEngine::GetRecorderRing() {
+    return g_recorder_ring;
+}
+
+void AudioEngine::SetSampleRate(float sample_rate) {
+    InitResources(sample_rate);
+    clouds_processor_.set_sample_rate(sample_rate);
 }
@@ -2,12 +2,28 @@
 #define AUDIO_ENGINE_H
 
 #include "Nimbus_SM/dsp/granular_processor.h"
+#include "DspGuard.h"
+#include "QualityGovernor.h"
+#include "SampleMemory.h"
+#include "SdramClear.h"
+#include "StagingDma.h"
+#include "WavRecorder.h"
 #include "daisy_patch_sm.h"
+#include <atomic>
 
 /**
  * AudioEngine encapsulates audio processing components:
  * - Clouds GranularProcessor (granular effects)
  * - Audio buffers for Clouds processing
+ * - Long-memory SDRAM buffer and its MDMA staging cache (LONG_MEMORY_MODE)
+ * - AXI SRAM working set for the spectral mode
+ * - MDMA zeroing of the SDRAM buffers during boot (FAST_BOOT)
+ * - CPU-load-driven quality governor for Clouds
+ * - Flush-to-zero, and the debug sentinels on Clouds' stages (DspGuard)
+ * - Sample-rate changes that keep the recording buffers
+ * - Saving and loading the recording buffers (SampleMemory)
+ * - Freeze snapshot banks of the recording, and their SDRAM page pool
+ * - Multitrack WAV recording of the dry, wet and CV streams (WavRecorder)
  *
  * Simplified from previous polyphonic architecture to focus on
  * keyboard-controlled granular processing.
@@ -17,8 +33,14 @@ public:
     AudioEngine();
     ~AudioEngine() = default;
 
-    // Initialize the audio engine
+    // Initialize the audio engine. With FAST_BOOT the SDRAM buffers are
+    // still being zeroed on return: call FinishInit() before audio starts
     void Init(daisy::patch_sm::DaisyPatchSM* hw);
+    void FinishInit();
+
+    // Rebuild Clouds' lookup tables and coefficients for a new sample rate.
+    // Audio must be stopped; the recorded audio is kept.
+    void SetSampleRate(float sample_rate);
 
     // Get Clouds processor
     GranularProcessorClouds& GetCloudsProcessor() { return clouds_processor_; }
@@ -31,13 +53,48 @@ public:
     uint8_t* GetCloudBufferCCM() { return cloud_buffer_ccm_; }
     static constexpr size_t CLOUD_BUFFER_CCM_SIZE = 196224;  // 65408 * 3
 
+    // Pool for the snapshot banks: room for every bank to lose the whole
+    // stereo recording (two CCM-sized channels, the largest case)
+    static constexpr size_t SNAPSHOT_POOL_SIZE =
+        kNumSnapshotBanks * 2 * (CLOUD_BUFFER_CCM_SIZE + kBufferPageSize);
+
+    // Main loop: capture the recording into a snapshot bank, or play one
+    // back (-1: the live recording again), from the next audio block on
+    void RequestSnapshotCapture(int bank) { capture_request_.store(bank, std::memory_order_release); }
+    void RequestSnapshotRecall(int bank) { recall_request_.store(bank, std::memory_order_release); }
+
+    // Audio callback, after the processor's Prepare()
+    void ApplySnapshotRequests();
+
+    StagingDma& GetStagingDma() { return staging_dma_; }
+    QualityGovernor& GetQualityGovernor() { return quality_governor_; }
+    DspGuard& GetDspGuard() { return dsp_guard_; }
+    SampleMemory& GetSampleMemory() { return sample_memory_; }
+
+    WavRecorder& GetRecorder() { return recorder_; }
+    // SDRAM ring the recorder streams through (WavRecorder::Config::ring)
+    uint8_t* GetRecorderRing();
+    static constexpr size_t RECORDER_RING_SIZE = 8 * 1024 * 1024;
+
 private:
+    static constexpr int kNoSnapshotRequest = -2;
+
     // Clouds processor
     GranularProcessorClouds clouds_processor_;
 
     // Pointers to SDRAM buffers (actual buffers defined in AudioEngine.cpp with DSY_SDRAM_BSS)
     uint8_t* cloud_buffer_;
     uint8_t* cloud_buffer_ccm_;
+
+    StagingDma staging_dma_;
+    SdramClear sdram_clear_;
+    QualityGovernor quality_governor_;
+    DspGuard dsp_guard_;
+    SampleMemory sample_memory_;
+    WavRecorder recorder_;
+
+    std::atomic<int> capture_request_;
+    std::atomic<int> recall_request_;
 };
 
 #endif // AUDIO_ENGINE_H
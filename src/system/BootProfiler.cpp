@@ -0,0 +1,43 @@
+#include "BootProfiler.h"
+#include "stm32h7xx.h"
+
+namespace {
+// Unlocks the DWT registers on the Cortex-M7 (CoreSight lock access key)
+constexpr uint32_t kDwtUnlock = 0xC5ACCE55;
+}
+
+BootProfiler::BootProfiler() : num_steps_(0), last_cycles_(0) {
+}
+
+void BootProfiler::Start() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = kDwtUnlock;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    num_steps_ = 0;
+    last_cycles_ = 0;
+}
+
+void BootProfiler::Mark(const char* step) {
+    const uint32_t now = DWT->CYCCNT;
+    if (num_steps_ < kMaxSteps) {
+        Step& entry = steps_[num_steps_++];
+        entry.name = step;
+        entry.cycles = now - last_cycles_;
+        entry.clock_mhz = SystemCoreClock / 1000000;
+    }
+    last_cycles_ = now;
+}
+
+uint32_t BootProfiler::GetStepUs(int i) const {
+    const Step& step = steps_[i];
+    return step.clock_mhz ? step.cycles / step.clock_mhz : 0;
+}
+
+uint32_t BootProfiler::GetTotalUs() const {
+    uint32_t total = 0;
+    for (int i = 0; i < num_steps_; ++i) {
+        total += GetStepUs(i);
+    }
+    return total;
+}
@@ -0,0 +1,43 @@
+#ifndef BOOT_PROFILER_H
+#define BOOT_PROFILER_H
+
+#include <cstdint>
+
+/**
+ * BootProfiler times the init steps with the DWT cycle counter:
+ * - Start() enables the counter; each Mark() closes the step since the
+ *   previous mark
+ * - A step is converted to microseconds at the core clock it ended at, so
+ *   the one that switches the PLL on reads short
+ *
+ * Marks cost a register read; the report is printed once audio runs.
+ */
+class BootProfiler {
+public:
+    static constexpr int kMaxSteps = 24;
+
+    BootProfiler();
+    ~BootProfiler() = default;
+
+    void Start();
+    void Mark(const char* step);
+
+    int GetNumSteps() const { return num_steps_; }
+    const char* GetStepName(int i) const { return steps_[i].name; }
+    uint32_t GetStepUs(int i) const;
+    // From Start() to the last mark
+    uint32_t GetTotalUs() const;
+
+private:
+    struct Step {
+        const char* name;
+        uint32_t cycles;
+        uint32_t clock_mhz;
+    };
+
+    Step steps_[kMaxSteps];
+    int num_steps_;
+    uint32_t last_cycles_;
+};
+
+#endif // BOOT_PROFILER_H
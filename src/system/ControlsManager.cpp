@@ -9,7 +9,6 @@ ControlsManager::ControlsManager()
       arp_clear_requested_(false),
       control_read_index_(0),
       control_write_index_(0),
-      update_display_(false),
       smoothed_level_(0.0f),
       input_peak_(0.0f),
       was_arp_on_(false) {
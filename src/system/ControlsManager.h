@@ -4,6 +4,7 @@
 #include <atomic>
 #include <cstdint>
 #include "Arpeggiator.h"
+#include "OutputEventQueue.h"
 
 class ControlsManager {
 public:
@@ -45,6 +46,9 @@ public:
     void SetArpEnabled(bool enabled);
     bool ConsumeArpClearRequest();
 
+    // Notes played in the audio callback, rendered by the main loop
+    OutputEventQueue& GetOutputEvents() { return output_events_; }
+
     // ADC raw values (main thread only)
     float* GetADCRawValues() { return adc_raw_values_; }
     float GetADCRawValue(int index) const { return adc_raw_values_[index]; }
@@ -59,13 +63,11 @@ public:
     const ControlSnapshot& GetAudioControlSnapshot() const { return audio_control_snapshot_; }
     const ControlSnapshot& GetLatestControlSnapshot() const { return latest_control_snapshot_; }
 
-    // Display state (ISR writes, main reads)
-    bool ShouldUpdateDisplay() const { return update_display_.load(std::memory_order_relaxed); }
-    void SetUpdateDisplay(bool v) { update_display_.store(v, std::memory_order_relaxed); }
+    // Output level (ISR writes, main reads)
     float GetSmoothedOutputLevel() const { return smoothed_level_.load(std::memory_order_relaxed); }
     void SetSmoothedOutputLevel(float v) { smoothed_level_.store(v, std::memory_order_relaxed); }
 
-    // ARP LED timestamps (ISR writes via callback, main reads)
+    // ARP LED timestamps (main loop)
     uint32_t GetArpLEDTimestamp(int i) const { return arp_led_ts_[i].load(std::memory_order_relaxed); }
     void SetArpLEDTimestamp(int i, uint32_t t) { arp_led_ts_[i].store(t, std::memory_order_relaxed); }
 
@@ -82,6 +84,7 @@ private:
     Arpeggiator arp_;
     std::atomic<bool> arp_enabled_;
     std::atomic<bool> arp_clear_requested_;
+    OutputEventQueue output_events_;
 
     float adc_raw_values_[12];
 
@@ -91,7 +94,6 @@ private:
     uint8_t control_read_index_;
     std::atomic<uint8_t> control_write_index_;
 
-    std::atomic<bool> update_display_;
     std::atomic<float> smoothed_level_;
     std::atomic<float> input_peak_;
     std::atomic<uint32_t> arp_led_ts_[12];
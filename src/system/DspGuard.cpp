@@ -0,0 +1,90 @@
+#include "DspGuard.h"
+#include "AudioConfig.h"
+#include "stm32h7xx.h"
+#include <cstring>
+
+namespace {
+
+// FPSCR.FZ: denormal operands and results are flushed to (signed) zero
+constexpr uint32_t kFpscrFlushToZero = 1u << 24;
+
+constexpr uint32_t kExponentMask = 0x7f800000u;
+constexpr uint32_t kMantissaMask = 0x007fffffu;
+
+} // namespace
+
+DspGuard::DspGuard() : processor_(nullptr), fault_pending_(false), faults_(0) {
+}
+
+void DspGuard::Init(GranularProcessorClouds* processor) {
+    processor_ = processor;
+    if (DSP_SENTINELS) {
+        // Flush-to-zero stays off, or there would be no denormals to find
+        processor_->set_stage_check(&DspGuard::CheckStage, this);
+        return;
+    }
+    // The audio callback runs in the DMA interrupt, whose floating-point
+    // context starts from FPDSCR rather than from the main loop's FPSCR
+    __set_FPSCR(__get_FPSCR() | kFpscrFlushToZero);
+    FPU->FPDSCR |= FPU_FPDSCR_FZ_Msk;
+}
+
+bool DspGuard::PopFault(Fault* fault) {
+    if (!fault_pending_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    *fault = fault_;
+    fault_pending_.store(false, std::memory_order_release);
+    return true;
+}
+
+uint8_t DspGuard::Classify(const FloatFrame* block, size_t size) {
+    const float* samples = &block[0].l;
+    uint8_t kinds = 0;
+    for (size_t i = 0; i < size * 2; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &samples[i], sizeof(bits));
+        const uint32_t exponent = bits & kExponentMask;
+        const uint32_t mantissa = bits & kMantissaMask;
+        if (exponent == 0 && mantissa) {
+            kinds |= KIND_DENORMAL;
+        } else if (exponent == kExponentMask) {
+            kinds |= mantissa ? KIND_NAN : KIND_INF;
+        }
+    }
+    return kinds;
+}
+
+const char* DspGuard::StageName(ProcessStage stage) {
+    switch (stage) {
+        case PROCESS_STAGE_FEEDBACK: return "feedback";
+        case PROCESS_STAGE_PLAYBACK: return "playback";
+        case PROCESS_STAGE_DIFFUSER: return "diffuser";
+        case PROCESS_STAGE_PITCH_SHIFTER: return "pitch shifter";
+        case PROCESS_STAGE_FILTERS: return "filters";
+        case PROCESS_STAGE_REVERB: return "reverb";
+        case PROCESS_STAGE_OUTPUT: return "output";
+        default: return "?";
+    }
+}
+
+// Audio callback
+void DspGuard::CheckStage(void* context, ProcessStage stage, const FloatFrame* block, size_t size,
+                          const Parameters& parameters) {
+    const uint8_t kinds = Classify(block, size);
+    if (!kinds) {
+        return;
+    }
+    DspGuard* guard = static_cast<DspGuard*>(context);
+    guard->faults_.store(guard->faults_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (guard->fault_pending_.load(std::memory_order_acquire)) {
+        return;
+    }
+    Fault& fault = guard->fault_;
+    fault.stage = stage;
+    fault.kinds = kinds;
+    fault.playback_mode = guard->processor_->playback_mode();
+    fault.quality = guard->processor_->quality();
+    fault.parameters = parameters;
+    guard->fault_pending_.store(true, std::memory_order_release);
+}
@@ -0,0 +1,65 @@
+#ifndef DSP_GUARD_H
+#define DSP_GUARD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Nimbus_SM/dsp/granular_processor.h"
+
+/**
+ * DspGuard keeps denormals, NaNs and Infs out of Clouds' signal path:
+ * - Release builds set flush-to-zero for the main loop and for interrupt
+ *   handlers (FPDSCR), so the audio callback never runs on denormals.
+ *   Clouds itself resets any stage whose block turns non-finite
+ *   (GranularProcessorClouds::num_recoveries)
+ * - With DSP_SENTINELS (debug builds), every stage's output block is
+ *   scanned in the audio callback, and the first faulty one is kept with
+ *   the stage, the playback mode, the quality and the parameters, for the
+ *   main loop to report
+ *
+ * tools/dsp_fuzz runs the same checks on the host against random parameters.
+ */
+class DspGuard {
+public:
+    enum Kind : uint8_t {
+        KIND_DENORMAL = 1,
+        KIND_NAN = 2,
+        KIND_INF = 4,
+    };
+
+    struct Fault {
+        ProcessStage stage;
+        uint8_t kinds;            // Kind bits, all found in the block
+        PlaybackMode playback_mode;
+        int32_t quality;
+        Parameters parameters;
+    };
+
+    DspGuard();
+    ~DspGuard() = default;
+
+    // Before audio starts
+    void Init(GranularProcessorClouds* processor);
+
+    // Main loop: the fault kept since the last call, if any. Faults found
+    // meanwhile are only counted.
+    bool PopFault(Fault* fault);
+
+    // Faulty blocks found by the sentinels, all stages
+    uint32_t GetFaultCount() const { return faults_.load(std::memory_order_relaxed); }
+
+    // Kind bits found in a block (0 when clean)
+    static uint8_t Classify(const FloatFrame* block, size_t size);
+    static const char* StageName(ProcessStage stage);
+
+private:
+    static void CheckStage(void* context, ProcessStage stage, const FloatFrame* block, size_t size,
+                           const Parameters& parameters);
+
+    GranularProcessorClouds* processor_;
+    Fault fault_;
+    std::atomic<bool> fault_pending_;
+    std::atomic<uint32_t> faults_;
+};
+
+#endif // DSP_GUARD_H
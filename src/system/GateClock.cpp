@@ -0,0 +1,44 @@
+#include "GateClock.h"
+#include "sys/system.h"
+#include "stm32h7xx_hal.h"
+
+using daisy::System;
+
+namespace {
+
+GateClock* g_gate_clock = nullptr;
+
+// Gate in 1 is B10, on PG13 (EXTI line 13). The input stage inverts, so a
+// rising gate is a falling pin.
+constexpr uint16_t kGatePin = GPIO_PIN_13;
+
+} // namespace
+
+void GateClock::Init() {
+    g_gate_clock = this;
+    edge_tick_.store(0, std::memory_order_relaxed);
+    has_block_tick_ = false;
+    has_pending_ = false;
+
+    // Still an input for GateIn, now with the edge interrupt
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    GPIO_InitTypeDef init = {};
+    init.Pin = kGatePin;
+    init.Mode = GPIO_MODE_IT_FALLING;
+    init.Pull = GPIO_NOPULL;
+    init.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(GPIOG, &init);
+
+    // As the audio DMA: the handler only reads the tick
+    HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+}
+
+extern "C" void EXTI15_10_IRQHandler() {
+    if (__HAL_GPIO_EXTI_GET_IT(kGatePin)) {
+        __HAL_GPIO_EXTI_CLEAR_IT(kGatePin);
+        if (g_gate_clock) {
+            g_gate_clock->OnEdge(System::GetTick());
+        }
+    }
+}
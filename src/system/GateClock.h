@@ -0,0 +1,80 @@
+#ifndef GATE_CLOCK_H
+#define GATE_CLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * GateClock times the rising edges of gate in 1, which clocks the
+ * arpeggiator, to the sample rather than to the audio block:
+ * - An EXTI interrupt on the gate pin stores the TIM2 tick of each edge.
+ *   It shares the top priority with the audio DMA, so an edge that comes
+ *   during the audio callback is stamped when the callback returns
+ * - Once per block, the audio callback maps the edge's tick onto the span
+ *   since the previous block started. The input of that span is what the
+ *   block processes, so edges keep their spacing, one block late like the
+ *   audio itself
+ *
+ * Only the latest edge of a block is kept; the arpeggiator ignores edges
+ * that close anyway.
+ */
+class GateClock {
+public:
+    GateClock() : edge_tick_(0), block_tick_(0), pending_tick_(0), has_block_tick_(false), has_pending_(false) {}
+    ~GateClock() = default;
+
+    // Enables the edge interrupt. Call after the gate input is initialised.
+    void Init();
+
+    // Audio callback, once per block, with the TIM2 tick at its start.
+    // Returns true when gate in 1 rose since the previous block, with the
+    // edge's offset in this block.
+    bool ReadEdge(uint32_t block_tick, size_t block_size, size_t* offset) {
+        const uint32_t tick = edge_tick_.exchange(0, std::memory_order_acquire);
+        if (tick) {
+            pending_tick_ = tick;
+            has_pending_ = true;
+        }
+        const uint32_t previous = block_tick_;
+        const uint32_t span = block_tick - previous;
+        const bool has_span = has_block_tick_ && span > 0;
+        block_tick_ = block_tick;
+        has_block_tick_ = true;
+        if (!has_pending_) {
+            return false;
+        }
+
+        // An edge stamped since this block started belongs to the next one;
+        // one from before the span (the first block after a restart) lands
+        // on its start
+        const int32_t since = static_cast<int32_t>(pending_tick_ - previous);
+        if (has_span && since >= static_cast<int32_t>(span)) {
+            return false;
+        }
+        has_pending_ = false;
+        float position = 0.0f;
+        if (has_span && since > 0) {
+            position = static_cast<float>(since) / static_cast<float>(span);
+        }
+        const size_t sample = static_cast<size_t>(position * static_cast<float>(block_size));
+        *offset = sample < block_size ? sample : block_size - 1;
+        return true;
+    }
+
+    // Edge interrupt, with the TIM2 tick it was taken at
+    void OnEdge(uint32_t tick) {
+        // The low bit marks the edge, so that a tick never reads as none
+        edge_tick_.store(tick | 1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t> edge_tick_;   // Latest edge not yet read, 0 when none
+
+    uint32_t block_tick_;               // Start of the previous block
+    uint32_t pending_tick_;             // Edge not yet handed to a block
+    bool has_block_tick_;
+    bool has_pending_;
+};
+
+#endif // GATE_CLOCK_H
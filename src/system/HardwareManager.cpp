@@ -22,15 +22,34 @@ void HardwareManager::InitHardware() {
     // Initialize Daisy Patch SM hardware
     hw_.Init();
 
-    // Run Daisy audio at 32 kHz for lower latency
-    hw_.SetAudioSampleRate(SaiHandle::Config::SampleRate::SAI_32KHZ);
+    // Times the arpeggiator's clock edges on gate in 1
+    gate_clock_.Init();
+
+    // Run Daisy audio at 32 kHz by default for lower CPU load
+    hw_.SetAudioSampleRate(DEFAULT_SAMPLE_RATE);
     hw_.SetAudioBlockSize(BLOCK_SIZE);
-    sample_rate_ = hw_.AudioSampleRate(); // Should report 48000
+    sample_rate_ = hw_.AudioSampleRate();
 
     // Initialize CPU load meter
     cpu_meter_.Init(sample_rate_, BLOCK_SIZE);
 }
 
+bool HardwareManager::IsSupportedSampleRate(float sample_rate) {
+    return sample_rate == 32000.0f || sample_rate == 48000.0f || sample_rate == 96000.0f;
+}
+
+bool HardwareManager::SetSampleRate(float sample_rate) {
+    if (!IsSupportedSampleRate(sample_rate)) {
+        return false;
+    }
+    hw_.SetAudioSampleRate(sample_rate);
+    sample_rate_ = hw_.AudioSampleRate();
+
+    // The block period changed
+    cpu_meter_.Init(sample_rate_, BLOCK_SIZE);
+    return true;
+}
+
 void HardwareManager::InitADCs() {
     // Reuse Daisy Patch SM control ADCs and map them to the active parameters
     constexpr int kCv5    = CV_5;   // ADC 4
@@ -134,11 +153,9 @@ void HardwareManager::SetGateOut2(bool state) {
 }
 
 void HardwareManager::SetPitchCvVoltage(float volts) {
-    volts = std::max(0.0f, std::min(5.0f, volts));
-    hw_.WriteCvOut(daisy::patch_sm::CV_OUT_1, volts);
+    cv_output_.SetPitchVoltage(volts);
 }
 
 void HardwareManager::SetPressureCvVoltage(float volts) {
-    volts = std::max(0.0f, std::min(5.0f, volts));
-    hw_.WriteCvOut(daisy::patch_sm::CV_OUT_2, volts);
+    cv_output_.SetPressureVoltage(volts);
 }
@@ -4,6 +4,8 @@
 #include "daisy_patch_sm.h"
 #include "mpr121_daisy.h"
 #include "util/CpuLoadMeter.h"
+#include "CvOutputEngine.h"
+#include "GateClock.h"
 
 // NOTE: using namespace directives removed from header to avoid namespace pollution
 // Implementation file (.cpp) should add using namespace as needed locally
@@ -15,6 +17,8 @@
  * - ADC controls (knobs/pads)
  * - 12 LED GPIOs
  * - CPU load meter
+ * - CV output engine (pitch/pressure rendered by the DAC DMA)
+ * - Gate in 1 edge timing (arpeggiator clock)
  *
  * This eliminates 29 global variables and provides a single
  * point of hardware initialization and access.
@@ -31,6 +35,8 @@ public:
     daisy::patch_sm::DaisyPatchSM& GetHardware() { return hw_; }
     kymatikos_hal::Mpr121& GetTouchSensor() { return touch_sensor_; }
     daisy::CpuLoadMeter& GetCpuMeter() { return cpu_meter_; }
+    CvOutputEngine& GetCvOutput() { return cv_output_; }
+    GateClock& GetGateClock() { return gate_clock_; }
 
     // ADC Control access
     daisy::AnalogControl& GetCV5Knob() { return cv5_knob_; }
@@ -47,6 +53,7 @@ public:
     daisy::GPIO& GetTouchLED(int index) { return touch_leds_[index]; }
     void SetTouchLEDs(bool state);
     void SetGateOut2(bool state);
+    // CV targets, rendered with slew by the CV output engine
     void SetPitchCvVoltage(float volts);
     void SetPressureCvVoltage(float volts);
 
@@ -57,11 +64,18 @@ public:
     // Sample rate (returns reference for backward compatibility with assignment)
     float& GetSampleRate() { return sample_rate_; }
 
+    // Re-initialises the SAI at 32000, 48000 or 96000 Hz. Audio must be
+    // stopped. Returns false for an unsupported rate.
+    bool SetSampleRate(float sample_rate);
+    static bool IsSupportedSampleRate(float sample_rate);
+
 private:
     // Hardware
     daisy::patch_sm::DaisyPatchSM hw_;
     kymatikos_hal::Mpr121 touch_sensor_;
     daisy::CpuLoadMeter cpu_meter_;
+    CvOutputEngine cv_output_;
+    GateClock gate_clock_;
 
     // ADC Controls
     daisy::AnalogControl cv5_knob_;               // ADC 4 (Pin 20)
@@ -0,0 +1,77 @@
+#ifndef OUTPUT_EVENT_QUEUE_H
+#define OUTPUT_EVENT_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// A note played by the audio thread, to be rendered on the hardware outputs.
+// Its pitch CV is scheduled on the DAC directly (CvOutputEngine).
+struct OutputEvent {
+    uint32_t timestamp;  // TIM2 tick at which the note is due at the outputs
+    int8_t pad;          // Pad index (LED feedback)
+    bool gate;           // Fire a gate pulse
+};
+
+/**
+ * OutputEventQueue carries output side effects out of the audio callback:
+ * - Lock-free single-producer (audio ISR) / single-consumer (main loop) ring
+ * - Fixed capacity, no allocation; Push() drops and counts the event when
+ *   the consumer has fallen behind rather than blocking the ISR
+ * - Events are pushed in timestamp order; the consumer peeks at the oldest
+ *   and pops it once it is due
+ *
+ * DAC writes, GPIO and LED updates then run in the main loop, outside the
+ * audio deadline.
+ */
+class OutputEventQueue {
+public:
+    static constexpr size_t kCapacity = 32;  // Power of two
+
+    OutputEventQueue() : head_(0), tail_(0), dropped_(0) {}
+    ~OutputEventQueue() = default;
+
+    // Producer side (audio ISR)
+    bool Push(const OutputEvent& event) {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kCapacity) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        events_[head & (kCapacity - 1)] = event;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side (main loop)
+    bool Peek(OutputEvent* event) const {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *event = events_[tail & (kCapacity - 1)];
+        return true;
+    }
+
+    bool Pop(OutputEvent* event) {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *event = events_[tail & (kCapacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "kCapacity must be a power of two");
+
+    OutputEvent events_[kCapacity];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+    std::atomic<uint32_t> dropped_;
+};
+
+#endif // OUTPUT_EVENT_QUEUE_H
@@ -0,0 +1,87 @@
+#include "QualityGovernor.h"
+#include "AudioConfig.h"
+
+namespace {
+
+// Level 0 is Clouds' stock behaviour; each level trades a little more.
+constexpr CpuBudget kBudgets[QualityGovernor::kNumLevels] = {
+    // grains, midfi, lofi, correlator, fx economy, half-rate reverb, resonator chords
+    {1.0f, 0.75f, 0.0f, 1.0f, false, false, 1.0f},
+    {1.0f, 1.0f, 0.0f, 1.0f, false, false, 1.0f},
+    {0.75f, 1.0f, 0.5f, 0.5f, true, true, 0.75f},
+    {0.5f, 1.0f, 1.0f, 0.5f, true, true, 0.5f},
+    {0.375f, 1.0f, 1.0f, 0.25f, true, true, 0.5f},
+};
+
+} // namespace
+
+void QualityGovernor::Config::Defaults() {
+    load_target = CPU_LOAD_TARGET;
+    hysteresis = CPU_LOAD_HYSTERESIS;
+    panic_load = CPU_LOAD_PANIC;
+    // Counted in callbacks: keep the durations independent of BLOCK_SIZE
+    overload_blocks = 4 * CONTROL_RATE_DIVIDER;    // ~4 ms
+    settle_blocks = 16 * CONTROL_RATE_DIVIDER;     // ~16 ms at 32 kHz
+    recover_blocks = 1000 * CONTROL_RATE_DIVIDER;  // ~1 s
+}
+
+QualityGovernor::QualityGovernor()
+    : processor_(nullptr), level_(0), settle_counter_(0), recover_counter_(0), overload_counter_(0),
+      downgrades_(0) {
+    config_.Defaults();
+}
+
+void QualityGovernor::Init(const Config& config, GranularProcessorClouds* processor) {
+    config_ = config;
+    processor_ = processor;
+    settle_counter_ = 0;
+    recover_counter_ = 0;
+    overload_counter_ = 0;
+    downgrades_ = 0;
+    SetLevel(0);
+}
+
+void QualityGovernor::Update(float block_load) {
+    if (!processor_) {
+        return;
+    }
+    if (settle_counter_) {
+        // Grains started at the previous level are still playing.
+        --settle_counter_;
+        return;
+    }
+
+    if (block_load > config_.load_target) {
+        // One busy block (a burst of grains, a flash slice) is not worth a
+        // level, unless it nearly missed the deadline
+        recover_counter_ = 0;
+        if (overload_counter_ < config_.overload_blocks) {
+            ++overload_counter_;
+        }
+        const bool overloaded =
+            overload_counter_ >= config_.overload_blocks || block_load > config_.panic_load;
+        if (overloaded && level_ < kNumLevels - 1) {
+            SetLevel(level_ + 1);
+            settle_counter_ = config_.settle_blocks;
+            overload_counter_ = 0;
+            ++downgrades_;
+        }
+        return;
+    }
+    overload_counter_ = 0;
+    if (block_load < config_.load_target - config_.hysteresis) {
+        if (level_ > 0 && ++recover_counter_ >= config_.recover_blocks) {
+            SetLevel(level_ - 1);
+            recover_counter_ = 0;
+        }
+    } else {
+        recover_counter_ = 0;
+    }
+}
+
+void QualityGovernor::SetLevel(int level) {
+    level_ = level;
+    CpuBudget budget = kBudgets[level];
+    budget.half_rate_reverb = budget.half_rate_reverb || REVERB_HALF_RATE;
+    processor_->set_cpu_budget(budget);
+}
@@ -0,0 +1,58 @@
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+#include <cstdint>
+#include "Nimbus_SM/dsp/granular_processor.h"
+
+/**
+ * QualityGovernor keeps the audio callback under its deadline by trading
+ * Clouds quality for CPU time:
+ * - Steps down one level once a few blocks in a row overshoot the load
+ *   target, or as soon as one comes close to the deadline
+ * - Steps back up after the load stayed below target - hysteresis for a
+ *   while (slow attack, fast release of the degradation)
+ * - Each level sets a CpuBudget (grain cap, mid/low quality thresholds,
+ *   correlator budget, reverb/diffuser economy, half-rate reverb,
+ *   resonestor chords)
+ *
+ * Runs in the audio callback, after the CPU meter has measured the block.
+ */
+class QualityGovernor {
+public:
+    struct Config {
+        float load_target;        // fraction of the block period, 0..1
+        float hysteresis;         // recover only below load_target - hysteresis
+        float panic_load;         // step down on a single block above this
+        uint32_t overload_blocks; // blocks in a row above load_target to step down
+        uint32_t settle_blocks;   // blocks to let a downgrade take effect
+        uint32_t recover_blocks;  // quiet blocks required before upgrading
+
+        void Defaults();
+    };
+
+    static constexpr int kNumLevels = 5;
+
+    QualityGovernor();
+    ~QualityGovernor() = default;
+
+    void Init(const Config& config, GranularProcessorClouds* processor);
+
+    // Call once per block with the load of that block.
+    void Update(float block_load);
+
+    int GetLevel() const { return level_; }
+    uint32_t GetDowngradeCount() const { return downgrades_; }
+
+private:
+    void SetLevel(int level);
+
+    Config config_;
+    GranularProcessorClouds* processor_;
+    int level_;
+    uint32_t settle_counter_;
+    uint32_t recover_counter_;
+    uint32_t overload_counter_;
+    uint32_t downgrades_;
+};
+
+#endif // QUALITY_GOVERNOR_H
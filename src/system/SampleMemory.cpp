@@ -0,0 +1,420 @@
+#include "SampleMemory.h"
+#include <algorithm>
+#include <cstring>
+#include "FlashLog.h"
+#include "dev/sdram.h"
+#include "stm32h7xx.h"
+#include "sys/system.h"
+
+using daisy::System;
+using QspiFlash::kBlockSize;
+using QspiFlash::kPageSize;
+using QspiFlash::kSectorSize;
+using QspiFlash::Mapped;
+
+namespace {
+constexpr uint32_t kMagic = 0x504D534B;    // 'KSMP'
+// Memory-mapped flash checked or copied per Process() call
+constexpr uint32_t kReadChunk = 16384;
+// Silent pages passed over per Process() call
+constexpr uint32_t kMaxSkipsPerCall = 64;
+
+// The saved blocks back to back, as LoadPersistentData() expects them
+DSY_SDRAM_BSS uint8_t g_image[SampleMemory::kMaxImageSize] __attribute__((aligned(32)));
+
+bool IsFilled(const uint8_t* data, size_t size, uint32_t word) {
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(data);
+    for (size_t i = 0; i < size / 4; ++i) {
+        if (words[i] != word) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+void SampleMemory::Config::Defaults() {
+    base = 0x700000;    // Top 1 MB of the 8 MB flash
+    slice_us = 100;
+    sparse = true;
+    mute = nullptr;
+    muted = nullptr;
+}
+
+SampleMemory::SampleMemory()
+    : processor_(nullptr),
+      slice_ticks_(1),
+      writable_(false),
+      state_(State::IDLE),
+      result_(Result::NONE),
+      current_slot_(-1),
+      current_sequence_(0),
+      spare_ready_(false),
+      erase_offset_(0),
+      image_size_(0),
+      image_crc_(0),
+      position_(0),
+      header_started_(false),
+      freeze_was_held_(false),
+      faded_(false),
+      wait_from_(0),
+      flash_busy_(false),
+      flash_erasing_(false),
+      flash_suspended_(false),
+      flash_address_(0),
+      flash_data_(nullptr),
+      flash_size_(0),
+      flash_done_(0),
+      flash_chunk_(0),
+      freeze_hold_(false),
+      blocks_(0),
+      frozen_blocks_(0),
+      erase_count_(0),
+      pages_skipped_(0) {
+    static_assert(kSlotSize % kBlockSize == 0, "slots are erased in whole blocks");
+    static_assert(kReadChunk % kPageSize == 0 && kBlockSize % kReadChunk == 0, "chunks must tile the blocks");
+    static_assert(sizeof(SlotHeader) <= kSectorSize, "header must fit its sector");
+    config_.Defaults();
+    memset(&header_, 0, sizeof(header_));
+}
+
+void SampleMemory::Init(const Config& config, GranularProcessorClouds* processor) {
+    config_ = config;
+    processor_ = processor;
+    const uint32_t ticks_per_us = System::GetTickFreq() / 1000000;
+    slice_ticks_ = config_.slice_us * (ticks_per_us ? ticks_per_us : 1);
+    writable_ = true;
+    state_ = State::IDLE;
+    result_ = Result::NONE;
+
+    current_slot_ = -1;
+    current_sequence_ = 0;
+    for (int slot = 0; slot < kNumSlots; ++slot) {
+        const SlotHeader* header = ValidHeader(slot);
+        if (header && (current_slot_ < 0 || static_cast<int32_t>(header->sequence - current_sequence_) > 0)) {
+            current_slot_ = slot;
+            current_sequence_ = header->sequence;
+        }
+    }
+    spare_ready_ = false;
+    erase_offset_ = 0;
+}
+
+bool SampleMemory::Save() {
+    if (state_ != State::IDLE) {
+        return false;
+    }
+    PersistentBlock blocks[3];
+    size_t num_blocks;
+    if (!writable_ || !processor_->GetPersistentData(blocks, &num_blocks)) {
+        result_ = Result::UNAVAILABLE;
+        return false;
+    }
+    // The buffers are copied once a whole block has run without recording
+    freeze_was_held_ = IsFreezeHeld();
+    wait_from_ = frozen_blocks_.load(std::memory_order_acquire);
+    freeze_hold_.store(true, std::memory_order_relaxed);
+    state_ = State::CAPTURING;
+    return true;
+}
+
+bool SampleMemory::Load() {
+    if (state_ != State::IDLE) {
+        return false;
+    }
+    PersistentBlock blocks[3];
+    size_t num_blocks;
+    if (!processor_->GetPersistentData(blocks, &num_blocks)) {
+        result_ = Result::UNAVAILABLE;
+        return false;
+    }
+    const SlotHeader* header = current_slot_ >= 0 ? ValidHeader(current_slot_) : nullptr;
+    if (!header) {
+        result_ = Result::EMPTY;
+        return false;
+    }
+    header_ = *header;
+    image_size_ = header_.image_size;
+    image_crc_ = 0;
+    position_ = 0;
+    state_ = State::LOADING;
+    return true;
+}
+
+void SampleMemory::Process() {
+    switch (state_) {
+        case State::IDLE:
+            // Get the next save's slot ready while nothing else is going on
+            if (writable_ && !spare_ready_) {
+                StepErase();
+            }
+            break;
+        case State::CAPTURING:
+            if (frozen_blocks_.load(std::memory_order_acquire) != wait_from_) {
+                Capture();
+            }
+            break;
+        case State::SAVING:
+            StepSave();
+            break;
+        case State::LOADING:
+            StepLoad();
+            break;
+        case State::SWAPPING:
+            StepSwap();
+            break;
+    }
+}
+
+float SampleMemory::GetProgress() const {
+    if ((state_ != State::SAVING && state_ != State::LOADING) || !image_size_) {
+        return state_ == State::SWAPPING ? 1.0f : 0.0f;
+    }
+    return static_cast<float>(position_) / static_cast<float>(image_size_);
+}
+
+const SampleMemory::SlotHeader* SampleMemory::ValidHeader(int slot) const {
+    const SlotHeader* header = reinterpret_cast<const SlotHeader*>(Mapped(SlotAddress(slot)));
+    if (header->magic != kMagic || header->image_size > kMaxImageSize) {
+        return nullptr;
+    }
+    return FlashLog::Crc32(header, offsetof(SlotHeader, crc)) == header->crc ? header : nullptr;
+}
+
+void SampleMemory::Capture() {
+    PersistentBlock blocks[3];
+    size_t num_blocks;
+    processor_->PreparePersistentData();
+    bool ok = processor_->GetPersistentData(blocks, &num_blocks);
+    uint32_t size = 0;
+    for (size_t i = 0; ok && i < num_blocks; ++i) {
+        size += 2 * sizeof(uint32_t) + blocks[i].size;
+    }
+    ok = ok && size <= kMaxImageSize;
+
+    if (ok) {
+        uint8_t* cursor = g_image;
+        for (size_t i = 0; i < num_blocks; ++i) {
+            memcpy(cursor, &blocks[i].tag, sizeof(uint32_t));
+            memcpy(cursor + sizeof(uint32_t), &blocks[i].size, sizeof(uint32_t));
+            memcpy(cursor + 2 * sizeof(uint32_t), blocks[i].data, blocks[i].size);
+            cursor += 2 * sizeof(uint32_t) + blocks[i].size;
+        }
+        // Whole pages are programmed
+        memset(cursor, 0, std::min((kPageSize - size % kPageSize) % kPageSize, kMaxImageSize - size));
+    }
+    freeze_hold_.store(freeze_was_held_, std::memory_order_relaxed);
+    if (!ok) {
+        Finish(Result::UNAVAILABLE);
+        return;
+    }
+
+    image_size_ = size;
+    image_crc_ = 0;
+    position_ = 0;
+    header_started_ = false;
+    memset(&header_, 0, sizeof(header_));
+    state_ = State::SAVING;
+}
+
+bool SampleMemory::StepErase() {
+    const uint32_t slot = SlotAddress(SpareSlot());
+    if (flash_busy_) {
+        if (StepFlash() && writable_) {
+            ++erase_count_;    // Checked again from the start of the block
+        }
+        return false;
+    }
+    if (erase_offset_ >= kSlotSize) {
+        spare_ready_ = true;
+        return true;
+    }
+    if (IsFilled(Mapped(slot + erase_offset_), kReadChunk, 0xFFFFFFFF)) {
+        erase_offset_ += kReadChunk;
+        return false;
+    }
+    erase_offset_ &= ~(kBlockSize - 1);
+    flash_busy_ = true;
+    flash_erasing_ = true;
+    flash_suspended_ = false;
+    flash_address_ = slot + erase_offset_;
+    flash_size_ = kBlockSize;
+    return false;
+}
+
+void SampleMemory::StepSave() {
+    if (!writable_) {
+        Finish(Result::UNAVAILABLE);
+        return;
+    }
+    if (!flash_busy_) {
+        if (!spare_ready_) {
+            StepErase();
+            return;
+        }
+        if (!StartNextSavePage()) {
+            return;
+        }
+    }
+    if (!StepFlash()) {
+        return;
+    }
+    if (!writable_) {
+        Finish(Result::UNAVAILABLE);
+        return;
+    }
+    if (memcmp(Mapped(flash_address_), flash_data_, flash_size_) != 0) {
+        // The slot is erased again before the next save
+        spare_ready_ = false;
+        erase_offset_ = 0;
+        Finish(Result::FAILED);
+        return;
+    }
+    if (!header_started_) {
+        position_ += kPageSize;
+        return;
+    }
+    current_slot_ = SpareSlot();
+    current_sequence_ = header_.sequence;
+    spare_ready_ = false;
+    erase_offset_ = 0;
+    Finish(Result::SAVED);
+}
+
+// Starts programming the next page that is not silence, or the header once
+// the image is done. False when this call only passed over silent pages.
+bool SampleMemory::StartNextSavePage() {
+    const uint32_t image_base = SlotAddress(SpareSlot()) + kSectorSize;
+    for (uint32_t skipped = 0; position_ < image_size_; ++skipped) {
+        if (skipped == kMaxSkipsPerCall) {
+            return false;
+        }
+        const uint32_t page = position_ / kPageSize;
+        const uint8_t* data = g_image + position_;
+        image_crc_ = FlashLog::Crc32(data, std::min(kPageSize, image_size_ - position_), image_crc_);
+        if (!config_.sparse || !IsFilled(data, kPageSize, 0)) {
+            StartProgram(image_base + position_, data, kPageSize);
+            return true;
+        }
+        header_.silent_pages[page / 8] |= static_cast<uint8_t>(1 << (page % 8));
+        ++pages_skipped_;
+        position_ += kPageSize;
+    }
+
+    header_.magic = kMagic;
+    header_.sequence = current_slot_ >= 0 ? current_sequence_ + 1 : 1;
+    header_.image_size = image_size_;
+    header_.image_crc = image_crc_;
+    header_.crc = FlashLog::Crc32(&header_, offsetof(SlotHeader, crc));
+    header_started_ = true;
+    StartProgram(SlotAddress(SpareSlot()), reinterpret_cast<const uint8_t*>(&header_), sizeof(header_));
+    return true;
+}
+
+void SampleMemory::StepLoad() {
+    const uint32_t image_base = SlotAddress(current_slot_) + kSectorSize;
+    const uint32_t end = std::min(position_ + kReadChunk, image_size_);
+    while (position_ < end) {
+        const uint32_t page = position_ / kPageSize;
+        const uint32_t size = std::min(kPageSize, image_size_ - position_);
+        if (header_.silent_pages[page / 8] & (1 << (page % 8))) {
+            memset(g_image + position_, 0, size);
+        } else {
+            memcpy(g_image + position_, Mapped(image_base + position_), size);
+        }
+        image_crc_ = FlashLog::Crc32(g_image + position_, size, image_crc_);
+        position_ += size;
+    }
+    if (position_ < image_size_) {
+        return;
+    }
+    if (image_crc_ != header_.image_crc) {
+        Finish(Result::CORRUPT);
+        return;
+    }
+    faded_ = false;
+    if (config_.mute) {
+        config_.mute(true);
+    }
+    state_ = State::SWAPPING;
+}
+
+void SampleMemory::StepSwap() {
+    if (!faded_) {
+        if (config_.muted && !config_.muted()) {
+            return;
+        }
+        processor_->set_silence(true);
+        wait_from_ = blocks_.load(std::memory_order_acquire);
+        faded_ = true;
+        return;
+    }
+    // Once a silent block has run, the callback leaves the buffers alone
+    if (blocks_.load(std::memory_order_acquire) == wait_from_) {
+        return;
+    }
+    const bool loaded = processor_->LoadPersistentData(reinterpret_cast<const uint32_t*>(g_image));
+    processor_->set_silence(false);
+    if (loaded) {
+        freeze_hold_.store(true, std::memory_order_relaxed);
+    }
+    if (config_.mute) {
+        config_.mute(false);
+    }
+    Finish(loaded ? Result::LOADED : Result::MISMATCH);
+}
+
+void SampleMemory::Finish(Result result) {
+    result_ = result;
+    state_ = State::IDLE;
+}
+
+void SampleMemory::StartProgram(uint32_t address, const uint8_t* data, uint32_t size) {
+    flash_busy_ = true;
+    flash_erasing_ = false;
+    flash_suspended_ = false;
+    flash_address_ = address;
+    flash_data_ = data;
+    flash_size_ = size;
+    flash_done_ = 0;
+}
+
+bool SampleMemory::StepFlash() {
+    QspiFlash::Result result;
+    if (!flash_suspended_ && QspiFlash::IsSuspended()) {
+        return false;    // The settings log's operation
+    } else if (flash_suspended_) {
+        result = QspiFlash::Resume(slice_ticks_);
+    } else if (flash_erasing_) {
+        result = QspiFlash::EraseBlock(flash_address_, slice_ticks_);
+    } else {
+        const uint32_t address = flash_address_ + flash_done_;
+        flash_chunk_ = std::min(flash_size_ - flash_done_, kPageSize - address % kPageSize);
+        result = QspiFlash::Program(address, flash_data_ + flash_done_, flash_chunk_, slice_ticks_);
+    }
+
+    if (result == QspiFlash::Result::DEFERRED) {
+        return false;    // Too close to the next audio block
+    }
+    if (result == QspiFlash::Result::ERROR) {
+        writable_ = false;
+        flash_busy_ = false;
+        return true;
+    }
+    if (result == QspiFlash::Result::SUSPENDED) {
+        flash_suspended_ = true;
+        return false;
+    }
+    flash_suspended_ = false;
+    if (!flash_erasing_) {
+        flash_done_ += flash_chunk_;
+        if (flash_done_ < flash_size_) {
+            return false;
+        }
+    }
+    flash_busy_ = false;
+
+    // The flash changed underneath the D-cache
+    SCB_InvalidateDCache_by_Addr(const_cast<uint8_t*>(Mapped(flash_address_)), flash_size_);
+    return true;
+}
@@ -0,0 +1,171 @@
+#ifndef SAMPLE_MEMORY_H
+#define SAMPLE_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Nimbus_SM/dsp/granular_processor.h"
+#include "QspiFlash.h"
+
+/**
+ * SampleMemory saves the Clouds recording buffers to the QSPI flash and
+ * loads them back, as Clouds' sample memories do, without stopping audio:
+ * - Saving freezes the recording for the one block it takes to copy the
+ *   buffers and their write heads into an SDRAM image. The image is then
+ *   programmed page by page, one QspiFlash slice per Process() call
+ * - Two slots alternate; the one not holding the latest save is erased in
+ *   the background beforehand, so a save only programs. Its header,
+ *   written last with a CRC of the image, makes it current
+ * - Pages of digital silence are not programmed, only flagged in the
+ *   header (a partly filled buffer saves and loads faster)
+ * - Loading copies the slot from memory-mapped flash into the SDRAM image
+ *   in chunks and checks it; only then is the output faded out, the image
+ *   copied into the buffers, the write heads resynced and the output faded
+ *   back in. The loaded audio is kept frozen until ReleaseFreeze()
+ *
+ * The slots sit at the top of the flash, which the linker script does not
+ * reserve: the firmware image must stay below Config::base. Long memory
+ * does not fit and is refused. Process() runs in the main loop;
+ * OnAudioBlock() and IsFreezeHeld() in the audio callback.
+ */
+class SampleMemory {
+public:
+    typedef void (*MuteFunction)(bool muted);
+    typedef bool (*MutedFunction)();
+
+    struct Config {
+        uint32_t base;          // Flash offset of the first slot (64 kB aligned)
+        uint32_t slice_us;      // Flash busy time per Process() call, at most
+        bool sparse;            // Skip pages of silence
+        MuteFunction mute;      // Output fade around a load
+        MutedFunction muted;
+
+        void Defaults();
+    };
+
+    enum class State {
+        IDLE,
+        CAPTURING,      // Waiting for the freeze to copy the buffers
+        SAVING,         // Programming the image (erasing first if needed)
+        LOADING,        // Copying and checking the saved image
+        SWAPPING,       // Fading out, loading the buffers, fading in
+    };
+
+    enum class Result {
+        NONE,
+        SAVED,
+        LOADED,
+        EMPTY,          // Nothing saved
+        CORRUPT,        // CRC mismatch
+        MISMATCH,       // Saved with another quality or mode
+        UNAVAILABLE,    // Long memory, or the flash is write protected
+        FAILED,         // Verify failed after programming
+    };
+
+    static constexpr int kNumSlots = 2;
+    static constexpr uint32_t kSlotSize = 512 * 1024;
+    static constexpr uint32_t kMaxImageSize = kSlotSize - QspiFlash::kSectorSize;
+
+    SampleMemory();
+    ~SampleMemory() = default;
+
+    // Finds the latest save
+    void Init(const Config& config, GranularProcessorClouds* processor);
+
+    // Start a save or a load; false when another is in progress
+    bool Save();
+    bool Load();
+
+    void Process();
+
+    // Audio callback: once per block, after the processor has run
+    void OnAudioBlock(bool frozen) {
+        blocks_.fetch_add(1, std::memory_order_release);
+        if (frozen) {
+            frozen_blocks_.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    bool IsFreezeHeld() const { return freeze_hold_.load(std::memory_order_relaxed); }
+    void ReleaseFreeze() { freeze_hold_.store(false, std::memory_order_relaxed); }
+
+    State GetState() const { return state_; }
+    bool IsBusy() const { return state_ != State::IDLE; }
+    Result GetLastResult() const { return result_; }
+    bool HasSave() const { return current_slot_ >= 0; }
+
+    // Fraction of the save or load done, 0..1
+    float GetProgress() const;
+
+    uint32_t GetEraseCount() const { return erase_count_; }
+    uint32_t GetPagesSkipped() const { return pages_skipped_; }
+
+private:
+    static constexpr uint32_t kMaxPages = kMaxImageSize / QspiFlash::kPageSize;
+
+    struct SlotHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t image_size;
+        uint32_t image_crc;
+        uint8_t silent_pages[kMaxPages / 8];    // Not programmed, read as zeros
+        uint32_t crc;
+    };
+
+    uint32_t SlotAddress(int slot) const { return config_.base + slot * kSlotSize; }
+    int SpareSlot() const { return current_slot_ == 0 ? 1 : 0; }
+    const SlotHeader* ValidHeader(int slot) const;
+
+    bool StepErase();
+    void StepSave();
+    bool StartNextSavePage();
+    void StepLoad();
+    void StepSwap();
+    void Capture();
+    void Finish(Result result);
+
+    void StartProgram(uint32_t address, const uint8_t* data, uint32_t size);
+    // One slice of the current flash operation; true once it is complete
+    bool StepFlash();
+
+    Config config_;
+    GranularProcessorClouds* processor_;
+    uint32_t slice_ticks_;
+    bool writable_;
+
+    State state_;
+    Result result_;
+    int current_slot_;
+    uint32_t current_sequence_;
+    bool spare_ready_;
+    uint32_t erase_offset_;         // Within the spare slot, checked blank below
+
+    uint32_t image_size_;
+    uint32_t image_crc_;
+    uint32_t position_;             // Bytes saved or loaded so far
+    bool header_started_;
+    bool freeze_was_held_;
+    bool faded_;
+    uint32_t wait_from_;            // Block count the current wait started at
+
+    // Flash operation in progress; the source must be in RAM
+    bool flash_busy_;
+    bool flash_erasing_;
+    bool flash_suspended_;
+    uint32_t flash_address_;
+    const uint8_t* flash_data_;
+    uint32_t flash_size_;
+    uint32_t flash_done_;
+    uint32_t flash_chunk_;
+
+    SlotHeader header_;
+
+    std::atomic<bool> freeze_hold_;
+    std::atomic<uint32_t> blocks_;
+    std::atomic<uint32_t> frozen_blocks_;
+
+    uint32_t erase_count_;
+    uint32_t pages_skipped_;
+};
+
+#endif // SAMPLE_MEMORY_H
@@ -0,0 +1,135 @@
+#include "SdramClear.h"
+#include "daisy_core.h"
+#include "stm32h7xx_hal.h"
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t kBlockSize = 65536;          // Largest MDMA block
+constexpr uint32_t kMaxBlockCount = 4096;
+constexpr size_t kMaxRegionSize = static_cast<size_t>(kBlockSize) * kMaxBlockCount;
+constexpr int kMaxSegments = SdramClear::kMaxRegions * 2;
+
+// Outside the D-cache, like the nodes: MDMA reads them from memory
+DMA_BUFFER_MEM_SECTION uint32_t g_zero_word;
+DMA_BUFFER_MEM_SECTION MDMA_LinkNodeTypeDef g_clear_nodes[kMaxSegments] __attribute__((aligned(8)));
+
+MDMA_HandleTypeDef g_clear_mdma;
+
+struct Segment {
+    uint8_t* destination;
+    uint32_t block_size;
+    uint32_t block_count;
+};
+
+} // namespace
+
+SdramClear::SdramClear() : num_regions_(0), started_(false) {
+}
+
+bool SdramClear::Add(void* start, size_t size) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(start);
+    if (started_ || num_regions_ >= kMaxRegions || address % 4 || size % 4 || size > kMaxRegionSize) {
+        return false;
+    }
+    if (size) {
+        regions_[num_regions_++] = Region{static_cast<uint8_t*>(start), size};
+    }
+    return true;
+}
+
+bool SdramClear::Start() {
+    // Whole blocks, then the remainder, for each region
+    Segment segments[kMaxSegments];
+    int num_segments = 0;
+    for (int i = 0; i < num_regions_; ++i) {
+        const Region& region = regions_[i];
+        const uint32_t blocks = static_cast<uint32_t>(region.size / kBlockSize);
+        const uint32_t remainder = static_cast<uint32_t>(region.size % kBlockSize);
+        if (blocks) {
+            segments[num_segments++] = Segment{region.start, kBlockSize, blocks};
+        }
+        if (remainder) {
+            segments[num_segments++] = Segment{region.start + region.size - remainder, remainder, 1};
+        }
+    }
+    if (num_segments == 0) {
+        return true;
+    }
+
+    __HAL_RCC_MDMA_CLK_ENABLE();
+    MDMA_InitTypeDef& init = g_clear_mdma.Init;
+    g_clear_mdma.Instance = MDMA_Channel1;
+    init.Request = MDMA_REQUEST_SW;
+    init.TransferTriggerMode = MDMA_FULL_TRANSFER;
+    init.Priority = MDMA_PRIORITY_LOW;
+    init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    init.SourceInc = MDMA_SRC_INC_DISABLE;
+    init.DestinationInc = MDMA_DEST_INC_WORD;
+    init.SourceDataSize = MDMA_SRC_DATASIZE_WORD;
+    init.DestDataSize = MDMA_DEST_DATASIZE_WORD;
+    init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+    init.BufferTransferLength = 128;
+    init.SourceBurst = MDMA_SOURCE_BURST_SINGLE;
+    init.DestBurst = MDMA_DEST_BURST_32BEATS;
+    init.SourceBlockAddressOffset = 0;
+    init.DestBlockAddressOffset = 0;
+    if (HAL_MDMA_Init(&g_clear_mdma) != HAL_OK) {
+        return false;
+    }
+
+    // Segment 0 goes into the channel registers; the rest are chained
+    MDMA_LinkNodeConfTypeDef node_config;
+    node_config.Init = init;
+    node_config.SrcAddress = reinterpret_cast<uint32_t>(&g_zero_word);
+    node_config.PostRequestMaskAddress = 0;
+    node_config.PostRequestMaskData = 0;
+    for (int i = 1; i < num_segments; ++i) {
+        node_config.DstAddress = reinterpret_cast<uint32_t>(segments[i].destination);
+        node_config.BlockDataLength = segments[i].block_size;
+        node_config.BlockCount = segments[i].block_count;
+        HAL_MDMA_LinkedList_CreateNode(&g_clear_nodes[i], &node_config);
+        if (i > 1) {
+            g_clear_nodes[i - 1].CLAR = reinterpret_cast<uint32_t>(&g_clear_nodes[i]);
+        }
+    }
+    g_zero_word = 0;
+    __DSB();
+
+    // Dirty lines in the regions would be evicted over the zeros later
+    SCB_CleanInvalidateDCache();
+
+    g_clear_mdma.FirstLinkedListNodeAddress = num_segments > 1 ? &g_clear_nodes[1] : nullptr;
+    if (HAL_MDMA_Start(&g_clear_mdma,
+                       reinterpret_cast<uint32_t>(&g_zero_word),
+                       reinterpret_cast<uint32_t>(segments[0].destination),
+                       segments[0].block_size,
+                       segments[0].block_count) != HAL_OK) {
+        HAL_MDMA_Abort(&g_clear_mdma);
+        return false;
+    }
+    started_ = true;
+    return true;
+}
+
+bool SdramClear::IsBusy() {
+    return started_ && !__HAL_MDMA_GET_FLAG(&g_clear_mdma, MDMA_FLAG_CTC);
+}
+
+void SdramClear::Wait() {
+    if (started_) {
+        const bool ok = HAL_MDMA_PollForTransfer(&g_clear_mdma, HAL_MDMA_FULL_TRANSFER, HAL_MAX_DELAY) == HAL_OK;
+        started_ = false;
+        // Lines the CPU may have fetched (speculatively) during the transfer
+        SCB_CleanInvalidateDCache();
+        if (ok) {
+            num_regions_ = 0;
+            return;
+        }
+        HAL_MDMA_Abort(&g_clear_mdma);
+    }
+    for (int i = 0; i < num_regions_; ++i) {
+        memset(regions_[i].start, 0, regions_[i].size);
+    }
+    num_regions_ = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef SDRAM_CLEAR_H
+#define SDRAM_CLEAR_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * SdramClear zeroes large buffers with MDMA while the CPU does something
+ * else (the rest of the init at boot):
+ * - Each region becomes one or two linked-list nodes of 64 kB blocks
+ *   (repeated up to 4096 times) written from a single zero word
+ * - The D-cache is cleaned and invalidated around the transfer, so no
+ *   line cached before or during it lands on top of the zeros
+ *
+ * The regions must not be touched until Wait() returns. Uses MDMA
+ * channel 1, at low priority (channel 0 is StagingDma's).
+ */
+class SdramClear {
+public:
+    static constexpr int kMaxRegions = 4;
+
+    SdramClear();
+    ~SdramClear() = default;
+
+    // Word aligned start and size; false when full or misaligned
+    bool Add(void* start, size_t size);
+
+    // Starts the transfer; false (nothing started) on a DMA error
+    bool Start();
+
+    bool IsBusy();
+    // Blocks until done; falls back to memset when the DMA failed
+    void Wait();
+
+private:
+    struct Region {
+        uint8_t* start;
+        size_t size;
+    };
+
+    Region regions_[kMaxRegions];
+    int num_regions_;
+    bool started_;
+};
+
+#endif // SDRAM_CLEAR_H
@@ -0,0 +1,127 @@
+#include "StagingDma.h"
+#include "daisy_core.h"
+#include "stm32h7xx_hal.h"
+
+namespace {
+
+constexpr size_t kMaxTransfers = kNumStagingSlots * kMaxNumChannels * 2;
+
+// MDMA reads the linked list straight from memory: keep it out of the D-cache.
+DMA_BUFFER_MEM_SECTION MDMA_LinkNodeTypeDef g_staging_nodes[kMaxTransfers]
+    __attribute__((aligned(8)));
+
+MDMA_HandleTypeDef g_staging_mdma;
+
+} // namespace
+
+StagingDma::StagingDma()
+    : busy_(false), late_count_(0), last_transfers_(nullptr), last_num_transfers_(0) {
+}
+
+void StagingDma::Init() {
+    __HAL_RCC_MDMA_CLK_ENABLE();
+
+    MDMA_InitTypeDef& init = g_staging_mdma.Init;
+    g_staging_mdma.Instance = MDMA_Channel0;
+    init.Request = MDMA_REQUEST_SW;
+    init.TransferTriggerMode = MDMA_FULL_TRANSFER; // one request runs the whole list
+    init.Priority = MDMA_PRIORITY_HIGH;
+    init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    init.SourceInc = MDMA_SRC_INC_HALFWORD;
+    init.DestinationInc = MDMA_DEST_INC_HALFWORD;
+    init.SourceDataSize = MDMA_SRC_DATASIZE_HALFWORD;
+    init.DestDataSize = MDMA_DEST_DATASIZE_HALFWORD;
+    init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+    init.BufferTransferLength = 128;
+    init.SourceBurst = MDMA_SOURCE_BURST_SINGLE;
+    init.DestBurst = MDMA_DEST_BURST_SINGLE;
+    init.SourceBlockAddressOffset = 0;
+    init.DestBlockAddressOffset = 0;
+    HAL_MDMA_Init(&g_staging_mdma);
+
+    // Pre-build every node once (control and bus bits for SDRAM -> AXI SRAM);
+    // only addresses, lengths and links are patched per block.
+    MDMA_LinkNodeConfTypeDef node_config;
+    node_config.Init = init;
+    node_config.SrcAddress = 0xC0000000;
+    node_config.DstAddress = 0x24000000;
+    node_config.BlockDataLength = sizeof(int16_t);
+    node_config.BlockCount = 1;
+    node_config.PostRequestMaskAddress = 0;
+    node_config.PostRequestMaskData = 0;
+    for (size_t i = 0; i < kMaxTransfers; ++i) {
+        HAL_MDMA_LinkedList_CreateNode(&g_staging_nodes[i], &node_config);
+    }
+}
+
+void StagingDma::Attach(SampleStager* stager) {
+    stager->set_transport(&StagingDma::Submit, &StagingDma::Wait, this);
+}
+
+void StagingDma::Submit(const StagingTransfer* transfers, size_t num_transfers, void* context) {
+    StagingDma* self = static_cast<StagingDma*>(context);
+    if (num_transfers > kMaxTransfers) {
+        num_transfers = kMaxTransfers;
+    }
+
+    // The recording buffer is written through the D-cache.
+    for (size_t i = 0; i < num_transfers; ++i) {
+        SCB_CleanDCache_by_Addr((void*)transfers[i].source, transfers[i].size * sizeof(int16_t));
+    }
+
+    // Node 0 is programmed into the channel registers by the HAL; the rest
+    // are chained from it.
+    for (size_t i = 1; i < num_transfers; ++i) {
+        MDMA_LinkNodeTypeDef& node = g_staging_nodes[i];
+        node.CSAR = reinterpret_cast<uint32_t>(transfers[i].source);
+        node.CDAR = reinterpret_cast<uint32_t>(transfers[i].destination);
+        node.CBNDTR = (transfers[i].size * sizeof(int16_t)) & MDMA_CBNDTR_BNDT;
+        node.CLAR = i + 1 < num_transfers ? reinterpret_cast<uint32_t>(&g_staging_nodes[i + 1]) : 0;
+    }
+    __DSB();
+
+    g_staging_mdma.FirstLinkedListNodeAddress = num_transfers > 1 ? &g_staging_nodes[1] : nullptr;
+    self->last_transfers_ = transfers;
+    self->last_num_transfers_ = num_transfers;
+    self->busy_ = true;
+    if (HAL_MDMA_Start(&g_staging_mdma,
+                          reinterpret_cast<uint32_t>(transfers[0].source),
+                          reinterpret_cast<uint32_t>(transfers[0].destination),
+                          transfers[0].size * sizeof(int16_t),
+                          1) != HAL_OK) {
+        // Channel still busy or in error: fall back to a CPU copy.
+        HAL_MDMA_Abort(&g_staging_mdma);
+        for (size_t i = 0; i < num_transfers; ++i) {
+            const int16_t* source = transfers[i].source;
+            int16_t* destination = transfers[i].destination;
+            for (int32_t n = 0; n < transfers[i].size; ++n) {
+                destination[n] = source[n];
+            }
+        }
+        self->busy_ = false;
+        self->last_num_transfers_ = 0;
+    }
+}
+
+void StagingDma::Wait(void* context) {
+    StagingDma* self = static_cast<StagingDma*>(context);
+    if (!self->busy_) {
+        return;
+    }
+    // Polled rather than interrupt-driven: this runs inside the audio
+    // callback, which an MDMA interrupt would not be able to preempt.
+    if (!__HAL_MDMA_GET_FLAG(&g_staging_mdma, MDMA_FLAG_CTC)) {
+        ++self->late_count_;
+    }
+    if (HAL_MDMA_PollForTransfer(&g_staging_mdma, HAL_MDMA_FULL_TRANSFER, 1) != HAL_OK) {
+        HAL_MDMA_Abort(&g_staging_mdma);
+    }
+    self->busy_ = false;
+
+    // Drop any stale lines the CPU may hold for the freshly written slots.
+    for (size_t i = 0; i < self->last_num_transfers_; ++i) {
+        const StagingTransfer& t = self->last_transfers_[i];
+        SCB_InvalidateDCache_by_Addr(t.destination, t.size * sizeof(int16_t));
+    }
+    self->last_num_transfers_ = 0;
+}
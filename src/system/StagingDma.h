@@ -0,0 +1,43 @@
+#ifndef STAGING_DMA_H
+#define STAGING_DMA_H
+
+#include <cstddef>
+#include "Nimbus_SM/dsp/sample_stager.h"
+
+/**
+ * StagingDma is the hardware transport behind Clouds' SampleStager in
+ * long-memory mode:
+ * - Each block's batch of SDRAM -> AXI SRAM copies runs as one MDMA
+ *   linked list, kicked by a single software request
+ * - Sources are cleaned from the D-cache before the transfer, destinations
+ *   invalidated once it has landed
+ *
+ * The copies run while the rest of the audio callback (FX, output) and the
+ * main loop execute; the wait at the start of the next block normally
+ * finds them done. Both ends run in the audio callback, so no interrupt or
+ * atomics are involved.
+ */
+class StagingDma {
+public:
+    StagingDma();
+    ~StagingDma() = default;
+
+    void Init();
+
+    // Installs this transport on a stager.
+    void Attach(SampleStager* stager);
+
+    // Number of blocks whose prefetch had not landed when it was needed.
+    uint32_t GetLateCount() const { return late_count_; }
+
+private:
+    static void Submit(const StagingTransfer* transfers, size_t num_transfers, void* context);
+    static void Wait(void* context);
+
+    bool busy_;
+    uint32_t late_count_;
+    const StagingTransfer* last_transfers_;
+    size_t last_num_transfers_;
+};
+
+#endif // STAGING_DMA_H
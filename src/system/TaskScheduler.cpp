@@ -0,0 +1,144 @@
+#include "TaskScheduler.h"
+#include "sys/system.h"
+#include "stm32h7xx.h"
+
+using daisy::System;
+using daisy::TimerHandle;
+
+void TaskScheduler::Config::Defaults() {
+    wake_period_us = 100;
+    sleep = true;
+}
+
+TaskScheduler::TaskScheduler()
+    : num_tasks_(0),
+      ticks_per_us_(1),
+      last_tick_(0),
+      tick_remainder_(0),
+      now_us_(0),
+      idle_us_(0) {
+    config_.Defaults();
+}
+
+void TaskScheduler::Init(const Config& config) {
+    config_ = config;
+    num_tasks_ = 0;
+
+    const uint32_t ticks_per_us = System::GetTickFreq() / 1000000;
+    ticks_per_us_ = ticks_per_us ? ticks_per_us : 1;
+    last_tick_ = System::GetTick();
+    tick_remainder_ = 0;
+    now_us_ = 0;
+    idle_us_ = 0;
+
+    if (config_.sleep) {
+        // The interrupt only ends WFI; no callback needed
+        TimerHandle::Config timer_config;
+        timer_config.periph = TimerHandle::Config::Peripheral::TIM_5;
+        timer_config.dir = TimerHandle::Config::CounterDir::UP;
+        timer_config.period = config_.wake_period_us * ticks_per_us_ - 1;
+        timer_config.enable_irq = true;
+        wake_timer_.Init(timer_config);
+        wake_timer_.Start();
+    }
+}
+
+int TaskScheduler::AddTask(const char* name, TaskFunction function, uint32_t period_us, uint8_t priority) {
+    if (num_tasks_ >= kMaxTasks || !function || period_us == 0) {
+        return -1;
+    }
+    Task& task = tasks_[num_tasks_];
+    task.name = name;
+    task.function = function;
+    task.period_us = period_us;
+    task.priority = priority;
+    task.release_us = NowUs() + period_us;
+    task.stats = TaskStats{};
+    return num_tasks_++;
+}
+
+uint32_t TaskScheduler::NowUs() {
+    // TIM2 wraps cleanly at 2^32 ticks, System::GetUs() does not
+    const uint32_t tick = System::GetTick();
+    tick_remainder_ += tick - last_tick_;
+    last_tick_ = tick;
+    now_us_ += tick_remainder_ / ticks_per_us_;
+    tick_remainder_ %= ticks_per_us_;
+    return now_us_;
+}
+
+bool TaskScheduler::RunOnce() {
+    const uint32_t now = NowUs();
+    Task* next = nullptr;
+    for (int i = 0; i < num_tasks_; ++i) {
+        Task& task = tasks_[i];
+        if (Until(task.release_us, now) > 0) {
+            continue;
+        }
+        if (!next || task.priority < next->priority
+            || (task.priority == next->priority && Until(task.release_us, next->release_us) < 0)) {
+            next = &task;
+        }
+    }
+    if (!next) {
+        return false;
+    }
+    Dispatch(*next, now);
+    return true;
+}
+
+void TaskScheduler::Run() {
+    while (true) {
+        if (!RunOnce()) {
+            Idle(now_us_);
+        }
+    }
+}
+
+void TaskScheduler::Dispatch(Task& task, uint32_t now_us) {
+    TaskStats& stats = task.stats;
+    const uint32_t lateness = now_us - task.release_us;
+    if (lateness > stats.max_lateness_us) {
+        stats.max_lateness_us = lateness;
+    }
+
+    // Releases that passed while the task waited are skipped, keeping the
+    // grid
+    const uint32_t missed = lateness / task.period_us;
+    stats.overruns += missed;
+    task.release_us += (missed + 1) * task.period_us;
+
+    const uint32_t start = System::GetTick();
+    task.function();
+    const uint32_t elapsed = (System::GetTick() - start) / ticks_per_us_;
+
+    ++stats.runs;
+    stats.last_us = elapsed;
+    stats.total_us += elapsed;
+    if (elapsed > stats.max_us) {
+        stats.max_us = elapsed;
+    }
+}
+
+void TaskScheduler::Idle(uint32_t now_us) {
+    int32_t slack = INT32_MAX;
+    for (int i = 0; i < num_tasks_; ++i) {
+        const int32_t until = Until(tasks_[i].release_us, now_us);
+        if (until < slack) {
+            slack = until;
+        }
+    }
+
+    // Any interrupt ends the sleep: the wake timer, SysTick, audio, USB
+    if (config_.sleep && slack > static_cast<int32_t>(config_.wake_period_us)) {
+        __WFI();
+    }
+    idle_us_ += NowUs() - now_us;
+}
+
+void TaskScheduler::ResetStats() {
+    for (int i = 0; i < num_tasks_; ++i) {
+        tasks_[i].stats = TaskStats{};
+    }
+    idle_us_ = 0;
+}
@@ -0,0 +1,110 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "per/tim.h"
+
+/**
+ * TaskScheduler runs the main loop's periodic work cooperatively:
+ * - Each task has a period in microseconds, timed from the TIM2 tick,
+ *   and releases on a fixed grid (no drift from late starts)
+ * - When several tasks are due, the highest priority (lowest value) runs
+ *   first, then the one released earliest
+ * - A task that starts a full period late has missed releases: they are
+ *   counted as overruns and skipped rather than run back to back
+ * - Per-task run count, execution time (last/avg/max) and worst start
+ *   latency
+ * - The core sleeps (WFI) until the next release; TIM5 ticks every
+ *   wake_period_us so that sleeping never delays a release by more than
+ *   that. Releases closer than one wake period are waited out awake
+ *
+ * Tasks must return promptly; the audio callback preempts them as usual.
+ */
+class TaskScheduler {
+public:
+    typedef void (*TaskFunction)();
+
+    struct Config {
+        uint32_t wake_period_us;      // Sleep granularity (TIM5 interrupt period)
+        bool sleep;                   // WFI when idle; spin otherwise
+
+        void Defaults();
+    };
+
+    struct TaskStats {
+        uint32_t runs;
+        uint32_t overruns;            // Releases missed
+        uint32_t last_us;
+        uint32_t max_us;
+        uint32_t max_lateness_us;     // Worst start time after release
+        uint64_t total_us;
+
+        uint32_t GetAverageUs() const { return runs ? static_cast<uint32_t>(total_us / runs) : 0; }
+    };
+
+    static constexpr int kMaxTasks = 12;
+
+    TaskScheduler();
+    ~TaskScheduler() = default;
+
+    void Init(const Config& config);
+
+    // Returns the task id, or -1 when the table is full. Priority 0 is the
+    // highest. The first release is one period from now.
+    int AddTask(const char* name, TaskFunction function, uint32_t period_us, uint8_t priority);
+
+    // Runs the due task with the highest priority, if any. Returns false
+    // when nothing was due.
+    bool RunOnce();
+
+    // Dispatches forever, sleeping when idle.
+    void Run();
+
+    // Microseconds since Init(), wrapping at 2^32. Main loop only.
+    uint32_t NowUs();
+
+    int GetNumTasks() const { return num_tasks_; }
+    const char* GetTaskName(int id) const { return tasks_[id].name; }
+    uint32_t GetTaskPeriod(int id) const { return tasks_[id].period_us; }
+    uint8_t GetTaskPriority(int id) const { return tasks_[id].priority; }
+    const TaskStats& GetTaskStats(int id) const { return tasks_[id].stats; }
+    void ResetStats();
+
+    // Time spent waiting for releases (sleeping or spinning)
+    uint64_t GetIdleUs() const { return idle_us_; }
+
+private:
+    struct Task {
+        const char* name;
+        TaskFunction function;
+        uint32_t period_us;
+        uint32_t release_us;
+        uint8_t priority;
+        TaskStats stats;
+    };
+
+    // Signed distance from now to a release: negative or zero when due
+    static int32_t Until(uint32_t release_us, uint32_t now_us) {
+        return static_cast<int32_t>(release_us - now_us);
+    }
+
+    void Dispatch(Task& task, uint32_t now_us);
+    void Idle(uint32_t now_us);
+
+    Config config_;
+    Task tasks_[kMaxTasks];
+    int num_tasks_;
+
+    daisy::TimerHandle wake_timer_;
+
+    // Microsecond clock extended from the raw timer tick
+    uint32_t ticks_per_us_;
+    uint32_t last_tick_;
+    uint32_t tick_remainder_;
+    uint32_t now_us_;
+
+    uint64_t idle_us_;
+};
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,88 @@
+#include "Telemetry.h"
+#include <cstring>
+#include "hid/usb.h"
+#include "sys/system.h"
+
+Telemetry::Telemetry()
+    : head_(0), tail_(0), sequence_(0), dropped_(0), tx_length_(0), tx_index_(0) {
+    for(size_t i = 0; i < kNumSlots; ++i) {
+        slots_[i].ready.store(false, std::memory_order_relaxed);
+        slots_[i].length = 0;
+    }
+}
+
+void Telemetry::Init() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+    sequence_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    for(size_t i = 0; i < kNumSlots; ++i) {
+        slots_[i].ready.store(false, std::memory_order_relaxed);
+    }
+    tx_length_ = 0;
+    tx_index_ = 0;
+}
+
+bool Telemetry::Write(TelemetryType type, const void* payload, size_t length) {
+    if (length > kMaxPayload) {
+        return false;
+    }
+    // Numbered before the slot is reserved so that drops leave a gap
+    const uint16_t sequence = static_cast<uint16_t>(sequence_.fetch_add(1, std::memory_order_relaxed));
+
+    // Reserve a slot; an interrupt may preempt us and reserve the next one
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    do {
+        if (head - tail_.load(std::memory_order_acquire) >= kNumSlots) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } while (!head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    Slot& slot = slots_[head & (kNumSlots - 1)];
+    TelemetryHeader header;
+    header.sync[0] = kTelemetrySync0;
+    header.sync[1] = kTelemetrySync1;
+    header.type = type;
+    header.length = static_cast<uint8_t>(length);
+    header.sequence = sequence;
+    header.timestamp_us = daisy::System::GetUs();
+    memcpy(slot.frame, &header, sizeof(header));
+    memcpy(slot.frame + sizeof(header), payload, length);
+    slot.frame[sizeof(header) + length] = TelemetryChecksum(slot.frame, length);
+    slot.length = static_cast<uint8_t>(length + kTelemetryFrameOverhead);
+
+    slot.ready.store(true, std::memory_order_release);
+    return true;
+}
+
+void Telemetry::Process() {
+    if (tx_length_ == 0) {
+        // Pack published records in order; stop at one still being written
+        uint8_t* tx = tx_buffers_[tx_index_];
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        while (tail != head_.load(std::memory_order_acquire)) {
+            Slot& slot = slots_[tail & (kNumSlots - 1)];
+            if (!slot.ready.load(std::memory_order_acquire)
+                || tx_length_ + slot.length > kTxBufferSize) {
+                break;
+            }
+            memcpy(tx + tx_length_, slot.frame, slot.length);
+            tx_length_ += slot.length;
+            slot.ready.store(false, std::memory_order_relaxed);
+            tail_.store(++tail, std::memory_order_release);
+        }
+        if (tx_length_ == 0) {
+            return;
+        }
+    }
+
+    // Busy (previous transfer in flight) or unplugged: keep the batch and
+    // retry on the next pass. UsbHandle is stateless; the logger has already
+    // brought up the CDC interface.
+    daisy::UsbHandle usb;
+    if (usb.TransmitInternal(tx_buffers_[tx_index_], tx_length_) == daisy::UsbHandle::Result::OK) {
+        tx_length_ = 0;
+        tx_index_ ^= 1;
+    }
+}
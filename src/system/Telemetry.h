@@ -0,0 +1,71 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "TelemetryRecords.h"
+
+/**
+ * Telemetry streams fixed-layout binary records (TelemetryRecords.h) over
+ * USB CDC, in place of formatted text:
+ * - Write() may be called from any context, including the audio and DAC
+ *   interrupts: it reserves a slot of a lock-free ring, frames the record
+ *   and publishes it. When the ring is full the record is dropped and
+ *   counted; the sequence number then shows a gap
+ * - Process() runs in the main loop, packs the published records into a
+ *   transmit buffer and hands it to the USB stack, retrying while it is busy
+ *
+ * No formatting and no allocation on the producer side; a record costs a
+ * copy of a few tens of bytes. Decode with tools/telemetry.
+ */
+class Telemetry {
+public:
+    static constexpr size_t kNumSlots = 64;        // Power of two
+    static constexpr size_t kSlotSize = 64;        // Largest frame
+    static constexpr size_t kMaxPayload = kSlotSize - kTelemetryFrameOverhead;
+    static constexpr size_t kTxBufferSize = 128;
+
+    Telemetry();
+    ~Telemetry() = default;
+
+    void Init();
+
+    // Producer side (any context)
+    bool Write(TelemetryType type, const void* payload, size_t length);
+
+    template <typename Record>
+    bool Write(TelemetryType type, const Record& record) {
+        static_assert(sizeof(Record) <= kMaxPayload, "Telemetry record too large");
+        return Write(type, &record, sizeof(Record));
+    }
+
+    // Consumer side (main loop)
+    void Process();
+
+    uint32_t GetDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((kNumSlots & (kNumSlots - 1)) == 0, "kNumSlots must be a power of two");
+    static_assert(kSlotSize <= kTxBufferSize, "A frame must fit the transmit buffer");
+
+    struct Slot {
+        std::atomic<bool> ready;
+        uint8_t length;         // Frame bytes
+        uint8_t frame[kSlotSize];
+    };
+
+    Slot slots_[kNumSlots];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+    std::atomic<uint32_t> sequence_;
+    std::atomic<uint32_t> dropped_;
+
+    // The USB stack sends from the buffer after TransmitInternal() returns,
+    // so the next batch is packed into the other one
+    uint8_t tx_buffers_[2][kTxBufferSize];
+    size_t tx_length_;
+    uint8_t tx_index_;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,150 @@
+#ifndef TELEMETRY_RECORDS_H
+#define TELEMETRY_RECORDS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format of the binary telemetry stream, shared by the firmware and the
+// host decoder (tools/telemetry). No Daisy dependencies.
+//
+// Each frame is a TelemetryHeader, `length` payload bytes and a checksum
+// byte (XOR of every byte from `type` to the end of the payload). The sync
+// bytes let the decoder skip text log lines interleaved on the same port.
+// All fields are little-endian; "milli" fields are value * 1000.
+
+constexpr uint8_t kTelemetrySync0 = 0xA5;
+constexpr uint8_t kTelemetrySync1 = 0x5A;
+
+enum TelemetryType : uint8_t {
+    TELEMETRY_CPU = 1,
+    TELEMETRY_CONTROLS = 2,
+    TELEMETRY_TOUCH = 3,
+    TELEMETRY_ENGINE = 4,
+    TELEMETRY_XRUN = 5,
+    TELEMETRY_TASK = 6,
+    TELEMETRY_INPUTS = 7,
+    TELEMETRY_DSP_FAULT = 8,
+};
+
+#pragma pack(push, 1)
+
+struct TelemetryHeader {
+    uint8_t sync[2];
+    uint8_t type;
+    uint8_t length;           // Payload bytes
+    uint16_t sequence;        // Per-stream counter, gaps mean dropped records
+    uint32_t timestamp_us;
+};
+
+struct TelemetryCpu {
+    uint16_t avg_permille;
+    uint16_t max_permille;
+    uint16_t last_permille;
+    uint8_t quality_level;
+    uint8_t block_size;
+    uint32_t sample_rate;
+    uint32_t governor_downgrades;
+    uint32_t xruns;
+    uint32_t telemetry_dropped;
+};
+
+struct TelemetryControls {
+    int16_t pitch;            // milli
+    int16_t position_knob;
+    int16_t density_knob;
+    int16_t blend_knob;
+    int16_t clouds_position;
+    int16_t clouds_size;
+    int16_t clouds_density;
+    int16_t clouds_texture;
+    int16_t clouds_feedback;
+    int16_t clouds_reverb;
+    int16_t clouds_dry_wet;
+    int16_t master_volume;
+    int16_t mod_wheel;
+};
+
+struct TelemetryTouch {
+    uint16_t touched;         // One bit per MPR121 electrode
+    uint8_t sensor_present;
+    uint8_t reserved;
+    int16_t deviation[12];    // Baseline - filtered, per electrode
+    uint16_t pressure;        // milli
+    uint16_t slider;          // Pad position, milli
+};
+
+struct TelemetryEngine {
+    uint16_t grains;          // Smoothed active grain count * 100
+    uint8_t playback_mode;
+    uint8_t num_channels;
+    uint16_t input_peak;      // milli
+    uint16_t output_level;    // Smoothed output level, milli
+    uint32_t staging_late;    // Long-memory prefetches that landed late
+    uint32_t output_events_dropped;
+    uint32_t dsp_recoveries;  // Clouds stages reset after a NaN or an Inf
+};
+
+struct TelemetryXrun {
+    uint16_t load_permille;
+    uint16_t reserved;
+    uint32_t xruns;
+};
+
+struct TelemetryTask {
+    uint8_t id;
+    uint8_t priority;
+    char name[10];            // Not NUL-terminated when 10 characters long
+    uint32_t period_us;
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t max_lateness_us;
+    uint16_t idle_permille;   // Main loop time spent idle, all tasks
+    uint16_t reserved;
+};
+
+// Raw control inputs, one record per controls task run (INPUT_CAPTURE):
+// a trace tools/cosim can replay
+struct TelemetryInputs {
+    uint16_t adc[12];         // Raw 16-bit ADC codes, CV_1 to ADC_12
+    uint8_t gates;            // Bit 0: gate in 1, bit 1: gate in 2
+    uint8_t reserved;
+};
+
+// First non-finite or denormal block a Clouds stage wrote since the last
+// record, and what the processor was set to (DSP_SENTINELS builds only)
+struct TelemetryDspFault {
+    uint8_t stage;            // ProcessStage
+    uint8_t kinds;            // Bit 0: denormal, bit 1: NaN, bit 2: Inf
+    uint8_t playback_mode;
+    uint8_t quality;
+    uint32_t faults;          // Blocks flagged so far, all stages
+    int16_t position;         // milli
+    int16_t size;
+    int16_t pitch;            // Semitones * 100
+    int16_t density;
+    int16_t texture;
+    int16_t dry_wet;
+    int16_t stereo_spread;
+    int16_t feedback;
+    int16_t reverb;
+    uint8_t freeze;
+    uint8_t reserved;
+};
+
+#pragma pack(pop)
+
+constexpr size_t kTelemetryFrameOverhead = sizeof(TelemetryHeader) + 1;
+
+inline uint8_t TelemetryChecksum(const uint8_t* frame, size_t payload_length) {
+    // From the type byte to the end of the payload
+    uint8_t checksum = 0;
+    const size_t end = sizeof(TelemetryHeader) + payload_length;
+    for (size_t i = 2; i < end; ++i) {
+        checksum ^= frame[i];
+    }
+    return checksum;
+}
+
+#endif // TELEMETRY_RECORDS_H
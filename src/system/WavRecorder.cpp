@@ -0,0 +1,278 @@
+#include "WavRecorder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Header sector: RIFF, fmt and JUNK chunks, then the data chunk header
+constexpr uint32_t kFmtSize = 16;
+constexpr uint32_t kJunkSize = WavRecorder::kSectorSize - 12 - (8 + kFmtSize) - 8 - 8;
+constexpr uint16_t kFormatPcm = 1;
+// Sizes written while recording, for readers that meet an unfinished file
+constexpr uint32_t kUnknownSize = 0xFFFFFFFF;
+
+void Put32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+void Put16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+}
+}
+
+void WavRecorder::Config::Defaults() {
+    ring = nullptr;
+    ring_size = 8 * 1024 * 1024;
+    chunk_size = 32 * 1024;
+    max_chunks = 4;
+    capacity = 512u * 1024u * 1024u;
+    num_channels = 6;
+    bits = 16;
+    now_us = nullptr;
+}
+
+WavRecorder::WavRecorder()
+    : ready_(false),
+      frame_bytes_(0),
+      sample_rate_(0),
+      state_(State::IDLE),
+      result_(Result::NONE),
+      header_written_(false),
+      write_(0),
+      read_(0),
+      recording_(false),
+      full_(false),
+      writing_(false),
+      in_flight_(0),
+      issued_us_(0),
+      stats_{},
+      high_water_(0),
+      dropped_frames_(0) {
+    config_.Defaults();
+    sink_ = RecorderSink{};
+}
+
+bool WavRecorder::Init(const Config& config, const RecorderSink& sink) {
+    config_ = config;
+    sink_ = sink;
+    frame_bytes_ = static_cast<uint32_t>(config_.num_channels * config_.bits / 8);
+    const bool power_of_two = config_.ring_size && !(config_.ring_size & (config_.ring_size - 1));
+    ready_ = config_.ring && power_of_two && config_.chunk_size >= kSectorSize
+             && config_.chunk_size % kSectorSize == 0 && config_.ring_size % config_.chunk_size == 0
+             && config_.ring_size >= 2 * config_.chunk_size && config_.max_chunks > 0
+             && config_.num_channels > 0 && config_.num_channels <= kMaxChannels
+             && (config_.bits == 16 || config_.bits == 24) && sink_.open && sink_.write && sink_.status
+             && sink_.close;
+    state_ = State::IDLE;
+    result_ = Result::NONE;
+    return ready_;
+}
+
+bool WavRecorder::Start(const char* name, float sample_rate) {
+    if (!ready_ || state_ != State::IDLE) {
+        return false;
+    }
+    sample_rate_ = static_cast<uint32_t>(sample_rate);
+    stats_ = Stats{};
+    high_water_.store(0, std::memory_order_relaxed);
+    dropped_frames_.store(0, std::memory_order_relaxed);
+    full_.store(false, std::memory_order_relaxed);
+    writing_ = false;
+    header_written_ = false;
+
+    // File offset 0 is ring offset 0: the header goes out with the first
+    // chunk, and is rewritten with the real sizes at the end
+    WriteHeader(config_.ring, kUnknownSize);
+    read_.store(0, std::memory_order_relaxed);
+    write_.store(kSectorSize, std::memory_order_relaxed);
+
+    if (!sink_.open(sink_.context, name, config_.capacity)) {
+        result_ = Result::OPEN_FAILED;
+        return false;
+    }
+    state_ = State::RECORDING;
+    recording_.store(true, std::memory_order_release);
+    return true;
+}
+
+void WavRecorder::Stop() {
+    if (state_ == State::RECORDING) {
+        recording_.store(false, std::memory_order_relaxed);
+        state_ = State::STOPPING;
+    }
+}
+
+void WavRecorder::Push(const float* frames, size_t num_frames) {
+    if (!recording_.load(std::memory_order_acquire)) {
+        return;
+    }
+    const uint32_t write = write_.load(std::memory_order_relaxed);
+    const uint32_t read = read_.load(std::memory_order_acquire);
+    const uint32_t bytes = static_cast<uint32_t>(num_frames) * frame_bytes_;
+
+    // A sector stays free for the padding of the last write
+    if (write - read + bytes > config_.ring_size - kSectorSize) {
+        dropped_frames_.fetch_add(static_cast<uint32_t>(num_frames), std::memory_order_relaxed);
+        return;
+    }
+    if (write + bytes > config_.capacity) {
+        full_.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint32_t mask = config_.ring_size - 1;
+    uint8_t* ring = config_.ring;
+    uint32_t position = write & mask;
+    const size_t num_samples = num_frames * config_.num_channels;
+    if (config_.bits == 16) {
+        for (size_t i = 0; i < num_samples; ++i) {
+            const float sample = std::min(std::max(frames[i], -1.0f), 1.0f);
+            const int32_t value = static_cast<int32_t>(sample * 32767.0f);
+            ring[position] = static_cast<uint8_t>(value);
+            ring[(position + 1) & mask] = static_cast<uint8_t>(value >> 8);
+            position = (position + 2) & mask;
+        }
+    } else {
+        for (size_t i = 0; i < num_samples; ++i) {
+            const float sample = std::min(std::max(frames[i], -1.0f), 1.0f);
+            const int32_t value = static_cast<int32_t>(sample * 8388607.0f);
+            ring[position] = static_cast<uint8_t>(value);
+            ring[(position + 1) & mask] = static_cast<uint8_t>(value >> 8);
+            ring[(position + 2) & mask] = static_cast<uint8_t>(value >> 16);
+            position = (position + 3) & mask;
+        }
+    }
+    write_.store(write + bytes, std::memory_order_release);
+
+    const uint32_t fill = write + bytes - read;
+    if (fill > high_water_.load(std::memory_order_relaxed)) {
+        high_water_.store(fill, std::memory_order_relaxed);
+    }
+}
+
+void WavRecorder::Process() {
+    if (state_ == State::IDLE) {
+        return;
+    }
+    if (writing_) {
+        const RecorderSink::Status status = sink_.status(sink_.context);
+        if (status == RecorderSink::Status::BUSY) {
+            return;
+        }
+        writing_ = false;
+        if (status == RecorderSink::Status::FAILED) {
+            Finish(Result::WRITE_FAILED);
+            return;
+        }
+        const uint32_t latency = config_.now_us ? config_.now_us() - issued_us_ : 0;
+        stats_.last_write_us = latency;
+        stats_.max_write_us = std::max(stats_.max_write_us, latency);
+        stats_.total_write_us += latency;
+        ++stats_.writes;
+        read_.store(read_.load(std::memory_order_relaxed) + in_flight_, std::memory_order_release);
+    }
+    if (state_ == State::RECORDING && full_.load(std::memory_order_relaxed)) {
+        Stop();
+    }
+
+    const uint32_t read = read_.load(std::memory_order_relaxed);
+    const uint32_t write = write_.load(std::memory_order_acquire);
+    const uint32_t mask = config_.ring_size - 1;
+    uint8_t* ring = config_.ring;
+
+    // Whole chunks; read stays chunk aligned, so they never wrap
+    uint32_t size = (write - read) / config_.chunk_size * config_.chunk_size;
+    size = std::min(size, config_.max_chunks * config_.chunk_size);
+    size = std::min(size, config_.ring_size - (read & mask));
+    if (size) {
+        Issue(read, ring + (read & mask), size, size);
+        return;
+    }
+    if (state_ != State::STOPPING) {
+        return;
+    }
+
+    if (write != read) {
+        // The tail, padded with zeros to a whole sector. The frames after
+        // write are free: nothing is pushed any more
+        const uint32_t tail = write - read;
+        const uint32_t padded = (tail + kSectorSize - 1) / kSectorSize * kSectorSize;
+        memset(ring + (write & mask), 0, padded - tail);
+        Issue(read, ring + (read & mask), padded, tail);
+    } else if (!header_written_) {
+        // Everything is out: any part of the ring can hold the header
+        WriteHeader(ring, write - kSectorSize);
+        header_written_ = true;
+        Issue(0, ring, kSectorSize, 0);
+    } else {
+        // RIFF chunks are padded to an even size; the padding was written
+        const uint32_t file_size = write + ((write - kSectorSize) & 1);
+        Finish(sink_.close(sink_.context, file_size) ? Result::SAVED : Result::WRITE_FAILED);
+    }
+}
+
+WavRecorder::Stats WavRecorder::GetStats() const {
+    Stats stats = stats_;
+    stats.high_water = high_water_.load(std::memory_order_relaxed);
+    stats.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint32_t WavRecorder::GetFramesRecorded() const {
+    const uint32_t write = write_.load(std::memory_order_relaxed);
+    return frame_bytes_ && write > kSectorSize ? (write - kSectorSize) / frame_bytes_ : 0;
+}
+
+uint32_t WavRecorder::GetFill() const {
+    return write_.load(std::memory_order_relaxed) - read_.load(std::memory_order_relaxed);
+}
+
+void WavRecorder::WriteHeader(uint8_t* sector, uint32_t data_size) const {
+    const uint16_t block_align = static_cast<uint16_t>(frame_bytes_);
+    memset(sector, 0, kSectorSize);
+    memcpy(sector, "RIFF", 4);
+    Put32(sector + 4, data_size == kUnknownSize ? kUnknownSize : kSectorSize - 8 + ((data_size + 1) & ~1u));
+    memcpy(sector + 8, "WAVE", 4);
+
+    uint8_t* fmt = sector + 12;
+    memcpy(fmt, "fmt ", 4);
+    Put32(fmt + 4, kFmtSize);
+    Put16(fmt + 8, kFormatPcm);
+    Put16(fmt + 10, static_cast<uint16_t>(config_.num_channels));
+    Put32(fmt + 12, sample_rate_);
+    Put32(fmt + 16, sample_rate_ * block_align);
+    Put16(fmt + 20, block_align);
+    Put16(fmt + 22, static_cast<uint16_t>(config_.bits));
+
+    uint8_t* junk = fmt + 8 + kFmtSize;
+    memcpy(junk, "JUNK", 4);
+    Put32(junk + 4, kJunkSize);
+
+    uint8_t* data = junk + 8 + kJunkSize;
+    memcpy(data, "data", 4);
+    Put32(data + 4, data_size);
+}
+
+void WavRecorder::Issue(uint32_t offset, const uint8_t* data, uint32_t size, uint32_t advance) {
+    if (!sink_.write(sink_.context, offset, data, size)) {
+        Finish(Result::WRITE_FAILED);
+        return;
+    }
+    writing_ = true;
+    in_flight_ = advance;
+    issued_us_ = config_.now_us ? config_.now_us() : 0;
+    stats_.bytes_written += size;
+}
+
+void WavRecorder::Finish(Result result) {
+    if (result != Result::SAVED) {
+        // Keeps what was written; the header may still say streaming
+        sink_.close(sink_.context, read_.load(std::memory_order_relaxed));
+    }
+    recording_.store(false, std::memory_order_relaxed);
+    state_ = State::IDLE;
+    result_ = result;
+}
@@ -0,0 +1,153 @@
+#ifndef WAV_RECORDER_H
+#define WAV_RECORDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Storage behind a WavRecorder, as functions plus a context (the SD card on
+ * the device, a plain file on the host). Offsets and sizes are whole
+ * 512-byte sectors.
+ */
+struct RecorderSink {
+    enum class Status {
+        IDLE,
+        BUSY,
+        FAILED,
+    };
+
+    // Creates the file with room for capacity bytes; may block
+    bool (*open)(void* context, const char* name, uint32_t capacity);
+    // Starts a write. The data is left alone until status() is not BUSY
+    bool (*write)(void* context, uint32_t offset, const uint8_t* data, uint32_t size);
+    Status (*status)(void* context);
+    // Cuts the file to size bytes and closes it; may block
+    bool (*close)(void* context, uint32_t size);
+    void* context;
+};
+
+/**
+ * WavRecorder streams multichannel PCM to a WAV file without ever making
+ * the audio callback wait for storage:
+ * - Push() (audio callback) converts a block of frames to 16- or 24-bit
+ *   and appends it to a large single-producer/single-consumer ring. A full
+ *   ring drops the block and counts it
+ * - The ring holds the file image: ring offset = file offset modulo the
+ *   ring size. The WAV header fills the first sector (padded with a JUNK
+ *   chunk), so every write covers whole chunks (whole clusters) at chunk
+ *   aligned file offsets and never wraps
+ * - Process() (main loop) keeps one write in flight, of up to max_chunks
+ *   chunks when behind. The bytes stay in the ring until the sink reports
+ *   them written, so the ring doubles as the DMA buffer
+ * - Stop() flushes the tail (zero padded to a sector) and rewrites the
+ *   header with the final sizes
+ *
+ * Stats: the ring high-water mark, dropped frames and the latency of each
+ * write, from issue to completion.
+ */
+class WavRecorder {
+public:
+    typedef uint32_t (*ClockFunction)();    // Microseconds
+
+    static constexpr uint32_t kSectorSize = 512;
+    static constexpr int kMaxChannels = 8;
+
+    struct Config {
+        uint8_t* ring;
+        uint32_t ring_size;     // Power of two, a multiple of chunk_size
+        uint32_t chunk_size;    // Bytes per write, whole clusters
+        uint32_t max_chunks;    // Per write when catching up
+        uint32_t capacity;      // File size limit; recording stops there
+        int num_channels;
+        int bits;               // 16 or 24
+        ClockFunction now_us;
+
+        void Defaults();
+    };
+
+    enum class State {
+        IDLE,
+        RECORDING,
+        STOPPING,       // Flushing the ring, then the header
+    };
+
+    enum class Result {
+        NONE,
+        SAVED,
+        OPEN_FAILED,
+        WRITE_FAILED,
+    };
+
+    struct Stats {
+        uint32_t high_water;        // Most bytes waiting in the ring
+        uint32_t dropped_frames;
+        uint32_t writes;
+        uint32_t bytes_written;
+        uint32_t last_write_us;
+        uint32_t max_write_us;
+        uint64_t total_write_us;
+    };
+
+    WavRecorder();
+    ~WavRecorder() = default;
+
+    // False when the configuration is unusable
+    bool Init(const Config& config, const RecorderSink& sink);
+
+    // Opens the file and starts taking frames; false when busy or the sink
+    // could not open it
+    bool Start(const char* name, float sample_rate);
+
+    // No more frames are taken; Process() finishes the file
+    void Stop();
+
+    // Audio callback: num_frames interleaved frames of num_channels samples
+    // in -1..1
+    void Push(const float* frames, size_t num_frames);
+
+    void Process();
+
+    bool IsRecording() const { return recording_.load(std::memory_order_relaxed); }
+    State GetState() const { return state_; }
+    Result GetLastResult() const { return result_; }
+    int GetNumChannels() const { return config_.num_channels; }
+
+    Stats GetStats() const;
+    uint32_t GetFramesRecorded() const;
+    // Bytes waiting in the ring
+    uint32_t GetFill() const;
+
+private:
+    void WriteHeader(uint8_t* sector, uint32_t data_size) const;
+    void Issue(uint32_t offset, const uint8_t* data, uint32_t size, uint32_t advance);
+    void Finish(Result result);
+
+    Config config_;
+    RecorderSink sink_;
+    bool ready_;
+    uint32_t frame_bytes_;
+    uint32_t sample_rate_;
+
+    State state_;
+    Result result_;
+    bool header_written_;
+
+    // Absolute byte counts (= file offsets); the ring index is the offset
+    // modulo ring_size. The callback advances write_, the main loop read_
+    std::atomic<uint32_t> write_;
+    std::atomic<uint32_t> read_;
+    std::atomic<bool> recording_;
+    std::atomic<bool> full_;
+
+    // Write in flight
+    bool writing_;
+    uint32_t in_flight_;            // Bytes read_ advances by when it lands
+    uint32_t issued_us_;
+
+    Stats stats_;
+    std::atomic<uint32_t> high_water_;
+    std::atomic<uint32_t> dropped_frames_;
+};
+
+#endif // WAV_RECORDER_H
@@ -0,0 +1,604 @@
+// Host batch renderer: runs the Clouds processor (eurorack/Nimbus_SM) over
+// every stimulus x parameter combination, spread over all cores, for tuning
+// the knob mappings offline.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -Ieurorack -I$N -I$N/dsp -I$N/dsp/fx -I$N/dsp/pvoc"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   SRC="$N/resources.cpp $N/dsp/*.cpp $N/dsp/pvoc/*.cpp lib/DaisySP/Source/Filters/svf.cpp"
+//   g++ -std=gnu++14 -O2 -pthread $INC tools/batch_render/batch_render.cpp $SRC -o batch_render
+//
+// Usage: batch_render [options] stimulus.wav...
+//   -p <name=values> set a parameter to one value, a list (a,b,c) or a range
+//                    (first:last:count); every combination of the values
+//                    given is rendered for every stimulus
+//   -o <dir>         output directory (default renders)
+//   -t <seconds>     tail rendered after the stimulus (default 2)
+//   -j <threads>     worker threads (default: one per core)
+//
+// Parameters: position, size, pitch, density, texture, dry_wet,
+// stereo_spread, feedback, reverb, freeze (0/1), mode (0 granular, 1 stretch,
+// 2 looping delay, 3 spectral, 4 resonestor, 5 oliverb), quality (0-3, as
+// set_quality()), half_rate_reverb (0/1, as the quality governor's
+// CpuBudget), post_oliverb (0/1, Oliverb as the post-processing reverb)
+// and trigger (seconds between one-block triggers, from the start; 0 for
+// none). Those not given take the firmware's settings. Outputs are stereo 32-bit float
+// WAV files at the stimulus' rate, named after the stimulus and the swept
+// values; stimuli are 16/24/32-bit PCM or 32-bit float, mono or stereo.
+//
+// Each worker owns a processor and its buffers, and takes jobs from its own
+// queue, then from the back of the others' once it runs dry. Nothing they
+// write is shared: the lookup tables are filled once per sample rate before
+// the workers start (InitResources()), and each processor draws its random
+// numbers from its own generator, so a render does not depend on the thread
+// or the order it ran in.
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+#include "granular_processor.h"
+#include "pvoc/phase_vocoder.h"
+#include "resources.h"
+
+namespace {
+
+// The firmware's Clouds buffers (AudioEngine::CLOUD_BUFFER_SIZE and
+// CLOUD_BUFFER_CCM_SIZE)
+constexpr size_t kLargeBufferSize = 356352;
+constexpr size_t kSmallBufferSize = 196224;
+
+constexpr size_t kBlockSize = kMaxBlockSize;
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// --- WAV files ----------------------------------------------------------------
+
+struct MappedFile {
+    void* data = MAP_FAILED;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+};
+
+struct Stimulus {
+    std::string path;
+    std::string stem;
+    MappedFile file;
+    const uint8_t* samples;
+    uint32_t sample_rate;
+    uint16_t format;            // 1 PCM, 3 float
+    uint16_t channels;
+    uint16_t bits;
+    size_t frames;
+
+    float Sample(size_t frame, int channel) const {
+        const size_t index = frame * channels + (channel < channels ? channel : 0);
+        const uint8_t* p = samples + index * (bits / 8);
+        if (format == 3) {
+            float value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+        switch (bits) {
+            case 16: return static_cast<int16_t>(p[0] | p[1] << 8) / 32768.0f;
+            case 24: return static_cast<int32_t>(static_cast<uint32_t>(p[0] << 8 | p[1] << 16 | p[2] << 24)) / 2147483648.0f;
+            default: return static_cast<int32_t>(p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24)
+                            / 2147483648.0f;
+        }
+    }
+};
+
+uint32_t ReadLe(const uint8_t* p, int bytes) {
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = value << 8 | p[i];
+    }
+    return value;
+}
+
+bool OpenStimulus(const char* path, Stimulus* stimulus) {
+    stimulus->path = path;
+    std::string stem = path;
+    stem = stem.substr(stem.find_last_of('/') == std::string::npos ? 0 : stem.find_last_of('/') + 1);
+    stimulus->stem = stem.substr(0, stem.find_last_of('.'));
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 12) {
+        stimulus->file.size = static_cast<size_t>(st.st_size);
+        stimulus->file.data = mmap(nullptr, stimulus->file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (stimulus->file.data == MAP_FAILED) {
+        fprintf(stderr, "%s: cannot map\n", path);
+        return false;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(stimulus->file.data);
+    const size_t size = stimulus->file.size;
+    if (memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        return false;
+    }
+    bool have_format = false;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const uint32_t chunk_size = ReadLe(data + pos + 4, 4);
+        const uint8_t* chunk = data + pos + 8;
+        if (!memcmp(data + pos, "fmt ", 4) && chunk_size >= 16) {
+            stimulus->format = static_cast<uint16_t>(ReadLe(chunk, 2));
+            stimulus->channels = static_cast<uint16_t>(ReadLe(chunk + 2, 2));
+            stimulus->sample_rate = ReadLe(chunk + 4, 4);
+            stimulus->bits = static_cast<uint16_t>(ReadLe(chunk + 14, 2));
+            // WAVE_FORMAT_EXTENSIBLE: the format is the subformat's first word
+            if (stimulus->format == 0xFFFE && chunk_size >= 26) {
+                stimulus->format = static_cast<uint16_t>(ReadLe(chunk + 24, 2));
+            }
+            have_format = true;
+        } else if (!memcmp(data + pos, "data", 4) && have_format) {
+            const bool supported = (stimulus->format == 1 && (stimulus->bits == 16 || stimulus->bits == 24
+                                                             || stimulus->bits == 32))
+                                   || (stimulus->format == 3 && stimulus->bits == 32);
+            if (!supported || stimulus->channels < 1 || stimulus->channels > 2) {
+                fprintf(stderr, "%s: unsupported format %u, %u channels of %u bits\n", path, stimulus->format,
+                        stimulus->channels, stimulus->bits);
+                return false;
+            }
+            const size_t available = std::min<size_t>(chunk_size, size - (pos + 8));
+            stimulus->samples = chunk;
+            stimulus->frames = available / (stimulus->channels * stimulus->bits / 8);
+            return true;
+        }
+        pos += 8 + chunk_size + (chunk_size & 1);
+    }
+    fprintf(stderr, "%s: no audio data\n", path);
+    return false;
+}
+
+// Stereo 32-bit float, written through a mapping of the whole file
+class OutputFile {
+public:
+    bool Open(const std::string& path, uint32_t sample_rate, size_t frames) {
+        const size_t data_size = frames * 2 * sizeof(float);
+        file_.size = 44 + data_size;
+        const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(file_.size)) == 0) {
+            file_.data = mmap(nullptr, file_.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (file_.data == MAP_FAILED) {
+            return false;
+        }
+
+        uint8_t* header = static_cast<uint8_t*>(file_.data);
+        auto put = [&](size_t offset, uint32_t value, int bytes) {
+            for (int i = 0; i < bytes; ++i) {
+                header[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        };
+        memcpy(header, "RIFF", 4);
+        put(4, static_cast<uint32_t>(file_.size - 8), 4);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        put(16, 16, 4);
+        put(20, 3, 2);                                  // IEEE float
+        put(22, 2, 2);
+        put(24, sample_rate, 4);
+        put(28, sample_rate * 2 * sizeof(float), 4);
+        put(32, 2 * sizeof(float), 2);
+        put(34, 32, 2);
+        memcpy(header + 36, "data", 4);
+        put(40, static_cast<uint32_t>(data_size), 4);
+        samples_ = reinterpret_cast<float*>(header + 44);
+        return true;
+    }
+
+    float* samples() { return samples_; }
+
+private:
+    MappedFile file_;
+    float* samples_ = nullptr;
+};
+
+// --- Jobs ---------------------------------------------------------------------
+
+struct Setting {
+    std::string name;
+    std::vector<float> values;
+};
+
+struct Job {
+    const Stimulus* stimulus;
+    std::vector<float> values;  // One per setting
+    std::string output;
+};
+
+struct Settings {
+    Parameters parameters;
+    int mode;
+    int quality;
+    bool half_rate_reverb;
+    bool post_oliverb;
+    float trigger;
+};
+
+// The firmware's fixed settings (ReadKnobValues(), UpdateCloudsParameters())
+// and a centred position, size and density
+Settings DefaultSettings() {
+    Settings settings;
+    memset(&settings.parameters, 0, sizeof(settings.parameters));
+    Parameters& p = settings.parameters;
+    p.position = 0.5f;
+    p.size = 0.5f;
+    p.density = 0.5f;
+    p.texture = 0.7f;
+    p.dry_wet = 0.5f;
+    p.stereo_spread = 0.5f;
+    p.feedback = 0.6f;
+    p.reverb = 0.5f;
+    settings.mode = PLAYBACK_MODE_GRANULAR;
+    settings.quality = 0;
+    settings.half_rate_reverb = false;
+    settings.post_oliverb = false;
+    settings.trigger = 0.0f;
+    return settings;
+}
+
+bool Apply(const std::string& name, float value, Settings* settings) {
+    Parameters& p = settings->parameters;
+    if (name == "position") { p.position = value; }
+    else if (name == "size") { p.size = value; }
+    else if (name == "pitch") { p.pitch = value; }
+    else if (name == "density") { p.density = value; }
+    else if (name == "texture") { p.texture = value; }
+    else if (name == "dry_wet") { p.dry_wet = value; }
+    else if (name == "stereo_spread") { p.stereo_spread = value; }
+    else if (name == "feedback") { p.feedback = value; }
+    else if (name == "reverb") { p.reverb = value; }
+    else if (name == "freeze") { p.freeze = value != 0.0f; }
+    else if (name == "mode" && value >= 0.0f && value < PLAYBACK_MODE_LAST) { settings->mode = static_cast<int>(value); }
+    else if (name == "quality" && value >= 0.0f && value <= 3.0f) { settings->quality = static_cast<int>(value); }
+    else if (name == "half_rate_reverb") { settings->half_rate_reverb = value != 0.0f; }
+    else if (name == "post_oliverb") { settings->post_oliverb = value != 0.0f; }
+    else if (name == "trigger" && value >= 0.0f) { settings->trigger = value; }
+    else { return false; }
+    return true;
+}
+
+bool ParseSetting(const char* text, Setting* setting) {
+    const char* equals = strchr(text, '=');
+    if (!equals) {
+        return false;
+    }
+    setting->name.assign(text, equals - text);
+    const char* values = equals + 1;
+    double first, last;
+    int count;
+    char end;
+    if (sscanf(values, "%lf:%lf:%d%c", &first, &last, &count, &end) == 3 && count > 0) {
+        for (int i = 0; i < count; ++i) {
+            const double t = count > 1 ? static_cast<double>(i) / (count - 1) : 0.0;
+            setting->values.push_back(static_cast<float>(first + (last - first) * t));
+        }
+    } else {
+        for (const char* p = values; *p;) {
+            char* next;
+            const double value = strtod(p, &next);
+            if (next == p || (*next && *next != ',')) {
+                return false;
+            }
+            setting->values.push_back(static_cast<float>(value));
+            p = *next ? next + 1 : next;
+        }
+    }
+    Settings scratch = DefaultSettings();
+    for (float value : setting->values) {
+        if (!Apply(setting->name, value, &scratch)) {
+            return false;
+        }
+    }
+    return !setting->values.empty();
+}
+
+// --- Workers ------------------------------------------------------------------
+
+class JobQueue {
+public:
+    void Push(size_t job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(job);
+    }
+
+    // The owner works from the front, thieves take from the back
+    bool Pop(size_t* job, bool steal) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.empty()) {
+            return false;
+        }
+        if (steal) {
+            *job = jobs_.back();
+            jobs_.pop_back();
+        } else {
+            *job = jobs_.front();
+            jobs_.pop_front();
+        }
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<size_t> jobs_;
+};
+
+struct AlignedFree {
+    void operator()(uint8_t* p) const { free(p); }
+};
+
+typedef std::unique_ptr<uint8_t, AlignedFree> Arena;
+
+Arena AllocateArena(size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, size)) {
+        return Arena();
+    }
+    return Arena(static_cast<uint8_t*>(p));
+}
+
+struct Worker {
+    std::aligned_storage<sizeof(GranularProcessorClouds), alignof(GranularProcessorClouds)>::type processor;
+    Arena large_buffer;
+    Arena small_buffer;
+    Arena spectral_memory;
+    JobQueue queue;
+    std::thread thread;
+
+    size_t jobs_done = 0;
+    size_t jobs_stolen = 0;
+    double audio_seconds = 0.0;
+    double busy_seconds = 0.0;
+    bool failed = false;
+};
+
+std::vector<Setting> g_settings;
+std::vector<Job> g_jobs;
+double g_tail_seconds = 2.0;
+
+bool Render(Worker* worker, const Job& job) {
+    const Stimulus& stimulus = *job.stimulus;
+    Settings settings = DefaultSettings();
+    for (size_t i = 0; i < g_settings.size(); ++i) {
+        Apply(g_settings[i].name, job.values[i], &settings);
+    }
+
+    const size_t tail = static_cast<size_t>(g_tail_seconds * stimulus.sample_rate);
+    const size_t frames = (stimulus.frames + tail + kBlockSize - 1) / kBlockSize * kBlockSize;
+    OutputFile output;
+    if (!output.Open(job.output, stimulus.sample_rate, frames)) {
+        fprintf(stderr, "%s: cannot write\n", job.output.c_str());
+        return false;
+    }
+
+    // A fresh processor, zeroed as in the firmware's .bss before Init() (which
+    // leaves some of the state as it finds it): nothing carries over from
+    // the previous job. Zeroed once constructed, as the compiler may drop
+    // stores to the storage made before.
+    GranularProcessorClouds& processor = *new (&worker->processor) GranularProcessorClouds();
+    memset(static_cast<void*>(&processor), 0, sizeof(processor));
+    memset(worker->large_buffer.get(), 0, kLargeBufferSize);
+    memset(worker->small_buffer.get(), 0, kSmallBufferSize);
+    processor.Init(static_cast<float>(stimulus.sample_rate), worker->large_buffer.get(), kLargeBufferSize,
+                   worker->small_buffer.get(), kSmallBufferSize);
+    processor.set_spectral_memory(worker->spectral_memory.get());
+    processor.set_playback_mode(static_cast<PlaybackMode>(settings.mode));
+    processor.set_quality(settings.quality);
+    CpuBudget budget = processor.cpu_budget();
+    budget.half_rate_reverb = settings.half_rate_reverb;
+    processor.set_cpu_budget(budget);
+    processor.set_post_oliverb(settings.post_oliverb);
+    *processor.mutable_parameters() = settings.parameters;
+
+    FloatFrame in[kBlockSize] = {};
+    FloatFrame out[kBlockSize] = {};
+    float* samples = output.samples();
+    const size_t trigger_period = static_cast<size_t>(settings.trigger * stimulus.sample_rate);
+    size_t next_trigger = 0;
+    for (size_t start = 0; start < frames; start += kBlockSize) {
+        processor.mutable_parameters()->trigger = trigger_period && start >= next_trigger;
+        if (processor.parameters().trigger) {
+            next_trigger += trigger_period;
+        }
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            const size_t frame = start + i;
+            const bool playing = frame < stimulus.frames;
+            in[i].l = playing ? stimulus.Sample(frame, 0) : 0.0f;
+            in[i].r = playing ? stimulus.Sample(frame, 1) : 0.0f;
+        }
+        processor.Prepare();
+        processor.Process(in, out, kBlockSize);
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            samples[2 * (start + i)] = out[i].l;
+            samples[2 * (start + i) + 1] = out[i].r;
+        }
+    }
+    processor.~GranularProcessorClouds();
+    worker->audio_seconds += static_cast<double>(frames) / stimulus.sample_rate;
+    return true;
+}
+
+void RunWorker(std::vector<std::unique_ptr<Worker>>* workers, size_t index) {
+    Worker* self = (*workers)[index].get();
+    const size_t num_workers = workers->size();
+    const Clock::time_point start = Clock::now();
+    while (true) {
+        size_t job;
+        bool found = self->queue.Pop(&job, false);
+        for (size_t i = 1; !found && i < num_workers; ++i) {
+            found = (*workers)[(index + i) % num_workers]->queue.Pop(&job, true);
+            self->jobs_stolen += found;
+        }
+        if (!found) {
+            break;
+        }
+        self->failed |= !Render(self, g_jobs[job]);
+        ++self->jobs_done;
+    }
+    self->busy_seconds += SecondsSince(start);
+}
+
+std::string FormatValue(float value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%g", value);
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const char* output_dir = "renders";
+    unsigned num_threads = std::thread::hardware_concurrency();
+    int opt;
+    while ((opt = getopt(argc, argv, "p:o:t:j:")) != -1) {
+        switch (opt) {
+            case 'p': {
+                Setting setting;
+                if (!ParseSetting(optarg, &setting)) {
+                    fprintf(stderr, "bad parameter: %s\n", optarg);
+                    return 2;
+                }
+                g_settings.push_back(setting);
+                break;
+            }
+            case 'o': output_dir = optarg; break;
+            case 't': g_tail_seconds = atof(optarg); break;
+            case 'j': num_threads = static_cast<unsigned>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-p name=values]... [-o dir] [-t tail] [-j threads] stimulus.wav...\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "no stimulus given\n");
+        return 2;
+    }
+    if (mkdir(output_dir, 0755) && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", output_dir, strerror(errno));
+        return 2;
+    }
+    num_threads = std::max(num_threads, 1u);
+
+    std::vector<std::unique_ptr<Stimulus>> stimuli;
+    for (int i = optind; i < argc; ++i) {
+        stimuli.emplace_back(new Stimulus());
+        if (!OpenStimulus(argv[i], stimuli.back().get())) {
+            return 1;
+        }
+    }
+
+    // Every combination of the values, for every stimulus; the names carry
+    // the swept values
+    std::map<uint32_t, std::vector<size_t>> jobs_by_rate;
+    for (const auto& stimulus : stimuli) {
+        std::vector<size_t> index(g_settings.size(), 0);
+        while (true) {
+            Job job;
+            job.stimulus = stimulus.get();
+            job.output = std::string(output_dir) + "/" + stimulus->stem;
+            for (size_t i = 0; i < g_settings.size(); ++i) {
+                job.values.push_back(g_settings[i].values[index[i]]);
+                if (g_settings[i].values.size() > 1) {
+                    job.output += "_" + g_settings[i].name + FormatValue(job.values.back());
+                }
+            }
+            job.output += ".wav";
+            jobs_by_rate[stimulus->sample_rate].push_back(g_jobs.size());
+            g_jobs.push_back(job);
+
+            size_t i = 0;
+            while (i < index.size() && ++index[i] == g_settings[i].values.size()) {
+                index[i++] = 0;
+            }
+            if (i == index.size()) {
+                break;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < num_threads; ++i) {
+        workers.emplace_back(new Worker());
+        Worker& worker = *workers.back();
+        worker.large_buffer = AllocateArena(kLargeBufferSize);
+        worker.small_buffer = AllocateArena(kSmallBufferSize);
+        worker.spectral_memory = AllocateArena(kSpectralMemorySize);
+        if (!worker.large_buffer || !worker.small_buffer || !worker.spectral_memory) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+
+    // One batch per sample rate: the tables are rebuilt between batches,
+    // while no worker runs
+    const Clock::time_point start = Clock::now();
+    for (const auto& batch : jobs_by_rate) {
+        InitResources(static_cast<float>(batch.first));
+        const std::vector<size_t>& jobs = batch.second;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            workers[i * num_threads / jobs.size()]->queue.Push(jobs[i]);
+        }
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i]->thread = std::thread(RunWorker, &workers, i);
+        }
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+    const double wall_seconds = SecondsSince(start);
+
+    double audio_seconds = 0.0;
+    bool failed = false;
+    printf("%-6s %6s %7s %10s %9s %10s\n", "worker", "jobs", "stolen", "audio (s)", "busy (s)", "x realtime");
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const Worker& worker = *workers[i];
+        printf("%-6zu %6zu %7zu %10.1f %9.2f %10.1f\n", i, worker.jobs_done, worker.jobs_stolen,
+               worker.audio_seconds, worker.busy_seconds,
+               worker.busy_seconds > 0.0 ? worker.audio_seconds / worker.busy_seconds : 0.0);
+        audio_seconds += worker.audio_seconds;
+        failed |= worker.failed;
+    }
+    printf("%zu renders, %.1f s of audio in %.2f s on %u threads: %.1fx realtime, %.1fx per core\n",
+           g_jobs.size(), audio_seconds, wall_seconds, num_threads, audio_seconds / wall_seconds,
+           audio_seconds / wall_seconds / num_threads);
+    return failed ? 1 : 0;
+}
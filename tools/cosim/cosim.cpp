@@ -0,0 +1,970 @@
+// Host co-simulator: runs the firmware's src/app, src/dsp and src/system
+// code (interrupt handlers and main loop) on a virtual clock, against a
+// mocked libDaisy, an emulated MPR121 and replayed control inputs, and
+// reports touch-to-audio latencies and control-update jitter.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Itools/cosim -Isrc/app -Isrc/dsp -Isrc/system -Isrc/platform -Isrc/config"
+//   INC="$INC -Ieurorack -I$N -I$N/dsp -I$N/dsp/fx -I$N/dsp/pvoc -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   SRC="src/app/Interface.cpp src/dsp/*.cpp src/platform/mpr121_daisy.cpp src/system/AudioEngine.cpp"
+//   SRC="$SRC src/system/BootProfiler.cpp src/system/ControlsManager.cpp src/system/HardwareManager.cpp"
+//   SRC="$SRC src/system/QualityGovernor.cpp src/system/DspGuard.cpp src/system/TaskScheduler.cpp"
+//   SRC="$SRC src/system/Telemetry.cpp src/system/WavRecorder.cpp $N/resources.cpp $N/dsp/*.cpp $N/dsp/pvoc/*.cpp"
+//   SRC="$SRC lib/libdaisy/src/hid/ctrl.cpp lib/DaisySP/Source/Utility/metro.cpp lib/DaisySP/Source/Filters/svf.cpp"
+//   g++ -std=gnu++14 -O2 $INC tools/cosim/*.cpp $SRC -o cosim
+//
+// Usage: cosim [options]
+//   -t <file>        replay a telemetry capture: touch frames and, with
+//                    INPUT_CAPTURE, the raw ADC codes and gates
+//   -s <file>        replay a script, one event per line:
+//                      <ms> touch <mask> [12 deviations]
+//                      <ms> adc <channel> <0..1>
+//                      <ms> gate <1|2> <0|1>
+//   -r <seed>        synthetic taps and knob moves otherwise (default 1)
+//   -T <seconds>     length (default: the trace plus 1 s, 10 s synthetic)
+//   -l <load>        audio callback cost, fraction of the block (default 0.6)
+//   -j <fraction>    random variation of that cost (default 0.1)
+//   -d <us>          DAC callback cost (default 8)
+//   -x <factor>      time handlers and main-loop code on the host instead,
+//                    scaled by factor (the core's slowdown against the host)
+//   -k <step>        smallest knob step measured (default 0.05)
+//   -n               no touch sensor on the bus
+//   -o <file>        write the simulated telemetry stream (tools/telemetry)
+//   -v               print the firmware log
+//
+// By default the cost model is deterministic: each audio block takes load x
+// its period, the DAC block a fixed time, and main-loop code only the time
+// it waits (delays, blocking I2C at 400 kHz, 100 ns per clock read). Handlers
+// do not nest; one falling due during another is taken after it. The QSPI
+// storage, the SD card and the MDMA are stand-ins (mock_platform.cpp).
+//
+// Latencies are measured from the moment the MPR121 status changes (the
+// trace time) to the first touch poll that reads it, and to the first audio
+// callback that sees the new pads; the output carrying that block leaves one
+// block later. Knob latencies run from an ADC step to the first block whose
+// control snapshot moves, and to the one within 5% of the step. Recorded
+// traces only have the resolution they were captured at (5 ms for touch).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <unistd.h>
+#include <vector>
+#include "cosim.h"
+#include "AudioConfig.h"
+#include "Kymatikos.h"
+#include "TelemetryRecords.h"
+
+int FirmwareMain();
+
+namespace {
+
+constexpr uint64_t kNsPerMs = 1000000;
+constexpr uint64_t kNsPerS = 1000000000;
+constexpr uint64_t kTicksPerUs = 200;           // TIM2, as System::GetTickFreq()
+constexpr size_t kDacBlockSize = 48;            // At 48 kHz: one callback per ms
+constexpr uint64_t kDacPeriodNs = kDacBlockSize * kNsPerS / 48000;
+constexpr uint64_t kSysTickNs = kNsPerMs;
+constexpr size_t kMaxAudioBlockSize = 256;
+constexpr uint64_t kLeadInNs = 200 * kNsPerMs;  // Boot and settling before the trace
+
+// I2C at 400 kHz: 2.5 us per bit, 9 bits per byte with the acknowledge
+constexpr uint64_t kI2cBitNs = 2500;
+constexpr uint16_t kMpr121Address = MPR121_I2CADDR_DEFAULT << 1;
+constexpr uint8_t kMpr121Baseline = 180;        // Baseline register (upper 8 of 10 bits)
+
+struct Options {
+    const char* capture = nullptr;
+    const char* script = nullptr;
+    const char* output = nullptr;
+    uint32_t seed = 1;
+    double seconds = 0.0;
+    double load = 0.6;
+    double jitter = 0.1;
+    double dac_us = 8.0;
+    double host_factor = 0.0;
+    float knob_step = 0.05f;
+    bool sensor = true;
+    bool verbose = false;
+};
+
+Options g_options;
+
+// --- Inputs -----------------------------------------------------------------
+
+struct Event {
+    enum Kind { TOUCH, ADC, GATE };
+
+    uint64_t time;
+    Kind kind;
+    uint16_t mask;              // TOUCH
+    int16_t deviation[12];      // TOUCH
+    int channel;                // ADC, GATE
+    uint16_t code;              // ADC
+    bool state;                 // GATE
+};
+
+std::vector<Event> g_events;
+size_t g_next_event = 0;
+uint64_t g_end_ns = 0;
+
+uint16_t g_adc[12];
+bool g_gates[2];
+uint16_t g_touched;
+int16_t g_deviation[12];
+
+// --- Measurements -----------------------------------------------------------
+
+class Distribution {
+public:
+    void Add(double value) { values_.push_back(value); }
+    size_t Count() const { return values_.size(); }
+
+    void Print(const char* name, const char* unit, double scale) const {
+        if (values_.empty()) {
+            printf("  %-26s      -\n", name);
+            return;
+        }
+        std::vector<double> sorted(values_);
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&](double p) { return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)] * scale; };
+        printf("  %-26s %6zu %9.3f %9.3f %9.3f %9.3f %9.3f %s\n", name, sorted.size(), sorted.front() * scale,
+               at(0.5), at(0.95), at(0.99), sorted.back() * scale, unit);
+    }
+
+private:
+    std::vector<double> values_;
+};
+
+void PrintDistributionHeader(const char* title) {
+    printf("%-28s %6s %9s %9s %9s %9s %9s\n", title, "n", "min", "p50", "p95", "p99", "max");
+}
+
+struct TouchEdge {
+    uint64_t time;
+    uint16_t mask;
+    uint64_t polled;            // 0 until a poll reads the new mask
+};
+
+struct KnobStep {
+    uint64_t time;
+    int channel;
+    float from;
+    float to;
+    uint64_t moved;             // 0 until the snapshot moves
+};
+
+struct Knob {
+    int channel;
+    float ControlsManager::ControlSnapshot::*field;
+};
+
+// Snapshot fields that carry a knob's AnalogControl value unchanged
+const Knob kKnobs[] = {
+    {daisy::patch_sm::CV_5, &ControlsManager::ControlSnapshot::position_knob},
+    {daisy::patch_sm::CV_6, &ControlsManager::ControlSnapshot::density_knob},
+    {daisy::patch_sm::CV_8, &ControlsManager::ControlSnapshot::pitch},
+    {daisy::patch_sm::ADC_12, &ControlsManager::ControlSnapshot::mod_wheel},
+};
+
+const Knob* FindKnob(int channel) {
+    for (const Knob& knob : kKnobs) {
+        if (knob.channel == channel) {
+            return &knob;
+        }
+    }
+    return nullptr;
+}
+
+std::deque<TouchEdge> g_touch_edges;
+std::vector<KnobStep> g_knob_steps;
+uint32_t g_touch_edge_count = 0;
+uint32_t g_touch_missed_poll = 0;
+uint32_t g_touch_missed_audio = 0;
+uint32_t g_knob_step_count = 0;
+uint32_t g_knob_superseded = 0;
+
+Distribution g_touch_to_poll;
+Distribution g_touch_to_callback;
+Distribution g_touch_to_output;
+Distribution g_knob_to_response;
+Distribution g_knob_to_settled;
+Distribution g_controls_interval;
+Distribution g_snapshot_age;
+Distribution g_audio_entry_delay;
+
+uint64_t g_last_controls_read = 0;
+uint64_t g_audio_blocks = 0;
+uint64_t g_dac_blocks = 0;
+uint64_t g_usb_bytes = 0;
+FILE* g_telemetry_file = nullptr;
+
+// --- Simulated core ---------------------------------------------------------
+
+enum Source { SOURCE_AUDIO, SOURCE_DAC, SOURCE_WAKE, SOURCE_SYSTICK, NUM_SOURCES };
+
+struct Interrupt {
+    bool enabled;
+    uint64_t period;
+    uint64_t due;
+};
+
+Interrupt g_irq[NUM_SOURCES];
+uint64_t g_now = 0;
+
+bool g_in_handler = false;
+uint64_t g_handler_start = 0;
+uint64_t g_handler_cost = 0;
+int g_handler_reads = 0;
+
+std::mt19937 g_cost_random(12345);
+
+typedef std::chrono::steady_clock HostClock;
+HostClock::time_point g_host_mark;
+HostClock::time_point g_handler_host_start;
+
+daisy::AudioHandle::InterleavingAudioCallback g_audio_callback = nullptr;
+size_t g_block_size = 0;
+float g_sample_rate = 0.0f;
+uint64_t g_audio_frames = 0;
+
+daisy::DacHandle::DacCallback g_dac_callback = nullptr;
+
+uint64_t HostElapsedNs(HostClock::time_point since) {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(HostClock::now() - since);
+    return static_cast<uint64_t>(elapsed.count() * g_options.host_factor);
+}
+
+void Finish(const char* reason);
+
+void ApplyInputs();
+
+void RunAudioBlock() {
+    static float input[kMaxAudioBlockSize * 2];
+    static float output[kMaxAudioBlockSize * 2];
+
+    // 220 Hz at -12 dB with some noise, so that Clouds has material
+    static uint32_t noise = 1;
+    for (size_t i = 0; i < g_block_size; ++i) {
+        const double t = static_cast<double>(g_audio_frames + i) / g_sample_rate;
+        noise = noise * 1664525u + 1013904223u;
+        const float sample = 0.25f * static_cast<float>(sin(2.0 * M_PI * 220.0 * t))
+                             + 0.02f * (static_cast<float>(noise >> 8) / 8388608.0f - 1.0f);
+        input[2 * i] = sample;
+        input[2 * i + 1] = sample;
+    }
+    g_audio_frames += g_block_size;
+
+    ApplyInputs();
+    const uint64_t start = g_handler_start;
+    const bool control_tick = g_audio_blocks % CONTROL_RATE_DIVIDER == 0;
+    g_audio_callback(input, output, g_block_size * 2);
+    ++g_audio_blocks;
+
+    // What this block saw: touch state and, on control ticks, the snapshot
+    const uint64_t block_ns = static_cast<uint64_t>(g_block_size * 1e9 / g_sample_rate);
+    const uint16_t touch = g_controls.GetCurrentTouchState();
+    for (size_t i = g_touch_edges.size(); i-- > 0;) {
+        const TouchEdge& edge = g_touch_edges[i];
+        if (edge.polled && edge.mask == touch) {
+            g_touch_to_callback.Add(static_cast<double>(start - edge.time));
+            g_touch_to_output.Add(static_cast<double>(start + block_ns - edge.time));
+            // Earlier edges were overtaken before any block saw them
+            g_touch_missed_audio += static_cast<uint32_t>(i);
+            g_touch_edges.erase(g_touch_edges.begin(), g_touch_edges.begin() + i + 1);
+            break;
+        }
+    }
+
+    if (!control_tick) {
+        return;
+    }
+    if (g_last_controls_read) {
+        g_snapshot_age.Add(static_cast<double>(start - g_last_controls_read));
+    }
+    const ControlsManager::ControlSnapshot& snapshot = g_controls.GetAudioControlSnapshot();
+    for (size_t i = 0; i < g_knob_steps.size();) {
+        KnobStep& step = g_knob_steps[i];
+        const float value = snapshot.*(FindKnob(step.channel)->field);
+        const float span = fabsf(step.to - step.from);
+        if (!step.moved && fabsf(value - step.from) >= 0.01f * span) {
+            step.moved = start;
+            g_knob_to_response.Add(static_cast<double>(start - step.time));
+        }
+        if (step.moved && fabsf(value - step.to) <= 0.05f * span) {
+            g_knob_to_settled.Add(static_cast<double>(start - step.time));
+            g_knob_steps.erase(g_knob_steps.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RunDacBlock() {
+    static uint16_t channels[2][kDacBlockSize];
+    uint16_t* output[2] = {channels[0], channels[1]};
+    g_dac_callback(output, kDacBlockSize);
+    ++g_dac_blocks;
+}
+
+// Modelled cost of a handler, in the deterministic mode
+uint64_t HandlerCost(Source source) {
+    switch (source) {
+        case SOURCE_AUDIO: {
+            std::uniform_real_distribution<double> variation(-g_options.jitter, g_options.jitter);
+            const double load = std::max(g_options.load * (1.0 + variation(g_cost_random)), 0.0);
+            return static_cast<uint64_t>(load * g_irq[SOURCE_AUDIO].period);
+        }
+        case SOURCE_DAC:
+            return static_cast<uint64_t>(g_options.dac_us * 1000.0);
+        default:
+            return 200;
+    }
+}
+
+void RunHandler(Source source) {
+    Interrupt& irq = g_irq[source];
+    const uint64_t due = irq.due;
+    irq.due += irq.period;
+    if (source == SOURCE_AUDIO) {
+        g_audio_entry_delay.Add(static_cast<double>(g_now - due));
+    }
+
+    g_in_handler = true;
+    g_handler_start = g_now;
+    g_handler_cost = HandlerCost(source);
+    g_handler_reads = 0;
+    g_handler_host_start = HostClock::now();
+    switch (source) {
+        case SOURCE_AUDIO: RunAudioBlock(); break;
+        case SOURCE_DAC: RunDacBlock(); break;
+        default: break;
+    }
+    if (g_options.host_factor > 0.0) {
+        g_handler_cost = HostElapsedNs(g_handler_host_start);
+    }
+    g_in_handler = false;
+
+    // The main loop was preempted for the whole handler
+    g_now += g_handler_cost;
+    g_host_mark = HostClock::now();
+}
+
+Source NextInterrupt() {
+    Source next = SOURCE_SYSTICK;
+    for (int i = 0; i < NUM_SOURCES; ++i) {
+        if (g_irq[i].enabled && g_irq[i].due < g_irq[next].due) {
+            next = static_cast<Source>(i);
+        }
+    }
+    return next;
+}
+
+// Main-loop code costs host time in the host-timed mode
+void AdvanceMainLoop() {
+    if (g_options.host_factor > 0.0 && !g_in_handler) {
+        g_now += HostElapsedNs(g_host_mark);
+        g_host_mark = HostClock::now();
+    }
+}
+
+// --- MPR121 -----------------------------------------------------------------
+
+uint8_t g_mpr121[256];
+
+void ResetMpr121() {
+    memset(g_mpr121, 0, sizeof(g_mpr121));
+    g_mpr121[MPR121_CONFIG1] = 0x10;
+    g_mpr121[MPR121_CONFIG2] = 0x24;
+}
+
+uint8_t ReadMpr121(uint8_t reg) {
+    // Electrodes report only in run mode (ECR selects some)
+    const bool running = (g_mpr121[MPR121_ECR] & 0x0F) != 0;
+    const uint16_t touched = running ? g_touched : 0;
+    if (reg == MPR121_TOUCHSTATUS_L) {
+        return static_cast<uint8_t>(touched);
+    }
+    if (reg == MPR121_TOUCHSTATUS_H) {
+        return static_cast<uint8_t>(touched >> 8);
+    }
+    if (reg >= MPR121_FILTDATA_0L && reg < MPR121_FILTDATA_0L + 26) {
+        const int electrode = (reg - MPR121_FILTDATA_0L) / 2;
+        const int deviation = electrode < 12 && running ? g_deviation[electrode] : 0;
+        const uint16_t filtered = static_cast<uint16_t>((kMpr121Baseline << 2) - deviation);
+        return static_cast<uint8_t>((reg - MPR121_FILTDATA_0L) % 2 ? filtered >> 8 : filtered);
+    }
+    if (reg >= MPR121_BASELINE_0 && reg < MPR121_BASELINE_0 + 13) {
+        return kMpr121Baseline;
+    }
+    return g_mpr121[reg];
+}
+
+// --- Traces -----------------------------------------------------------------
+
+void AddTouch(uint64_t time, uint16_t mask, const int16_t* deviation) {
+    Event event = {};
+    event.time = time;
+    event.kind = Event::TOUCH;
+    event.mask = mask;
+    for (int i = 0; i < 12; ++i) {
+        event.deviation[i] = deviation ? deviation[i] : (mask & (1 << i) ? 80 : 0);
+    }
+    g_events.push_back(event);
+}
+
+void AddAdc(uint64_t time, int channel, uint16_t code) {
+    Event event = {};
+    event.time = time;
+    event.kind = Event::ADC;
+    event.channel = channel;
+    event.code = code;
+    g_events.push_back(event);
+}
+
+void AddGate(uint64_t time, int gate, bool state) {
+    Event event = {};
+    event.time = time;
+    event.kind = Event::GATE;
+    event.channel = gate;
+    event.state = state;
+    g_events.push_back(event);
+}
+
+uint16_t ToCode(double value) {
+    return static_cast<uint16_t>(std::min(std::max(value, 0.0), 1.0) * 65535.0 + 0.5);
+}
+
+// Telemetry frames as written by the firmware, timed from the first one
+bool LoadCapture(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(file);
+
+    bool started = false;
+    uint32_t last_us = 0;
+    uint64_t time = kLeadInNs;
+    uint16_t codes[12] = {};
+    bool have_codes = false;
+    uint8_t gates = 0;
+    size_t pos = 0;
+    while (data.size() - pos >= kTelemetryFrameOverhead) {
+        if (data[pos] != kTelemetrySync0 || data[pos + 1] != kTelemetrySync1) {
+            ++pos;
+            continue;
+        }
+        TelemetryHeader header;
+        memcpy(&header, &data[pos], sizeof(header));
+        const size_t frame_size = header.length + kTelemetryFrameOverhead;
+        if (data.size() - pos < frame_size
+            || TelemetryChecksum(&data[pos], header.length) != data[pos + sizeof(header) + header.length]) {
+            ++pos;
+            continue;
+        }
+        const uint8_t* payload = &data[pos] + sizeof(header);
+        pos += frame_size;
+
+        // The timestamp wraps every 71 minutes
+        if (started) {
+            time += static_cast<uint64_t>(header.timestamp_us - last_us) * 1000;
+        }
+        started = true;
+        last_us = header.timestamp_us;
+
+        if (header.type == TELEMETRY_TOUCH && header.length == sizeof(TelemetryTouch)) {
+            TelemetryTouch touch;
+            memcpy(&touch, payload, sizeof(touch));
+            AddTouch(time, touch.touched, touch.deviation);
+        } else if (header.type == TELEMETRY_INPUTS && header.length == sizeof(TelemetryInputs)) {
+            TelemetryInputs inputs;
+            memcpy(&inputs, payload, sizeof(inputs));
+            for (int i = 0; i < 12; ++i) {
+                if (!have_codes || inputs.adc[i] != codes[i]) {
+                    AddAdc(time, i, inputs.adc[i]);
+                    codes[i] = inputs.adc[i];
+                }
+            }
+            for (int i = 0; i < 2; ++i) {
+                if (!have_codes || ((inputs.gates ^ gates) >> i & 1)) {
+                    AddGate(time, i, inputs.gates >> i & 1);
+                }
+            }
+            gates = inputs.gates;
+            have_codes = true;
+        }
+    }
+    return started;
+}
+
+bool LoadScript(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[512];
+    int number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        ++number;
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        double ms;
+        char kind[16];
+        int consumed;
+        if (sscanf(line, "%lf %15s%n", &ms, kind, &consumed) != 2) {
+            continue;
+        }
+        const uint64_t time = static_cast<uint64_t>(ms * kNsPerMs);
+        const char* args = line + consumed;
+        if (!strcmp(kind, "touch")) {
+            unsigned mask;
+            int16_t deviation[12];
+            int n = 0;
+            ok = sscanf(args, "%i%n", reinterpret_cast<int*>(&mask), &consumed) == 1;
+            args += consumed;
+            int value;
+            while (ok && n < 12 && sscanf(args, "%d%n", &value, &consumed) == 1) {
+                deviation[n++] = static_cast<int16_t>(value);
+                args += consumed;
+            }
+            ok = ok && (n == 0 || n == 12);
+            if (ok) {
+                AddTouch(time, static_cast<uint16_t>(mask & 0x0FFF), n ? deviation : nullptr);
+            }
+        } else if (!strcmp(kind, "adc")) {
+            int channel;
+            double value;
+            ok = sscanf(args, "%d %lf", &channel, &value) == 2 && channel >= 0 && channel < 12;
+            if (ok) {
+                AddAdc(time, channel, ToCode(value));
+            }
+        } else if (!strcmp(kind, "gate")) {
+            int gate;
+            int state;
+            ok = sscanf(args, "%d %d", &gate, &state) == 2 && (gate == 1 || gate == 2);
+            if (ok) {
+                AddGate(time, gate - 1, state != 0);
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: cannot parse\n", path, number);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// Taps of random pads, some shorter than the touch poll period, and knob
+// steps on the measured channels
+void GenerateTrace(uint32_t seed, uint64_t end) {
+    std::mt19937 random(seed);
+    auto uniform = [&](double low, double high) { return std::uniform_real_distribution<double>(low, high)(random); };
+
+    uint64_t time = kLeadInNs;
+    while (true) {
+        time += static_cast<uint64_t>(uniform(20.0, 300.0) * kNsPerMs);
+        const uint64_t release = time + static_cast<uint64_t>(uniform(3.0, 250.0) * kNsPerMs);
+        if (release >= end) {
+            break;
+        }
+        const int pad = static_cast<int>(uniform(0.0, 12.0));
+        int16_t deviation[12] = {};
+        deviation[pad] = static_cast<int16_t>(uniform(20.0, 140.0));
+        uint16_t mask = static_cast<uint16_t>(1 << pad);
+        if (pad < 11 && uniform(0.0, 1.0) < 0.3) {
+            deviation[pad + 1] = deviation[pad] / 3;
+            mask |= static_cast<uint16_t>(1 << (pad + 1));
+        }
+        AddTouch(time, mask, deviation);
+        AddTouch(release, 0, nullptr);
+        time = release;
+    }
+
+    time = kLeadInNs;
+    float values[12] = {};
+    while (true) {
+        time += static_cast<uint64_t>(uniform(250.0, 750.0) * kNsPerMs);
+        if (time >= end) {
+            break;
+        }
+        const Knob& knob = kKnobs[static_cast<size_t>(uniform(0.0, sizeof(kKnobs) / sizeof(kKnobs[0])))];
+        float value;
+        do {
+            value = static_cast<float>(uniform(0.0, 1.0));
+        } while (fabsf(value - values[knob.channel]) < 0.1f);
+        values[knob.channel] = value;
+        AddAdc(time, knob.channel, ToCode(value));
+    }
+    std::stable_sort(g_events.begin(), g_events.end(),
+                     [](const Event& a, const Event& b) { return a.time < b.time; });
+}
+
+void ApplyInputs() {
+    while (g_next_event < g_events.size() && g_events[g_next_event].time <= g_now) {
+        const Event& event = g_events[g_next_event++];
+        switch (event.kind) {
+            case Event::TOUCH:
+                if (event.mask != g_touched) {
+                    g_touch_edges.push_back(TouchEdge{event.time, event.mask, 0});
+                    ++g_touch_edge_count;
+                }
+                g_touched = event.mask;
+                memcpy(g_deviation, event.deviation, sizeof(g_deviation));
+                break;
+            case Event::ADC: {
+                const float from = g_adc[event.channel] / 65536.0f;
+                const float to = event.code / 65536.0f;
+                g_adc[event.channel] = event.code;
+                if (!FindKnob(event.channel) || fabsf(to - from) < g_options.knob_step) {
+                    break;
+                }
+                // A step overtakes one still settling on the same knob
+                for (size_t i = 0; i < g_knob_steps.size(); ++i) {
+                    if (g_knob_steps[i].channel == event.channel) {
+                        g_knob_steps.erase(g_knob_steps.begin() + i);
+                        ++g_knob_superseded;
+                        break;
+                    }
+                }
+                g_knob_steps.push_back(KnobStep{event.time, event.channel, from, to, 0});
+                ++g_knob_step_count;
+                break;
+            }
+            case Event::GATE:
+                // Gate in 1's edge interrupt, stamped at the edge
+                if (event.channel == 0 && event.state && !g_gates[0]) {
+                    g_hardware.GetGateClock().OnEdge(static_cast<uint32_t>(event.time * kTicksPerUs / 1000));
+                }
+                g_gates[event.channel] = event.state;
+                break;
+        }
+    }
+}
+
+// --- Report -----------------------------------------------------------------
+
+void PrintReport(const char* reason) {
+    const double block_ms = g_sample_rate > 0.0f ? g_block_size * 1000.0 / g_sample_rate : 0.0;
+    printf("cosim: %.3f s simulated, %s\n", static_cast<double>(g_now) / kNsPerS, reason);
+    if (g_options.host_factor > 0.0) {
+        printf("cost model: host time x %.1f\n", g_options.host_factor);
+    } else {
+        printf("cost model: audio %.0f%% +-%.0f%% of the block, DAC %.1f us\n", g_options.load * 100.0,
+               g_options.jitter * 100.0, g_options.dac_us);
+    }
+
+    daisy::CpuLoadMeter& meter = g_hardware.GetCpuMeter();
+    printf("audio: %llu blocks of %zu frames at %.0f Hz (%.3f ms), cpu avg %.1f%% max %.1f%%, xruns %u, Q%d\n",
+           static_cast<unsigned long long>(g_audio_blocks), g_block_size, g_sample_rate, block_ms,
+           meter.GetAvgCpuLoad() * 100.0f, meter.GetMaxCpuLoad() * 100.0f, GetXrunCount(),
+           static_cast<int>(g_audio_engine.GetQualityGovernor().GetLevel()));
+    printf("dac: %llu blocks; output events dropped %u; telemetry %llu bytes, %u records dropped\n\n",
+           static_cast<unsigned long long>(g_dac_blocks), g_controls.GetOutputEvents().GetDroppedCount(),
+           static_cast<unsigned long long>(g_usb_bytes), g_telemetry.GetDroppedCount());
+
+    PrintDistributionHeader("touch (ms)");
+    g_touch_to_poll.Print("status -> touch poll", "", 1e-6);
+    g_touch_to_callback.Print("status -> audio callback", "", 1e-6);
+    g_touch_to_output.Print("status -> output", "", 1e-6);
+    printf("  %u edges: %u changed again before a poll read them, %u before a block saw them\n\n",
+           g_touch_edge_count, g_touch_missed_poll, g_touch_missed_audio);
+
+    PrintDistributionHeader("knobs (ms)");
+    g_knob_to_response.Print("step -> snapshot moves", "", 1e-6);
+    g_knob_to_settled.Print("step -> within 5%", "", 1e-6);
+    printf("  %u steps of %.2f or more, %u overtaken by the next one\n\n", g_knob_step_count,
+           g_options.knob_step, g_knob_superseded);
+
+    PrintDistributionHeader("control updates (us)");
+    g_controls_interval.Print("controls task interval", "", 1e-3);
+    g_snapshot_age.Print("snapshot age at tick", "", 1e-3);
+    g_audio_entry_delay.Print("audio interrupt entry delay", "", 1e-3);
+    printf("\n");
+
+    printf("%-10s %8s %8s %9s %7s %7s %9s\n", "task", "period", "runs", "overruns", "avg", "max", "max late");
+    for (int i = 0; i < g_scheduler.GetNumTasks(); ++i) {
+        const TaskScheduler::TaskStats& stats = g_scheduler.GetTaskStats(i);
+        printf("%-10s %8u %8u %9u %7u %7u %9u\n", g_scheduler.GetTaskName(i), g_scheduler.GetTaskPeriod(i),
+               stats.runs, stats.overruns, stats.GetAverageUs(), stats.max_us, stats.max_lateness_us);
+    }
+}
+
+void Finish(const char* reason) {
+    PrintReport(reason);
+    if (g_telemetry_file) {
+        fclose(g_telemetry_file);
+    }
+    fflush(stdout);
+    exit(0);
+}
+
+} // namespace
+
+// --- Simulated core interface -----------------------------------------------
+
+namespace cosim {
+
+uint64_t NowNs() {
+    if (g_in_handler) {
+        if (g_options.host_factor > 0.0) {
+            return g_handler_start + HostElapsedNs(g_handler_host_start);
+        }
+        return g_handler_reads++ == 0 ? g_handler_start : g_handler_start + g_handler_cost;
+    }
+    AdvanceMainLoop();
+    return g_now;
+}
+
+void Poll() {
+    if (g_in_handler) {
+        return;
+    }
+    AdvanceMainLoop();
+    while (true) {
+        const Source next = NextInterrupt();
+        if (g_irq[next].due > g_now) {
+            break;
+        }
+        RunHandler(next);
+    }
+    if (g_now >= g_end_ns) {
+        Finish("end of run");
+    }
+}
+
+void Spin(uint64_t ns) {
+    if (g_in_handler) {
+        return;
+    }
+    AdvanceMainLoop();
+    const uint64_t until = g_now + ns;
+    while (true) {
+        const Source next = NextInterrupt();
+        if (g_irq[next].due > until) {
+            break;
+        }
+        g_now = std::max(g_now, g_irq[next].due);
+        RunHandler(next);
+    }
+    g_now = std::max(g_now, until);
+    Poll();
+}
+
+void WaitForInterrupt() {
+    if (g_in_handler) {
+        return;
+    }
+    AdvanceMainLoop();
+    const Source next = NextInterrupt();
+    g_now = std::max(g_now, g_irq[next].due);
+    RunHandler(next);
+    Poll();
+}
+
+void StartAudio(daisy::AudioHandle::InterleavingAudioCallback callback, float sample_rate, size_t block_size) {
+    if (block_size > kMaxAudioBlockSize) {
+        fprintf(stderr, "audio blocks of %zu frames are not supported\n", block_size);
+        exit(2);
+    }
+    g_audio_callback = callback;
+    g_sample_rate = sample_rate;
+    g_block_size = block_size;
+    Interrupt& irq = g_irq[SOURCE_AUDIO];
+    irq.period = static_cast<uint64_t>(block_size * 1e9 / sample_rate);
+    irq.due = g_now + irq.period;
+    irq.enabled = callback != nullptr;
+}
+
+void StopAudio() {
+    g_irq[SOURCE_AUDIO].enabled = false;
+}
+
+void StartDac(daisy::DacHandle::DacCallback callback) {
+    g_dac_callback = callback;
+    Interrupt& irq = g_irq[SOURCE_DAC];
+    irq.period = kDacPeriodNs;
+    irq.due = g_now + irq.period;
+    irq.enabled = callback != nullptr;
+}
+
+void StartWakeTimer(uint32_t period_ticks) {
+    Interrupt& irq = g_irq[SOURCE_WAKE];
+    irq.period = static_cast<uint64_t>(period_ticks) * 1000 / kTicksPerUs;
+    irq.due = g_now + irq.period;
+    irq.enabled = period_ticks != 0;
+}
+
+uint16_t* AdcCodes() {
+    ApplyInputs();
+    return g_adc;
+}
+
+uint16_t AdcRead(uint8_t channel) {
+    // ProcessControls reads every channel once per pass, channel 0 first
+    if (channel == 0 && !g_in_handler) {
+        const uint64_t now = NowNs();
+        if (g_last_controls_read) {
+            g_controls_interval.Add(static_cast<double>(now - g_last_controls_read));
+        }
+        g_last_controls_read = now;
+    }
+    ApplyInputs();
+    return g_adc[channel];
+}
+
+bool GateState(int gate) {
+    ApplyInputs();
+    return g_gates[gate];
+}
+
+bool I2cRead(uint16_t address, uint8_t reg, uint8_t* data, size_t size) {
+    if (!g_options.sensor || address != kMpr121Address) {
+        Spin(20 * kI2cBitNs);       // Address not acknowledged
+        return false;
+    }
+    // Register address written, then a repeated start and the data read
+    Spin((4 + 9 * (3 + size)) * kI2cBitNs);
+    ApplyInputs();
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = ReadMpr121(static_cast<uint8_t>(reg + i));
+    }
+
+    if (reg == MPR121_TOUCHSTATUS_L && size == 2) {
+        const uint16_t mask = static_cast<uint16_t>(data[0] | data[1] << 8);
+        for (size_t i = g_touch_edges.size(); i-- > 0;) {
+            TouchEdge& edge = g_touch_edges[i];
+            if (edge.polled) {
+                break;
+            }
+            if (edge.mask == mask) {
+                edge.polled = g_now;
+                g_touch_to_poll.Add(static_cast<double>(g_now - edge.time));
+                // Earlier edges still waiting were overtaken
+                size_t first = i;
+                while (first > 0 && !g_touch_edges[first - 1].polled) {
+                    --first;
+                }
+                g_touch_missed_poll += static_cast<uint32_t>(i - first);
+                g_touch_edges.erase(g_touch_edges.begin() + first, g_touch_edges.begin() + i);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool I2cWrite(uint16_t address, uint8_t reg, const uint8_t* data, size_t size) {
+    if (!g_options.sensor || address != kMpr121Address) {
+        Spin(20 * kI2cBitNs);
+        return false;
+    }
+    Spin((2 + 9 * (2 + size)) * kI2cBitNs);
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t r = static_cast<uint8_t>(reg + i);
+        if (r == MPR121_SOFTRESET && data[i] == 0x63) {
+            ResetMpr121();
+        } else {
+            g_mpr121[r] = data[i];
+        }
+    }
+    return true;
+}
+
+void UsbTransmit(const uint8_t* data, size_t size) {
+    g_usb_bytes += size;
+    if (g_telemetry_file) {
+        fwrite(data, 1, size, g_telemetry_file);
+    }
+}
+
+void Log(const char* text) {
+    if (g_options.verbose) {
+        printf("[%10.3f ms] %s\n", static_cast<double>(g_in_handler ? g_handler_start : g_now) / kNsPerMs, text);
+    }
+}
+
+void Reset(const char* reason) {
+    Finish(reason);
+    abort();
+}
+
+} // namespace cosim
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:r:T:l:j:d:x:k:no:v")) != -1) {
+        switch (opt) {
+            case 't': g_options.capture = optarg; break;
+            case 's': g_options.script = optarg; break;
+            case 'r': g_options.seed = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'T': g_options.seconds = atof(optarg); break;
+            case 'l': g_options.load = atof(optarg); break;
+            case 'j': g_options.jitter = atof(optarg); break;
+            case 'd': g_options.dac_us = atof(optarg); break;
+            case 'x': g_options.host_factor = atof(optarg); break;
+            case 'k': g_options.knob_step = static_cast<float>(atof(optarg)); break;
+            case 'n': g_options.sensor = false; break;
+            case 'o': g_options.output = optarg; break;
+            case 'v': g_options.verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-t capture.bin | -s script.txt | -r seed] [-T sec] [-l load] "
+                                "[-j jitter] [-d dac_us] [-x factor] [-k step] [-n] [-o out.bin] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (g_options.capture && !LoadCapture(g_options.capture)) {
+        fprintf(stderr, "cannot read %s\n", g_options.capture);
+        return 2;
+    }
+    if (g_options.script && !LoadScript(g_options.script)) {
+        return 2;
+    }
+    const bool traced = g_options.capture || g_options.script;
+    std::stable_sort(g_events.begin(), g_events.end(),
+                     [](const Event& a, const Event& b) { return a.time < b.time; });
+    if (g_options.seconds > 0.0) {
+        g_end_ns = static_cast<uint64_t>(g_options.seconds * kNsPerS);
+    } else if (traced) {
+        g_end_ns = (g_events.empty() ? 0 : g_events.back().time) + kNsPerS;
+    } else {
+        g_end_ns = 10 * kNsPerS;
+    }
+    if (!traced) {
+        GenerateTrace(g_options.seed, g_end_ns);
+    }
+
+    if (g_options.output) {
+        g_telemetry_file = fopen(g_options.output, "wb");
+        if (!g_telemetry_file) {
+            fprintf(stderr, "cannot write %s\n", g_options.output);
+            return 2;
+        }
+    }
+
+    ResetMpr121();
+    g_irq[SOURCE_SYSTICK] = Interrupt{true, kSysTickNs, kSysTickNs};
+    g_host_mark = HostClock::now();
+
+    // Never returns: the run ends in Poll() at the end time
+    FirmwareMain();
+    Finish("firmware returned");
+}
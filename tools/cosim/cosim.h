@@ -0,0 +1,51 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <cstddef>
+#include <cstdint>
+#include "daisy.h"
+
+// The simulated core the mocked libDaisy runs on (cosim.cpp). One host
+// thread plays both contexts: interrupts are taken at the mock calls, which
+// are the only places the firmware can be preempted, and the main loop's
+// waits (WFI, delays, blocking I2C) move virtual time forward.
+namespace cosim {
+
+// Virtual time since reset. Inside an interrupt, the first read is the
+// entry time and later reads include the handler's modelled cost.
+uint64_t NowNs();
+
+// The main loop waits `ns` (a delay, a blocking transfer): interrupts due
+// meanwhile are taken, and it resumes once the span has passed and the last
+// handler has returned. No-op in a handler.
+void Spin(uint64_t ns);
+
+// Takes the interrupts due by now (main loop only; no-op in a handler)
+void Poll();
+
+// Sleeps until the next interrupt and takes it
+void WaitForInterrupt();
+
+void StartAudio(daisy::AudioHandle::InterleavingAudioCallback callback, float sample_rate, size_t block_size);
+void StopAudio();
+void StartDac(daisy::DacHandle::DacCallback callback);
+void StartWakeTimer(uint32_t period_ticks);
+
+// Inputs, as replayed from the trace at the current time
+uint16_t* AdcCodes();
+bool GateState(int gate);
+
+// One channel read by the controls task, which also times the task's runs
+uint16_t AdcRead(uint8_t channel);
+
+// MPR121 register transfers; false when no sensor answers at `address`
+bool I2cRead(uint16_t address, uint8_t reg, uint8_t* data, size_t size);
+bool I2cWrite(uint16_t address, uint8_t reg, const uint8_t* data, size_t size);
+
+void UsbTransmit(const uint8_t* data, size_t size);
+void Log(const char* text);
+[[noreturn]] void Reset(const char* reason);
+
+} // namespace cosim
+
+#endif // COSIM_H
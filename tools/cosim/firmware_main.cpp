@@ -0,0 +1,4 @@
+// The firmware's entry point (src/app/Kymatikos.cpp), renamed so that the
+// co-simulator can start it on the simulated core
+#define main FirmwareMain
+#include "../../src/app/Kymatikos.cpp"
@@ -0,0 +1,274 @@
+// The part of libDaisy the firmware uses, for the host co-simulator. Timing,
+// interrupts and inputs come from the simulated core (cosim.h); the classes
+// keep libDaisy's names and signatures so that src/ compiles unchanged.
+
+#pragma once
+#ifndef COSIM_DAISY_H
+#define COSIM_DAISY_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#define DSY_SDRAM_BSS
+#define DMA_BUFFER_MEM_SECTION
+
+namespace daisy {
+
+enum class GPIOPort {
+    PORTA,
+    PORTB,
+    PORTC,
+    PORTD,
+    PORTE,
+    PORTF,
+    PORTG,
+    PORTH,
+    PORTI,
+    PORTJ,
+    PORTK,
+    PORTX,
+};
+
+struct Pin {
+    GPIOPort port;
+    uint8_t pin;
+
+    constexpr Pin() : port(GPIOPort::PORTX), pin(255) {}
+    constexpr Pin(GPIOPort p, uint8_t n) : port(p), pin(n) {}
+};
+
+class GPIO {
+public:
+    enum class Mode { INPUT, OUTPUT, OPEN_DRAIN, ANALOG };
+    enum class Pull { NOPULL, PULLUP, PULLDOWN };
+    enum class Speed { LOW, MEDIUM, HIGH, VERY_HIGH };
+
+    struct Config {
+        Pin pin;
+        Mode mode = Mode::INPUT;
+        Pull pull = Pull::NOPULL;
+        Speed speed = Speed::LOW;
+    };
+
+    void Init(const Config& config) { config_ = config; }
+    bool Read() { return state_; }
+    void Write(bool state) { state_ = state; }
+    void Toggle() { state_ = !state_; }
+
+private:
+    Config config_;
+    bool state_ = false;
+};
+
+class System {
+public:
+    enum class BootloaderMode {
+        STM = 0,
+        DAISY,
+        DAISY_SKIP_TIMEOUT,
+        DAISY_INFINITE_TIMEOUT,
+    };
+
+    // TIM2 at 200 MHz, as on the Patch SM
+    static uint32_t GetTick();
+    static uint32_t GetTickFreq() { return 200000000; }
+    static uint32_t GetNow();
+    static uint32_t GetUs();
+    static void Delay(uint32_t ms);
+    static void DelayUs(uint32_t us);
+    static void DelayTicks(uint32_t ticks);
+    static void ResetToBootloader(BootloaderMode mode = BootloaderMode::STM);
+};
+
+class TimerHandle {
+public:
+    struct Config {
+        enum class Peripheral { TIM_2 = 0, TIM_3, TIM_4, TIM_5 };
+        enum class CounterDir { UP = 0, DOWN };
+
+        Peripheral periph = Peripheral::TIM_2;
+        CounterDir dir = CounterDir::UP;
+        uint32_t period = 0xFFFFFFFF;
+        bool enable_irq = false;
+    };
+
+    enum class Result { OK, ERR };
+
+    Result Init(const Config& config) {
+        config_ = config;
+        return Result::OK;
+    }
+    Result Start();
+    Result Stop();
+
+private:
+    Config config_;
+};
+
+class I2CHandle {
+public:
+    struct Config {
+        enum class Peripheral { I2C_1 = 0, I2C_2, I2C_3, I2C_4 };
+        enum class Speed { I2C_100KHZ, I2C_400KHZ, I2C_1MHZ };
+        enum class Mode { I2C_MASTER, I2C_SLAVE };
+
+        Peripheral periph = Peripheral::I2C_1;
+        struct {
+            Pin scl;
+            Pin sda;
+        } pin_config;
+        Speed speed = Speed::I2C_400KHZ;
+        Mode mode = Mode::I2C_MASTER;
+        uint8_t address = 0x10;
+    };
+
+    enum class Result { OK, ERR };
+
+    Result Init(const Config& config) {
+        config_ = config;
+        return Result::OK;
+    }
+
+    // Blocking register transfers with the emulated MPR121 (cosim.cpp)
+    Result ReadDataAtAddress(uint16_t address, uint16_t mem_address, uint16_t mem_address_size, uint8_t* data,
+                             uint16_t data_size, uint32_t timeout);
+    Result WriteDataAtAddress(uint16_t address, uint16_t mem_address, uint16_t mem_address_size, uint8_t* data,
+                              uint16_t data_size, uint32_t timeout);
+
+private:
+    Config config_;
+};
+
+class AudioHandle {
+public:
+    typedef const float* InterleavingInputBuffer;
+    typedef float* InterleavingOutputBuffer;
+    typedef void (*InterleavingAudioCallback)(InterleavingInputBuffer in, InterleavingOutputBuffer out,
+                                              size_t size);
+};
+
+class DacHandle {
+public:
+    typedef void (*DacCallback)(uint16_t** out, size_t size);
+};
+
+// Reads the simulated ADC codes, updated by the trace
+class AdcHandle {
+public:
+    uint16_t* GetPtr(uint8_t channel);
+    float GetFloat(uint8_t channel);
+    void Start() {}
+    void Stop() {}
+};
+
+class GateIn {
+public:
+    explicit GateIn(int index = 0) : index_(index), prev_state_(false), state_(false) {}
+
+    void Init(Pin pin, bool invert = true) {
+        (void)pin;
+        (void)invert;
+    }
+
+    // Rising edge since the previous call, as libDaisy's
+    bool Trig() {
+        prev_state_ = state_;
+        state_ = State();
+        return state_ && !prev_state_;
+    }
+
+    bool State();
+
+private:
+    int index_;
+    bool prev_state_;
+    bool state_;
+};
+
+class UsbHandle {
+public:
+    enum class Result { OK, ERR };
+
+    // Appends to the simulated telemetry capture
+    Result TransmitInternal(uint8_t* buffer, size_t size);
+};
+
+// FatFs and SD types, for SdCardSink's members; the card itself is absent
+typedef uint32_t DWORD;
+
+struct FIL {
+    DWORD* cltbl;
+};
+
+class SdmmcHandler {
+public:
+    struct Config {
+        void Defaults() {}
+    };
+};
+
+class FatFSInterface {
+};
+
+enum LoggerDestination {
+    LOGGER_NONE,
+    LOGGER_INTERNAL,
+    LOGGER_EXTERNAL,
+    LOGGER_SEMIHOST,
+};
+
+// Both loggers print to the simulation log, stamped with virtual time
+void CosimLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+template <LoggerDestination dest = LOGGER_INTERNAL>
+class Logger {
+public:
+    static void StartLog(bool wait_for_pc = false) { (void)wait_for_pc; }
+
+    template <typename... Args>
+    static void Print(const char* format, Args... args) {
+        CosimLog(format, args...);
+    }
+
+    template <typename... Args>
+    static void PrintLine(const char* format, Args... args) {
+        CosimLog(format, args...);
+    }
+};
+
+template <LoggerDestination dest = LOGGER_INTERNAL, size_t capacity = 32>
+class AsyncLogger {
+public:
+    // As the firmware's, so that the cosim build fails where it would
+    static constexpr size_t kMaxArgs = 6;
+
+    static void StartLog(bool wait_for_pc = false) { (void)wait_for_pc; }
+
+    template <typename... Args>
+    static bool Print(const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "Too many arguments for AsyncLogger");
+        CosimLog(format, args...);
+        return true;
+    }
+
+    template <typename... Args>
+    static bool PrintLine(const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "Too many arguments for AsyncLogger");
+        CosimLog(format, args...);
+        return true;
+    }
+
+    static size_t Drain() { return 0; }
+    static uint32_t GetDroppedCount() { return 0; }
+    static uint32_t GetTruncatedCount() { return 0; }
+};
+
+} // namespace daisy
+
+#include "hid/ctrl.h"
+#include "util/CpuLoadMeter.h"
+
+#endif // COSIM_DAISY_H
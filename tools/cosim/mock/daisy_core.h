@@ -0,0 +1,3 @@
+// Part of the mocked libDaisy (daisy.h)
+#pragma once
+#include "daisy.h"
@@ -0,0 +1,89 @@
+// Patch SM board support for the host co-simulator: audio and DAC callbacks
+// are driven by the simulated SAI and DAC clocks (cosim.h)
+
+#pragma once
+#ifndef COSIM_DAISY_PATCH_SM_H
+#define COSIM_DAISY_PATCH_SM_H
+
+#include "daisy.h"
+
+namespace daisy {
+namespace patch_sm {
+
+enum {
+    CV_1 = 0,
+    CV_2,
+    CV_3,
+    CV_4,
+    CV_5,
+    CV_6,
+    CV_7,
+    CV_8,
+    ADC_9,
+    ADC_10,
+    ADC_11,
+    ADC_12,
+    ADC_LAST,
+};
+
+class DaisyPatchSM {
+public:
+    DaisyPatchSM() : gate_in_1(0), gate_in_2(1), sample_rate_(48000.0f), block_size_(4) {}
+
+    void Init() {}
+
+    void StartAudio(AudioHandle::InterleavingAudioCallback callback);
+    void StopAudio();
+    void SetAudioBlockSize(size_t size) { block_size_ = size; }
+    void SetAudioSampleRate(float sample_rate) { sample_rate_ = sample_rate; }
+    size_t AudioBlockSize() const { return block_size_; }
+    float AudioSampleRate() const { return sample_rate_; }
+
+    void StartDac(DacHandle::DacCallback callback = nullptr);
+
+    void SetLed(bool state) { led_ = state; }
+
+    static void StartLog(bool wait_for_pc = false) { (void)wait_for_pc; }
+
+    template <typename... Args>
+    static void Print(const char* format, Args... args) {
+        CosimLog(format, args...);
+    }
+
+    template <typename... Args>
+    static void PrintLine(const char* format, Args... args) {
+        CosimLog(format, args...);
+    }
+
+    static constexpr Pin A1 = Pin(GPIOPort::PORTA, 1);
+    static constexpr Pin A8 = Pin(GPIOPort::PORTA, 8);
+    static constexpr Pin A9 = Pin(GPIOPort::PORTA, 9);
+    static constexpr Pin B5 = Pin(GPIOPort::PORTB, 5);
+    static constexpr Pin B6 = Pin(GPIOPort::PORTB, 6);
+    static constexpr Pin B10 = Pin(GPIOPort::PORTB, 10);
+    static constexpr Pin D1 = Pin(GPIOPort::PORTD, 1);
+    static constexpr Pin D2 = Pin(GPIOPort::PORTD, 2);
+    static constexpr Pin D3 = Pin(GPIOPort::PORTD, 3);
+    static constexpr Pin D4 = Pin(GPIOPort::PORTD, 4);
+    static constexpr Pin D5 = Pin(GPIOPort::PORTD, 5);
+    static constexpr Pin D6 = Pin(GPIOPort::PORTD, 6);
+    static constexpr Pin D7 = Pin(GPIOPort::PORTD, 7);
+    static constexpr Pin D8 = Pin(GPIOPort::PORTD, 8);
+    static constexpr Pin D9 = Pin(GPIOPort::PORTD, 9);
+    static constexpr Pin D10 = Pin(GPIOPort::PORTD, 10);
+
+    System system;
+    AdcHandle adc;
+    GateIn gate_in_1;
+    GateIn gate_in_2;
+
+private:
+    float sample_rate_;
+    size_t block_size_;
+    bool led_ = false;
+};
+
+} // namespace patch_sm
+} // namespace daisy
+
+#endif // COSIM_DAISY_PATCH_SM_H
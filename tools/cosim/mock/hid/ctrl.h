@@ -0,0 +1,3 @@
+// libDaisy's AnalogControl, unchanged
+#pragma once
+#include "../../../../lib/libdaisy/src/hid/ctrl.h"
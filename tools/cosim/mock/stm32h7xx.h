@@ -0,0 +1,60 @@
+// The few core registers the firmware touches, for the host co-simulator.
+// The STM32 device macros stay undefined, so the VTOR write is compiled out.
+
+#pragma once
+#ifndef COSIM_STM32H7XX_H
+#define COSIM_STM32H7XX_H
+
+#include <cstdint>
+
+struct CosimRtc {
+    uint32_t BKP0R;
+};
+
+// DWT cycle counter at the core clock, derived from virtual time
+class CosimCycleCounter {
+public:
+    CosimCycleCounter& operator=(uint32_t value);
+    operator uint32_t() const;
+
+private:
+    uint32_t offset_ = 0;
+};
+
+struct CosimDwt {
+    uint32_t CTRL;
+    uint32_t LAR;
+    CosimCycleCounter CYCCNT;
+};
+
+struct CosimCoreDebug {
+    uint32_t DEMCR;
+};
+
+struct CosimFpu {
+    uint32_t FPDSCR;
+};
+
+extern CosimRtc g_cosim_rtc;
+extern CosimDwt g_cosim_dwt;
+extern CosimCoreDebug g_cosim_core_debug;
+extern CosimFpu g_cosim_fpu;
+extern uint32_t SystemCoreClock;
+
+#define RTC (&g_cosim_rtc)
+#define DWT (&g_cosim_dwt)
+#define CoreDebug (&g_cosim_core_debug)
+#define FPU (&g_cosim_fpu)
+#define DWT_CTRL_CYCCNTENA_Msk 1u
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+#define FPU_FPDSCR_FZ_Msk (1u << 24)
+
+// The control registers are only stored: the host keeps its own
+// floating-point modes
+uint32_t __get_FPSCR();
+void __set_FPSCR(uint32_t fpscr);
+
+// Sleeps until the next simulated interrupt
+void __WFI();
+
+#endif // COSIM_STM32H7XX_H
@@ -0,0 +1,3 @@
+// libDaisy's CpuLoadMeter, unchanged: it reads the simulated TIM2 tick
+#pragma once
+#include "../../../../lib/libdaisy/src/util/CpuLoadMeter.h"
@@ -0,0 +1,182 @@
+// The mocked libDaisy and core registers, on top of the simulated core
+
+#include <cstdarg>
+#include <cstdio>
+#include "cosim.h"
+#include "daisy_patch_sm.h"
+#include "stm32h7xx.h"
+
+namespace {
+// What a main-loop clock read costs, so that busy waits on the tick make
+// progress when main-loop code is otherwise free (the default cost model)
+constexpr uint64_t kClockReadNs = 100;
+constexpr uint64_t kTicksPerUs = 200;
+}
+
+CosimRtc g_cosim_rtc;
+CosimDwt g_cosim_dwt;
+CosimCoreDebug g_cosim_core_debug;
+CosimFpu g_cosim_fpu;
+uint32_t SystemCoreClock = 480000000;
+
+namespace {
+
+uint32_t CycleCount() {
+    return static_cast<uint32_t>(cosim::NowNs() * (SystemCoreClock / 1000000) / 1000);
+}
+
+uint32_t Tick() {
+    cosim::Spin(kClockReadNs);
+    return static_cast<uint32_t>(cosim::NowNs() * kTicksPerUs / 1000);
+}
+
+} // namespace
+
+CosimCycleCounter& CosimCycleCounter::operator=(uint32_t value) {
+    offset_ = value - CycleCount();
+    return *this;
+}
+
+CosimCycleCounter::operator uint32_t() const {
+    return CycleCount() + offset_;
+}
+
+namespace {
+uint32_t g_fpscr;
+}
+
+uint32_t __get_FPSCR() {
+    return g_fpscr;
+}
+
+void __set_FPSCR(uint32_t fpscr) {
+    g_fpscr = fpscr;
+}
+
+void __WFI() {
+    cosim::WaitForInterrupt();
+}
+
+namespace daisy {
+
+uint32_t System::GetTick() {
+    return Tick();
+}
+
+uint32_t System::GetNow() {
+    Tick();
+    return static_cast<uint32_t>(cosim::NowNs() / 1000000);
+}
+
+uint32_t System::GetUs() {
+    Tick();
+    return static_cast<uint32_t>(cosim::NowNs() / 1000);
+}
+
+void System::Delay(uint32_t ms) {
+    cosim::Spin(static_cast<uint64_t>(ms) * 1000000);
+}
+
+void System::DelayUs(uint32_t us) {
+    cosim::Spin(static_cast<uint64_t>(us) * 1000);
+}
+
+void System::DelayTicks(uint32_t ticks) {
+    cosim::Spin(static_cast<uint64_t>(ticks) * 1000 / kTicksPerUs);
+}
+
+void System::ResetToBootloader(BootloaderMode mode) {
+    (void)mode;
+    cosim::Reset("reset to the bootloader");
+}
+
+TimerHandle::Result TimerHandle::Start() {
+    // Only the scheduler's wake timer raises interrupts
+    if (config_.enable_irq && config_.periph == Config::Peripheral::TIM_5) {
+        cosim::StartWakeTimer(config_.period + 1);
+    }
+    return Result::OK;
+}
+
+TimerHandle::Result TimerHandle::Stop() {
+    if (config_.enable_irq && config_.periph == Config::Peripheral::TIM_5) {
+        cosim::StartWakeTimer(0);
+    }
+    return Result::OK;
+}
+
+I2CHandle::Result I2CHandle::ReadDataAtAddress(uint16_t address, uint16_t mem_address, uint16_t mem_address_size,
+                                               uint8_t* data, uint16_t data_size, uint32_t timeout) {
+    (void)mem_address_size;
+    (void)timeout;
+    return cosim::I2cRead(address, static_cast<uint8_t>(mem_address), data, data_size) ? Result::OK
+                                                                                      : Result::ERR;
+}
+
+I2CHandle::Result I2CHandle::WriteDataAtAddress(uint16_t address, uint16_t mem_address, uint16_t mem_address_size,
+                                                uint8_t* data, uint16_t data_size, uint32_t timeout) {
+    (void)mem_address_size;
+    (void)timeout;
+    return cosim::I2cWrite(address, static_cast<uint8_t>(mem_address), data, data_size) ? Result::OK
+                                                                                        : Result::ERR;
+}
+
+uint16_t* AdcHandle::GetPtr(uint8_t channel) {
+    return &cosim::AdcCodes()[channel];
+}
+
+float AdcHandle::GetFloat(uint8_t channel) {
+    return cosim::AdcRead(channel) / 65535.0f;
+}
+
+bool GateIn::State() {
+    return cosim::GateState(index_);
+}
+
+UsbHandle::Result UsbHandle::TransmitInternal(uint8_t* buffer, size_t size) {
+    cosim::UsbTransmit(buffer, size);
+    return Result::OK;
+}
+
+void CosimLog(const char* format, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    cosim::Log(text);
+}
+
+namespace patch_sm {
+
+constexpr Pin DaisyPatchSM::A1;
+constexpr Pin DaisyPatchSM::A8;
+constexpr Pin DaisyPatchSM::A9;
+constexpr Pin DaisyPatchSM::B5;
+constexpr Pin DaisyPatchSM::B6;
+constexpr Pin DaisyPatchSM::B10;
+constexpr Pin DaisyPatchSM::D1;
+constexpr Pin DaisyPatchSM::D2;
+constexpr Pin DaisyPatchSM::D3;
+constexpr Pin DaisyPatchSM::D4;
+constexpr Pin DaisyPatchSM::D5;
+constexpr Pin DaisyPatchSM::D6;
+constexpr Pin DaisyPatchSM::D7;
+constexpr Pin DaisyPatchSM::D8;
+constexpr Pin DaisyPatchSM::D9;
+constexpr Pin DaisyPatchSM::D10;
+
+void DaisyPatchSM::StartAudio(AudioHandle::InterleavingAudioCallback callback) {
+    cosim::StartAudio(callback, sample_rate_, block_size_);
+}
+
+void DaisyPatchSM::StopAudio() {
+    cosim::StopAudio();
+}
+
+void DaisyPatchSM::StartDac(DacHandle::DacCallback callback) {
+    cosim::StartDac(callback);
+}
+
+} // namespace patch_sm
+} // namespace daisy
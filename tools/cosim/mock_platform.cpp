@@ -0,0 +1,228 @@
+// Stand-ins for the firmware modules that drive the QSPI flash, the SD card,
+// the MDMA and the gate interrupt, which the co-simulator does not model:
+// settings live in memory, there is no card, sample memory is unavailable,
+// the DMA copies complete at once and gate edges are stamped by the replay.
+
+#include <cstring>
+#include "GateClock.h"
+#include "QspiFlash.h"
+#include "SampleMemory.h"
+#include "SdCardSink.h"
+#include "SdramClear.h"
+#include "StagingDma.h"
+#include "SynthStateStorage.h"
+
+namespace {
+
+struct Record {
+    bool valid;
+    uint8_t data[sizeof(SynthPreset)];
+};
+
+Record g_settings;
+Record g_controls;
+Record g_presets[SynthStateStorage::kNumPresets];
+
+bool Read(const Record& record, void* data, size_t size) {
+    if (record.valid) {
+        memcpy(data, record.data, size);
+    }
+    return record.valid;
+}
+
+bool Write(Record& record, const void* data, size_t size) {
+    memcpy(record.data, data, size);
+    record.valid = true;
+    return true;
+}
+
+} // namespace
+
+namespace SynthStateStorage {
+
+void InitMemoryMapped() {}
+void Init() {}
+void Process() {}
+
+bool IsBusy() {
+    return false;
+}
+
+bool LoadSettings(SynthSettings& settings) {
+    return Read(g_settings, &settings, sizeof(settings));
+}
+
+bool SaveSettings(const SynthSettings& settings) {
+    return Write(g_settings, &settings, sizeof(settings));
+}
+
+bool LoadControls(ControlsManager::ControlSnapshot& snapshot) {
+    return Read(g_controls, &snapshot, sizeof(snapshot));
+}
+
+bool SaveControls(const ControlsManager::ControlSnapshot& snapshot) {
+    return Write(g_controls, &snapshot, sizeof(snapshot));
+}
+
+bool LoadPreset(int slot, SynthPreset& preset) {
+    return slot >= 0 && slot < kNumPresets && Read(g_presets[slot], &preset, sizeof(preset));
+}
+
+bool SavePreset(int slot, const SynthPreset& preset) {
+    return slot >= 0 && slot < kNumPresets && Write(g_presets[slot], &preset, sizeof(preset));
+}
+
+} // namespace SynthStateStorage
+
+SdCardSink::SdCardSink()
+    : mounted_(false),
+      open_(false),
+      data_(nullptr),
+      offset_(0),
+      remaining_(0),
+      transferring_(false),
+      failed_(false) {
+}
+
+RecorderSink SdCardSink::GetSink() {
+    RecorderSink sink;
+    sink.open = Open;
+    sink.write = Write;
+    sink.status = Status;
+    sink.close = Close;
+    sink.context = this;
+    return sink;
+}
+
+// No card: every recording fails to open
+bool SdCardSink::Open(void* context, const char* name, uint32_t capacity) {
+    (void)context;
+    (void)name;
+    (void)capacity;
+    return false;
+}
+
+bool SdCardSink::Write(void* context, uint32_t offset, const uint8_t* data, uint32_t size) {
+    (void)context;
+    (void)offset;
+    (void)data;
+    (void)size;
+    return false;
+}
+
+RecorderSink::Status SdCardSink::Status(void* context) {
+    (void)context;
+    return RecorderSink::Status::FAILED;
+}
+
+bool SdCardSink::Close(void* context, uint32_t size) {
+    (void)context;
+    (void)size;
+    return false;
+}
+
+void SampleMemory::Config::Defaults() {
+    base = 0;
+    slice_us = 200;
+    sparse = true;
+    mute = nullptr;
+    muted = nullptr;
+}
+
+SampleMemory::SampleMemory()
+    : processor_(nullptr),
+      slice_ticks_(0),
+      writable_(false),
+      state_(State::IDLE),
+      result_(Result::NONE),
+      current_slot_(-1),
+      freeze_hold_(false),
+      blocks_(0),
+      frozen_blocks_(0),
+      erase_count_(0),
+      pages_skipped_(0) {
+    config_.Defaults();
+}
+
+void SampleMemory::Init(const Config& config, GranularProcessorClouds* processor) {
+    config_ = config;
+    processor_ = processor;
+}
+
+// No flash behind it: both are refused, as on a write-protected chip
+bool SampleMemory::Save() {
+    result_ = Result::UNAVAILABLE;
+    return false;
+}
+
+bool SampleMemory::Load() {
+    result_ = Result::UNAVAILABLE;
+    return false;
+}
+
+void SampleMemory::Process() {}
+
+float SampleMemory::GetProgress() const {
+    return 0.0f;
+}
+
+SdramClear::SdramClear() : num_regions_(0), started_(false) {
+}
+
+bool SdramClear::Add(void* start, size_t size) {
+    if (started_ || num_regions_ >= kMaxRegions) {
+        return false;
+    }
+    if (size) {
+        regions_[num_regions_++] = Region{static_cast<uint8_t*>(start), size};
+    }
+    return true;
+}
+
+bool SdramClear::Start() {
+    started_ = true;
+    return true;
+}
+
+bool SdramClear::IsBusy() {
+    return false;
+}
+
+void SdramClear::Wait() {
+    for (int i = 0; i < num_regions_; ++i) {
+        memset(regions_[i].start, 0, regions_[i].size);
+    }
+    num_regions_ = 0;
+    started_ = false;
+}
+
+StagingDma::StagingDma()
+    : busy_(false), late_count_(0), last_transfers_(nullptr), last_num_transfers_(0) {
+}
+
+void StagingDma::Init() {}
+
+void StagingDma::Attach(SampleStager* stager) {
+    stager->set_transport(&StagingDma::Submit, &StagingDma::Wait, this);
+}
+
+// Copies at once, as the CPU fallback does
+void StagingDma::Submit(const StagingTransfer* transfers, size_t num_transfers, void* context) {
+    (void)context;
+    for (size_t i = 0; i < num_transfers; ++i) {
+        memcpy(transfers[i].destination, transfers[i].source, transfers[i].size * sizeof(int16_t));
+    }
+}
+
+void StagingDma::Wait(void* context) {
+    (void)context;
+}
+
+// cosim.cpp hands it the edges at their trace time
+void GateClock::Init() {}
+
+// No flash slices to fit around the audio blocks
+void QspiFlash::SetAudioBlock(uint32_t start_tick, uint32_t period_ticks) {
+    (void)start_tick;
+    (void)period_ticks;
+}
@@ -0,0 +1,361 @@
+// Host fuzzer for the Clouds processor (eurorack/Nimbus_SM): plays random
+// signals through it while throwing random parameters, playback modes and
+// qualities at it, and reports the stage and the settings of every block
+// that came out holding a denormal, a NaN or an Inf. The checks are the
+// firmware's DSP_SENTINELS ones (src/system/DspGuard), on the same hook.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -Ieurorack -I$N -I$N/dsp -I$N/dsp/fx -I$N/dsp/pvoc"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   SRC="$N/resources.cpp $N/dsp/*.cpp $N/dsp/pvoc/*.cpp lib/DaisySP/Source/Filters/svf.cpp"
+//   g++ -std=gnu++14 -O2 $INC tools/dsp_fuzz/dsp_fuzz.cpp $SRC -o dsp_fuzz
+//
+// Usage: dsp_fuzz [options]
+//   -n <trials>      number of trials (default 100)
+//   -s <seed>        seed of the first trial (default 1); trial k runs with
+//                    seed + k, so -s <seed> -n 1 replays a reported trial
+//   -T <seconds>     length of a trial (default 4)
+//   -c <changes>     parameter changes per trial (default 8)
+//   -r <rate>        sample rate (default 32000)
+//   -z               flush denormals to zero, as release firmware does: only
+//                    NaNs and Infs are left to find
+//   -v               print every faulty block, not only a trial's first
+//
+// A trial starts a fresh processor in a random mode and quality, with the
+// reverb at full or half rate and Clouds' reverb or Oliverb after the
+// playback, then applies a new random set of parameters (a quarter of the
+// values at the ends of their range) at random times, switching mode, or
+// quality and reverbs, now and then. The input is silence, noise, a sine, clicks, a full-scale square
+// or a noise burst followed by silence (which leaves decaying tails: the
+// usual source of denormals). Blocks the processor recovered from (reset a
+// stage after a NaN or an Inf) are counted too. The exit status is 1 when
+// any NaN or Inf was found.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <unistd.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#include "granular_processor.h"
+#include "pvoc/phase_vocoder.h"
+#include "resources.h"
+
+namespace {
+
+// The firmware's Clouds buffers (AudioEngine::CLOUD_BUFFER_SIZE and
+// CLOUD_BUFFER_CCM_SIZE)
+constexpr size_t kLargeBufferSize = 356352;
+constexpr size_t kSmallBufferSize = 196224;
+
+constexpr size_t kBlockSize = kMaxBlockSize;
+
+// DspGuard::Kind
+constexpr uint8_t kKindDenormal = 1;
+constexpr uint8_t kKindNan = 2;
+constexpr uint8_t kKindInf = 4;
+constexpr int kNumKinds = 3;
+
+const char* const kStageNames[PROCESS_STAGE_LAST] = {
+    "feedback", "playback", "diffuser", "pitch shifter", "filters", "reverb", "output",
+};
+const char* const kKindNames[kNumKinds] = {"denormal", "NaN", "Inf"};
+const char* const kModeNames[PLAYBACK_MODE_LAST] = {"granular", "stretch", "looping delay", "spectral",
+                                                      "resonestor", "oliverb"};
+
+enum Stimulus {
+    STIMULUS_SILENCE,
+    STIMULUS_NOISE,
+    STIMULUS_SINE,
+    STIMULUS_CLICKS,
+    STIMULUS_SQUARE,
+    STIMULUS_BURST,
+    STIMULUS_LAST
+};
+
+const char* const kStimulusNames[STIMULUS_LAST] = {"silence", "noise", "sine", "clicks", "square", "burst"};
+
+struct Options {
+    int trials = 100;
+    uint32_t seed = 1;
+    double seconds = 4.0;
+    int changes = 8;
+    float sample_rate = 32000.0f;
+    bool flush_to_zero = false;
+    bool verbose = false;
+};
+
+// What the hook found during one trial
+struct Findings {
+    uint32_t blocks[PROCESS_STAGE_LAST][kNumKinds] = {};
+    bool found = false;
+    bool verbose = false;
+    uint32_t trial_seed = 0;
+    double now = 0.0;           // Seconds into the trial
+    PlaybackMode mode = PLAYBACK_MODE_GRANULAR;
+    int quality = 0;
+    bool half_rate_reverb = false;
+    bool post_oliverb = false;
+    uint8_t ignored_kinds = 0;
+};
+
+uint8_t Classify(const FloatFrame* block, size_t size) {
+    uint8_t kinds = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const float samples[2] = {block[i].l, block[i].r};
+        for (float sample : samples) {
+            switch (std::fpclassify(sample)) {
+                case FP_SUBNORMAL: kinds |= kKindDenormal; break;
+                case FP_NAN: kinds |= kKindNan; break;
+                case FP_INFINITE: kinds |= kKindInf; break;
+                default: break;
+            }
+        }
+    }
+    return kinds;
+}
+
+void PrintParameters(const Parameters& p) {
+    printf("  position %g size %g pitch %g density %g texture %g dry_wet %g stereo_spread %g"
+           " feedback %g reverb %g freeze %d\n",
+           p.position, p.size, p.pitch, p.density, p.texture, p.dry_wet, p.stereo_spread, p.feedback,
+           p.reverb, p.freeze ? 1 : 0);
+}
+
+void CheckStage(void* context, ProcessStage stage, const FloatFrame* block, size_t size,
+                const Parameters& parameters) {
+    Findings* findings = static_cast<Findings*>(context);
+    const uint8_t kinds = Classify(block, size) & ~findings->ignored_kinds;
+    if (!kinds) {
+        return;
+    }
+    for (int kind = 0; kind < kNumKinds; ++kind) {
+        findings->blocks[stage][kind] += (kinds >> kind) & 1;
+    }
+    if (findings->found && !findings->verbose) {
+        return;
+    }
+    printf("seed %u:%s%s%s in %s at %.3f s, %s, quality %d%s%s\n", findings->trial_seed,
+           kinds & kKindDenormal ? " denormal" : "", kinds & kKindNan ? " NaN" : "",
+           kinds & kKindInf ? " Inf" : "", kStageNames[stage], findings->now, kModeNames[findings->mode],
+           findings->quality, findings->half_rate_reverb ? ", half-rate reverb" : "",
+           findings->post_oliverb ? ", post oliverb" : "");
+    PrintParameters(parameters);
+    findings->found = true;
+}
+
+class Fuzzer {
+public:
+    explicit Fuzzer(uint32_t seed) : random_(seed), uniform_(0.0f, 1.0f) {}
+
+    float Uniform() { return uniform_(random_); }
+
+    // A value in [low, high]; one in four at either end
+    float Value(float low, float high) {
+        const float u = Uniform();
+        if (u < 0.125f) {
+            return low;
+        }
+        if (u < 0.25f) {
+            return high;
+        }
+        return low + (high - low) * Uniform();
+    }
+
+    int Integer(int count) { return static_cast<int>(random_() % static_cast<uint32_t>(count)); }
+
+    void RandomParameters(Parameters* p) {
+        p->position = Value(0.0f, 1.0f);
+        p->size = Value(0.0f, 1.0f);
+        p->pitch = Value(-48.0f, 48.0f);
+        p->density = Value(0.0f, 1.0f);
+        p->texture = Value(0.0f, 1.0f);
+        p->dry_wet = Value(0.0f, 1.0f);
+        p->stereo_spread = Value(0.0f, 1.0f);
+        p->feedback = Value(0.0f, 1.0f);
+        p->reverb = Value(0.0f, 1.0f);
+        p->freeze = Integer(4) == 0;
+        p->trigger = Integer(8) == 0;
+        p->gate = p->trigger;
+    }
+
+    float Sample(Stimulus stimulus, size_t frame, float sample_rate, double length) {
+        const double t = frame / static_cast<double>(sample_rate);
+        switch (stimulus) {
+            case STIMULUS_NOISE: return 2.0f * Uniform() - 1.0f;
+            case STIMULUS_SINE: return 0.8f * static_cast<float>(sin(2.0 * M_PI * 220.0 * t));
+            case STIMULUS_CLICKS: return frame % static_cast<size_t>(sample_rate / 4) == 0 ? 1.0f : 0.0f;
+            case STIMULUS_SQUARE: return fmod(t * 110.0, 1.0) < 0.5 ? 1.0f : -1.0f;
+            case STIMULUS_BURST: return t < length * 0.25 ? 2.0f * Uniform() - 1.0f : 0.0f;
+            default: return 0.0f;
+        }
+    }
+
+private:
+    std::mt19937 random_;
+    std::uniform_real_distribution<float> uniform_;
+};
+
+struct AlignedFree {
+    void operator()(uint8_t* p) const { free(p); }
+};
+
+typedef std::unique_ptr<uint8_t, AlignedFree> Arena;
+
+Arena AllocateArena(size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, size)) {
+        return Arena();
+    }
+    return Arena(static_cast<uint8_t*>(p));
+}
+
+struct Memory {
+    std::aligned_storage<sizeof(GranularProcessorClouds), alignof(GranularProcessorClouds)>::type processor;
+    Arena large_buffer = AllocateArena(kLargeBufferSize);
+    Arena small_buffer = AllocateArena(kSmallBufferSize);
+    Arena spectral_memory = AllocateArena(kSpectralMemorySize);
+};
+
+// As the quality governor's levels do
+void SetHalfRateReverb(GranularProcessorClouds* processor, bool half_rate) {
+    CpuBudget budget = processor->cpu_budget();
+    budget.half_rate_reverb = half_rate;
+    processor->set_cpu_budget(budget);
+}
+
+// Runs one trial; returns the recoveries the processor made
+uint32_t RunTrial(const Options& options, uint32_t seed, Memory* memory, Findings* findings) {
+    Fuzzer fuzzer(seed);
+    findings->trial_seed = seed;
+    findings->mode = static_cast<PlaybackMode>(fuzzer.Integer(PLAYBACK_MODE_LAST));
+    findings->quality = fuzzer.Integer(4);
+    findings->half_rate_reverb = fuzzer.Integer(2) != 0;
+    findings->post_oliverb = fuzzer.Integer(2) != 0;
+    const Stimulus stimulus = static_cast<Stimulus>(fuzzer.Integer(STIMULUS_LAST));
+
+    // A fresh processor, zeroed as in the firmware's .bss (see batch_render)
+    GranularProcessorClouds& processor = *new (&memory->processor) GranularProcessorClouds();
+    memset(static_cast<void*>(&processor), 0, sizeof(processor));
+    memset(memory->large_buffer.get(), 0, kLargeBufferSize);
+    memset(memory->small_buffer.get(), 0, kSmallBufferSize);
+    processor.Init(options.sample_rate, memory->large_buffer.get(), kLargeBufferSize,
+                   memory->small_buffer.get(), kSmallBufferSize);
+    processor.set_spectral_memory(memory->spectral_memory.get());
+    processor.set_playback_mode(findings->mode);
+    processor.set_quality(findings->quality);
+    SetHalfRateReverb(&processor, findings->half_rate_reverb);
+    processor.set_post_oliverb(findings->post_oliverb);
+    fuzzer.RandomParameters(processor.mutable_parameters());
+    processor.set_stage_check(CheckStage, findings);
+
+    const size_t blocks = static_cast<size_t>(options.seconds * options.sample_rate) / kBlockSize;
+    const float change_probability = options.changes / static_cast<float>(blocks ? blocks : 1);
+    FloatFrame in[kBlockSize] = {};
+    FloatFrame out[kBlockSize] = {};
+    for (size_t block = 0; block < blocks; ++block) {
+        if (fuzzer.Uniform() < change_probability) {
+            fuzzer.RandomParameters(processor.mutable_parameters());
+            if (fuzzer.Integer(4) == 0) {
+                findings->mode = static_cast<PlaybackMode>(fuzzer.Integer(PLAYBACK_MODE_LAST));
+                processor.set_playback_mode(findings->mode);
+            }
+            if (fuzzer.Integer(8) == 0) {
+                findings->quality = fuzzer.Integer(4);
+                processor.set_quality(findings->quality);
+                findings->half_rate_reverb = fuzzer.Integer(2) != 0;
+                SetHalfRateReverb(&processor, findings->half_rate_reverb);
+                findings->post_oliverb = fuzzer.Integer(2) != 0;
+                processor.set_post_oliverb(findings->post_oliverb);
+            }
+        }
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            const size_t frame = block * kBlockSize + i;
+            in[i].l = fuzzer.Sample(stimulus, frame, options.sample_rate, options.seconds);
+            in[i].r = stimulus == STIMULUS_NOISE ? fuzzer.Uniform() * 2.0f - 1.0f : in[i].l;
+        }
+        findings->now = block * kBlockSize / static_cast<double>(options.sample_rate);
+        processor.Prepare();
+        processor.Process(in, out, kBlockSize);
+        // Triggers last one block, as in the firmware
+        processor.mutable_parameters()->trigger = false;
+    }
+    const uint32_t recoveries = processor.num_recoveries();
+    if (recoveries) {
+        printf("seed %u: %u recoveries, last in %s (%s input)\n", seed, recoveries,
+               kStageNames[processor.last_recovered_stage()], kStimulusNames[stimulus]);
+    }
+    processor.~GranularProcessorClouds();
+    return recoveries;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:T:c:r:zv")) != -1) {
+        switch (opt) {
+            case 'n': options.trials = atoi(optarg); break;
+            case 's': options.seed = static_cast<uint32_t>(strtoul(optarg, nullptr, 0)); break;
+            case 'T': options.seconds = atof(optarg); break;
+            case 'c': options.changes = atoi(optarg); break;
+            case 'r': options.sample_rate = static_cast<float>(atof(optarg)); break;
+            case 'z': options.flush_to_zero = true; break;
+            case 'v': options.verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-n trials] [-s seed] [-T seconds] [-c changes] [-r rate] [-z] [-v]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if (options.flush_to_zero) {
+#if defined(__SSE__)
+        // FTZ and DAZ: the host's take on the Cortex-M7's FPSCR.FZ
+        _mm_setcsr(_mm_getcsr() | 0x8040);
+#else
+        fprintf(stderr, "-z: not supported on this host\n");
+        return 2;
+#endif
+    }
+
+    Memory memory;
+    if (!memory.large_buffer || !memory.small_buffer || !memory.spectral_memory) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    InitResources(options.sample_rate);
+
+    uint32_t totals[PROCESS_STAGE_LAST][kNumKinds] = {};
+    int faulty_trials = 0;
+    uint32_t recoveries = 0;
+    for (int trial = 0; trial < options.trials; ++trial) {
+        Findings findings;
+        findings.verbose = options.verbose;
+        findings.ignored_kinds = options.flush_to_zero ? kKindDenormal : 0;
+        recoveries += RunTrial(options, options.seed + trial, &memory, &findings);
+        faulty_trials += findings.found;
+        for (int stage = 0; stage < PROCESS_STAGE_LAST; ++stage) {
+            for (int kind = 0; kind < kNumKinds; ++kind) {
+                totals[stage][kind] += findings.blocks[stage][kind];
+            }
+        }
+    }
+
+    printf("\n%-14s %10s %10s %10s\n", "stage", kKindNames[0], kKindNames[1], kKindNames[2]);
+    bool non_finite = false;
+    for (int stage = 0; stage < PROCESS_STAGE_LAST; ++stage) {
+        printf("%-14s %10u %10u %10u\n", kStageNames[stage], totals[stage][0], totals[stage][1], totals[stage][2]);
+        non_finite |= totals[stage][1] || totals[stage][2];
+    }
+    printf("%d trials, %d with faulty blocks, %u recoveries\n", options.trials, faulty_trials, recoveries);
+    return non_finite ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+// Host check: grain onsets of GranularSamplePlayer (dsp/grain_seeder.h),
+// which jumps from one seed to the next, against the per-sample loop it
+// replaced, which drew a Bernoulli(p) variable and advanced the clock at
+// every sample.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -I$N -I$N/dsp"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   g++ -std=gnu++14 -O2 $INC tools/grain_onsets/grain_onsets.cpp -o grain_onsets
+//
+// Usage: grain_onsets [-n intervals] [-b block_size]
+//
+// Probabilistic seeding: both schedulers run at the same densities until
+// each has produced the requested number of inter-onset intervals, with
+// grains always available and the space between grains at 1 / p, as in
+// Play(). Their intervals are compared by mean, variance and histogram
+// (two-sample chi-square over bins of equal probability under the geometric
+// law). The geometric law's own mean and variance are shown for reference:
+// the clock, restarted by each seed, still fires within a block, which
+// shortens the intervals at high densities.
+// Deterministic seeding, with a trigger now and then: the onsets must be the
+// same sample for sample. The run fails if the intervals differ beyond
+// sampling noise or an onset moves.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "grain_seeder.h"
+#include "random.h"
+
+namespace {
+
+// Bins of the interval histograms
+constexpr int kNumBins = 16;
+// Two-sided z-score beyond which the means or variances differ
+constexpr double kMaxZ = 4.0;
+// Standard normal quantile for the chi-square test's false alarm rate, 1e-4
+constexpr double kChiSquareZ = 3.72;
+
+struct Options {
+    size_t intervals;
+    size_t block_size;
+};
+
+// The per-sample loop of GranularSamplePlayer::Play() before the seeder
+class ReferenceSeeder {
+public:
+    ReferenceSeeder() : phasor_(0.0f) {
+        random_.Seed(RandomSource::kDefaultSeed + 1);
+    }
+
+    // Appends the block's onsets, as absolute sample numbers
+    void Block(bool trigger, float p, float space, uint64_t start, size_t size, std::vector<uint64_t>* onsets) {
+        if (p >= 0.0f) {
+            phasor_ = -1000.0f;
+        }
+        for (size_t t = 0; t < size; ++t) {
+            phasor_ += 1.0f;
+            const bool probabilistic = kRandFrac * random_.Next() < p;
+            const bool deterministic = phasor_ >= space;
+            if (probabilistic || deterministic || trigger) {
+                onsets->push_back(start + t);
+                phasor_ = 0.0f;
+                trigger = false;
+            }
+        }
+    }
+
+private:
+    RandomSource random_;
+    float phasor_;
+};
+
+class PlayerSeeder {
+public:
+    PlayerSeeder() {
+        random_.Seed(RandomSource::kDefaultSeed);
+        seeder_.Init(&random_);
+    }
+
+    void Block(bool trigger, float p, float space, uint64_t start, size_t size, std::vector<uint64_t>* onsets) {
+        seeder_.Start(trigger, p, space, true);
+        for (size_t t = seeder_.Next(size); t < size; t = seeder_.Next(size)) {
+            onsets->push_back(start + t);
+        }
+        seeder_.End(size);
+    }
+
+private:
+    RandomSource random_;
+    GrainSeeder seeder_;
+};
+
+template <typename Seeder>
+std::vector<uint64_t> Intervals(float p, const Options& options) {
+    Seeder seeder;
+    std::vector<uint64_t> onsets;
+    onsets.reserve(options.intervals + options.block_size + 1);
+    uint64_t start = 0;
+    while (onsets.size() <= options.intervals) {
+        seeder.Block(false, p, 1.0f / p, start, options.block_size, &onsets);
+        start += options.block_size;
+    }
+    std::vector<uint64_t> intervals(options.intervals);
+    for (size_t i = 0; i < options.intervals; ++i) {
+        intervals[i] = onsets[i + 1] - onsets[i];
+    }
+    return intervals;
+}
+
+struct Moments {
+    double mean;
+    double variance;
+    double fourth;  // Fourth central moment, for the variance's error
+};
+
+Moments Measure(const std::vector<uint64_t>& intervals) {
+    const double n = static_cast<double>(intervals.size());
+    double sum = 0.0;
+    for (uint64_t interval : intervals) {
+        sum += static_cast<double>(interval);
+    }
+    Moments moments = {sum / n, 0.0, 0.0};
+    for (uint64_t interval : intervals) {
+        const double d = static_cast<double>(interval) - moments.mean;
+        moments.variance += d * d;
+        moments.fourth += d * d * d * d;
+    }
+    moments.variance /= n - 1.0;
+    moments.fourth /= n;
+    return moments;
+}
+
+// Upper edges of kNumBins bins of about equal probability for intervals of
+// law P(k) = p (1 - p)^(k - 1), merged where they coincide. The last bin is
+// open.
+std::vector<uint64_t> BinEdges(float p) {
+    std::vector<uint64_t> edges;
+    for (int i = 1; i < kNumBins; ++i) {
+        const double q = 1.0 - static_cast<double>(i) / kNumBins;
+        const uint64_t edge = static_cast<uint64_t>(ceil(log(q) / log1p(-static_cast<double>(p))));
+        if (edges.empty() || edge > edges.back()) {
+            edges.push_back(edge);
+        }
+    }
+    return edges;
+}
+
+std::vector<double> Histogram(const std::vector<uint64_t>& intervals, const std::vector<uint64_t>& edges) {
+    std::vector<double> counts(edges.size() + 1, 0.0);
+    for (uint64_t interval : intervals) {
+        const size_t bin = std::lower_bound(edges.begin(), edges.end(), interval) - edges.begin();
+        counts[bin] += 1.0;
+    }
+    return counts;
+}
+
+// Two-sample chi-square of two histograms with the same total
+double ChiSquare(const std::vector<double>& a, const std::vector<double>& b) {
+    double chi_square = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i] + b[i] > 0.0) {
+            chi_square += (a[i] - b[i]) * (a[i] - b[i]) / (a[i] + b[i]);
+        }
+    }
+    return chi_square;
+}
+
+// Wilson-Hilferty approximation of the chi-square quantile
+double ChiSquareLimit(double dof) {
+    const double k = 2.0 / (9.0 * dof);
+    const double c = 1.0 - k + kChiSquareZ * sqrt(k);
+    return dof * c * c * c;
+}
+
+bool CheckProbabilistic(float p, const Options& options) {
+    const std::vector<uint64_t> reference = Intervals<ReferenceSeeder>(p, options);
+    const std::vector<uint64_t> player = Intervals<PlayerSeeder>(p, options);
+    const Moments r = Measure(reference);
+    const Moments s = Measure(player);
+
+    const double n = static_cast<double>(options.intervals);
+    const double mean_z = (s.mean - r.mean) / sqrt((r.variance + s.variance) / n);
+    // The variance's standard error is about sqrt((m4 - var^2) / n)
+    const double variance_z = (s.variance - r.variance) /
+                              sqrt((r.fourth - r.variance * r.variance + s.fourth - s.variance * s.variance) / n);
+    const std::vector<uint64_t> edges = BinEdges(p);
+    const double chi_square = ChiSquare(Histogram(reference, edges), Histogram(player, edges));
+    const double dof = static_cast<double>(edges.size());
+    const double limit = ChiSquareLimit(dof);
+    const bool pass = fabs(mean_z) < kMaxZ && fabs(variance_z) < kMaxZ && chi_square < limit;
+
+    const double q = 1.0 - static_cast<double>(p);
+    printf("  p %-7g law %9.2f %11.1f  per-sample %9.2f %11.1f  seeder %9.2f %11.1f"
+           "  z %+5.2f %+5.2f  chi2 %5.1f/%4.1f  %s\n",
+           p, 1.0 / p, q / (static_cast<double>(p) * p), r.mean, r.variance, s.mean, s.variance, mean_z,
+           variance_z, chi_square, limit, pass ? "ok" : "FAIL");
+    return pass;
+}
+
+struct Deterministic {
+    float space;
+    // Blocks between triggers, 0 for none
+    size_t trigger_period;
+};
+
+const Deterministic kDeterministic[] = {
+    {1.0f, 0}, {7.5f, 0}, {31.0f, 0}, {32.0f, 0}, {100.3f, 5}, {1000.0f, 0}, {1000.0f, 17}, {5461.3f, 3},
+};
+
+bool CheckDeterministic(const Deterministic& scenario, const Options& options) {
+    ReferenceSeeder reference_seeder;
+    PlayerSeeder player_seeder;
+    std::vector<uint64_t> reference, player;
+    const size_t num_blocks = std::max<size_t>(1, options.intervals / options.block_size);
+    for (size_t block = 0; block < num_blocks; ++block) {
+        const bool trigger = scenario.trigger_period && block % scenario.trigger_period == 0;
+        const uint64_t start = block * options.block_size;
+        reference_seeder.Block(trigger, -1.0f, scenario.space, start, options.block_size, &reference);
+        player_seeder.Block(trigger, -1.0f, scenario.space, start, options.block_size, &player);
+    }
+    const bool pass = reference == player;
+    printf("  space %-7g trigger every %2zu blocks  %zu onsets  %s\n", scenario.space, scenario.trigger_period,
+           reference.size(), pass ? "same" : "DIFFERENT");
+    return pass;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    options.intervals = 200000;
+    options.block_size = 32;
+    int option;
+    while ((option = getopt(argc, argv, "n:b:")) != -1) {
+        switch (option) {
+            case 'n': options.intervals = static_cast<size_t>(atol(optarg)); break;
+            case 'b': options.block_size = static_cast<size_t>(atol(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-n intervals] [-b block_size]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (options.intervals < 1000 || options.block_size == 0) {
+        fprintf(stderr, "invalid number of intervals or block size\n");
+        return 1;
+    }
+
+    // From a few grains of the largest size to the smallest grains at full
+    // overlap (p = target_num_grains / grain_size_hint in Play())
+    const float kDensities[] = {0.0002f, 0.001f, 0.005f, 0.02f, 0.1f, 0.3f, 0.7f};
+    bool pass = true;
+    printf("Probabilistic seeding, %zu intervals, %zu-sample blocks (mean, variance in samples)\n",
+           options.intervals, options.block_size);
+    for (float p : kDensities) {
+        pass = CheckProbabilistic(p, options) && pass;
+    }
+    printf("Deterministic seeding\n");
+    for (const Deterministic& scenario : kDeterministic) {
+        pass = CheckDeterministic(scenario, options) && pass;
+    }
+    return pass ? 0 : 1;
+}
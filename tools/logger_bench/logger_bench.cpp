@@ -0,0 +1,168 @@
+// Host benchmark: caller-side cost of daisy::Logger (format now) against
+// daisy::AsyncLogger (queue now, format in Drain()).
+//
+// Build from the repository root:
+//   L=lib/libdaisy
+//   INC="-I$L/src -I$L/src/sys -I$L/core -I$L/Drivers/CMSIS_5/CMSIS/Core/Include"
+//   INC="$INC -I$L/Drivers/CMSIS-Device/ST/STM32H7xx/Include -I$L/Drivers/STM32H7xx_HAL_Driver/Inc"
+//   g++ -std=gnu++14 -O2 -fpermissive -w -DSTM32H750xx $INC tools/logger_bench/logger_bench.cpp -o logger_bench
+//
+// The synchronous path is Logger::PrintLineV() without the USB transfer
+// (vsnprintf into its 128-byte buffer plus the newline handling); the
+// transfer only adds to it on the device. Drain() runs with stdout sent to
+// /dev/null, so its figure includes a write() per batch. The HAL headers
+// are pulled in by logger_impl.h and need -fpermissive on a 64-bit host.
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "hid/logger.h"
+
+using namespace daisy;
+
+namespace {
+
+constexpr size_t kCapacity = 1024;
+constexpr int kRounds = 1000;
+
+using Async = AsyncLogger<LOGGER_SEMIHOST, kCapacity>;
+
+char g_sync_buffer[LOGGER_BUFFER];
+volatile size_t g_sink;
+
+// Logger<dest>::PrintLineV() minus TransmitBuf()
+void SyncPrintLine(const char* format, ...) {
+    va_list va;
+    va_start(va, format);
+    size_t length = vsnprintf(g_sync_buffer, sizeof(g_sync_buffer), format, va);
+    va_end(va);
+    if (length > sizeof(g_sync_buffer) - 3) {
+        length = sizeof(g_sync_buffer) - 3;
+    }
+    while (length > 0 && (g_sync_buffer[length - 1] == '\n' || g_sync_buffer[length - 1] == '\r')) {
+        length--;
+    }
+    g_sync_buffer[length++] = '\r';
+    g_sync_buffer[length++] = '\n';
+    g_sink = length;
+}
+
+// The messages a firmware typically logs: integers, a pointer, a string
+// and a float
+void LogSync(int i) {
+    SyncPrintLine("cpu : %d/%d Q:%d", i & 127, (i * 3) & 127, i & 3);
+    SyncPrintLine("late block %u, load %d%%", static_cast<unsigned>(i), 100 + (i & 15));
+    SyncPrintLine("[%s] pad %2d -> led %2d", "touch", i % 12, (i * 7) % 12);
+    SyncPrintLine("dma %p len %lu", static_cast<void*>(g_sync_buffer), static_cast<unsigned long>(i));
+    SyncPrintLine("pressure %.3f", i * 0.001);
+}
+
+void LogAsync(int i) {
+    Async::PrintLine("cpu : %d/%d Q:%d", i & 127, (i * 3) & 127, i & 3);
+    Async::PrintLine("late block %u, load %d%%", static_cast<unsigned>(i), 100 + (i & 15));
+    Async::PrintLine("[%s] pad %2d -> led %2d", "touch", i % 12, (i * 7) % 12);
+    Async::PrintLine("dma %p len %lu", static_cast<void*>(g_sync_buffer), static_cast<unsigned long>(i));
+    Async::PrintLine("pressure %.3f", i * 0.001);
+}
+constexpr int kMessagesPerCall = 5;
+
+double NsPerMessage(std::chrono::steady_clock::duration elapsed, long messages) {
+    return std::chrono::duration<double, std::nano>(elapsed).count() / messages;
+}
+
+// Deferred formatting must match printf's
+bool CheckFormat() {
+    struct Case {
+        const char* format;
+        uint64_t args[4];
+        size_t num_args;
+        const char* expected;
+    };
+    double pi = 3.14159;
+    uint64_t pi_word;
+    memcpy(&pi_word, &pi, sizeof(pi_word));
+    const Case cases[] = {
+        {"%d %i %u", {static_cast<uint64_t>(-5), 7, 42}, 3, "-5 7 42"},
+        {"%08x|%-4d|%+d", {0xBEEF, 12, 3}, 3, "0000beef|12  |+3"},
+        {"%*d|%.*f", {5, static_cast<uint64_t>(-2), 2, pi_word}, 4, "   -2|3.14"},
+        {"%-*d|%.*f", {4, 7, static_cast<uint64_t>(-1), pi_word}, 4, "7   |3.141590"},
+        {"%hhd %hu %lld", {0x1FF, 0x12345, static_cast<uint64_t>(-1)}, 3, "-1 9029 -1"},
+        {"%s=%c 100%%", {reinterpret_cast<uintptr_t>("key"), 'v'}, 2, "key=v 100%"},
+        {"%.2e", {pi_word}, 1, "3.14e+00"},
+    };
+    bool ok = true;
+    for (const Case& c : cases) {
+        char out[64];
+        size_t length = Async::Format(out, sizeof(out), c.format, c.args, c.num_args);
+        if (strcmp(out, c.expected) != 0 || length != strlen(c.expected)) {
+            fprintf(stderr, "format mismatch: \"%s\" -> \"%s\" (expected \"%s\")\n", c.format, out, c.expected);
+            ok = false;
+        }
+    }
+    // Truncation follows snprintf
+    char small[8];
+    const uint64_t value = 123456789;
+    if (Async::Format(small, sizeof(small), "n=%d", &value, 1) != 11 || strcmp(small, "n=12345") != 0) {
+        fprintf(stderr, "truncation mismatch: \"%s\"\n", small);
+        ok = false;
+    }
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    if (!CheckFormat()) {
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const long messages = static_cast<long>(kRounds) * (kCapacity / kMessagesPerCall) * kMessagesPerCall;
+
+    Clock::duration sync_time{};
+    Clock::duration enqueue_time{};
+    Clock::duration drain_time{};
+
+    // Drain() writes to stdout: keep it out of the terminal
+    fflush(stdout);
+    const int saved_stdout = dup(STDOUT_FILENO);
+    const int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+
+    for (int round = 0; round < kRounds; ++round) {
+        const int calls = kCapacity / kMessagesPerCall;
+
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < calls; ++i) {
+            LogSync(round * calls + i);
+        }
+        sync_time += Clock::now() - start;
+
+        start = Clock::now();
+        for (int i = 0; i < calls; ++i) {
+            LogAsync(round * calls + i);
+        }
+        enqueue_time += Clock::now() - start;
+
+        start = Clock::now();
+        while (Async::Drain() > 0) {
+        }
+        // Flush the last batch
+        Async::Drain();
+        drain_time += Clock::now() - start;
+    }
+
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(null_fd);
+    close(saved_stdout);
+
+    printf("%ld messages\n", messages);
+    printf("Logger (vsnprintf on the caller)  %8.1f ns/message\n", NsPerMessage(sync_time, messages));
+    printf("AsyncLogger Print (caller)        %8.1f ns/message\n", NsPerMessage(enqueue_time, messages));
+    printf("AsyncLogger Drain (idle time)     %8.1f ns/message\n", NsPerMessage(drain_time, messages));
+    printf("dropped %u, truncated %u\n", Async::GetDroppedCount(), Async::GetTruncatedCount());
+    return 0;
+}
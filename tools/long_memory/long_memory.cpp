@@ -0,0 +1,198 @@
+// Host check: the looping delay of the Clouds processor (eurorack/Nimbus_SM)
+// in long-memory mode, where reads go through the staging cache
+// (dsp/sample_stager.h), against the same delay on the normal recording
+// buffers, read directly.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -Ieurorack -I$N -I$N/dsp -I$N/dsp/fx -I$N/dsp/pvoc"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   SRC="$N/resources.cpp $N/dsp/*.cpp $N/dsp/pvoc/*.cpp lib/DaisySP/Source/Filters/svf.cpp"
+//   g++ -std=gnu++14 -O2 $INC tools/long_memory/long_memory.cpp $SRC -o long_memory
+//
+// Usage: long_memory [-T seconds] [-r sample_rate]
+//
+// With the position at 0 the delay is the same few samples whatever the
+// buffer size, so both processors must put out the same signal: the taps
+// read samples recorded during the block itself, which the staged copy,
+// made at the end of the previous block, does not hold. Each quality is run
+// on noise and on a sine, fully wet, with no feedback nor reverb. The run
+// fails if the outputs differ by more than kMaxDifference of their level.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <unistd.h>
+#include "granular_processor.h"
+#include "resources.h"
+
+namespace {
+
+// The firmware's Clouds buffers (AudioEngine::CLOUD_BUFFER_SIZE and
+// CLOUD_BUFFER_CCM_SIZE)
+constexpr size_t kLargeBufferSize = 356352;
+constexpr size_t kSmallBufferSize = 196224;
+// Long enough to be well beyond the normal buffers, short of the firmware's
+// LONG_MEMORY_SIZE to keep the run quick
+constexpr size_t kLongBufferSize = 4u * 1024u * 1024u;
+
+constexpr size_t kBlockSize = kMaxBlockSize;
+
+// Largest difference RMS, relative to the normal output's RMS
+constexpr double kMaxDifference = 1e-4;
+
+struct Options {
+    double seconds = 4.0;
+    float sample_rate = 32000.0f;
+};
+
+struct AlignedFree {
+    void operator()(uint8_t* p) const { free(p); }
+};
+
+typedef std::unique_ptr<uint8_t, AlignedFree> Arena;
+
+Arena AllocateArena(size_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, size)) {
+        return Arena();
+    }
+    memset(p, 0, size);
+    return Arena(static_cast<uint8_t*>(p));
+}
+
+// One processor with its own buffers, in the looping delay at position 0
+struct Looper {
+    std::aligned_storage<sizeof(GranularProcessorClouds), alignof(GranularProcessorClouds)>::type storage;
+    Arena large_buffer = AllocateArena(kLargeBufferSize);
+    Arena small_buffer = AllocateArena(kSmallBufferSize);
+    Arena long_buffer;
+    Arena staging_memory;
+    GranularProcessorClouds* processor = nullptr;
+
+    Looper(const Options& options, int quality, bool long_memory) {
+        // Zeroed as in the firmware's .bss (see batch_render)
+        processor = new (&storage) GranularProcessorClouds();
+        memset(static_cast<void*>(processor), 0, sizeof(*processor));
+        processor->Init(options.sample_rate, large_buffer.get(), kLargeBufferSize, small_buffer.get(),
+                        kSmallBufferSize);
+        if (long_memory) {
+            long_buffer = AllocateArena(kLongBufferSize);
+            staging_memory = AllocateArena(kStagingMemorySize);
+            processor->set_long_memory(long_buffer.get(), kLongBufferSize, staging_memory.get());
+        }
+        processor->set_playback_mode(PLAYBACK_MODE_LOOPING_DELAY);
+        processor->set_quality(quality);
+
+        Parameters* p = processor->mutable_parameters();
+        p->position = 0.0f;
+        p->size = 0.5f;
+        p->pitch = 0.0f;
+        p->density = 0.5f;
+        p->texture = 0.5f;
+        p->dry_wet = 1.0f;
+        p->stereo_spread = 0.0f;
+        p->feedback = 0.0f;
+        p->reverb = 0.0f;
+        p->freeze = false;
+    }
+
+    void Process(FloatFrame* in, FloatFrame* out) {
+        processor->Prepare();
+        processor->Process(in, out, kBlockSize);
+    }
+};
+
+enum Stimulus {
+    STIMULUS_NOISE,
+    STIMULUS_SINE,
+    STIMULUS_LAST
+};
+
+const char* const kStimulusNames[STIMULUS_LAST] = {"noise", "sine"};
+const char* const kQualityNames[] = {"stereo", "mono", "stereo lo-fi", "mono lo-fi"};
+
+bool Check(int quality, Stimulus stimulus, const Options& options) {
+    Looper normal(options, quality, false);
+    Looper staged(options, quality, true);
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+    const size_t blocks = static_cast<size_t>(options.seconds * options.sample_rate) / kBlockSize;
+    FloatFrame in[kBlockSize];
+    FloatFrame out_normal[kBlockSize];
+    FloatFrame out_staged[kBlockSize];
+    double normal_power = 0.0, staged_power = 0.0, difference_power = 0.0;
+    for (size_t block = 0; block < blocks; ++block) {
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            const double t = static_cast<double>(block * kBlockSize + i) / options.sample_rate;
+            const float l = stimulus == STIMULUS_NOISE ? uniform(random) : 0.5f * sin(2.0 * M_PI * 440.0 * t);
+            const float r = stimulus == STIMULUS_NOISE ? uniform(random) : 0.5f * sin(2.0 * M_PI * 660.0 * t);
+            in[i].l = l;
+            in[i].r = r;
+        }
+        // Process may write to its input
+        FloatFrame in_staged[kBlockSize];
+        memcpy(in_staged, in, sizeof(in));
+        normal.Process(in, out_normal);
+        staged.Process(in_staged, out_staged);
+        for (size_t i = 0; i < kBlockSize; ++i) {
+            const double a[2] = {out_normal[i].l, out_normal[i].r};
+            const double b[2] = {out_staged[i].l, out_staged[i].r};
+            for (int c = 0; c < 2; ++c) {
+                normal_power += a[c] * a[c];
+                staged_power += b[c] * b[c];
+                difference_power += (a[c] - b[c]) * (a[c] - b[c]);
+            }
+        }
+    }
+
+    const double n = 2.0 * static_cast<double>(blocks * kBlockSize);
+    const double normal_rms = sqrt(normal_power / n);
+    const double staged_rms = sqrt(staged_power / n);
+    const double difference_rms = sqrt(difference_power / n);
+    const bool pass = normal_rms > 0.0 && difference_rms <= kMaxDifference * normal_rms;
+    printf("  %-12s %-5s  normal %.4f  long %.4f  difference %.6f  %s\n", kQualityNames[quality],
+           kStimulusNames[stimulus], normal_rms, staged_rms, difference_rms, pass ? "ok" : "FAIL");
+    return pass;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    int option;
+    while ((option = getopt(argc, argv, "T:r:")) != -1) {
+        switch (option) {
+            case 'T': options.seconds = atof(optarg); break;
+            case 'r': options.sample_rate = static_cast<float>(atof(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-T seconds] [-r sample_rate]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (options.seconds <= 0.0 || options.sample_rate < 8000.0f) {
+        fprintf(stderr, "invalid length or sample rate\n");
+        return 1;
+    }
+
+    InitResources(options.sample_rate);
+
+    // Long memory records 16-bit whatever the quality: only the qualities
+    // the normal buffers also record 16-bit compare
+    const int kQualities[] = {0, 1};
+    bool pass = true;
+    printf("Looping delay at position 0, long memory against normal, %g s at %g Hz (RMS)\n", options.seconds,
+           options.sample_rate);
+    for (int quality : kQualities) {
+        for (int stimulus = 0; stimulus < STIMULUS_LAST; ++stimulus) {
+            pass = Check(quality, static_cast<Stimulus>(stimulus), options) && pass;
+        }
+    }
+    return pass ? 0 : 1;
+}
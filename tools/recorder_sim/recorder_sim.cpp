@@ -0,0 +1,294 @@
+// Host simulation of the WAV recorder: runs WavRecorder (src/system) against
+// a plain file standing in for the SD card, with the audio callback and the
+// main loop interleaved on a virtual clock.
+//
+// Build from the repository root:
+//   g++ -std=gnu++14 -O2 -Isrc/system tools/recorder_sim/recorder_sim.cpp src/system/WavRecorder.cpp -o recorder_sim
+//
+// Usage: recorder_sim [options] out.wav
+//   -s <seconds>     recording length (default 20)
+//   -r <rate>        sample rate (default 48000)
+//   -b <16|24>       bits per sample (default 16)
+//   -c <channels>    channels (default 6)
+//   -k <kB>          ring size, a power of two (default 8192)
+//   -w <kB/s>        card write speed (default 4000)
+//   -l <us>          card latency per write (default 800)
+//   -p <ms>          stall length, as when the card erases (default 250)
+//   -e <writes>      stall every n writes, 0 for never (default 64)
+//
+// A write completes after latency + size / speed, plus a stall every n-th
+// write. Each frame carries its own index in channels 0 and 1 and a pattern
+// derived from it in the others, so the checker finds dropped blocks, torn
+// writes and misplaced data. Exits 1 when the file does not verify.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "WavRecorder.h"
+
+namespace {
+
+constexpr size_t kBlockSize = 32;        // Frames per audio callback, as on the device
+constexpr uint32_t kMainLoopUs = 1000;   // Recorder task period
+
+uint32_t g_now_us = 0;
+
+uint32_t NowUs() {
+    return g_now_us;
+}
+
+struct FileSink {
+    int fd = -1;
+    uint32_t speed_kbps = 4000;
+    uint32_t latency_us = 800;
+    uint32_t stall_us = 250000;
+    uint32_t stall_every = 64;
+    uint32_t writes = 0;
+    uint32_t done_us = 0;
+    bool busy = false;
+
+    static bool Open(void* context, const char* name, uint32_t capacity) {
+        FileSink* self = static_cast<FileSink*>(context);
+        self->fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        return self->fd >= 0 && ftruncate(self->fd, capacity) == 0;
+    }
+
+    static bool Write(void* context, uint32_t offset, const uint8_t* data, uint32_t size) {
+        FileSink* self = static_cast<FileSink*>(context);
+        if (self->busy || offset % WavRecorder::kSectorSize || size % WavRecorder::kSectorSize) {
+            return false;
+        }
+        if (pwrite(self->fd, data, size, offset) != static_cast<ssize_t>(size)) {
+            return false;
+        }
+        uint32_t duration = self->latency_us + static_cast<uint32_t>(uint64_t(size) * 1000 / self->speed_kbps);
+        if (self->stall_every && ++self->writes % self->stall_every == 0) {
+            duration += self->stall_us;
+        }
+        self->done_us = g_now_us + duration;
+        self->busy = true;
+        return true;
+    }
+
+    static RecorderSink::Status Status(void* context) {
+        FileSink* self = static_cast<FileSink*>(context);
+        if (self->busy && static_cast<int32_t>(g_now_us - self->done_us) < 0) {
+            return RecorderSink::Status::BUSY;
+        }
+        self->busy = false;
+        return RecorderSink::Status::IDLE;
+    }
+
+    static bool Close(void* context, uint32_t size) {
+        FileSink* self = static_cast<FileSink*>(context);
+        const bool ok = ftruncate(self->fd, size) == 0;
+        return close(self->fd) == 0 && ok;
+    }
+
+    RecorderSink GetSink() {
+        RecorderSink sink;
+        sink.open = Open;
+        sink.write = Write;
+        sink.status = Status;
+        sink.close = Close;
+        sink.context = this;
+        return sink;
+    }
+};
+
+// Exactly representable in 16 bits after the recorder's conversion
+float Sample(uint32_t frame, int channel) {
+    int32_t value;
+    if (channel == 0) {
+        value = frame & 0x7FFF;
+    } else if (channel == 1) {
+        value = (frame >> 15) & 0x7FFF;
+    } else {
+        value = static_cast<int32_t>((frame * 2654435761u + channel * 40503u) >> 17) - 32768;
+        value = std::max(value, -32767);
+    }
+    return static_cast<float>(value) / 32767.0f;
+}
+
+int32_t Expected(float sample, int bits) {
+    const float full_scale = bits == 16 ? 32767.0f : 8388607.0f;
+    return static_cast<int32_t>(std::min(std::max(sample, -1.0f), 1.0f) * full_scale);
+}
+
+uint32_t Get32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint16_t Get16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+int32_t GetSample(const uint8_t* p, int bits) {
+    if (bits == 16) {
+        return static_cast<int16_t>(Get16(p));
+    }
+    const int32_t value = p[0] | p[1] << 8 | p[2] << 16;
+    return value & 0x800000 ? value - 0x1000000 : value;
+}
+
+// Checks the header against what was recorded and every frame against the
+// pattern; frames may only be missing in whole blocks
+bool Verify(const char* path, int channels, int bits, uint32_t rate, uint32_t frames, uint32_t dropped) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("cannot read %s\n", path);
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    const uint32_t frame_bytes = channels * bits / 8;
+    const uint32_t data_size = frames * frame_bytes;
+    const uint8_t* h = data.data();
+    const uint32_t header_size = WavRecorder::kSectorSize;
+    bool ok = data.size() >= header_size && !memcmp(h, "RIFF", 4) && !memcmp(h + 8, "WAVE", 4)
+              && !memcmp(h + 12, "fmt ", 4) && Get16(h + 20) == 1 && Get16(h + 22) == channels
+              && Get32(h + 24) == rate && Get32(h + 28) == rate * frame_bytes && Get16(h + 32) == frame_bytes
+              && Get16(h + 34) == bits && !memcmp(h + header_size - 8, "data", 4)
+              && Get32(h + header_size - 4) == data_size
+              && Get32(h + 4) == header_size - 8 + ((data_size + 1) & ~1u)
+              && data.size() == header_size + data_size + (data_size & 1);
+    if (!ok) {
+        printf("header mismatch (file %zu bytes, %u frames expected)\n", data.size(), frames);
+        return false;
+    }
+
+    uint32_t expected_frame = 0;
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < frames; ++i) {
+        const uint8_t* frame = h + header_size + i * frame_bytes;
+        const int sample_bytes = bits / 8;
+        const float scale = bits == 16 ? 1.0f : 256.0f;
+        const uint32_t index = static_cast<uint32_t>(GetSample(frame, bits) / scale)
+                               | static_cast<uint32_t>(GetSample(frame + sample_bytes, bits) / scale) << 15;
+        if (index != expected_frame) {
+            if (index < expected_frame || (index - expected_frame) % kBlockSize) {
+                printf("frame %u: index %u, expected %u\n", i, index, expected_frame);
+                return false;
+            }
+            missing += index - expected_frame;
+        }
+        for (int c = 0; c < channels; ++c) {
+            if (GetSample(frame + c * sample_bytes, bits) != Expected(Sample(index, c), bits)) {
+                printf("frame %u channel %d: wrong sample\n", i, c);
+                return false;
+            }
+        }
+        expected_frame = index + 1;
+    }
+    if (missing != dropped) {
+        printf("%u frames missing, the recorder counted %u\n", missing, dropped);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    float seconds = 20.0f;
+    uint32_t rate = 48000;
+    int bits = 16;
+    int channels = 6;
+    uint32_t ring_kb = 8192;
+    FileSink sink;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:b:c:k:w:l:p:e:")) != -1) {
+        switch (opt) {
+            case 's': seconds = static_cast<float>(atof(optarg)); break;
+            case 'r': rate = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'b': bits = atoi(optarg); break;
+            case 'c': channels = atoi(optarg); break;
+            case 'k': ring_kb = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'w': sink.speed_kbps = static_cast<uint32_t>(std::max(atoi(optarg), 1)); break;
+            case 'l': sink.latency_us = static_cast<uint32_t>(atoi(optarg)); break;
+            case 'p': sink.stall_us = static_cast<uint32_t>(atoi(optarg)) * 1000; break;
+            case 'e': sink.stall_every = static_cast<uint32_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-s sec] [-r rate] [-b bits] [-c channels] [-k ring_kb] "
+                                "[-w kB/s] [-l us] [-p stall_ms] [-e every] out.wav\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc || channels < 2) {
+        fprintf(stderr, "usage: %s [options] out.wav (at least 2 channels)\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[optind];
+
+    std::vector<uint8_t> ring(ring_kb * 1024);
+    WavRecorder recorder;
+    WavRecorder::Config config;
+    config.Defaults();
+    config.ring = ring.data();
+    config.ring_size = static_cast<uint32_t>(ring.size());
+    config.num_channels = channels;
+    config.bits = bits;
+    config.now_us = NowUs;
+    if (!recorder.Init(config, sink.GetSink())) {
+        fprintf(stderr, "unusable recorder configuration\n");
+        return 2;
+    }
+    if (!recorder.Start(path, static_cast<float>(rate))) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    // Audio blocks and main-loop passes in time order
+    const uint64_t total_blocks = static_cast<uint64_t>(seconds * rate) / kBlockSize;
+    std::vector<float> block(kBlockSize * channels);
+    uint64_t blocks = 0;
+    uint32_t frame = 0;
+    uint64_t next_main_us = 0;
+    while (recorder.GetState() != WavRecorder::State::IDLE) {
+        const uint64_t next_audio_us = blocks < total_blocks ? (blocks * kBlockSize * 1000000) / rate : UINT64_MAX;
+        if (next_audio_us <= next_main_us) {
+            g_now_us = static_cast<uint32_t>(next_audio_us);
+            for (size_t i = 0; i < kBlockSize; ++i) {
+                for (int c = 0; c < channels; ++c) {
+                    block[i * channels + c] = Sample(frame, c);
+                }
+                ++frame;
+            }
+            recorder.Push(block.data(), kBlockSize);
+            if (++blocks == total_blocks) {
+                recorder.Stop();
+            }
+        } else {
+            g_now_us = static_cast<uint32_t>(next_main_us);
+            recorder.Process();
+            next_main_us += kMainLoopUs;
+        }
+    }
+
+    const WavRecorder::Stats stats = recorder.GetStats();
+    const uint32_t recorded = recorder.GetFramesRecorded();
+    const bool saved = recorder.GetLastResult() == WavRecorder::Result::SAVED;
+    printf("%s: %u frames of %d x %d bit at %u Hz, %s\n", path, recorded, channels, bits, rate,
+           saved ? "saved" : "failed");
+    printf("ring      %u kB, high water %u kB (%.1f%%)\n", ring_kb, stats.high_water / 1024,
+           100.0 * stats.high_water / ring.size());
+    printf("dropped   %u frames\n", stats.dropped_frames);
+    printf("writes    %u, %u kB, latency avg %.0f us max %u us\n", stats.writes, stats.bytes_written / 1024,
+           stats.writes ? static_cast<double>(stats.total_write_us) / stats.writes : 0.0, stats.max_write_us);
+
+    // The recorded frames are the pushed ones minus the dropped blocks
+    const bool verified = saved && Verify(path, channels, bits, rate, recorded, stats.dropped_frames);
+    printf("verify    %s\n", verified ? "ok" : "FAILED");
+    return verified ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+// Host benchmark: cost of Clouds' resonestor mode
+// (eurorack/Nimbus_SM/dsp/resonestor.h) at 32 and 48 kHz, from all chords
+// decayed to all of them ringing, and with the chords the quality governor
+// leaves at each level (CpuBudget::resonator_chords).
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -I$N -I$N/dsp -I$N/dsp/fx"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   g++ -std=gnu++14 -O2 $INC tools/resonestor_bench/resonestor_bench.cpp $N/resources.cpp -o resonestor_bench
+//
+// Usage: resonestor_bench [-t seconds] [-x factor]
+//
+// The resonators run in 32-frame blocks with the processor's knob mapping
+// at its defaults, and the decay set to self-oscillation so that a struck
+// chord never dies out: the worst case. Times are the best of 5 runs, in ns
+// per stereo frame. With -x, the core's slowdown against the host, they are
+// also given as a share of the core's real time, and the run fails if all
+// chords ringing would take more than kBudget of it at either rate.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "frame.h"
+#include "resonestor.h"
+
+namespace {
+
+constexpr size_t kBlockSize = kMaxBlockSize;
+constexpr int kRuns = 5;
+
+// Share of the core the resonators may take with every chord ringing,
+// leaving the rest for the callback, the controls and the main loop.
+constexpr double kBudget = 0.25;
+
+struct Options {
+    float seconds;
+    double factor;
+};
+
+struct Scenario {
+    const char* name;
+    // Seconds between strikes, 0 for none
+    float strike_period;
+    bool input;
+    int32_t max_chords;
+};
+
+const Scenario kScenarios[] = {
+    {"idle", 0.0f, false, kNumResonestorChords},
+    {"input only", 0.0f, true, kNumResonestorChords},
+    {"1 chord", 1000.0f, false, kNumResonestorChords},
+    {"4 chords", 0.25f, true, kNumResonestorChords},
+    {"4 chords, 3 kept", 0.25f, true, 3},
+    {"4 chords, 2 kept", 0.25f, true, 2},
+};
+
+uint32_t g_seed = 0x12345678;
+
+float Noise() {
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return static_cast<float>(g_seed) * (2.0f / 4294967296.0f) - 1.0f;
+}
+
+// GranularProcessorClouds::ProcessGranular()'s mapping of the default
+// knobs, with DENSITY all the way up
+void Configure(Resonestor* resonestor) {
+    resonestor->set_pitch(0.0f);
+    resonestor->set_chord(0.5f);
+    resonestor->set_burst_damp(0.5f);
+    resonestor->set_burst_comb(0.5f);
+    resonestor->set_burst_duration(0.5f);
+    resonestor->set_spread_amount(0.5f);
+    resonestor->set_stereo(0.0f);
+    resonestor->set_separation(0.0f);
+    resonestor->set_harmonicity(0.75f);
+    resonestor->set_distortion(0.0f);
+    resonestor->set_narrow(0.001f);
+    resonestor->set_damp(1.0f);
+    resonestor->set_feedback(20.0f);
+}
+
+struct Result {
+    double ns;
+    float chords;
+};
+
+Result Run(const Options& options, float sample_rate, const Scenario& scenario) {
+    using Clock = std::chrono::steady_clock;
+    const size_t num_blocks = static_cast<size_t>(sample_rate * options.seconds) / kBlockSize;
+    const size_t strike_blocks =
+        scenario.strike_period > 0.0f ? static_cast<size_t>(sample_rate * scenario.strike_period) / kBlockSize : 0;
+    std::vector<FloatFrame> input(kBlockSize * 64);
+    for (FloatFrame& frame : input) {
+        frame.l = scenario.input ? Noise() * 0.5f : 0.0f;
+        frame.r = scenario.input ? Noise() * 0.5f : 0.0f;
+    }
+
+    std::vector<float> memory(kResonestorMemorySize / sizeof(float));
+    Result best = {0.0, 0.0f};
+    for (int run = 0; run < kRuns; ++run) {
+        Resonestor resonestor;
+        resonestor.Init(memory.data(), sample_rate);
+        Configure(&resonestor);
+        resonestor.set_max_chords(scenario.max_chords);
+        FloatFrame block[kBlockSize];
+        float sink = 0.0f;
+        size_t chords = 0;
+        const Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < num_blocks; ++i) {
+            const size_t offset = (i % 64) * kBlockSize;
+            std::copy(&input[offset], &input[offset + kBlockSize], block);
+            resonestor.set_trigger(strike_blocks && i % strike_blocks == 0);
+            resonestor.Process(block, kBlockSize);
+            sink += block[0].l;
+            chords += resonestor.num_active_chords();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+                          (num_blocks * kBlockSize);
+        // Keep the output alive
+        if (sink == 12345.0f) {
+            printf(" ");
+        }
+        if (run == 0 || ns < best.ns) {
+            best.ns = ns;
+            best.chords = static_cast<float>(chords) / num_blocks;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    options.seconds = 10.0f;
+    options.factor = 0.0;
+    int option;
+    while ((option = getopt(argc, argv, "t:x:")) != -1) {
+        switch (option) {
+            case 't': options.seconds = static_cast<float>(atof(optarg)); break;
+            case 'x': options.factor = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-x factor]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (options.seconds <= 0.0f || options.factor < 0.0) {
+        fprintf(stderr, "invalid duration or factor\n");
+        return 1;
+    }
+
+    const float kSampleRates[] = {32000.0f, 48000.0f};
+    bool over_budget = false;
+    for (float sample_rate : kSampleRates) {
+        printf("%.0f Hz, %.0f s, %zu-frame blocks (ns per frame, chords processed per block)\n", sample_rate,
+               options.seconds, kBlockSize);
+        for (const Scenario& scenario : kScenarios) {
+            const Result result = Run(options, sample_rate, scenario);
+            printf("  %-18s %7.2f  %4.2f", scenario.name, result.ns, result.chords);
+            if (options.factor > 0.0) {
+                const double share = result.ns * options.factor * sample_rate * 1e-9;
+                printf("  %5.1f%% of the core", 100.0 * share);
+                if (scenario.max_chords == kNumResonestorChords && share > kBudget) {
+                    printf(" (over the %.0f%% budget)", 100.0 * kBudget);
+                    over_budget = true;
+                }
+            }
+            printf("\n");
+        }
+    }
+    return over_budget ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+// Host benchmark: cost of Clouds' reverb (eurorack/Nimbus_SM/dsp/fx/reverb.h)
+// at the full sample rate against half rate (Reverb::set_half_rate), with
+// and without economy, and how closely the half-rate tank decays like the
+// full-rate one; then the same for Oliverb (dsp/fx/oliverb.h), as the
+// post-processing reverb and with its shimmer, as in its playback mode.
+//
+// Build from the repository root:
+//   N=eurorack/Nimbus_SM
+//   INC="-Itools/cosim/mock -Isrc/config -I$N -I$N/dsp -I$N/dsp/fx"
+//   INC="$INC -Ilib/DaisySP/Source -Ilib/DaisySP/Source/Utility"
+//   g++ -std=gnu++14 -O2 $INC tools/reverb_bench/reverb_bench.cpp $N/resources.cpp -o reverb_bench
+//
+// Usage: reverb_bench [-r sample_rate] [-t seconds]
+//
+// The reverbs run fully wet on white noise in 32-frame blocks, with the
+// settings GranularProcessorClouds uses at the firmware's default reverb and
+// feedback knobs, or, for the shimmer, at its default knobs in the oliverb
+// mode with PITCH an octave up. Times are the best of 5 runs, in ns per
+// stereo frame. The decay is compared on the impulse responses: their
+// energy in 50 ms windows, and the time each takes to fall 30 dB below its
+// first window.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "frame.h"
+#include "oliverb.h"
+#include "resources.h"
+#include "reverb.h"
+
+namespace {
+
+constexpr size_t kBlockSize = kMaxBlockSize;
+constexpr int kRuns = 5;
+constexpr float kWindowSeconds = 0.05f;
+
+// The processor's settings (GranularProcessorClouds::Process()) for
+// reverb = 0.5, feedback = 0.6, not frozen
+constexpr float kReverbAmount = 0.5f * 0.95f;
+constexpr float kTime = 0.35f + 0.63f * kReverbAmount;
+constexpr float kLp = 0.6f + 0.37f * 0.6f;
+
+struct Options {
+    float sample_rate;
+    float seconds;
+};
+
+enum Engine {
+    ENGINE_REVERB,
+    ENGINE_REVERB_HALF_RATE,
+    // GranularProcessorClouds::set_post_oliverb()
+    ENGINE_OLIVERB,
+    // The oliverb mode's mapping of the default knobs, PITCH at +12
+    ENGINE_OLIVERB_SHIMMER,
+};
+
+class Tank {
+public:
+    Tank(float sample_rate, Engine engine, bool economy) : engine_(engine), memory_(16384) {
+        if (engine == ENGINE_REVERB || engine == ENGINE_REVERB_HALF_RATE) {
+            reverb_.Init(memory_.data(), sample_rate);
+            reverb_.set_half_rate(engine == ENGINE_REVERB_HALF_RATE);
+            reverb_.set_economy(economy);
+            reverb_.set_diffusion(0.7f);
+            reverb_.set_time(kTime);
+            reverb_.set_input_gain(0.2f);
+            reverb_.set_lp(kLp);
+        } else if (engine == ENGINE_OLIVERB) {
+            oliverb_.Init(memory_.data(), sample_rate);
+            oliverb_.set_economy(economy);
+            oliverb_.set_diffusion(0.7f);
+            oliverb_.set_size(0.9f);
+            oliverb_.set_decay(kTime);
+            oliverb_.set_input_gain(0.2f);
+            oliverb_.set_lp(kLp);
+            oliverb_.set_hp(0.01f);
+            oliverb_.set_mod_rate(0.3f);
+            oliverb_.set_mod_amount(20.0f);
+            oliverb_.set_pitch_shift_amount(0.0f);
+        } else {
+            oliverb_.Init(memory_.data(), sample_rate);
+            oliverb_.set_economy(economy);
+            oliverb_.set_diffusion(0.3f + 0.5f * 0.5f);
+            oliverb_.set_size(0.05f + 0.94f * 0.5f);
+            oliverb_.set_decay(0.5f * 1.3f + 0.15f * 12.0f / 24.0f);
+            oliverb_.set_input_gain(0.5f);
+            oliverb_.set_lp(0.03f + 0.9f);
+            oliverb_.set_hp(0.01f + 0.2f * 0.4f);
+            oliverb_.set_mod_rate(0.6f);
+            oliverb_.set_mod_amount(0.5f * 300.0f);
+            oliverb_.set_ratio(2.0f);
+            oliverb_.set_pitch_shift_amount(1.0f);
+        }
+    }
+
+    void Process(FloatFrame* block) {
+        if (engine_ == ENGINE_REVERB || engine_ == ENGINE_REVERB_HALF_RATE) {
+            reverb_.Process(block, kBlockSize, LinearRamp(1.0f, 0.0f));
+        } else {
+            oliverb_.Process(block, kBlockSize, LinearRamp(1.0f, 0.0f));
+        }
+    }
+
+private:
+    Engine engine_;
+    std::vector<uint16_t> memory_;
+    Reverb reverb_;
+    Oliverb oliverb_;
+};
+
+uint32_t g_seed = 0x12345678;
+
+float Noise() {
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return static_cast<float>(g_seed) * (2.0f / 4294967296.0f) - 1.0f;
+}
+
+double NsPerFrame(const Options& options, Engine engine, bool economy, const std::vector<FloatFrame>& input) {
+    using Clock = std::chrono::steady_clock;
+    double best = 0.0;
+    for (int run = 0; run < kRuns; ++run) {
+        Tank tank(options.sample_rate, engine, economy);
+        FloatFrame block[kBlockSize];
+        float sink = 0.0f;
+        const Clock::time_point start = Clock::now();
+        for (size_t i = 0; i + kBlockSize <= input.size(); i += kBlockSize) {
+            std::copy(&input[i], &input[i + kBlockSize], block);
+            tank.Process(block);
+            sink += block[0].l;
+        }
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / input.size();
+        // Keep the output alive
+        if (sink == 12345.0f) {
+            printf(" ");
+        }
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// Energy of the impulse response in kWindowSeconds windows, in dB
+std::vector<double> DecayCurve(const Options& options, Engine engine) {
+    Tank tank(options.sample_rate, engine, false);
+    const size_t window = static_cast<size_t>(options.sample_rate * kWindowSeconds) / kBlockSize * kBlockSize;
+    const size_t frames = static_cast<size_t>(options.sample_rate * 3.0f) / window * window;
+    std::vector<double> curve;
+    double energy = 0.0;
+    for (size_t i = 0; i < frames; i += kBlockSize) {
+        FloatFrame block[kBlockSize] = {};
+        if (i == 0) {
+            block[0].l = block[0].r = 1.0f;
+        }
+        tank.Process(block);
+        for (size_t j = 0; j < kBlockSize; ++j) {
+            energy += block[j].l * block[j].l + block[j].r * block[j].r;
+        }
+        if ((i + kBlockSize) % window == 0) {
+            curve.push_back(10.0 * log10(energy + 1e-30));
+            energy = 0.0;
+        }
+    }
+    return curve;
+}
+
+// Seconds for the curve to fall 30 dB below its first window
+float DecayTime(const std::vector<double>& curve) {
+    for (size_t i = 1; i < curve.size(); ++i) {
+        if (curve[i] < curve[0] - 30.0) {
+            return i * kWindowSeconds;
+        }
+    }
+    return curve.size() * kWindowSeconds;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    options.sample_rate = 32000.0f;
+    options.seconds = 10.0f;
+    int option;
+    while ((option = getopt(argc, argv, "r:t:")) != -1) {
+        switch (option) {
+            case 'r': options.sample_rate = static_cast<float>(atof(optarg)); break;
+            case 't': options.seconds = static_cast<float>(atof(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-r sample_rate] [-t seconds]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (options.sample_rate < 8000.0f || options.seconds <= 0.0f) {
+        fprintf(stderr, "invalid sample rate or duration\n");
+        return 1;
+    }
+
+    InitResources(options.sample_rate);
+    std::vector<FloatFrame> input(static_cast<size_t>(options.sample_rate * options.seconds) / kBlockSize * kBlockSize);
+    for (FloatFrame& frame : input) {
+        frame.l = Noise();
+        frame.r = Noise();
+    }
+
+    printf("%.0f Hz, %.0f s of noise, %zu-frame blocks (ns per frame)\n", options.sample_rate, options.seconds,
+           kBlockSize);
+    double reverb[2];
+    for (int economy = 0; economy < 2; ++economy) {
+        const double full = NsPerFrame(options, ENGINE_REVERB, economy, input);
+        const double half = NsPerFrame(options, ENGINE_REVERB_HALF_RATE, economy, input);
+        printf("  %-8s full rate %6.2f  half rate %6.2f  (%.0f%% saved)\n", economy ? "economy" : "normal", full,
+               half, 100.0 * (1.0 - half / full));
+        reverb[economy] = full;
+    }
+    printf("Oliverb, against the full-rate reverb\n");
+    for (int economy = 0; economy < 2; ++economy) {
+        const double post = NsPerFrame(options, ENGINE_OLIVERB, economy, input);
+        const double shimmer = NsPerFrame(options, ENGINE_OLIVERB_SHIMMER, economy, input);
+        printf("  %-8s post-processing %6.2f (%+.0f%%)  shimmer %6.2f (%+.0f%%)\n", economy ? "economy" : "normal",
+               post, 100.0 * (post / reverb[economy] - 1.0), shimmer, 100.0 * (shimmer / reverb[economy] - 1.0));
+    }
+
+    const std::vector<double> full = DecayCurve(options, ENGINE_REVERB);
+    const std::vector<double> half = DecayCurve(options, ENGINE_REVERB_HALF_RATE);
+    double worst = 0.0;
+    for (size_t i = 0; i < full.size() && full[i] > full[0] - 40.0; ++i) {
+        worst = std::max(worst, fabs(half[i] - full[i]));
+    }
+    printf("impulse response: -30 dB after %.2f s at full rate, %.2f s at half rate; windows within %.1f dB\n",
+           DecayTime(full), DecayTime(half), worst);
+    printf("  -30 dB after %.2f s with Oliverb, %.2f s with its shimmer\n",
+           DecayTime(DecayCurve(options, ENGINE_OLIVERB)), DecayTime(DecayCurve(options, ENGINE_OLIVERB_SHIMMER)));
+    return 0;
+}
@@ -0,0 +1,271 @@
+// Host decoder for the Kymatikos binary telemetry stream.
+//
+// Build:
+//   g++ -std=c++17 -O2 -I../../src/system telemetry_decode.cpp -o telemetry_decode
+//
+// Usage:
+//   telemetry_decode [--csv] [capture.bin | /dev/ttyACM0]
+//
+// Reads from stdin when no path is given. Serial devices should be put in
+// raw mode first (stty -F /dev/ttyACM0 raw). Text log lines sharing the
+// port are skipped. With --csv, one row per record: type, sequence,
+// timestamp_us, then the record fields.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "TelemetryRecords.h"
+
+namespace {
+
+struct Stats {
+    uint64_t frames = 0;
+    uint64_t bad_checksums = 0;
+    uint64_t lost = 0;          // Sequence gaps (dropped on the device)
+    bool have_sequence = false;
+    uint16_t next_sequence = 0;
+};
+
+template <typename Record>
+bool Load(const uint8_t* payload, size_t length, Record* record) {
+    if (length != sizeof(Record)) {
+        return false;
+    }
+    memcpy(record, payload, sizeof(Record));
+    return true;
+}
+
+const char* TypeName(uint8_t type) {
+    switch (type) {
+        case TELEMETRY_CPU: return "cpu";
+        case TELEMETRY_CONTROLS: return "controls";
+        case TELEMETRY_TOUCH: return "touch";
+        case TELEMETRY_ENGINE: return "engine";
+        case TELEMETRY_XRUN: return "xrun";
+        case TELEMETRY_TASK: return "task";
+        case TELEMETRY_INPUTS: return "inputs";
+        case TELEMETRY_DSP_FAULT: return "dspfault";
+        default: return "unknown";
+    }
+}
+
+void PrintRecord(const TelemetryHeader& header, const uint8_t* payload, bool csv) {
+    const char* sep = csv ? "," : " ";
+    if (csv) {
+        printf("%s,%u,%u", TypeName(header.type), header.sequence, header.timestamp_us);
+    } else {
+        printf("%10.3f ms #%-5u %-8s", header.timestamp_us / 1000.0, header.sequence, TypeName(header.type));
+    }
+
+    switch (header.type) {
+        case TELEMETRY_CPU: {
+            TelemetryCpu r;
+            if (!Load(payload, header.length, &r)) break;
+            if (csv) {
+                printf(",%u,%u,%u,%u,%u,%u,%u,%u,%u", r.avg_permille, r.max_permille, r.last_permille,
+                       r.quality_level, r.block_size, r.sample_rate, r.governor_downgrades, r.xruns,
+                       r.telemetry_dropped);
+            } else {
+                printf(" avg %5.1f%% max %5.1f%% last %5.1f%% Q%u | %u frames @ %u Hz | downgrades %u xruns %u dropped %u",
+                       r.avg_permille / 10.0, r.max_permille / 10.0, r.last_permille / 10.0, r.quality_level,
+                       r.block_size, r.sample_rate, r.governor_downgrades, r.xruns, r.telemetry_dropped);
+            }
+            break;
+        }
+        case TELEMETRY_CONTROLS: {
+            TelemetryControls r;
+            if (!Load(payload, header.length, &r)) break;
+            const int16_t* values = &r.pitch;
+            static const char* kNames[] = {"pitch", "cv5", "cv6", "cv7", "pos", "size", "dens", "tex",
+                                           "fdbk", "rev", "wet", "vol", "mod"};
+            for (size_t i = 0; i < sizeof(r) / sizeof(int16_t); ++i) {
+                int16_t value;
+                memcpy(&value, values + i, sizeof(value));
+                if (csv) {
+                    printf(",%.3f", value / 1000.0);
+                } else {
+                    printf(" %s %.3f", kNames[i], value / 1000.0);
+                }
+            }
+            break;
+        }
+        case TELEMETRY_TOUCH: {
+            TelemetryTouch r;
+            if (!Load(payload, header.length, &r)) break;
+            if (csv) {
+                printf(",%u", r.touched);
+            } else {
+                printf(" pads %03X dev", r.touched);
+            }
+            for (int i = 0; i < 12; ++i) {
+                printf("%s%d", sep, r.deviation[i]);
+            }
+            if (csv) {
+                printf(",%.3f,%.3f", r.pressure / 1000.0, r.slider / 1000.0);
+            } else {
+                printf(" | pressure %.3f slider %.2f", r.pressure / 1000.0, r.slider / 1000.0);
+            }
+            break;
+        }
+        case TELEMETRY_ENGINE: {
+            TelemetryEngine r;
+            if (!Load(payload, header.length, &r)) break;
+            if (csv) {
+                printf(",%.2f,%u,%u,%.3f,%.3f,%u,%u,%u", r.grains / 100.0, r.playback_mode, r.num_channels,
+                       r.input_peak / 1000.0, r.output_level / 1000.0, r.staging_late,
+                       r.output_events_dropped, r.dsp_recoveries);
+            } else {
+                printf(" grains %.2f mode %u ch %u | in %.3f out %.3f | staging late %u events dropped %u"
+                       " | dsp recoveries %u",
+                       r.grains / 100.0, r.playback_mode, r.num_channels, r.input_peak / 1000.0,
+                       r.output_level / 1000.0, r.staging_late, r.output_events_dropped, r.dsp_recoveries);
+            }
+            break;
+        }
+        case TELEMETRY_XRUN: {
+            TelemetryXrun r;
+            if (!Load(payload, header.length, &r)) break;
+            if (csv) {
+                printf(",%u,%u", r.load_permille, r.xruns);
+            } else {
+                printf(" load %.1f%% total %u", r.load_permille / 10.0, r.xruns);
+            }
+            break;
+        }
+        case TELEMETRY_TASK: {
+            TelemetryTask r;
+            if (!Load(payload, header.length, &r)) break;
+            char name[sizeof(r.name) + 1] = {};
+            memcpy(name, r.name, sizeof(r.name));
+            if (csv) {
+                printf(",%u,%s,%u,%u,%u,%u,%u,%u,%u,%.1f", r.id, name, r.priority, r.period_us, r.runs,
+                       r.overruns, r.avg_us, r.max_us, r.max_lateness_us, r.idle_permille / 10.0);
+            } else {
+                printf(" %2u %-10s P%u every %u us | runs %u overruns %u | avg %u max %u us late %u us | idle %.1f%%",
+                       r.id, name, r.priority, r.period_us, r.runs, r.overruns, r.avg_us, r.max_us,
+                       r.max_lateness_us, r.idle_permille / 10.0);
+            }
+            break;
+        }
+        case TELEMETRY_INPUTS: {
+            TelemetryInputs r;
+            if (!Load(payload, header.length, &r)) break;
+            if (!csv) {
+                printf(" adc");
+            }
+            for (int i = 0; i < 12; ++i) {
+                printf("%s%u", sep, r.adc[i]);
+            }
+            if (csv) {
+                printf(",%u", r.gates);
+            } else {
+                printf(" | gates %u%u", r.gates & 1, (r.gates >> 1) & 1);
+            }
+            break;
+        }
+        case TELEMETRY_DSP_FAULT: {
+            static const char* const kStages[] = {"feedback", "playback", "diffuser", "pitch",
+                                                  "filters", "reverb", "output"};
+            TelemetryDspFault r;
+            if (!Load(payload, header.length, &r)) break;
+            const char* stage = r.stage < sizeof(kStages) / sizeof(kStages[0]) ? kStages[r.stage] : "?";
+            if (csv) {
+                printf(",%s,%u,%u,%u,%u,%.3f,%.3f,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u", stage, r.kinds,
+                       r.playback_mode, r.quality, r.faults, r.position / 1000.0, r.size / 1000.0,
+                       r.pitch / 100.0, r.density / 1000.0, r.texture / 1000.0, r.dry_wet / 1000.0,
+                       r.stereo_spread / 1000.0, r.feedback / 1000.0, r.reverb / 1000.0, r.freeze);
+            } else {
+                printf(" %s%s%s%s mode %u quality %u total %u | pos %.3f size %.3f pitch %.2f dens %.3f"
+                       " tex %.3f wet %.3f spread %.3f fb %.3f rev %.3f freeze %u",
+                       stage, r.kinds & 1 ? " denormal" : "", r.kinds & 2 ? " nan" : "", r.kinds & 4 ? " inf" : "",
+                       r.playback_mode, r.quality, r.faults, r.position / 1000.0, r.size / 1000.0,
+                       r.pitch / 100.0, r.density / 1000.0, r.texture / 1000.0, r.dry_wet / 1000.0,
+                       r.stereo_spread / 1000.0, r.feedback / 1000.0, r.reverb / 1000.0, r.freeze);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    printf("\n");
+}
+
+// Decodes every complete frame in `data`; returns the number of bytes
+// consumed (an incomplete frame at the end is kept for the next read).
+size_t Decode(const std::vector<uint8_t>& data, bool csv, Stats* stats) {
+    size_t pos = 0;
+    while (data.size() - pos >= kTelemetryFrameOverhead) {
+        if (data[pos] != kTelemetrySync0 || data[pos + 1] != kTelemetrySync1) {
+            ++pos;
+            continue;
+        }
+        TelemetryHeader header;
+        memcpy(&header, &data[pos], sizeof(header));
+        const size_t frame_size = header.length + kTelemetryFrameOverhead;
+        if (data.size() - pos < frame_size) {
+            break;
+        }
+        const uint8_t* frame = &data[pos];
+        if (TelemetryChecksum(frame, header.length) != frame[sizeof(header) + header.length]) {
+            // False sync inside text or a corrupted frame
+            ++stats->bad_checksums;
+            ++pos;
+            continue;
+        }
+
+        if (stats->have_sequence && header.sequence != stats->next_sequence) {
+            stats->lost += static_cast<uint16_t>(header.sequence - stats->next_sequence);
+        }
+        stats->have_sequence = true;
+        stats->next_sequence = header.sequence + 1;
+        ++stats->frames;
+
+        PrintRecord(header, frame + sizeof(header), csv);
+        pos += frame_size;
+    }
+    return pos;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool csv = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            fprintf(stderr, "usage: %s [--csv] [capture.bin | /dev/ttyACM0]\n", argv[0]);
+            return 0;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    FILE* input = path ? fopen(path, "rb") : stdin;
+    if (!input) {
+        perror(path);
+        return 1;
+    }
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    Stats stats;
+    std::vector<uint8_t> pending;
+    uint8_t chunk[4096];
+    ssize_t length;
+    // read() returns what a serial port has, rather than waiting for a full chunk
+    while ((length = read(fileno(input), chunk, sizeof(chunk))) > 0) {
+        pending.insert(pending.end(), chunk, chunk + length);
+        pending.erase(pending.begin(), pending.begin() + Decode(pending, csv, &stats));
+    }
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    fprintf(stderr, "%llu frames, %llu lost, %llu bad checksums\n",
+            static_cast<unsigned long long>(stats.frames),
+            static_cast<unsigned long long>(stats.lost),
+            static_cast<unsigned long long>(stats.bad_checksums));
+    return 0;
+}